@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""Store benchmark results by git revision and compare them with a baseline.
+
+    bench_compare.py [--dir DIR] run [--repeat N] [--rev REV] -- SUITE [:: SUITE]...
+    bench_compare.py [--dir DIR] compare [--threshold PCT] [--confidence C] BASELINE [CANDIDATE]
+    bench_compare.py [--dir DIR] list
+
+A suite is a benchmark command line. Benchmarks report their results on
+stdout as lines of the form
+
+    metric NAME UNIT higher|lower SAMPLE...
+
+where higher or lower says which direction is better, and every sample is
+one independent measurement (a run, a batch). "run" executes the suites,
+REPEAT times each, and stores all samples in DIR/REV.json; REV is the
+short commit id, with "-dirty" appended when tracked files have changed.
+
+"compare" loads the results of two revisions (BASELINE and CANDIDATE,
+by default the current one) given as git revisions, stored names or JSON
+paths. For each metric it bootstraps a confidence interval for the
+relative change of the mean. A change is significant when the interval
+excludes zero. It is reported as a regression or an improvement when it
+is also at least THRESHOLD percent. The exit status is 1 if any metric
+regressed.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import random
+import subprocess
+import sys
+
+BOOTSTRAP_ROUNDS = 10000
+
+
+def git(*args):
+    return subprocess.run(["git"] + list(args), check=True, capture_output=True,
+                          text=True).stdout.strip()
+
+
+def current_revision():
+    rev = git("rev-parse", "--short=12", "HEAD")
+    dirty = git("status", "--porcelain", "--untracked-files=no")
+    return rev + "-dirty" if dirty else rev
+
+
+def parse_metrics(output, metrics):
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) < 5 or fields[0] != "metric":
+            continue
+        name, unit, better = fields[1], fields[2], fields[3]
+        if better not in ("higher", "lower"):
+            raise ValueError("%s: direction must be higher or lower" % name)
+        samples = [float(v) for v in fields[4:]]
+        entry = metrics.setdefault(name, {"unit": unit, "better": better, "samples": []})
+        if entry["unit"] != unit or entry["better"] != better:
+            raise ValueError("%s: reported with different units or directions" % name)
+        entry["samples"].extend(samples)
+
+
+def cmd_run(args):
+    suites, suite = [], []
+    for word in args.suites:
+        if word == "::":
+            if suite:
+                suites.append(suite)
+            suite = []
+        else:
+            suite.append(word)
+    if suite:
+        suites.append(suite)
+    if not suites:
+        print("No suites given", file=sys.stderr)
+        return 2
+
+    rev = args.rev or current_revision()
+    metrics = {}
+    for suite in suites:
+        for i in range(args.repeat):
+            print("==> %s (%d/%d)" % (" ".join(suite), i + 1, args.repeat), flush=True)
+            proc = subprocess.run(suite, capture_output=True, text=True)
+            sys.stdout.write(proc.stdout)
+            sys.stderr.write(proc.stderr)
+            if proc.returncode != 0:
+                print("%s failed with status %d, nothing stored" % (suite[0], proc.returncode),
+                      file=sys.stderr)
+                return 1
+            try:
+                parse_metrics(proc.stdout, metrics)
+            except ValueError as e:
+                print("%s: %s" % (suite[0], e), file=sys.stderr)
+                return 1
+    if not metrics:
+        print("The suites reported no metric lines", file=sys.stderr)
+        return 1
+
+    result = {
+        "revision": rev,
+        "commit": git("rev-parse", "HEAD"),
+        "date": datetime.datetime.now(datetime.timezone.utc).isoformat(timespec="seconds"),
+        "host": platform.node(),
+        "suites": [" ".join(s) for s in suites],
+        "repeat": args.repeat,
+        "metrics": metrics,
+    }
+    os.makedirs(args.dir, exist_ok=True)
+    path = os.path.join(args.dir, rev + ".json")
+    with open(path + ".tmp", "w") as f:
+        json.dump(result, f, indent=1, sort_keys=True)
+        f.write("\n")
+    os.replace(path + ".tmp", path)
+    print("Stored %d metrics in %s" % (len(metrics), path))
+    return 0
+
+
+def load_result(directory, name):
+    candidates = [name, os.path.join(directory, name + ".json")]
+    try:
+        candidates.append(os.path.join(directory, git("rev-parse", "--short=12", name) + ".json"))
+    except subprocess.CalledProcessError:
+        pass
+    for path in candidates:
+        if os.path.isfile(path):
+            with open(path) as f:
+                return json.load(f)
+    raise FileNotFoundError("no stored results for %s in %s (see: %s list)"
+                            % (name, directory, sys.argv[0]))
+
+
+def mean(values):
+    return sum(values) / len(values)
+
+
+def bootstrap_change(base, cand, confidence, rng):
+    """Relative change of the mean and its percentile bootstrap interval"""
+    changes = []
+    for _ in range(BOOTSTRAP_ROUNDS):
+        b = mean(rng.choices(base, k=len(base)))
+        c = mean(rng.choices(cand, k=len(cand)))
+        changes.append(c / b - 1 if b else 0.0)
+    changes.sort()
+    tail = (1 - confidence) / 2
+    low = changes[int(tail * (BOOTSTRAP_ROUNDS - 1))]
+    high = changes[int((1 - tail) * (BOOTSTRAP_ROUNDS - 1))]
+    return low, high
+
+
+def cmd_compare(args):
+    base = load_result(args.dir, args.baseline)
+    cand = load_result(args.dir, args.candidate or current_revision())
+    rng = random.Random(0)  # Same inputs, same verdicts
+    threshold = args.threshold / 100
+
+    print("baseline %s (%s), candidate %s (%s), %.0f%% intervals"
+          % (base["revision"], base["host"], cand["revision"], cand["host"],
+             args.confidence * 100))
+    if base["host"] != cand["host"]:
+        print("warning: results come from different hosts")
+    print("%-24s %-6s %12s %12s %8s %19s  %s"
+          % ("metric", "unit", "baseline", "candidate", "change", "interval", "verdict"))
+
+    regressions = 0
+    for name in sorted(set(base["metrics"]) | set(cand["metrics"])):
+        b, c = base["metrics"].get(name), cand["metrics"].get(name)
+        if not b or not c:
+            print("%-24s only in %s" % (name, "baseline" if b else "candidate"))
+            continue
+        bs, cs = b["samples"], c["samples"]
+        change = mean(cs) / mean(bs) - 1 if mean(bs) else 0.0
+        if len(bs) < 2 or len(cs) < 2:
+            interval, verdict = "", "too few samples"
+        else:
+            low, high = bootstrap_change(bs, cs, args.confidence, rng)
+            interval = "[%+6.1f%%, %+6.1f%%]" % (low * 100, high * 100)
+            worse = change < 0 if c["better"] == "higher" else change > 0
+            if low <= 0 <= high:
+                verdict = "no significant change"
+            elif abs(change) < threshold:
+                verdict = "significant, below threshold"
+            elif worse:
+                verdict = "REGRESSION"
+                regressions += 1
+            else:
+                verdict = "improvement"
+        print("%-24s %-6s %12.4g %12.4g %+7.1f%% %19s  %s"
+              % (name, c["unit"], mean(bs), mean(cs), change * 100, interval, verdict))
+    if regressions:
+        print("%d metric%s regressed" % (regressions, "" if regressions == 1 else "s"))
+    return 1 if regressions else 0
+
+
+def cmd_list(args):
+    if not os.path.isdir(args.dir):
+        return 0
+    for entry in sorted(os.listdir(args.dir)):
+        if entry.endswith(".json"):
+            with open(os.path.join(args.dir, entry)) as f:
+                result = json.load(f)
+            print("%-20s %s %-16s %d metrics" % (result["revision"], result["date"],
+                                                 result["host"], len(result["metrics"])))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--dir", default="bench_results", help="result store (default %(default)s)")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    run = sub.add_parser("run", help="run suites and store their metrics")
+    run.add_argument("--repeat", type=int, default=1, help="runs of every suite")
+    run.add_argument("--rev", help="store under this name instead of the revision")
+    run.add_argument("suites", nargs=argparse.REMAINDER, help="-- SUITE [:: SUITE]...")
+
+    compare = sub.add_parser("compare", help="compare two stored revisions")
+    compare.add_argument("--threshold", type=float, default=2.0,
+                         help="smallest change in percent that counts (default %(default)s)")
+    compare.add_argument("--confidence", type=float, default=0.95,
+                         help="confidence of the intervals (default %(default)s)")
+    compare.add_argument("baseline")
+    compare.add_argument("candidate", nargs="?")
+
+    sub.add_parser("list", help="list stored revisions")
+
+    args = parser.parse_args()
+    if args.command == "run":
+        if args.suites and args.suites[0] == "--":
+            args.suites = args.suites[1:]
+        if args.repeat < 1:
+            parser.error("--repeat must be at least 1")
+        return cmd_run(args)
+    if args.command == "compare":
+        if not 0 < args.confidence < 1:
+            parser.error("--confidence must be between 0 and 1")
+        try:
+            return cmd_compare(args)
+        except FileNotFoundError as e:
+            print(e, file=sys.stderr)
+            return 2
+    return cmd_list(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,186 @@
+#include "gpu_admit.h"
+#include "gpu_policy.h"
+#include <errno.h>
+#include <string.h>
+
+// Initialise a condition variable that times out against CLOCK_MONOTONIC
+static void gpu_admit_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+int gpu_admit_init(gpu_admit_t *admit, size_t capacity, gpu_admit_policy_t policy,
+                   bool wait, unsigned timeout_ms)
+{
+    memset(admit, 0, sizeof(*admit));
+    admit->capacity = capacity;
+    admit->policy = policy;
+    admit->wait = wait;
+    admit->timeout_ms = timeout_ms;
+    pthread_mutex_init(&admit->mutex, NULL);
+    gpu_admit_cond_init(&admit->release_cond);
+    return 0;
+}
+
+void gpu_admit_destroy(gpu_admit_t *admit)
+{
+    pthread_cond_destroy(&admit->release_cond);
+    pthread_mutex_destroy(&admit->mutex);
+}
+
+const struct timespec *gpu_admit_deadline(const gpu_admit_t *admit, struct timespec *ts)
+{
+    if (!admit->wait) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += admit->timeout_ms / 1000;
+    ts->tv_nsec += (long)(admit->timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+// Grant queued requests from the head while they fit. Stopping at the first
+// request that does not fit keeps large requests from being starved by a
+// stream of small ones. Called with admit->mutex held.
+static void gpu_admit_grant_locked(gpu_admit_t *admit)
+{
+    while (admit->waiters != NULL) {
+        gpu_admit_waiter_t *head = admit->waiters;
+        if (admit->used + head->bytes > admit->capacity) {
+            break;
+        }
+        admit->used += head->bytes;
+        head->granted = true;
+        admit->waiters = head->next;
+        pthread_cond_signal(&head->cond);
+    }
+}
+
+// Insert a waiter according to the policy (admit->mutex held)
+static void gpu_admit_enqueue_locked(gpu_admit_t *admit, gpu_admit_waiter_t *waiter)
+{
+    gpu_admit_waiter_t **link = &admit->waiters;
+    while (*link != NULL) {
+        if (gpu_policy_queue_ahead(admit->policy, waiter->priority, (*link)->priority)) {
+            break;
+        }
+        link = &(*link)->next;
+    }
+    waiter->next = *link;
+    *link = waiter;
+}
+
+// Remove a waiter that is still queued (admit->mutex held)
+static void gpu_admit_dequeue_locked(gpu_admit_t *admit, gpu_admit_waiter_t *waiter)
+{
+    for (gpu_admit_waiter_t **link = &admit->waiters; *link != NULL; link = &(*link)->next) {
+        if (*link == waiter) {
+            *link = waiter->next;
+            return;
+        }
+    }
+}
+
+int gpu_admit_acquire(gpu_admit_t *admit, size_t bytes, int priority,
+                      const struct timespec *deadline)
+{
+    pthread_mutex_lock(&admit->mutex);
+
+    if (bytes > admit->capacity) {
+        pthread_mutex_unlock(&admit->mutex);
+        return -ENOMEM;  // Would never fit
+    }
+
+    // Fast path: nobody queued ahead of us and the request fits
+    if (admit->waiters == NULL && admit->used + bytes <= admit->capacity) {
+        admit->used += bytes;
+        pthread_mutex_unlock(&admit->mutex);
+        return 0;
+    }
+
+    if (deadline == NULL) {
+        pthread_mutex_unlock(&admit->mutex);
+        return -ENOMEM;
+    }
+
+    gpu_admit_waiter_t waiter = {
+        .bytes = bytes,
+        .priority = priority,
+        .granted = false,
+    };
+    gpu_admit_cond_init(&waiter.cond);
+    gpu_admit_enqueue_locked(admit, &waiter);
+    admit->queued++;
+
+    // A high priority request may land at the head and fit right away
+    gpu_admit_grant_locked(admit);
+
+    int rc = 0;
+    while (!waiter.granted && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&waiter.cond, &admit->mutex, deadline);
+    }
+
+    if (!waiter.granted) {
+        gpu_admit_dequeue_locked(admit, &waiter);
+        admit->timed_out++;
+        // Our departure may unblock whoever queued behind us
+        gpu_admit_grant_locked(admit);
+    }
+
+    pthread_mutex_unlock(&admit->mutex);
+    pthread_cond_destroy(&waiter.cond);
+    return waiter.granted ? 0 : -ENOMEM;
+}
+
+void gpu_admit_release(gpu_admit_t *admit, size_t bytes)
+{
+    pthread_mutex_lock(&admit->mutex);
+    admit->used = bytes > admit->used ? 0 : admit->used - bytes;
+    admit->release_gen++;
+    gpu_admit_grant_locked(admit);
+    pthread_cond_broadcast(&admit->release_cond);
+    pthread_mutex_unlock(&admit->mutex);
+}
+
+void gpu_admit_get_stats(gpu_admit_t *admit, gpu_admit_stats_t *stats)
+{
+    pthread_mutex_lock(&admit->mutex);
+    stats->capacity = admit->capacity;
+    stats->used = admit->used;
+    stats->waiting = 0;
+    for (gpu_admit_waiter_t *w = admit->waiters; w != NULL; w = w->next) {
+        stats->waiting++;
+    }
+    stats->queued = admit->queued;
+    stats->timed_out = admit->timed_out;
+    pthread_mutex_unlock(&admit->mutex);
+}
+
+uint64_t gpu_admit_generation(gpu_admit_t *admit)
+{
+    pthread_mutex_lock(&admit->mutex);
+    uint64_t gen = admit->release_gen;
+    pthread_mutex_unlock(&admit->mutex);
+    return gen;
+}
+
+int gpu_admit_wait_release(gpu_admit_t *admit, uint64_t seen_gen,
+                           const struct timespec *deadline)
+{
+    int rc = 0;
+    pthread_mutex_lock(&admit->mutex);
+    while (admit->release_gen == seen_gen && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&admit->release_cond, &admit->mutex, deadline);
+    }
+    bool released = admit->release_gen != seen_gen;
+    pthread_mutex_unlock(&admit->mutex);
+    return released ? 0 : -ETIMEDOUT;
+}
@@ -0,0 +1,71 @@
+#ifndef GPU_ADMIT_H
+#define GPU_ADMIT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Admission control for device memory. Allocations acquire bytes against a
+// capacity before calling the driver; when the device is full they either
+// fail right away or queue until releases make room (or a timeout expires).
+
+typedef enum {
+    GPU_ADMIT_FIFO,       // Grant in arrival order
+    GPU_ADMIT_PRIORITY,   // Grant highest priority first, FIFO among equals
+} gpu_admit_policy_t;
+
+typedef struct gpu_admit_waiter {
+    size_t bytes;
+    int priority;
+    bool granted;
+    pthread_cond_t cond;
+    struct gpu_admit_waiter *next;
+} gpu_admit_waiter_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    size_t capacity;              // Bytes that may be admitted in total
+    size_t used;                  // Bytes currently admitted
+    gpu_admit_policy_t policy;
+    bool wait;                    // Queue instead of failing immediately
+    unsigned timeout_ms;          // Longest time a request may queue
+    gpu_admit_waiter_t *waiters;  // Queue in grant order
+    uint64_t release_gen;         // Bumped on every release
+    pthread_cond_t release_cond;  // Signalled on every release
+    uint64_t queued;              // Requests that had to wait
+    uint64_t timed_out;           // Requests that gave up waiting
+} gpu_admit_t;
+
+int gpu_admit_init(gpu_admit_t *admit, size_t capacity, gpu_admit_policy_t policy,
+                   bool wait, unsigned timeout_ms);
+void gpu_admit_destroy(gpu_admit_t *admit);
+
+// Returns the absolute CLOCK_MONOTONIC deadline for a request starting now,
+// or NULL when the admission is configured not to wait.
+const struct timespec *gpu_admit_deadline(const gpu_admit_t *admit, struct timespec *ts);
+
+// Admit bytes, queueing until deadline if needed. Returns 0 or -ENOMEM.
+int gpu_admit_acquire(gpu_admit_t *admit, size_t bytes, int priority,
+                      const struct timespec *deadline);
+// Return admitted bytes and wake queued requests that now fit.
+void gpu_admit_release(gpu_admit_t *admit, size_t bytes);
+
+typedef struct {
+    size_t capacity;
+    size_t used;
+    unsigned waiting;             // Requests queued right now
+    uint64_t queued;
+    uint64_t timed_out;
+} gpu_admit_stats_t;
+
+void gpu_admit_get_stats(gpu_admit_t *admit, gpu_admit_stats_t *stats);
+
+// Release generation, for callers that retry after a driver-side failure
+uint64_t gpu_admit_generation(gpu_admit_t *admit);
+// Wait until a release happens after seen_gen. Returns 0 or -ETIMEDOUT.
+int gpu_admit_wait_release(gpu_admit_t *admit, uint64_t seen_gen,
+                           const struct timespec *deadline);
+
+#endif // GPU_ADMIT_H
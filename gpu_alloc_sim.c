@@ -0,0 +1,938 @@
+// Allocator simulator driven by an operation trace (-o trace=FILE)
+//
+//   gpu_alloc_sim -c CAPACITY [-g GRANULARITY] [-w TIMEOUT_MS] [-a ADMIT,...]
+//                 [-e EVICT,...] [-p PLACE,...] TRACE
+//
+// Replays the allocations, frees, publishes and accesses of a trace against
+// a simulated device of CAPACITY bytes, once for every combination of the
+// given policies, and prints one line per combination. No GPU is needed.
+// Admission runs through gpu_admit and the queue and eviction orders come
+// from gpu_policy, so the decisions are the daemon's own.
+//
+//   -a fifo|priority        Order of queued allocations (default fifo)
+//   -w TIMEOUT_MS           Queue allocations that do not fit, like
+//                           alloc_wait, for up to TIMEOUT_MS of trace time
+//   -e none|lru|largest|priority
+//                           What to evict when an allocation does not fit;
+//                           none is what the daemon does today
+//   -p direct|first:SIZE|best:SIZE
+//                           direct gives every allocation its own physical
+//                           allocation, as the daemon does. first and best
+//                           carve allocations out of pooled chunks of SIZE,
+//                           first fit or best fit, to try pooling.
+//
+// Evicted files are published durable files that nobody has open. They are
+// assumed to be in a checkpoint and are allocated again when next opened,
+// read or asked for their fabric handle; those reloads are counted as
+// refaults. Fragmentation is the share of the device footprint that does
+// not back requested bytes, so it includes rounding to the granularity. The
+// external column is the share of free pool space outside the largest free
+// extent. Renamed directories lose track of their files, because a trace
+// only has path hashes.
+
+#include "gpu_admit.h"
+#include "gpu_policy.h"
+#include "gpu_trace.h"
+#include <errno.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_MIB (1024.0 * 1024.0)
+
+typedef enum {
+    SIM_DIRECT,
+    SIM_FIRST_FIT,
+    SIM_BEST_FIT,
+} sim_place_t;
+
+typedef struct {
+    size_t offset;
+    size_t length;
+} sim_extent_t;
+
+typedef struct {
+    size_t size;
+    size_t used;
+    GArray *free;                     // sim_extent_t by offset, coalesced
+} sim_chunk_t;
+
+typedef struct {
+    sim_chunk_t *chunk;               // NULL if allocated on its own
+    size_t offset;
+    size_t size;                      // Rounded to the granularity
+} sim_block_t;
+
+typedef struct {
+    size_t capacity;
+    size_t granularity;
+    sim_place_t place;
+    size_t chunk_size;
+    size_t footprint;                 // Bytes taken from the device
+    GPtrArray *chunks;                // sim_chunk_t
+} sim_device_t;
+
+typedef struct sim_file {
+    uint64_t path;
+    size_t current;                   // Requested bytes, 0 if none
+    sim_block_t current_blk;
+    size_t staged;
+    sim_block_t staged_blk;
+    size_t evicted;                   // Bytes to reload on the next use
+    int opens;
+    int priority;
+    bool ready;
+    bool durable;
+    bool unlinked;
+    bool waiting;                     // An allocation is queued
+    uint64_t last_use;
+    uint64_t id;
+    guint index;                      // In sim_t.live
+} sim_file_t;
+
+typedef struct {
+    sim_file_t *file;
+    size_t size;
+    bool stage;
+    bool refault;
+    int priority;
+    uint64_t since_ns;
+    uint64_t deadline_ns;
+} sim_waiter_t;
+
+typedef struct {
+    gpu_admit_policy_t admit_policy;
+    gpu_evict_policy_t evict;
+    sim_place_t place;
+    size_t chunk_size;
+} sim_config_t;
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t failed;
+    uint64_t failed_bytes;
+    uint64_t queued;
+    uint64_t timed_out;
+    uint64_t evictions;
+    uint64_t evicted_bytes;
+    uint64_t refaults;
+    uint64_t refault_bytes;
+    size_t peak_footprint;
+    size_t peak_live;
+    double frag_at_peak;
+    double ext_max;
+    double held_ns;                   // Integral of the footprint over time
+    double unused_ns;                 // Integral of footprint minus live bytes
+    GArray *waits_ns;                 // uint64_t, of granted queued requests
+} sim_stats_t;
+
+typedef struct {
+    const sim_config_t *config;
+    size_t capacity;
+    unsigned timeout_ms;              // 0 to fail instead of queueing
+    gpu_admit_t admit;
+    sim_device_t dev;
+    GHashTable *files;                // path hash -> sim_file_t
+    GPtrArray *live;                  // Files not dropped yet, owns them
+    GPtrArray *orphans;               // Unlinked files still open
+    GQueue waiters;                   // sim_waiter_t in grant order
+    uint64_t now_ns;
+    uint64_t clock;                   // Use order for LRU
+    uint64_t next_id;
+    sim_stats_t stats;
+} sim_t;
+
+static uint64_t g_fabric_handle_hash;
+static uint64_t g_size_hash, g_stage_size_hash, g_publish_hash, g_ready_hash;
+static uint64_t g_durable_hash, g_priority_hash;
+
+static int sim_parse_size(const char *str, size_t *out)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno != 0 || end == str) {
+        return -EINVAL;
+    }
+    unsigned shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    case 'T': case 't': shift = 40; end++; break;
+    }
+    if (*end != '\0' || (shift && value > (~0ull >> shift))) {
+        return -EINVAL;
+    }
+    *out = (size_t)(value << shift);
+    return 0;
+}
+
+// --- Device model
+
+static void sim_chunk_free(gpointer data)
+{
+    sim_chunk_t *chunk = data;
+    g_array_free(chunk->free, TRUE);
+    free(chunk);
+}
+
+static void sim_device_init(sim_device_t *dev, size_t capacity, size_t granularity,
+                            const sim_config_t *config)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->capacity = capacity;
+    dev->granularity = granularity;
+    dev->place = config->place;
+    dev->chunk_size = gpu_policy_alloc_size(config->chunk_size, granularity);
+    dev->chunks = g_ptr_array_new_with_free_func(sim_chunk_free);
+}
+
+// Place size bytes, false if the device has no room for them
+static bool sim_device_alloc(sim_device_t *dev, size_t size, sim_block_t *blk)
+{
+    size_t need = gpu_policy_alloc_size(size, dev->granularity);
+    if (dev->place == SIM_DIRECT || need > dev->chunk_size) {
+        if (dev->footprint + need > dev->capacity) {
+            return false;
+        }
+        dev->footprint += need;
+        *blk = (sim_block_t){ .chunk = NULL, .size = need };
+        return true;
+    }
+
+    sim_chunk_t *best = NULL;
+    guint best_index = 0;
+    for (guint i = 0; i < dev->chunks->len && !(best && dev->place == SIM_FIRST_FIT); i++) {
+        sim_chunk_t *chunk = g_ptr_array_index(dev->chunks, i);
+        for (guint j = 0; j < chunk->free->len; j++) {
+            sim_extent_t *e = &g_array_index(chunk->free, sim_extent_t, j);
+            if (e->length >= need &&
+                (!best || e->length < g_array_index(best->free, sim_extent_t, best_index).length)) {
+                best = chunk;
+                best_index = j;
+                if (dev->place == SIM_FIRST_FIT) {
+                    break;
+                }
+            }
+        }
+    }
+    if (!best) {
+        if (dev->footprint + dev->chunk_size > dev->capacity) {
+            return false;
+        }
+        best = calloc(1, sizeof(sim_chunk_t));
+        if (!best) {
+            return false;
+        }
+        best->size = dev->chunk_size;
+        best->free = g_array_new(FALSE, FALSE, sizeof(sim_extent_t));
+        sim_extent_t whole = { .offset = 0, .length = dev->chunk_size };
+        g_array_append_val(best->free, whole);
+        g_ptr_array_add(dev->chunks, best);
+        dev->footprint += dev->chunk_size;
+        best_index = 0;
+    }
+    sim_extent_t *e = &g_array_index(best->free, sim_extent_t, best_index);
+    *blk = (sim_block_t){ .chunk = best, .offset = e->offset, .size = need };
+    e->offset += need;
+    e->length -= need;
+    if (e->length == 0) {
+        g_array_remove_index(best->free, best_index);
+    }
+    best->used += need;
+    return true;
+}
+
+static void sim_device_free(sim_device_t *dev, const sim_block_t *blk)
+{
+    sim_chunk_t *chunk = blk->chunk;
+    if (!chunk) {
+        dev->footprint -= blk->size;
+        return;
+    }
+    chunk->used -= blk->size;
+    if (chunk->used == 0) {
+        dev->footprint -= chunk->size;  // Empty chunks go back to the device
+        g_ptr_array_remove_fast(dev->chunks, chunk);
+        return;
+    }
+
+    guint i = 0;
+    while (i < chunk->free->len && g_array_index(chunk->free, sim_extent_t, i).offset < blk->offset) {
+        i++;
+    }
+    sim_extent_t extent = { .offset = blk->offset, .length = blk->size };
+    g_array_insert_val(chunk->free, i, extent);
+    if (i + 1 < chunk->free->len) {
+        sim_extent_t *cur = &g_array_index(chunk->free, sim_extent_t, i);
+        sim_extent_t *next = cur + 1;
+        if (cur->offset + cur->length == next->offset) {
+            cur->length += next->length;
+            g_array_remove_index(chunk->free, i + 1);
+        }
+    }
+    if (i > 0) {
+        sim_extent_t *prev = &g_array_index(chunk->free, sim_extent_t, i - 1);
+        sim_extent_t *cur = prev + 1;
+        if (prev->offset + prev->length == cur->offset) {
+            prev->length += cur->length;
+            g_array_remove_index(chunk->free, i);
+        }
+    }
+}
+
+// Share of the free pool space outside its largest extent
+static double sim_device_external(const sim_device_t *dev)
+{
+    size_t total = 0, largest = 0;
+    for (guint i = 0; i < dev->chunks->len; i++) {
+        sim_chunk_t *chunk = g_ptr_array_index(dev->chunks, i);
+        for (guint j = 0; j < chunk->free->len; j++) {
+            size_t len = g_array_index(chunk->free, sim_extent_t, j).length;
+            total += len;
+            largest = MAX(largest, len);
+        }
+    }
+    return total ? 1.0 - (double)largest / (double)total : 0.0;
+}
+
+// --- Allocation
+
+static size_t sim_live(sim_t *sim)
+{
+    gpu_admit_stats_t stats;
+    gpu_admit_get_stats(&sim->admit, &stats);
+    return stats.used;
+}
+
+static void sim_note_usage(sim_t *sim)
+{
+    size_t live = sim_live(sim);
+    sim->stats.peak_live = MAX(sim->stats.peak_live, live);
+    if (sim->dev.footprint > sim->stats.peak_footprint) {
+        sim->stats.peak_footprint = sim->dev.footprint;
+        sim->stats.frag_at_peak = 1.0 - (double)live / (double)sim->dev.footprint;
+    }
+    if (sim->dev.place != SIM_DIRECT) {
+        sim->stats.ext_max = MAX(sim->stats.ext_max, sim_device_external(&sim->dev));
+    }
+}
+
+static void sim_release(sim_t *sim, size_t *bytes, sim_block_t *blk)
+{
+    if (*bytes == 0) {
+        return;
+    }
+    sim_device_free(&sim->dev, blk);
+    gpu_admit_release(&sim->admit, *bytes);
+    *bytes = 0;
+}
+
+// Admission, then placement; nothing is held on failure
+static bool sim_try_alloc(sim_t *sim, size_t size, sim_block_t *blk)
+{
+    if (gpu_admit_acquire(&sim->admit, size, 0, NULL) != 0) {
+        return false;
+    }
+    if (!sim_device_alloc(&sim->dev, size, blk)) {
+        gpu_admit_release(&sim->admit, size);
+        return false;
+    }
+    return true;
+}
+
+// Evict under the configured policy until size fits
+static bool sim_alloc_evicting(sim_t *sim, sim_file_t *self, size_t size, sim_block_t *blk)
+{
+    if (sim_try_alloc(sim, size, blk)) {
+        return true;
+    }
+    if (sim->config->evict == GPU_EVICT_NONE || size > sim->capacity) {
+        return false;
+    }
+
+    GArray *candidates = g_array_new(FALSE, FALSE, sizeof(gpu_evict_candidate_t));
+    for (guint i = 0; i < sim->live->len; i++) {
+        sim_file_t *file = g_ptr_array_index(sim->live, i);
+        if (file != self && file->current && file->durable && file->ready && file->opens == 0) {
+            gpu_evict_candidate_t c = {
+                .bytes = file->current,
+                .priority = file->priority,
+                .last_use = file->last_use,
+                .id = file->id,
+                .item = file,
+            };
+            g_array_append_val(candidates, c);
+        }
+    }
+    gpu_policy_evict_order(sim->config->evict, (gpu_evict_candidate_t *)candidates->data,
+                           candidates->len);
+
+    bool placed = false;
+    for (guint i = 0; i < candidates->len && !placed; i++) {
+        sim_file_t *victim = g_array_index(candidates, gpu_evict_candidate_t, i).item;
+        size_t bytes = victim->current;
+        sim_release(sim, &victim->current, &victim->current_blk);
+        victim->evicted = bytes;
+        sim->stats.evictions++;
+        sim->stats.evicted_bytes += bytes;
+        placed = sim_try_alloc(sim, size, blk);
+    }
+    g_array_free(candidates, TRUE);
+    return placed;
+}
+
+// A new allocation is unpublished; a reloaded one keeps its state
+static void sim_grant(sim_t *sim, sim_file_t *file, size_t size, bool stage, bool refault,
+                      const sim_block_t *blk)
+{
+    if (stage) {
+        file->staged = size;
+        file->staged_blk = *blk;
+    } else {
+        file->current = size;
+        file->current_blk = *blk;
+        file->ready = file->ready && refault;
+    }
+    sim_note_usage(sim);
+}
+
+static void sim_fail(sim_t *sim, size_t size)
+{
+    sim->stats.failed++;
+    sim->stats.failed_bytes += size;
+}
+
+// Grant queued requests from the head while they fit, as gpu_admit does
+static void sim_grant_waiters(sim_t *sim)
+{
+    while (!g_queue_is_empty(&sim->waiters)) {
+        sim_waiter_t *w = g_queue_peek_head(&sim->waiters);
+        sim_block_t blk;
+        if (!sim_alloc_evicting(sim, w->file, w->size, &blk)) {
+            break;
+        }
+        g_queue_pop_head(&sim->waiters);
+        w->file->waiting = false;
+        uint64_t waited = sim->now_ns - w->since_ns;
+        g_array_append_val(sim->stats.waits_ns, waited);
+        sim_grant(sim, w->file, w->size, w->stage, w->refault, &blk);
+        free(w);
+    }
+}
+
+static void sim_expire_waiters(sim_t *sim)
+{
+    for (GList *l = sim->waiters.head; l;) {
+        GList *next = l->next;
+        sim_waiter_t *w = l->data;
+        if (w->deadline_ns <= sim->now_ns) {
+            g_queue_delete_link(&sim->waiters, l);
+            w->file->waiting = false;
+            sim->stats.timed_out++;
+            sim_fail(sim, w->size);
+            free(w);
+        }
+        l = next;
+    }
+    sim_grant_waiters(sim);  // A departure may unblock whoever queued behind
+}
+
+static void sim_alloc(sim_t *sim, sim_file_t *file, size_t size, bool stage, bool refault)
+{
+    if (file->waiting) {
+        return;  // The daemon answers EBUSY while an allocation is in flight
+    }
+    sim->stats.allocs++;
+    sim_block_t blk;
+    // Nobody may overtake queued requests
+    if (g_queue_is_empty(&sim->waiters) && sim_alloc_evicting(sim, file, size, &blk)) {
+        sim_grant(sim, file, size, stage, refault, &blk);
+        return;
+    }
+    if (sim->timeout_ms == 0 || size > sim->capacity) {
+        sim_fail(sim, size);
+        return;
+    }
+
+    sim_waiter_t *w = calloc(1, sizeof(sim_waiter_t));
+    if (!w) {
+        sim_fail(sim, size);
+        return;
+    }
+    *w = (sim_waiter_t){
+        .file = file,
+        .size = size,
+        .stage = stage,
+        .refault = refault,
+        .priority = file->priority,
+        .since_ns = sim->now_ns,
+        .deadline_ns = sim->now_ns + (uint64_t)sim->timeout_ms * 1000000ull,
+    };
+    GList *l = sim->waiters.head;
+    while (l && !gpu_policy_queue_ahead(sim->config->admit_policy, w->priority,
+                                        ((sim_waiter_t *)l->data)->priority)) {
+        l = l->next;
+    }
+    if (l) {
+        g_queue_insert_before(&sim->waiters, l, w);
+    } else {
+        g_queue_push_tail(&sim->waiters, w);
+    }
+    file->waiting = true;
+    sim->stats.queued++;
+    sim_grant_waiters(sim);  // A high priority request may fit at the head
+}
+
+// --- Files
+
+static sim_file_t *sim_file(sim_t *sim, uint64_t path, bool create)
+{
+    sim_file_t *file = g_hash_table_lookup(sim->files, &path);
+    if (file || !create) {
+        return file;
+    }
+    file = calloc(1, sizeof(sim_file_t));
+    if (!file) {
+        return NULL;
+    }
+    file->path = path;
+    file->id = sim->next_id++;
+    file->index = sim->live->len;
+    g_ptr_array_add(sim->live, file);
+    g_hash_table_insert(sim->files, &file->path, file);
+    return file;
+}
+
+static void sim_touch(sim_t *sim, sim_file_t *file)
+{
+    file->last_use = ++sim->clock;
+}
+
+// Reload an evicted file before it is used
+static void sim_access(sim_t *sim, sim_file_t *file)
+{
+    sim_touch(sim, file);
+    if (file->evicted == 0 || file->current != 0 || file->waiting) {
+        return;
+    }
+    size_t bytes = file->evicted;
+    file->evicted = 0;
+    sim->stats.refaults++;
+    sim->stats.refault_bytes += bytes;
+    sim_alloc(sim, file, bytes, false, true);
+}
+
+static void sim_forget_path(sim_t *sim, sim_file_t *file)
+{
+    if (g_hash_table_lookup(sim->files, &file->path) == file) {
+        g_hash_table_remove(sim->files, &file->path);
+    }
+}
+
+static void sim_drop(sim_t *sim, sim_file_t *file)
+{
+    for (GList *l = sim->waiters.head; file->waiting && l; l = l->next) {
+        sim_waiter_t *w = l->data;
+        if (w->file == file) {
+            g_queue_delete_link(&sim->waiters, l);  // Nobody waits for it any more
+            file->waiting = false;
+            free(w);
+            break;  // A file waits at most once, and l is gone
+        }
+    }
+    sim_release(sim, &file->current, &file->current_blk);
+    sim_release(sim, &file->staged, &file->staged_blk);
+    sim_forget_path(sim, file);
+    sim_file_t *last = g_ptr_array_index(sim->live, sim->live->len - 1);
+    last->index = file->index;
+    g_ptr_array_remove_index_fast(sim->live, file->index);  // Frees the file
+    sim_grant_waiters(sim);
+}
+
+static void sim_unlink(sim_t *sim, sim_file_t *file)
+{
+    if (file->opens == 0) {
+        sim_drop(sim, file);
+    } else {
+        file->unlinked = true;  // Freed at the last release
+        sim_forget_path(sim, file);
+        g_ptr_array_add(sim->orphans, file);
+    }
+}
+
+static void sim_setxattr(sim_t *sim, sim_file_t *file, const gpu_trace_record_t *rec)
+{
+    uint64_t name = rec->aux;
+    if (name == g_size_hash) {
+        if (rec->arg == 0) {
+            sim_release(sim, &file->current, &file->current_blk);
+            file->evicted = 0;
+            sim_grant_waiters(sim);
+        } else if (file->current == 0) {
+            sim_alloc(sim, file, rec->arg, false, false);
+        }
+    } else if (name == g_stage_size_hash) {
+        if (rec->arg == 0) {
+            sim_release(sim, &file->staged, &file->staged_blk);
+            sim_grant_waiters(sim);
+        } else if (file->staged == 0) {
+            sim_alloc(sim, file, rec->arg, true, false);
+        }
+    } else if (name == g_publish_hash && file->staged) {
+        sim_release(sim, &file->current, &file->current_blk);
+        file->current = file->staged;
+        file->current_blk = file->staged_blk;
+        file->staged = 0;
+        file->evicted = 0;
+        file->ready = true;
+        sim_grant_waiters(sim);
+    } else if (name == g_ready_hash) {
+        file->ready = rec->arg != 0;
+    } else if (name == g_durable_hash) {
+        file->durable = rec->arg != 0;
+    } else if (name == g_priority_hash) {
+        file->priority = (int)(int64_t)rec->arg;
+    }
+}
+
+static void sim_apply(sim_t *sim, const gpu_trace_record_t *rec)
+{
+    // Allocations that failed for lack of memory are tried again, since the
+    // simulated device may have room; anything else that failed is skipped
+    bool alloc = rec->op == GPU_TRACE_TRUNCATE ||
+                 (rec->op == GPU_TRACE_SETXATTR &&
+                  (rec->aux == g_size_hash || rec->aux == g_stage_size_hash));
+    if (rec->err != 0 && !(alloc && (rec->err == ENOMEM || rec->err == EDQUOT))) {
+        return;
+    }
+
+    sim_file_t *file = NULL, *to;
+    switch (rec->op) {
+    case GPU_TRACE_CREATE:
+        if ((file = sim_file(sim, rec->path, false))) {
+            sim_unlink(sim, file);  // Replaced by O_TRUNC or a new file
+        }
+        if ((file = sim_file(sim, rec->path, true))) {
+            file->opens++;
+            sim_touch(sim, file);
+        }
+        break;
+    case GPU_TRACE_OPEN:
+        if ((file = sim_file(sim, rec->path, true))) {
+            file->opens++;
+            sim_access(sim, file);
+        }
+        break;
+    case GPU_TRACE_RELEASE:
+        if ((file = sim_file(sim, rec->path, false)) && file->opens > 0) {
+            file->opens--;
+            sim_touch(sim, file);
+        }
+        break;
+    case GPU_TRACE_READ:
+        if ((file = sim_file(sim, rec->path, false))) {
+            sim_access(sim, file);
+        }
+        break;
+    case GPU_TRACE_GETXATTR:
+        if (rec->aux == g_fabric_handle_hash && (file = sim_file(sim, rec->path, false))) {
+            sim_access(sim, file);
+        }
+        break;
+    case GPU_TRACE_TRUNCATE:
+        if ((file = sim_file(sim, rec->path, true))) {
+            gpu_trace_record_t size = { .aux = g_size_hash, .arg = rec->arg };
+            if (rec->arg != 0) {
+                sim_access(sim, file);  // A restored file keeps its size
+            }
+            sim_setxattr(sim, file, &size);
+        }
+        break;
+    case GPU_TRACE_SETXATTR:
+        if ((file = sim_file(sim, rec->path, false))) {
+            sim_setxattr(sim, file, rec);
+        }
+        break;
+    case GPU_TRACE_UNLINK:
+        if ((file = sim_file(sim, rec->path, false))) {
+            sim_unlink(sim, file);
+        }
+        break;
+    case GPU_TRACE_RENAME:
+        if ((file = sim_file(sim, rec->path, false)) && rec->aux != rec->path) {
+            if ((to = sim_file(sim, rec->aux, false))) {
+                sim_unlink(sim, to);
+            }
+            g_hash_table_remove(sim->files, &file->path);
+            file->path = rec->aux;
+            g_hash_table_insert(sim->files, &file->path, file);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Files unlinked while open are freed at their last release. A release
+// goes to a file created at the same path since, if there is one.
+static bool sim_reap(sim_t *sim, const gpu_trace_record_t *rec)
+{
+    if (rec->op != GPU_TRACE_RELEASE || g_hash_table_contains(sim->files, &rec->path)) {
+        return false;
+    }
+    for (guint i = 0; i < sim->orphans->len; i++) {
+        sim_file_t *file = g_ptr_array_index(sim->orphans, i);
+        if (file->path == rec->path) {
+            if (--file->opens == 0) {
+                g_ptr_array_remove_index_fast(sim->orphans, i);
+                sim_drop(sim, file);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// --- Runs
+
+static int sim_compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_run(const sim_config_t *config, size_t capacity, size_t granularity,
+                    unsigned timeout_ms, const gpu_trace_record_t *records, const size_t *order,
+                    size_t count, sim_stats_t *stats)
+{
+    sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.config = config;
+    sim.capacity = capacity;
+    sim.timeout_ms = timeout_ms;
+    gpu_admit_init(&sim.admit, capacity, config->admit_policy, false, 0);
+    sim_device_init(&sim.dev, capacity, granularity, config);
+    sim.files = g_hash_table_new(g_int64_hash, g_int64_equal);
+    sim.live = g_ptr_array_new_with_free_func(free);
+    sim.orphans = g_ptr_array_new();
+    g_queue_init(&sim.waiters);
+    sim.stats.waits_ns = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+
+    for (size_t i = 0; i < count; i++) {
+        const gpu_trace_record_t *rec = &records[order[i]];
+        if (rec->time_ns > sim.now_ns) {
+            double dt = (double)(rec->time_ns - sim.now_ns);
+            sim.stats.held_ns += dt * (double)sim.dev.footprint;
+            sim.stats.unused_ns += dt * (double)(sim.dev.footprint - MIN(sim_live(&sim),
+                                                                        sim.dev.footprint));
+            sim.now_ns = rec->time_ns;
+        }
+        sim_expire_waiters(&sim);
+        if (!sim_reap(&sim, rec)) {
+            sim_apply(&sim, rec);
+        }
+    }
+    // Whatever is still queued at the end would have timed out
+    sim.now_ns = UINT64_MAX;
+    sim_expire_waiters(&sim);
+
+    *stats = sim.stats;
+    g_queue_clear(&sim.waiters);
+    g_ptr_array_free(sim.orphans, TRUE);
+    g_ptr_array_free(sim.live, TRUE);
+    g_hash_table_destroy(sim.files);
+    g_ptr_array_free(sim.dev.chunks, TRUE);
+    gpu_admit_destroy(&sim.admit);
+}
+
+static void sim_print(const sim_config_t *config, sim_stats_t *stats)
+{
+    char place[48];
+    if (config->place == SIM_DIRECT) {
+        snprintf(place, sizeof(place), "direct");
+    } else {
+        snprintf(place, sizeof(place), "%s:%.0fM", config->place == SIM_FIRST_FIT ? "first" : "best",
+                 config->chunk_size / SIM_MIB);
+    }
+    GArray *waits = stats->waits_ns;
+    double wait_p99 = 0.0;
+    if (waits->len > 0) {
+        qsort(waits->data, waits->len, sizeof(uint64_t), sim_compare_u64);
+        wait_p99 = g_array_index(waits, uint64_t, (waits->len - 1) * 99 / 100) / 1e6;
+    }
+    printf("%-8s %-8s %-12s %8llu %7llu %10.1f %7llu %7llu %10.2f %7llu %10.1f %7llu %10.1f "
+           "%10.1f %10.1f %6.1f %6.1f %6.1f\n",
+           gpu_policy_admit_name(config->admit_policy), gpu_policy_evict_name(config->evict), place,
+           (unsigned long long)stats->allocs, (unsigned long long)stats->failed,
+           stats->failed_bytes / SIM_MIB, (unsigned long long)stats->queued,
+           (unsigned long long)stats->timed_out, wait_p99, (unsigned long long)stats->evictions,
+           stats->evicted_bytes / SIM_MIB, (unsigned long long)stats->refaults,
+           stats->refault_bytes / SIM_MIB, stats->peak_footprint / SIM_MIB,
+           stats->peak_live / SIM_MIB,
+           stats->held_ns > 0 ? 100.0 * stats->unused_ns / stats->held_ns : 0.0,
+           100.0 * stats->frag_at_peak, 100.0 * stats->ext_max);
+    g_array_free(waits, TRUE);
+}
+
+static const gpu_trace_record_t *g_sort_records;
+
+static int sim_compare_time(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    uint64_t tx = g_sort_records[x].time_ns, ty = g_sort_records[y].time_ns;
+    if (tx != ty) {
+        return tx < ty ? -1 : 1;
+    }
+    return (x > y) - (x < y);
+}
+
+static int sim_parse_place(const char *str, sim_config_t *config)
+{
+    if (strcmp(str, "direct") == 0) {
+        config->place = SIM_DIRECT;
+        config->chunk_size = 0;
+        return 0;
+    }
+    const char *colon = strchr(str, ':');
+    if (!colon || sim_parse_size(colon + 1, &config->chunk_size) != 0 || config->chunk_size == 0) {
+        return -EINVAL;
+    }
+    size_t len = (size_t)(colon - str);
+    if (len == 5 && strncmp(str, "first", 5) == 0) {
+        config->place = SIM_FIRST_FIT;
+    } else if (len == 4 && strncmp(str, "best", 4) == 0) {
+        config->place = SIM_BEST_FIT;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -c CAPACITY [-g GRANULARITY] [-w TIMEOUT_MS] [-a fifo|priority,...]\n"
+            "          [-e none|lru|largest|priority,...] [-p direct|first:SIZE|best:SIZE,...] "
+            "TRACE\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t capacity = 0, granularity = 2u << 20;
+    unsigned long timeout_ms = 0;
+    const char *admit_list = "fifo", *evict_list = "none,lru,largest,priority";
+    const char *place_list = "direct";
+    int c;
+    while ((c = getopt(argc, argv, "c:g:w:a:e:p:")) != -1) {
+        switch (c) {
+        case 'c':
+            if (sim_parse_size(optarg, &capacity) != 0) {
+                capacity = 0;
+            }
+            break;
+        case 'g':
+            if (sim_parse_size(optarg, &granularity) != 0) {
+                granularity = 0;
+            }
+            break;
+        case 'w':
+            timeout_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            admit_list = optarg;
+            break;
+        case 'e':
+            evict_list = optarg;
+            break;
+        case 'p':
+            place_list = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind != 1 || capacity == 0 || granularity == 0 || timeout_ms > UINT32_MAX) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    GArray *configs = g_array_new(FALSE, FALSE, sizeof(sim_config_t));
+    gchar **admits = g_strsplit(admit_list, ",", -1);
+    gchar **evicts = g_strsplit(evict_list, ",", -1);
+    gchar **places = g_strsplit(place_list, ",", -1);
+    int rc = 0;
+    for (gchar **a = admits; *a && rc == 0; a++) {
+        for (gchar **e = evicts; *e && rc == 0; e++) {
+            for (gchar **p = places; *p && rc == 0; p++) {
+                sim_config_t config;
+                if (gpu_policy_parse_admit(*a, &config.admit_policy) != 0 ||
+                    gpu_policy_parse_evict(*e, &config.evict) != 0 ||
+                    sim_parse_place(*p, &config) != 0) {
+                    fprintf(stderr, "Unknown policy in %s / %s / %s\n", *a, *e, *p);
+                    rc = 2;
+                    break;
+                }
+                g_array_append_val(configs, config);
+            }
+        }
+    }
+    g_strfreev(admits);
+    g_strfreev(evicts);
+    g_strfreev(places);
+    if (rc != 0) {
+        return rc;
+    }
+
+    gpu_trace_header_t header;
+    gpu_trace_record_t *records;
+    size_t count;
+    rc = gpu_trace_load(argv[optind], &header, &records, &count);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], rc == -EINVAL ? "not a trace" : strerror(-rc));
+        return 1;
+    }
+    g_fabric_handle_hash = gpu_trace_hash("user.fabric_handle");
+    g_size_hash = gpu_trace_hash("user.gpu.size");
+    g_stage_size_hash = gpu_trace_hash("user.gpu.stage_size");
+    g_publish_hash = gpu_trace_hash("user.gpu.publish");
+    g_ready_hash = gpu_trace_hash("user.gpu.ready");
+    g_durable_hash = gpu_trace_hash("user.gpu.durable");
+    g_priority_hash = gpu_trace_hash("user.gpu.priority");
+
+    // Records are written as operations finish; simulate them as they began
+    size_t *order = malloc((count ? count : 1) * sizeof(size_t));
+    if (!order) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    g_sort_records = records;
+    qsort(order, count, sizeof(size_t), sim_compare_time);
+
+    uint64_t span_ns = count ? records[order[count - 1]].time_ns : 0;
+    printf("%s: %zu operations over %.3f s%s, capacity %.1f MiB, granularity %zu, %s\n",
+           argv[optind], count, span_ns / 1e9, header.dropped ? " (some dropped)" : "",
+           capacity / SIM_MIB, granularity, timeout_ms ? "queueing" : "failing when full");
+    printf("%-8s %-8s %-12s %8s %7s %10s %7s %7s %10s %7s %10s %7s %10s %10s %10s %6s %6s %6s\n",
+           "admit", "evict", "place", "allocs", "failed", "fail_MiB", "queued", "timeout",
+           "wait99_ms", "evicted", "evict_MiB", "refault", "refault_MiB", "peak_MiB", "live_MiB",
+           "frag%", "fpeak%", "ext%");
+    for (guint i = 0; i < configs->len; i++) {
+        sim_stats_t stats;
+        sim_run(&g_array_index(configs, sim_config_t, i), capacity, granularity,
+                (unsigned)timeout_ms, records, order, count, &stats);
+        sim_print(&g_array_index(configs, sim_config_t, i), &stats);
+    }
+    free(order);
+    free(records);
+    g_array_free(configs, TRUE);
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include "gpu_bundle.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define GPU_BUNDLE_PIECE (16 * GPU_CKPT_CRC_CHUNK)  // Stored bytes per read
+
+typedef struct {
+    size_t in_off;
+    size_t in_len;
+    size_t out_off;
+    size_t out_len;
+    bool raw;
+} gpu_bundle_frame_t;
+
+typedef struct {
+    const uint8_t *in;
+    uint8_t *out;
+    gpu_bundle_frame_t *frames;
+    size_t count;
+    int level;                       // 0 to decompress
+    size_t next;                     // Next frame to take (atomic)
+    int rc;                          // First failure (atomic)
+} gpu_bundle_job_t;
+
+static void gpu_bundle_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t gpu_bundle_get32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void gpu_bundle_fail(gpu_bundle_job_t *job, int rc)
+{
+    int expected = 0;
+    __atomic_compare_exchange_n(&job->rc, &expected, rc, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void *gpu_bundle_worker(void *arg)
+{
+    gpu_bundle_job_t *job = arg;
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count || __atomic_load_n(&job->rc, __ATOMIC_RELAXED) != 0) {
+            break;
+        }
+        gpu_bundle_frame_t *frame = &job->frames[index];
+        const uint8_t *in = job->in + frame->in_off;
+        uint8_t *out = job->out + frame->out_off;
+
+        if (job->level > 0) {
+            // Compress behind the header; keep the raw bytes if that does not pay
+            uLongf stored = compressBound(frame->in_len);
+            if (compress2(out + GPU_BUNDLE_HEADER, &stored, in, frame->in_len, job->level) != Z_OK ||
+                stored >= frame->in_len) {
+                memcpy(out + GPU_BUNDLE_HEADER, in, frame->in_len);
+                stored = frame->in_len;
+                frame->raw = true;
+            }
+            gpu_bundle_put32(out, (uint32_t)stored | (frame->raw ? GPU_BUNDLE_RAW : 0));
+            gpu_bundle_put32(out + 4, (uint32_t)frame->in_len);
+            frame->out_len = GPU_BUNDLE_HEADER + stored;
+        } else if (frame->raw) {
+            memcpy(out, in, frame->in_len);
+        } else {
+            uLongf raw = frame->out_len;
+            if (uncompress(out, &raw, in, frame->in_len) != Z_OK || raw != frame->out_len) {
+                gpu_bundle_fail(job, -EIO);
+            }
+        }
+    }
+    return NULL;
+}
+
+// The calling thread is one of the workers
+static int gpu_bundle_run(gpu_bundle_job_t *job, unsigned nthreads)
+{
+    unsigned extra = MIN(MAX(nthreads, 1u), MAX(job->count, (size_t)1)) - 1;
+    pthread_t *threads = calloc(extra ? extra : 1, sizeof(pthread_t));
+    unsigned started = 0;
+    while (threads && started < extra &&
+           pthread_create(&threads[started], NULL, gpu_bundle_worker, job) == 0) {
+        started++;
+    }
+    gpu_bundle_worker(job);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return job->rc;
+}
+
+int gpu_bundle_pack(const void *data, size_t len, int level, unsigned nthreads,
+                    GByteArray *out)
+{
+    if (level < 1 || level > 9) {
+        return -EINVAL;
+    }
+    size_t count = (len + GPU_BUNDLE_FRAME - 1) / GPU_BUNDLE_FRAME;
+    if (count == 0) {
+        return 0;
+    }
+    gpu_bundle_frame_t *frames = calloc(count, sizeof(gpu_bundle_frame_t));
+    if (!frames) {
+        return -ENOMEM;
+    }
+
+    // Every frame gets a slot of the worst case size; the slots are
+    // packed together once all are done
+    size_t slot = GPU_BUNDLE_HEADER + compressBound(GPU_BUNDLE_FRAME);
+    size_t base = out->len;
+    g_byte_array_set_size(out, base + count * slot);
+    for (size_t i = 0; i < count; i++) {
+        frames[i].in_off = i * GPU_BUNDLE_FRAME;
+        frames[i].in_len = MIN(GPU_BUNDLE_FRAME, len - frames[i].in_off);
+        frames[i].out_off = base + i * slot;
+    }
+    gpu_bundle_job_t job = {
+        .in = data,
+        .out = out->data,
+        .frames = frames,
+        .count = count,
+        .level = level,
+    };
+    int rc = gpu_bundle_run(&job, nthreads);
+
+    size_t end = base;
+    for (size_t i = 0; i < count; i++) {
+        memmove(out->data + end, out->data + frames[i].out_off, frames[i].out_len);
+        end += frames[i].out_len;
+    }
+    g_byte_array_set_size(out, end);
+    free(frames);
+    return rc;
+}
+
+ssize_t gpu_bundle_unpack(const void *in, size_t len, size_t *consumed, void *out,
+                          size_t out_len, unsigned nthreads)
+{
+    const uint8_t *p = in;
+    size_t pos = 0, produced = 0;
+    GArray *frames = g_array_new(FALSE, FALSE, sizeof(gpu_bundle_frame_t));
+    ssize_t rc = 0;
+
+    while (len - pos >= GPU_BUNDLE_HEADER) {
+        uint32_t stored = gpu_bundle_get32(p + pos);
+        uint32_t raw = gpu_bundle_get32(p + pos + 4);
+        gpu_bundle_frame_t frame = {
+            .in_off = pos + GPU_BUNDLE_HEADER,
+            .in_len = stored & ~GPU_BUNDLE_RAW,
+            .out_off = produced,
+            .out_len = raw,
+            .raw = (stored & GPU_BUNDLE_RAW) != 0,
+        };
+        // Checked before the frame is complete, so callers can size their
+        // buffers for the largest valid frame
+        if (raw == 0 || raw > GPU_BUNDLE_FRAME ||
+            (frame.raw ? frame.in_len != raw : frame.in_len > compressBound(raw))) {
+            rc = -EIO;
+            break;
+        }
+        if (len - frame.in_off < frame.in_len || out_len - produced < raw) {
+            break;
+        }
+        g_array_append_val(frames, frame);
+        pos = frame.in_off + frame.in_len;
+        produced += raw;
+    }
+
+    if (rc == 0 && frames->len > 0) {
+        gpu_bundle_job_t job = {
+            .in = in,
+            .out = out,
+            .frames = (gpu_bundle_frame_t *)frames->data,
+            .count = frames->len,
+        };
+        rc = gpu_bundle_run(&job, nthreads);
+    }
+    g_array_free(frames, TRUE);
+    *consumed = pos;
+    return rc == 0 ? (ssize_t)produced : rc;
+}
+
+int gpu_bundle_read(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec, unsigned nthreads,
+                    gpu_bundle_sink_fn sink, void *arg)
+{
+    bool zlib = (rec->flags & GPU_CKPT_ZLIB) != 0;
+    // Reads start on checksum chunks so each can be verified as it arrives
+    size_t piece = GPU_BUNDLE_PIECE;
+    if (rec->flags & GPU_CKPT_CRC) {
+        piece = MAX(piece / rec->crc_chunk, (size_t)1) * rec->crc_chunk;
+    }
+    // Room for a piece behind the partial frame left by the previous one
+    size_t capacity = piece + GPU_BUNDLE_HEADER + compressBound(GPU_BUNDLE_FRAME);
+    size_t out_len = GPU_BUNDLE_PIECE;
+    uint8_t *buf = malloc(capacity);
+    uint8_t *out = zlib ? malloc(out_len) : NULL;
+    if (!buf || (zlib && !out)) {
+        free(buf);
+        free(out);
+        return -ENOMEM;
+    }
+
+    size_t fill = 0;
+    uint64_t raw = 0;
+    int rc = 0;
+    for (uint64_t pos = 0; pos < rec->length && rc == 0;) {
+        size_t n = MIN(piece, rec->length - pos);
+        ssize_t got = gpu_ckpt_read(r, rec, buf + fill, n, pos);
+        if (got != (ssize_t)n) {
+            rc = got < 0 ? (int)got : -EIO;
+            break;
+        }
+        rc = gpu_ckpt_verify(r, rec, pos, buf + fill, n);
+        pos += n;
+        if (rc != 0 || !zlib) {
+            rc = rc == 0 ? sink(buf, n, arg) : rc;
+            raw += n;
+            continue;
+        }
+
+        fill += n;
+        size_t start = 0;
+        while (rc == 0) {
+            size_t consumed;
+            ssize_t produced = gpu_bundle_unpack(buf + start, fill - start, &consumed, out,
+                                                 out_len, nthreads);
+            if (produced < 0) {
+                rc = (int)produced;
+            } else if (produced == 0) {
+                break;
+            } else if ((uint64_t)produced > rec->raw_length - raw) {
+                rc = -EIO;  // More data than the record claims
+            } else {
+                rc = sink(out, (size_t)produced, arg);
+                raw += (uint64_t)produced;
+                start += consumed;
+            }
+        }
+        memmove(buf, buf + start, fill - start);
+        fill -= start;
+    }
+    if (rc == 0 && (fill != 0 || raw != (zlib ? rec->raw_length : rec->length))) {
+        rc = -EIO;  // Truncated frame or sizes that do not add up
+    }
+    free(buf);
+    free(out);
+    return rc;
+}
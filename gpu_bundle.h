@@ -0,0 +1,48 @@
+#ifndef GPU_BUNDLE_H
+#define GPU_BUNDLE_H
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "gpu_ckpt.h"
+
+// Compressed payloads of bundles, the checkpoint containers written by
+// user.gpu.export to move a directory tree to another daemon. A payload is
+// a sequence of frames, each the zlib stream of up to GPU_BUNDLE_FRAME raw
+// bytes behind an 8-byte header:
+//
+//   [uint32 stored size | GPU_BUNDLE_RAW][uint32 raw size][stored bytes]
+//
+// Frames are independent, so both directions spread them over threads.
+// A frame that does not shrink is stored as it is, with GPU_BUNDLE_RAW.
+// Like gpu_ckpt.c, this file does not depend on CUDA.
+
+#define GPU_BUNDLE_FRAME (1u << 20)          // Raw bytes per frame
+#define GPU_BUNDLE_HEADER 8
+#define GPU_BUNDLE_RAW (1u << 31)            // Frame stored uncompressed
+#define GPU_BUNDLE_LEVEL 1                   // Default zlib level, fastest
+
+// Compress len bytes at level (1-9) into frames appended to out, with
+// nthreads threads. Returns 0 or -EINVAL/-ENOMEM.
+int gpu_bundle_pack(const void *data, size_t len, int level, unsigned nthreads,
+                    GByteArray *out);
+
+// Decode the complete frames at the start of in, as many as fit into
+// out_len bytes, with nthreads threads. Sets *consumed to the input used
+// and returns the bytes written, or -EIO for a corrupt frame. A partial
+// frame at the end is left for the next call.
+ssize_t gpu_bundle_unpack(const void *in, size_t len, size_t *consumed, void *out,
+                          size_t out_len, unsigned nthreads);
+
+typedef int (*gpu_bundle_sink_fn)(const void *data, size_t len, void *arg);
+
+// Stream the data of a record to sink in order, verifying the stored bytes
+// against the record's checksums as they are read. Plain payloads are
+// passed through. Returns 0, -EIO on a checksum mismatch or a corrupt
+// payload, or the first error of sink.
+int gpu_bundle_read(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec, unsigned nthreads,
+                    gpu_bundle_sink_fn sink, void *arg);
+
+#endif // GPU_BUNDLE_H
@@ -0,0 +1,227 @@
+#include "gpu_cgroup.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GPU_CGROUP_LINE_LEN 4096
+
+static void gpu_cgroup_free(gpu_cgroup_t *cg)
+{
+    free(cg->path);
+    free(cg);
+}
+
+void gpu_cgroup_ledger_init(gpu_cgroup_ledger_t *ledger)
+{
+    pthread_mutex_init(&ledger->mutex, NULL);
+    ledger->groups = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                           (GDestroyNotify)gpu_cgroup_free);
+}
+
+void gpu_cgroup_ledger_destroy(gpu_cgroup_ledger_t *ledger)
+{
+    g_hash_table_destroy(ledger->groups);
+    pthread_mutex_destroy(&ledger->mutex);
+}
+
+// Find or create a cgroup and its ancestors (ledger->mutex held)
+static gpu_cgroup_t *gpu_cgroup_get_locked(gpu_cgroup_ledger_t *ledger, const char *path)
+{
+    gpu_cgroup_t *cg = g_hash_table_lookup(ledger->groups, path);
+    if (cg) {
+        return cg;
+    }
+
+    gpu_cgroup_t *parent = NULL;
+    if (strcmp(path, "/") != 0) {
+        char *parent_path = g_path_get_dirname(path);
+        parent = gpu_cgroup_get_locked(ledger, parent_path);
+        g_free(parent_path);
+        if (!parent) {
+            return NULL;
+        }
+    }
+
+    cg = calloc(1, sizeof(gpu_cgroup_t));
+    if (!cg) {
+        return NULL;
+    }
+    cg->path = strdup(path);
+    cg->parent = parent;
+    g_hash_table_insert(ledger->groups, cg->path, cg);
+    return cg;
+}
+
+// Strip trailing slashes so "/a/b/" and "/a/b" are the same group
+static void gpu_cgroup_normalize(char *path)
+{
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') {
+        path[--len] = '\0';
+    }
+}
+
+gpu_cgroup_t *gpu_cgroup_get(gpu_cgroup_ledger_t *ledger, const char *path)
+{
+    if (path[0] != '/') {
+        return NULL;
+    }
+    char *normalized = strdup(path);
+    if (!normalized) {
+        return NULL;
+    }
+    gpu_cgroup_normalize(normalized);
+
+    pthread_mutex_lock(&ledger->mutex);
+    gpu_cgroup_t *cg = gpu_cgroup_get_locked(ledger, normalized);
+    pthread_mutex_unlock(&ledger->mutex);
+
+    free(normalized);
+    return cg;
+}
+
+gpu_cgroup_t *gpu_cgroup_of_pid(gpu_cgroup_ledger_t *ledger, pid_t pid)
+{
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/%d/cgroup", (int)pid);
+
+    char found[GPU_CGROUP_LINE_LEN] = "/";
+    FILE *fp = pid > 0 ? fopen(proc_path, "r") : NULL;
+    if (fp) {
+        // Lines are "hierarchy-ID:controllers:path". Prefer the unified
+        // hierarchy ("0::path"), fall back to the v1 memory controller.
+        char line[GPU_CGROUP_LINE_LEN];
+        bool have_v1 = false;
+        while (fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\n")] = '\0';
+            char *controllers = strchr(line, ':');
+            if (!controllers) {
+                continue;
+            }
+            *controllers++ = '\0';
+            char *path = strchr(controllers, ':');
+            if (!path || path[1] != '/') {
+                continue;
+            }
+            *path++ = '\0';
+
+            if (strcmp(line, "0") == 0 && controllers[0] == '\0') {
+                snprintf(found, sizeof(found), "%s", path);
+                break;
+            }
+            if (!have_v1 && strstr(controllers, "memory") != NULL) {
+                snprintf(found, sizeof(found), "%s", path);
+                have_v1 = true;
+            }
+        }
+        fclose(fp);
+    }
+
+    return gpu_cgroup_get(ledger, found);
+}
+
+int gpu_cgroup_charge(gpu_cgroup_ledger_t *ledger, gpu_cgroup_t *cg, size_t bytes)
+{
+    pthread_mutex_lock(&ledger->mutex);
+
+    // Check every level before charging any, so a refusal leaves no trace
+    for (gpu_cgroup_t *level = cg; level != NULL; level = level->parent) {
+        if (level->limit != 0 && level->usage + bytes > level->limit) {
+            level->failcnt++;
+            pthread_mutex_unlock(&ledger->mutex);
+            printf("cgroup %s over its limit of %zu bytes (charging %zu for %s)\n",
+                   level->path, level->limit, bytes, cg->path);
+            return -EDQUOT;
+        }
+    }
+
+    for (gpu_cgroup_t *level = cg; level != NULL; level = level->parent) {
+        level->usage += bytes;
+        if (level->usage > level->peak) {
+            level->peak = level->usage;
+        }
+    }
+
+    pthread_mutex_unlock(&ledger->mutex);
+    return 0;
+}
+
+void gpu_cgroup_uncharge(gpu_cgroup_ledger_t *ledger, gpu_cgroup_t *cg, size_t bytes)
+{
+    pthread_mutex_lock(&ledger->mutex);
+    for (gpu_cgroup_t *level = cg; level != NULL; level = level->parent) {
+        level->usage = bytes > level->usage ? 0 : level->usage - bytes;
+    }
+    pthread_mutex_unlock(&ledger->mutex);
+}
+
+int gpu_cgroup_set_limit(gpu_cgroup_ledger_t *ledger, const char *path, size_t limit)
+{
+    gpu_cgroup_t *cg = gpu_cgroup_get(ledger, path);
+    if (!cg) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ledger->mutex);
+    cg->limit = limit;
+    pthread_mutex_unlock(&ledger->mutex);
+
+    printf("cgroup %s limit set to %zu bytes\n", cg->path, limit);
+    return 0;
+}
+
+int gpu_cgroup_load_limits(gpu_cgroup_ledger_t *ledger, const char *filename,
+                           int (*parse_size)(const char *, size_t *))
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        return -errno;
+    }
+
+    char line[GPU_CGROUP_LINE_LEN];
+    int lineno = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *save;
+        char *path = strtok_r(line, " \t\n", &save);
+        if (!path || path[0] == '#') {
+            continue;  // Blank line or comment
+        }
+        char *size_str = strtok_r(NULL, " \t\n", &save);
+        size_t limit;
+        if (!size_str || parse_size(size_str, &limit) != 0) {
+            fprintf(stderr, "%s:%d: expected \"PATH SIZE\"\n", filename, lineno);
+            rc = -EINVAL;
+            break;
+        }
+        rc = gpu_cgroup_set_limit(ledger, path, limit);
+    }
+
+    fclose(fp);
+    return rc;
+}
+
+static gint gpu_cgroup_compare_path(gconstpointer a, gconstpointer b)
+{
+    return strcmp(a, b);
+}
+
+GString *gpu_cgroup_format(gpu_cgroup_ledger_t *ledger)
+{
+    GString *out = g_string_new(NULL);
+
+    pthread_mutex_lock(&ledger->mutex);
+    GList *paths = g_list_sort(g_hash_table_get_keys(ledger->groups), gpu_cgroup_compare_path);
+    for (GList *l = paths; l != NULL; l = l->next) {
+        gpu_cgroup_t *cg = g_hash_table_lookup(ledger->groups, l->data);
+        g_string_append_printf(out, "%s %zu %zu %zu %llu\n", cg->path, cg->usage,
+                               cg->peak, cg->limit, (unsigned long long)cg->failcnt);
+    }
+    g_list_free(paths);
+    pthread_mutex_unlock(&ledger->mutex);
+
+    return out;
+}
@@ -0,0 +1,48 @@
+#ifndef GPU_CGROUP_H
+#define GPU_CGROUP_H
+
+#include <glib.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Per-cgroup ledger of device memory. Allocations are charged to the cgroup
+// of the calling process and to all of its ancestors, and a limit set at any
+// level applies to the whole subtree, mirroring the cgroup memory controller.
+
+typedef struct gpu_cgroup {
+    char *path;                   // cgroup path, "/" is the root
+    struct gpu_cgroup *parent;    // NULL for the root
+    size_t usage;                 // Bytes charged to this subtree
+    size_t peak;                  // Highest usage seen
+    size_t limit;                 // 0 means unlimited
+    uint64_t failcnt;             // Charges refused at this level
+} gpu_cgroup_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    GHashTable *groups;           // path -> gpu_cgroup_t*, entries live until destroy
+} gpu_cgroup_ledger_t;
+
+void gpu_cgroup_ledger_init(gpu_cgroup_ledger_t *ledger);
+void gpu_cgroup_ledger_destroy(gpu_cgroup_ledger_t *ledger);
+
+// Resolve the cgroup of a process from /proc/<pid>/cgroup (the unified
+// hierarchy, or the v1 memory controller). Unknown pids map to the root.
+gpu_cgroup_t *gpu_cgroup_of_pid(gpu_cgroup_ledger_t *ledger, pid_t pid);
+gpu_cgroup_t *gpu_cgroup_get(gpu_cgroup_ledger_t *ledger, const char *path);
+
+// Charge bytes to a cgroup and its ancestors, -EDQUOT if a limit is hit
+int gpu_cgroup_charge(gpu_cgroup_ledger_t *ledger, gpu_cgroup_t *cg, size_t bytes);
+void gpu_cgroup_uncharge(gpu_cgroup_ledger_t *ledger, gpu_cgroup_t *cg, size_t bytes);
+
+// Limits: 0 removes the limit. The file holds "PATH SIZE" lines.
+int gpu_cgroup_set_limit(gpu_cgroup_ledger_t *ledger, const char *path, size_t limit);
+int gpu_cgroup_load_limits(gpu_cgroup_ledger_t *ledger, const char *filename,
+                           int (*parse_size)(const char *, size_t *));
+
+// One line per cgroup: "path usage peak limit failcnt"
+GString *gpu_cgroup_format(gpu_cgroup_ledger_t *ledger);
+
+#endif // GPU_CGROUP_H
@@ -0,0 +1,504 @@
+#include "gpu_ckpt.h"
+#include "gpu_crc32c.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t gpu_ckpt_align_up(uint64_t offset)
+{
+    return (offset + GPU_CKPT_ALIGN - 1) & ~(uint64_t)(GPU_CKPT_ALIGN - 1);
+}
+
+static int gpu_ckpt_pwrite(int fd, const void *data, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, (const char *)data + done, len - done, (off_t)(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int gpu_ckpt_pread(int fd, void *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, (off_t)(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            return -EINVAL;  // Truncated
+        }
+        done += n;
+    }
+    return 0;
+}
+
+int gpu_ckpt_writer_open(gpu_ckpt_writer_t *w, const char *path)
+{
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->path = strdup(path);
+    w->tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+    int rc = -ENOMEM;
+    if (w->path && w->tmp_path) {
+        sprintf(w->tmp_path, "%s.tmp", path);
+        w->fd = open(w->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        rc = w->fd < 0 ? -errno : 0;
+    }
+    if (rc != 0) {
+        // Nothing is left for gpu_ckpt_writer_abort
+        free(w->path);
+        free(w->tmp_path);
+        w->path = NULL;
+        w->tmp_path = NULL;
+        w->fd = -1;
+        return rc;
+    }
+    w->offset = GPU_CKPT_ALIGN;  // Header is written by finish
+    w->records = g_array_new(FALSE, FALSE, sizeof(gpu_ckpt_record_t));
+    w->crcs = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    return 0;
+}
+
+int gpu_ckpt_writer_add(gpu_ckpt_writer_t *w, const gpu_ckpt_record_t *rec)
+{
+    if (w->in_payload) {
+        return -EINVAL;
+    }
+    gpu_ckpt_record_t copy = *rec;
+    copy.offset = 0;
+    copy.length = 0;
+    copy.flags &= ~(GPU_CKPT_CRC | GPU_CKPT_ZLIB);
+    copy.crc_index = 0;
+    copy.crc_chunk = 0;
+    copy.frame_size = 0;
+    copy.raw_length = 0;
+    g_array_append_val(w->records, copy);
+    return 0;
+}
+
+int gpu_ckpt_writer_begin(gpu_ckpt_writer_t *w, const gpu_ckpt_record_t *rec)
+{
+    if (w->in_payload) {
+        return -EINVAL;
+    }
+    w->current = *rec;
+    w->current.offset = gpu_ckpt_align_up(w->offset);  // The gap stays a hole
+    w->current.length = 0;
+    w->current.flags |= GPU_CKPT_CRC;
+    w->current.crc_index = w->crcs->len;
+    w->current.crc_chunk = GPU_CKPT_CRC_CHUNK;
+    w->offset = w->current.offset;
+    w->in_payload = true;
+    w->crc = 0;
+    w->crc_fill = 0;
+    return 0;
+}
+
+int gpu_ckpt_writer_append(gpu_ckpt_writer_t *w, const void *data, size_t len)
+{
+    if (!w->in_payload) {
+        return -EINVAL;
+    }
+    int rc = gpu_ckpt_pwrite(w->fd, data, len, w->offset);
+    if (rc != 0) {
+        return rc;
+    }
+    w->offset += len;
+    w->current.length += len;
+
+    // Appends need not line up with the checksum chunks
+    const char *p = data;
+    while (len > 0) {
+        size_t n = GPU_CKPT_CRC_CHUNK - w->crc_fill;
+        if (n > len) {
+            n = len;
+        }
+        w->crc = gpu_crc32c(w->crc, p, n);
+        w->crc_fill += n;
+        p += n;
+        len -= n;
+        if (w->crc_fill == GPU_CKPT_CRC_CHUNK) {
+            g_array_append_val(w->crcs, w->crc);
+            w->crc = 0;
+            w->crc_fill = 0;
+        }
+    }
+    return 0;
+}
+
+int gpu_ckpt_writer_end(gpu_ckpt_writer_t *w)
+{
+    if (!w->in_payload) {
+        return -EINVAL;
+    }
+    if (w->crc_fill > 0) {
+        g_array_append_val(w->crcs, w->crc);
+    }
+    g_array_append_val(w->records, w->current);
+    w->in_payload = false;
+    return 0;
+}
+
+static void gpu_ckpt_writer_free(gpu_ckpt_writer_t *w)
+{
+    if (w->fd >= 0) {
+        close(w->fd);
+        w->fd = -1;
+    }
+    g_array_free(w->records, TRUE);
+    g_array_free(w->crcs, TRUE);
+    free(w->path);
+    free(w->tmp_path);
+}
+
+// Make the rename durable too
+static void gpu_ckpt_sync_parent(const char *path)
+{
+    char *copy = strdup(path);
+    if (!copy) {
+        return;
+    }
+    int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(copy);
+}
+
+int gpu_ckpt_writer_finish(gpu_ckpt_writer_t *w)
+{
+    if (w->in_payload) {
+        gpu_ckpt_writer_abort(w);
+        return -EINVAL;
+    }
+
+    gpu_ckpt_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GPU_CKPT_MAGIC, sizeof(header.magic));
+    header.version = GPU_CKPT_VERSION;
+    header.header_size = sizeof(gpu_ckpt_header_t);
+    header.record_size = sizeof(gpu_ckpt_record_t);
+    header.align = GPU_CKPT_ALIGN;
+    header.count = w->records->len;
+    header.crc_count = w->crcs->len;
+    header.crc_offset = header.crc_count ? gpu_ckpt_align_up(w->offset) : 0;
+    header.index_offset = header.crc_count
+                              ? gpu_ckpt_align_up(header.crc_offset +
+                                                  header.crc_count * sizeof(uint32_t))
+                              : gpu_ckpt_align_up(w->offset);
+    header.created = (uint64_t)time(NULL);
+
+    // Checksums and index first, then the header that makes them reachable
+    int rc = gpu_ckpt_pwrite(w->fd, w->crcs->data, (size_t)w->crcs->len * sizeof(uint32_t),
+                             header.crc_offset);
+    if (rc == 0) {
+        rc = gpu_ckpt_pwrite(w->fd, w->records->data,
+                             (size_t)w->records->len * sizeof(gpu_ckpt_record_t),
+                             header.index_offset);
+    }
+    if (rc == 0) {
+        rc = gpu_ckpt_pwrite(w->fd, &header, sizeof(header), 0);
+    }
+    if (rc == 0 && fdatasync(w->fd) != 0) {
+        rc = -errno;
+    }
+    if (rc == 0 && rename(w->tmp_path, w->path) != 0) {
+        rc = -errno;
+    }
+    if (rc != 0) {
+        gpu_ckpt_writer_abort(w);
+        return rc;
+    }
+
+    gpu_ckpt_sync_parent(w->path);
+    gpu_ckpt_writer_free(w);
+    return 0;
+}
+
+void gpu_ckpt_writer_abort(gpu_ckpt_writer_t *w)
+{
+    unlink(w->tmp_path);
+    gpu_ckpt_writer_free(w);
+}
+
+// Every record must be terminated, point inside the payload area and, if it
+// has checksums, inside the crc table
+static bool gpu_ckpt_record_valid(const gpu_ckpt_header_t *header, const gpu_ckpt_record_t *rec)
+{
+    if (memchr(rec->path, '\0', sizeof(rec->path)) == NULL || rec->path[0] != '/' ||
+        memchr(rec->dtype, '\0', sizeof(rec->dtype)) == NULL ||
+        memchr(rec->shape, '\0', sizeof(rec->shape)) == NULL) {
+        return false;
+    }
+    if (rec->length == 0) {
+        return true;
+    }
+    uint64_t end = header->crc_count ? header->crc_offset : header->index_offset;
+    if (rec->offset < header->header_size || rec->offset % header->align != 0 ||
+        rec->offset > end || rec->length > end - rec->offset) {
+        return false;
+    }
+    // Compressed payloads may grow past the allocation, their data may not
+    uint64_t raw = rec->flags & GPU_CKPT_ZLIB ? rec->raw_length : rec->length;
+    if (raw > rec->alloc_size || (rec->flags & GPU_CKPT_ZLIB && rec->frame_size == 0)) {
+        return false;
+    }
+    if (!(rec->flags & GPU_CKPT_CRC)) {
+        return true;
+    }
+    if (rec->crc_chunk == 0) {
+        return false;
+    }
+    uint64_t nchunks = (rec->length + rec->crc_chunk - 1) / rec->crc_chunk;
+    return rec->crc_index <= header->crc_count && nchunks <= header->crc_count - rec->crc_index;
+}
+
+int gpu_ckpt_open(gpu_ckpt_reader_t *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        return -errno;
+    }
+
+    struct stat st;
+    int rc = fstat(r->fd, &st) == 0 ? 0 : -errno;
+    if (rc == 0) {
+        rc = gpu_ckpt_pread(r->fd, &r->header, sizeof(r->header), 0);
+    }
+    const gpu_ckpt_header_t *h = &r->header;
+    if (rc == 0 &&
+        (memcmp(h->magic, GPU_CKPT_MAGIC, sizeof(h->magic)) != 0 ||
+         h->version != GPU_CKPT_VERSION || h->header_size != sizeof(gpu_ckpt_header_t) ||
+         h->record_size != sizeof(gpu_ckpt_record_t) || h->align != GPU_CKPT_ALIGN ||
+         h->index_offset < h->header_size ||
+         h->index_offset > (uint64_t)st.st_size ||
+         h->count > ((uint64_t)st.st_size - h->index_offset) / h->record_size ||
+         (h->crc_count &&
+          (h->crc_offset < h->header_size || h->crc_offset > h->index_offset ||
+           h->crc_count > (h->index_offset - h->crc_offset) / sizeof(uint32_t))))) {
+        rc = -EINVAL;
+    }
+
+    if (rc == 0 && h->crc_count) {
+        r->crcs = malloc(h->crc_count * sizeof(uint32_t));
+        rc = r->crcs ? gpu_ckpt_pread(r->fd, r->crcs, h->crc_count * sizeof(uint32_t),
+                                      h->crc_offset)
+                     : -ENOMEM;
+    }
+
+    if (rc == 0) {
+        r->records = malloc(h->count ? h->count * sizeof(gpu_ckpt_record_t) : 1);
+        rc = r->records ? gpu_ckpt_pread(r->fd, r->records,
+                                         h->count * sizeof(gpu_ckpt_record_t),
+                                         h->index_offset)
+                        : -ENOMEM;
+    }
+    if (rc == 0) {
+        r->by_path = g_hash_table_new(g_str_hash, g_str_equal);
+        for (uint64_t i = 0; i < h->count; i++) {
+            if (!gpu_ckpt_record_valid(h, &r->records[i])) {
+                rc = -EINVAL;
+                break;
+            }
+            g_hash_table_insert(r->by_path, r->records[i].path, &r->records[i]);
+        }
+    }
+
+    if (rc != 0) {
+        gpu_ckpt_close(r);
+    }
+    return rc;
+}
+
+void gpu_ckpt_close(gpu_ckpt_reader_t *r)
+{
+    if (r->by_path) {
+        g_hash_table_destroy(r->by_path);
+    }
+    free(r->records);
+    free(r->crcs);
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+const gpu_ckpt_record_t *gpu_ckpt_find(const gpu_ckpt_reader_t *r, const char *path)
+{
+    return g_hash_table_lookup(r->by_path, path);
+}
+
+ssize_t gpu_ckpt_read(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec, void *buf,
+                      size_t len, uint64_t pos)
+{
+    if (pos >= rec->length) {
+        return 0;
+    }
+    if (len > rec->length - pos) {
+        len = rec->length - pos;
+    }
+    int rc = gpu_ckpt_pread(r->fd, buf, len, rec->offset + pos);
+    return rc == 0 ? (ssize_t)len : rc;
+}
+
+const uint32_t *gpu_ckpt_crcs(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec)
+{
+    return rec->flags & GPU_CKPT_CRC ? r->crcs + rec->crc_index : NULL;
+}
+
+int gpu_ckpt_verify(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec, uint64_t pos,
+                    const void *data, size_t len)
+{
+    const uint32_t *crcs = gpu_ckpt_crcs(r, rec);
+    if (!crcs) {
+        return 0;
+    }
+    if (pos % rec->crc_chunk != 0 || pos > rec->length || len > rec->length - pos ||
+        (len % rec->crc_chunk != 0 && pos + len != rec->length)) {
+        return -EINVAL;
+    }
+    const char *p = data;
+    for (uint64_t i = pos / rec->crc_chunk; len > 0; i++) {
+        size_t n = len < rec->crc_chunk ? len : rec->crc_chunk;
+        if (gpu_crc32c(0, p, n) != crcs[i]) {
+            return -EIO;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+#define GPU_CKPT_SCRUB_BUF (16 * GPU_CKPT_CRC_CHUNK)
+
+typedef struct {
+    const gpu_ckpt_reader_t *r;
+    const bool *stop;
+    gpu_ckpt_scrub_stats_t *stats;
+    uint64_t next;                   // Next record to take (atomic)
+    pthread_mutex_t mutex;           // first_error
+} gpu_ckpt_scrub_job_t;
+
+static void gpu_ckpt_scrub_fail(gpu_ckpt_scrub_job_t *job, const gpu_ckpt_record_t *rec)
+{
+    pthread_mutex_lock(&job->mutex);
+    if (__atomic_fetch_add(&job->stats->errors, 1, __ATOMIC_RELAXED) == 0) {
+        snprintf(job->stats->first_error, sizeof(job->stats->first_error), "%s", rec->path);
+    }
+    pthread_mutex_unlock(&job->mutex);
+}
+
+static void *gpu_ckpt_scrub_worker(void *arg)
+{
+    gpu_ckpt_scrub_job_t *job = arg;
+    const gpu_ckpt_reader_t *r = job->r;
+    void *buf = NULL;
+
+    while (!__atomic_load_n(job->stop, __ATOMIC_RELAXED)) {
+        uint64_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= r->header.count) {
+            break;
+        }
+        const gpu_ckpt_record_t *rec = &r->records[index];
+        if (rec->length == 0) {
+            continue;
+        }
+        if (!(rec->flags & GPU_CKPT_CRC)) {
+            __atomic_add_fetch(&job->stats->unchecked, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!buf && !(buf = malloc(GPU_CKPT_SCRUB_BUF))) {
+            gpu_ckpt_scrub_fail(job, rec);
+            break;
+        }
+
+        // Whole chunks per read, so each read verifies on its own
+        size_t step = GPU_CKPT_SCRUB_BUF / rec->crc_chunk * rec->crc_chunk;
+        if (step == 0) {
+            step = rec->crc_chunk;
+            void *bigger = realloc(buf, step);
+            if (!bigger) {
+                gpu_ckpt_scrub_fail(job, rec);
+                continue;
+            }
+            buf = bigger;
+        }
+        int rc = 0;
+        for (uint64_t pos = 0; rc == 0 && pos < rec->length; pos += step) {
+            if (__atomic_load_n(job->stop, __ATOMIC_RELAXED)) {
+                break;
+            }
+            ssize_t n = gpu_ckpt_read(r, rec, buf, step, pos);
+            rc = n < 0 ? (int)n : gpu_ckpt_verify(r, rec, pos, buf, (size_t)n);
+            if (rc == 0) {
+                __atomic_add_fetch(&job->stats->bytes, (uint64_t)n, __ATOMIC_RELAXED);
+            }
+        }
+        if (rc != 0) {
+            gpu_ckpt_scrub_fail(job, rec);
+        } else {
+            __atomic_add_fetch(&job->stats->records, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+int gpu_ckpt_scrub(const gpu_ckpt_reader_t *r, unsigned nthreads, const bool *stop,
+                   gpu_ckpt_scrub_stats_t *stats)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    gpu_ckpt_scrub_job_t job = {.r = r, .stop = stop, .stats = stats};
+    pthread_mutex_init(&job.mutex, NULL);
+    if (nthreads == 0) {
+        nthreads = 1;
+    }
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+    unsigned started = 0;
+    if (threads) {
+        while (started < nthreads &&
+               pthread_create(&threads[started], NULL, gpu_ckpt_scrub_worker, &job) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        gpu_ckpt_scrub_worker(&job);  // Scrub on the calling thread
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.mutex);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->elapsed_us = (int64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+                        (end.tv_nsec - start.tv_nsec) / 1000;
+    if (__atomic_load_n(&stats->errors, __ATOMIC_RELAXED) != 0) {
+        return -EIO;
+    }
+    return __atomic_load_n(stop, __ATOMIC_RELAXED) ? -ECANCELED : 0;
+}
@@ -0,0 +1,148 @@
+#ifndef GPU_CKPT_H
+#define GPU_CKPT_H
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Checkpoint container: a single file holding the namespace and the
+// contents of many allocations. Layout (little endian):
+//
+//   [header, GPU_CKPT_ALIGN bytes][payload][pad]...[crc table][pad][index]
+//
+// Payloads start on GPU_CKPT_ALIGN boundaries so they can be read with
+// O_DIRECT or mapped with mmap. The index is an array of fixed size records
+// written after the last payload; the header, written last, points at it.
+// Payloads are checksummed with CRC32C per GPU_CKPT_CRC_CHUNK bytes; the
+// checksums of all records form one table before the index, and each record
+// with GPU_CKPT_CRC set names its first entry. Containers written before the
+// table existed have neither, and load without verification.
+// Payloads of records with GPU_CKPT_ZLIB are compressed in frames (see
+// gpu_bundle.h); length is then the stored size and raw_length the size
+// of the data. Checksums always cover the stored bytes.
+// A reader only touches the header and the index until it asks for the
+// bytes of a particular record. This file does not depend on CUDA, so
+// offline tools can use it.
+
+#define GPU_CKPT_MAGIC "GPUCKPT1"
+#define GPU_CKPT_VERSION 1
+#define GPU_CKPT_ALIGN 4096
+#define GPU_CKPT_PATH_LEN 512
+#define GPU_CKPT_DTYPE_LEN 16
+#define GPU_CKPT_SHAPE_LEN 192
+#define GPU_CKPT_CRC_CHUNK (1ULL << 20)  // Payload bytes per checksum
+
+// Record flags
+#define GPU_CKPT_DIR (1u << 0)       // Directory, no payload
+#define GPU_CKPT_READY (1u << 1)     // File was published
+#define GPU_CKPT_DURABLE (1u << 2)
+#define GPU_CKPT_CRC (1u << 3)       // Payload has checksums in the crc table
+#define GPU_CKPT_ZLIB (1u << 4)      // Payload is zlib frames of frame_size raw bytes
+
+typedef struct {
+    char magic[8];                   // GPU_CKPT_MAGIC
+    uint32_t version;
+    uint32_t header_size;            // GPU_CKPT_ALIGN
+    uint32_t record_size;            // sizeof(gpu_ckpt_record_t)
+    uint32_t align;                  // Payload alignment
+    uint64_t count;                  // Records in the index
+    uint64_t index_offset;
+    uint64_t created;                // Unix time the checkpoint completed
+    uint64_t crc_offset;             // CRC32C table, 0 if none
+    uint64_t crc_count;              // Entries in the table
+    uint8_t reserved[GPU_CKPT_ALIGN - 64];
+} gpu_ckpt_header_t;
+
+typedef struct {
+    char path[GPU_CKPT_PATH_LEN];    // NUL terminated
+    uint64_t offset;                 // Payload offset, 0 if none
+    uint64_t length;                 // Payload bytes
+    uint64_t alloc_size;             // Size of the allocation to restore into
+    uint64_t seq;                    // Version number at checkpoint time
+    uint32_t flags;
+    int32_t priority;
+    char dtype[GPU_CKPT_DTYPE_LEN];
+    char shape[GPU_CKPT_SHAPE_LEN];
+    uint64_t first_access;           // Order of first use, 0 if never used
+    uint64_t crc_index;              // First checksum of the payload in the crc table
+    uint32_t crc_chunk;              // Payload bytes per checksum
+    uint32_t frame_size;             // Raw bytes per frame, GPU_CKPT_ZLIB only
+    uint64_t raw_length;             // Bytes after decompression, GPU_CKPT_ZLIB only
+    uint8_t reserved[232];
+} gpu_ckpt_record_t;
+
+_Static_assert(sizeof(gpu_ckpt_header_t) == GPU_CKPT_ALIGN, "header must fill one block");
+_Static_assert(sizeof(gpu_ckpt_record_t) == 1024, "record size is part of the format");
+
+// Streaming writer. Records are appended in any order; the container is
+// written to PATH.tmp and renamed over PATH by finish, so an interrupted
+// checkpoint leaves the previous one intact.
+typedef struct {
+    int fd;
+    char *path;
+    char *tmp_path;
+    uint64_t offset;                 // End of the data written so far
+    GArray *records;                 // gpu_ckpt_record_t
+    gpu_ckpt_record_t current;       // Record whose payload is being appended
+    bool in_payload;
+    GArray *crcs;                    // uint32_t, the crc table
+    uint32_t crc;                    // Of the chunk being appended
+    size_t crc_fill;                 // Bytes in that chunk
+} gpu_ckpt_writer_t;
+
+int gpu_ckpt_writer_open(gpu_ckpt_writer_t *w, const char *path);
+// Add a record without payload (directories, files without memory)
+int gpu_ckpt_writer_add(gpu_ckpt_writer_t *w, const gpu_ckpt_record_t *rec);
+// Stream a payload: begin, any number of appends, end
+int gpu_ckpt_writer_begin(gpu_ckpt_writer_t *w, const gpu_ckpt_record_t *rec);
+int gpu_ckpt_writer_append(gpu_ckpt_writer_t *w, const void *data, size_t len);
+int gpu_ckpt_writer_end(gpu_ckpt_writer_t *w);
+// Write the index and header, sync and move into place. Frees the writer.
+int gpu_ckpt_writer_finish(gpu_ckpt_writer_t *w);
+void gpu_ckpt_writer_abort(gpu_ckpt_writer_t *w);
+
+typedef struct {
+    int fd;
+    gpu_ckpt_header_t header;
+    gpu_ckpt_record_t *records;      // header.count entries, in write order
+    GHashTable *by_path;             // path -> gpu_ckpt_record_t*
+    uint32_t *crcs;                  // header.crc_count entries
+} gpu_ckpt_reader_t;
+
+// Open a container and load its index. Returns 0, -errno, or -EINVAL if
+// the file is not a valid container.
+int gpu_ckpt_open(gpu_ckpt_reader_t *r, const char *path);
+void gpu_ckpt_close(gpu_ckpt_reader_t *r);
+const gpu_ckpt_record_t *gpu_ckpt_find(const gpu_ckpt_reader_t *r, const char *path);
+// Read payload bytes of a record from pos. Returns bytes read or -errno.
+ssize_t gpu_ckpt_read(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec, void *buf,
+                      size_t len, uint64_t pos);
+
+// Checksums of a record, one per rec->crc_chunk bytes, or NULL if the
+// payload has none
+const uint32_t *gpu_ckpt_crcs(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec);
+// Check payload bytes read from pos, which must start a chunk; len must
+// cover whole chunks or end at the end of the payload. Returns 0, -EIO on a
+// mismatch, or -EINVAL. Records without checksums always pass.
+int gpu_ckpt_verify(const gpu_ckpt_reader_t *r, const gpu_ckpt_record_t *rec, uint64_t pos,
+                    const void *data, size_t len);
+
+// Progress of a scrub, updated atomically while it runs
+typedef struct {
+    uint64_t records;                // Payloads checked
+    uint64_t unchecked;              // Payloads without checksums, skipped
+    uint64_t bytes;
+    uint64_t errors;                 // Payloads with a mismatch or a read error
+    char first_error[GPU_CKPT_PATH_LEN];
+    int64_t elapsed_us;
+} gpu_ckpt_scrub_stats_t;
+
+// Read and verify every payload with nthreads threads, each reading whole
+// chunks. Stops early when *stop becomes true. Returns 0, -EIO if any
+// payload failed, or -ECANCELED.
+int gpu_ckpt_scrub(const gpu_ckpt_reader_t *r, unsigned nthreads, const bool *stop,
+                   gpu_ckpt_scrub_stats_t *stats);
+
+#endif // GPU_CKPT_H
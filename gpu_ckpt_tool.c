@@ -0,0 +1,252 @@
+// Offline inspection of checkpoint containers and export bundles written
+// by the daemon
+//
+//   gpu_ckpt_tool info CKPT          header summary
+//   gpu_ckpt_tool list CKPT          one line per record
+//   gpu_ckpt_tool cat CKPT PATH      payload of one allocation to stdout
+//   gpu_ckpt_tool verify CKPT [N]    check every payload with N threads
+//   gpu_ckpt_tool bench [MiB]        checksum throughput of this CPU
+
+#include "gpu_bundle.h"
+#include "gpu_ckpt.h"
+#include "gpu_crc32c.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s info CKPT\n"
+            "       %s list CKPT\n"
+            "       %s cat CKPT PATH\n"
+            "       %s verify CKPT [THREADS]\n"
+            "       %s bench [MiB]\n", prog, prog, prog, prog, prog);
+}
+
+static int cmd_info(const gpu_ckpt_reader_t *r)
+{
+    uint64_t files = 0, dirs = 0, bytes = 0, compressed = 0, raw = 0;
+    for (uint64_t i = 0; i < r->header.count; i++) {
+        const gpu_ckpt_record_t *rec = &r->records[i];
+        if (rec->flags & GPU_CKPT_DIR) {
+            dirs++;
+        } else {
+            files++;
+            bytes += rec->length;
+            if (rec->flags & GPU_CKPT_ZLIB) {
+                compressed++;
+                raw += rec->raw_length;
+            } else {
+                raw += rec->length;
+            }
+        }
+    }
+    printf("version %u, created %llu\n", r->header.version,
+           (unsigned long long)r->header.created);
+    printf("%llu files, %llu directories, %llu payload bytes\n", (unsigned long long)files,
+           (unsigned long long)dirs, (unsigned long long)bytes);
+    if (compressed) {
+        printf("%llu payloads compressed, %llu bytes of data (ratio %.2f)\n",
+               (unsigned long long)compressed, (unsigned long long)raw,
+               bytes ? (double)raw / bytes : 0.0);
+    }
+    printf("index at %llu, %llu records of %u bytes\n",
+           (unsigned long long)r->header.index_offset, (unsigned long long)r->header.count,
+           r->header.record_size);
+    if (r->header.crc_count) {
+        printf("crc table at %llu, %llu checksums\n", (unsigned long long)r->header.crc_offset,
+               (unsigned long long)r->header.crc_count);
+    } else {
+        printf("no checksums\n");
+    }
+    return 0;
+}
+
+// "type path seq length alloc_size offset flags priority dtype shape",
+// flags r(eady) d(urable) z(lib)
+static int cmd_list(const gpu_ckpt_reader_t *r)
+{
+    for (uint64_t i = 0; i < r->header.count; i++) {
+        const gpu_ckpt_record_t *rec = &r->records[i];
+        printf("%c %s %llu %llu %llu %llu %s%s%s %d %s %s\n",
+               rec->flags & GPU_CKPT_DIR ? 'd' : 'f', rec->path,
+               (unsigned long long)rec->seq, (unsigned long long)rec->length,
+               (unsigned long long)rec->alloc_size, (unsigned long long)rec->offset,
+               rec->flags & GPU_CKPT_READY ? "r" : "-", rec->flags & GPU_CKPT_DURABLE ? "d" : "-",
+               rec->flags & GPU_CKPT_ZLIB ? "z" : "-", rec->priority, rec->dtype[0] ? rec->dtype : "-",
+               rec->dtype[0] ? (rec->shape[0] ? rec->shape : "[]") : "-");
+    }
+    return 0;
+}
+
+static int write_stdout(const void *data, size_t len, void *arg)
+{
+    (void)arg;
+    return fwrite(data, 1, len, stdout) == len ? 0 : -EIO;
+}
+
+// Payloads are block aligned, so they can be mapped straight from the file,
+// starting at the page boundary below them.
+// Compressed ones are streamed through the decoder instead.
+static int cmd_cat(const gpu_ckpt_reader_t *r, const char *path)
+{
+    const gpu_ckpt_record_t *rec = gpu_ckpt_find(r, path);
+    if (!rec || (rec->flags & GPU_CKPT_DIR)) {
+        fprintf(stderr, "%s: no such file in checkpoint\n", path);
+        return 1;
+    }
+    if (rec->length == 0) {
+        return 0;
+    }
+    if (rec->flags & GPU_CKPT_ZLIB) {
+        int rc = gpu_bundle_read(r, rec, 4, write_stdout, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "%s: %s\n", path, rc == -EIO ? "corrupt payload" : strerror(-rc));
+        }
+        return rc != 0;
+    }
+
+    // Blocks are smaller than the page on 16K and 64K page kernels
+    uint64_t skew = rec->offset % (uint64_t)sysconf(_SC_PAGESIZE);
+    size_t map_len = rec->length + skew;
+    char *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, r->fd, (off_t)(rec->offset - skew));
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const char *data = map + skew;
+    int rc = 0;
+    if (gpu_ckpt_verify(r, rec, 0, data, rec->length) != 0) {
+        fprintf(stderr, "%s: checksum mismatch\n", path);
+        rc = 1;
+    } else if (fwrite(data, 1, rec->length, stdout) != rec->length) {
+        rc = 1;
+    }
+    munmap(map, map_len);
+    return rc;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmd_verify(const gpu_ckpt_reader_t *r, unsigned nthreads)
+{
+    bool stop = false;
+    gpu_ckpt_scrub_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    int rc = gpu_ckpt_scrub(r, nthreads, &stop, &stats);
+    double seconds = stats.elapsed_us / 1e6;
+    printf("%llu payloads, %llu bytes verified in %.3f s (%.2f GB/s, %u threads, crc32c %s)\n",
+           (unsigned long long)stats.records, (unsigned long long)stats.bytes, seconds,
+           seconds > 0 ? stats.bytes / seconds / 1e9 : 0.0, nthreads, gpu_crc32c_impl());
+    if (stats.unchecked) {
+        printf("%llu payloads without checksums\n", (unsigned long long)stats.unchecked);
+    }
+    if (rc != 0) {
+        printf("%llu corrupt payloads, first %s\n", (unsigned long long)stats.errors,
+               stats.first_error);
+        return 1;
+    }
+    return 0;
+}
+
+#define BENCH_BATCHES 10
+
+// Checksum one buffer repeatedly with the dispatched and the table
+// implementation; the buffer is sized like a restore chunk. Every batch of
+// 50 ms is a sample of the metric line read by bench_compare.py.
+static int cmd_bench(size_t mib)
+{
+    size_t len = mib << 20;
+    unsigned char *buf = malloc(len);
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+
+    struct {
+        const char *name;
+        uint32_t (*fn)(uint32_t, const void *, size_t);
+    } impls[] = { { gpu_crc32c_impl(), gpu_crc32c }, { "table", gpu_crc32c_sw } };
+    uint32_t results[2];
+    for (int k = 0; k < 2; k++) {
+        uint32_t crc = impls[k].fn(0, buf, len);  // Warm up
+        unsigned total_rounds = 0;
+        double total = 0, samples[BENCH_BATCHES];
+        for (int batch = 0; batch < BENCH_BATCHES; batch++) {
+            unsigned rounds = 0;
+            double start = now_seconds(), elapsed;
+            do {
+                crc = impls[k].fn(0, buf, len);
+                rounds++;
+                elapsed = now_seconds() - start;
+            } while (elapsed < 0.05);
+            samples[batch] = (double)len * rounds / elapsed / 1e9;
+            total_rounds += rounds;
+            total += elapsed;
+        }
+        results[k] = crc;
+        printf("%-8s %8.2f GB/s  crc %08x\n", impls[k].name,
+               (double)len * total_rounds / total / 1e9, crc);
+        // Named by role, the dispatched implementation differs between hosts
+        printf("metric crc32c.%s GB/s higher", k == 0 ? "dispatch" : "table");
+        for (int batch = 0; batch < BENCH_BATCHES; batch++) {
+            printf(" %.4f", samples[batch]);
+        }
+        printf("\n");
+    }
+    free(buf);
+    if (results[0] != results[1]) {
+        fprintf(stderr, "implementations disagree\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        long mib = argc >= 3 ? strtol(argv[2], NULL, 10) : 16;
+        return mib > 0 ? cmd_bench((size_t)mib) : 2;
+    }
+    if (argc < 3) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    gpu_ckpt_reader_t r;
+    int rc = gpu_ckpt_open(&r, argv[2]);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", argv[2],
+                rc == -EINVAL ? "not a valid checkpoint" : strerror(-rc));
+        return 1;
+    }
+
+    int ret;
+    if (strcmp(argv[1], "info") == 0) {
+        ret = cmd_info(&r);
+    } else if (strcmp(argv[1], "list") == 0) {
+        ret = cmd_list(&r);
+    } else if (strcmp(argv[1], "cat") == 0 && argc == 4) {
+        ret = cmd_cat(&r, argv[3]);
+    } else if (strcmp(argv[1], "verify") == 0 && argc <= 4) {
+        long nthreads = argc == 4 ? strtol(argv[3], NULL, 10) : 4;
+        ret = nthreads > 0 ? cmd_verify(&r, (unsigned)nthreads) : 2;
+    } else {
+        usage(argv[0]);
+        ret = 2;
+    }
+    gpu_ckpt_close(&r);
+    return ret;
+}
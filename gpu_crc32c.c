@@ -0,0 +1,251 @@
+#include "gpu_crc32c.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#define GPU_CRC32C_POLY 0x82f63b78u   // Castagnoli, reflected
+// The CRC instructions have a latency of several cycles but issue every
+// cycle, so the hardware paths run three independent streams over blocks
+// of these sizes and merge them with the zeros operators below
+#define GPU_CRC32C_LONG 8192
+#define GPU_CRC32C_SHORT 256
+
+static uint32_t gpu_crc32c_table[8][256];
+static uint32_t gpu_crc32c_long[4][256];    // Appends GPU_CRC32C_LONG zero bytes
+static uint32_t gpu_crc32c_short[4][256];   // Appends GPU_CRC32C_SHORT zero bytes
+static uint32_t (*gpu_crc32c_fn)(uint32_t, const void *, size_t);
+static const char *gpu_crc32c_name;
+static pthread_once_t gpu_crc32c_once = PTHREAD_ONCE_INIT;
+
+// Slicing by 8: eight bytes per step through eight derived tables
+static uint32_t gpu_crc32c_slice8(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t c = ~crc;
+
+    while (len && ((uintptr_t)p & 7)) {
+        c = gpu_crc32c_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        v ^= c;  // Little endian: the low word lines up with the running crc
+        c = gpu_crc32c_table[7][v & 0xff] ^ gpu_crc32c_table[6][(v >> 8) & 0xff] ^
+            gpu_crc32c_table[5][(v >> 16) & 0xff] ^ gpu_crc32c_table[4][(v >> 24) & 0xff] ^
+            gpu_crc32c_table[3][(v >> 32) & 0xff] ^ gpu_crc32c_table[2][(v >> 40) & 0xff] ^
+            gpu_crc32c_table[1][(v >> 48) & 0xff] ^ gpu_crc32c_table[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = gpu_crc32c_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+    }
+    return ~c;
+}
+
+// Multiply a 32x32 matrix over GF(2) by a vector
+static uint32_t gpu_crc32c_gf2_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gpu_crc32c_gf2_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; n++) {
+        square[n] = gpu_crc32c_gf2_times(mat, mat[n]);
+    }
+}
+
+// Tables applying the operator that feeds len zero bytes (a power of two)
+// through a raw crc, one table per byte of the crc
+static void gpu_crc32c_zeros(uint32_t zeros[4][256], size_t len)
+{
+    uint32_t op[32], tmp[32];
+    op[0] = GPU_CRC32C_POLY;  // One zero bit
+    for (int n = 1; n < 32; n++) {
+        op[n] = 1u << (n - 1);
+    }
+    for (size_t bits = 1; bits < len * 8; bits <<= 1) {
+        gpu_crc32c_gf2_square(tmp, op);
+        memcpy(op, tmp, sizeof(op));
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        zeros[0][n] = gpu_crc32c_gf2_times(op, n);
+        zeros[1][n] = gpu_crc32c_gf2_times(op, n << 8);
+        zeros[2][n] = gpu_crc32c_gf2_times(op, n << 16);
+        zeros[3][n] = gpu_crc32c_gf2_times(op, n << 24);
+    }
+}
+
+static inline uint32_t gpu_crc32c_shift(uint32_t zeros[4][256], uint32_t crc)
+{
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+           zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t gpu_crc32c_sse42(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint64_t c = ~crc;
+
+    while (len && ((uintptr_t)p & 7)) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        len--;
+    }
+    for (size_t block = GPU_CRC32C_LONG; block >= GPU_CRC32C_SHORT; block = GPU_CRC32C_SHORT) {
+        uint32_t (*zeros)[256] = block == GPU_CRC32C_LONG ? gpu_crc32c_long : gpu_crc32c_short;
+        while (len >= 3 * block) {
+            uint64_t c1 = 0, c2 = 0;
+            const uint8_t *end = p + block;
+            do {
+                uint64_t v0, v1, v2;
+                memcpy(&v0, p, 8);
+                memcpy(&v1, p + block, 8);
+                memcpy(&v2, p + 2 * block, 8);
+                c = _mm_crc32_u64(c, v0);
+                c1 = _mm_crc32_u64(c1, v1);
+                c2 = _mm_crc32_u64(c2, v2);
+                p += 8;
+            } while (p < end);
+            c = gpu_crc32c_shift(zeros, (uint32_t)c) ^ (uint32_t)c1;
+            c = gpu_crc32c_shift(zeros, (uint32_t)c) ^ (uint32_t)c2;
+            p += 2 * block;
+            len -= 3 * block;
+        }
+        if (block == GPU_CRC32C_SHORT) {
+            break;
+        }
+    }
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+    return ~(uint32_t)c;
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+static uint32_t gpu_crc32c_armv8(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t c = ~crc;
+
+    while (len && ((uintptr_t)p & 7)) {
+        c = __crc32cb(c, *p++);
+        len--;
+    }
+    for (size_t block = GPU_CRC32C_LONG; block >= GPU_CRC32C_SHORT; block = GPU_CRC32C_SHORT) {
+        uint32_t (*zeros)[256] = block == GPU_CRC32C_LONG ? gpu_crc32c_long : gpu_crc32c_short;
+        while (len >= 3 * block) {
+            uint32_t c1 = 0, c2 = 0;
+            const uint8_t *end = p + block;
+            do {
+                uint64_t v0, v1, v2;
+                memcpy(&v0, p, 8);
+                memcpy(&v1, p + block, 8);
+                memcpy(&v2, p + 2 * block, 8);
+                c = __crc32cd(c, v0);
+                c1 = __crc32cd(c1, v1);
+                c2 = __crc32cd(c2, v2);
+                p += 8;
+            } while (p < end);
+            c = gpu_crc32c_shift(zeros, c) ^ c1;
+            c = gpu_crc32c_shift(zeros, c) ^ c2;
+            p += 2 * block;
+            len -= 3 * block;
+        }
+        if (block == GPU_CRC32C_SHORT) {
+            break;
+        }
+    }
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = __crc32cd(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = __crc32cb(c, *p++);
+    }
+    return ~c;
+}
+#endif
+
+static void gpu_crc32c_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? (c >> 1) ^ GPU_CRC32C_POLY : c >> 1;
+        }
+        gpu_crc32c_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = gpu_crc32c_table[t - 1][i];
+            gpu_crc32c_table[t][i] = gpu_crc32c_table[0][prev & 0xff] ^ (prev >> 8);
+        }
+    }
+
+    gpu_crc32c_zeros(gpu_crc32c_long, GPU_CRC32C_LONG);
+    gpu_crc32c_zeros(gpu_crc32c_short, GPU_CRC32C_SHORT);
+
+    gpu_crc32c_fn = gpu_crc32c_slice8;
+    gpu_crc32c_name = "table";
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        gpu_crc32c_fn = gpu_crc32c_sse42;
+        gpu_crc32c_name = "sse4.2";
+    }
+#elif defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        gpu_crc32c_fn = gpu_crc32c_armv8;
+        gpu_crc32c_name = "armv8";
+    }
+#endif
+}
+
+uint32_t gpu_crc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&gpu_crc32c_once, gpu_crc32c_init);
+    return gpu_crc32c_fn(crc, data, len);
+}
+
+uint32_t gpu_crc32c_sw(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&gpu_crc32c_once, gpu_crc32c_init);
+    return gpu_crc32c_slice8(crc, data, len);
+}
+
+const char *gpu_crc32c_impl(void)
+{
+    pthread_once(&gpu_crc32c_once, gpu_crc32c_init);
+    return gpu_crc32c_name;
+}
@@ -0,0 +1,20 @@
+#ifndef GPU_CRC32C_H
+#define GPU_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli), the checksum of checkpoint payloads. Uses the CRC32
+// instructions of SSE4.2 or ARMv8 when the CPU has them, picked once at
+// first use, and a slicing-by-8 table otherwise. Calls chain like zlib's
+// crc32: start with 0 and pass the previous result to continue a buffer.
+
+uint32_t gpu_crc32c(uint32_t crc, const void *data, size_t len);
+
+// Portable table implementation, for benchmarks and as the fallback
+uint32_t gpu_crc32c_sw(uint32_t crc, const void *data, size_t len);
+
+// "sse4.2", "armv8" or "table"
+const char *gpu_crc32c_impl(void);
+
+#endif // GPU_CRC32C_H
@@ -0,0 +1,277 @@
+#include "gpu_device.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Context last made current on this thread by gpu_device_make_current
+static __thread CUcontext gpu_device_current_ctx = NULL;
+
+void gpu_device_alloc_props(CUdevice device, CUmemAllocationProp *props)
+{
+    memset(props, 0, sizeof(*props));
+    props->type = CU_MEM_ALLOCATION_TYPE_PINNED;
+    props->location.type = CU_MEM_LOCATION_TYPE_DEVICE;
+    props->location.id = device;
+    props->requestedHandleTypes = CU_MEM_HANDLE_TYPE_FABRIC;
+}
+
+// Create, export and release one granule so the allocation and fabric
+// export paths are set up before a client waits on them
+static CUresult gpu_device_warmup(gpu_device_t *dev)
+{
+    CUmemAllocationProp props;
+    gpu_device_alloc_props(dev->device, &props);
+
+    CUmemGenericAllocationHandle handle;
+    CUresult result = cuMemCreate(&handle, dev->granularity, &props, 0);
+    if (result != CUDA_SUCCESS) {
+        return result;
+    }
+
+    CUmemFabricHandle fabric;
+    result = cuMemExportToShareableHandle((void *)&fabric, handle, CU_MEM_HANDLE_TYPE_FABRIC, 0);
+    cuMemRelease(handle);
+    return result;
+}
+
+static void *gpu_device_init_thread(void *arg)
+{
+    gpu_device_t *dev = arg;
+    int64_t start = g_get_monotonic_time();
+
+    dev->result = cuDeviceGet(&dev->device, dev->ordinal);
+    if (dev->result == CUDA_SUCCESS) {
+        dev->result = cuDeviceGetName(dev->name, sizeof(dev->name), dev->device);
+    }
+    if (dev->result == CUDA_SUCCESS) {
+        dev->result = cuDeviceTotalMem(&dev->memory, dev->device);
+    }
+    if (dev->result == CUDA_SUCCESS) {
+        CUmemAllocationProp props;
+        gpu_device_alloc_props(dev->device, &props);
+        dev->result = cuMemGetAllocationGranularity(&dev->granularity, &props,
+                                                    CU_MEM_ALLOC_GRANULARITY_MINIMUM);
+    }
+    if (dev->result == CUDA_SUCCESS) {
+        // Events are context objects, so keep the primary context alive
+        dev->result = cuDevicePrimaryCtxRetain(&dev->context, dev->device);
+        if (dev->result != CUDA_SUCCESS) {
+            dev->context = NULL;
+        }
+    }
+    if (dev->result == CUDA_SUCCESS) {
+        dev->result = gpu_device_make_current(dev);
+    }
+    if (dev->result == CUDA_SUCCESS) {
+        int64_t warmup_start = g_get_monotonic_time();
+        dev->result = gpu_device_warmup(dev);
+        dev->warmup_us = g_get_monotonic_time() - warmup_start;
+    }
+
+    dev->init_us = g_get_monotonic_time() - start;
+    return NULL;
+}
+
+int gpu_device_discover(gpu_device_t **devices, int *count)
+{
+    CUresult result = cuInit(0);
+    if (result != CUDA_SUCCESS) {
+        printf("Failed to initialize CUDA: %d\n", result);
+        return -1;
+    }
+
+    int ndevices = 0;
+    result = cuDeviceGetCount(&ndevices);
+    if (result != CUDA_SUCCESS || ndevices == 0) {
+        printf("No CUDA devices found: %d\n", result);
+        return -1;
+    }
+
+    gpu_device_t *devs = calloc(ndevices, sizeof(gpu_device_t));
+    pthread_t *threads = calloc(ndevices, sizeof(pthread_t));
+    bool *started = calloc(ndevices, sizeof(bool));
+    if (!devs || !threads || !started) {
+        free(devs);
+        free(threads);
+        free(started);
+        return -1;
+    }
+
+    int64_t start = g_get_monotonic_time();
+    for (int i = 0; i < ndevices; i++) {
+        devs[i].ordinal = i;
+        started[i] = pthread_create(&threads[i], NULL, gpu_device_init_thread, &devs[i]) == 0;
+        if (!started[i]) {
+            // Fall back to initialising this one on the calling thread
+            gpu_device_init_thread(&devs[i]);
+        }
+    }
+    for (int i = 0; i < ndevices; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+
+    for (int i = 0; i < ndevices; i++) {
+        printf("Device %d (%s): %s in %lld us (warm-up %lld us)\n", i, devs[i].name,
+               devs[i].result == CUDA_SUCCESS ? "ready" : "failed",
+               (long long)devs[i].init_us, (long long)devs[i].warmup_us);
+    }
+    printf("Initialized %d CUDA devices in %lld us\n", ndevices,
+           (long long)(g_get_monotonic_time() - start));
+
+    *devices = devs;
+    *count = ndevices;
+    return 0;
+}
+
+void gpu_device_release_all(gpu_device_t *devices, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (devices[i].context) {
+            cuDevicePrimaryCtxRelease(devices[i].device);
+        }
+    }
+    free(devices);
+}
+
+CUresult gpu_device_make_current(gpu_device_t *dev)
+{
+    if (gpu_device_current_ctx == dev->context) {
+        __atomic_add_fetch(&dev->ctx_skips, 1, __ATOMIC_RELAXED);
+        return CUDA_SUCCESS;
+    }
+
+    CUresult result = cuCtxSetCurrent(dev->context);
+    if (result == CUDA_SUCCESS) {
+        gpu_device_current_ctx = dev->context;
+        __atomic_add_fetch(&dev->ctx_switches, 1, __ATOMIC_RELAXED);
+    }
+    return result;
+}
+
+CUresult gpu_device_map(gpu_device_t *dev, CUmemGenericAllocationHandle handle, size_t size,
+                        CUdeviceptr *ptr)
+{
+    CUresult result = cuMemAddressReserve(ptr, size, 0, 0, 0);
+    if (result != CUDA_SUCCESS) {
+        return result;
+    }
+    result = cuMemMap(*ptr, size, 0, handle, 0);
+    if (result != CUDA_SUCCESS) {
+        cuMemAddressFree(*ptr, size);
+        return result;
+    }
+
+    CUmemAccessDesc access;
+    memset(&access, 0, sizeof(access));
+    access.location.type = CU_MEM_LOCATION_TYPE_DEVICE;
+    access.location.id = dev->device;
+    access.flags = CU_MEM_ACCESS_FLAGS_PROT_READWRITE;
+    result = cuMemSetAccess(*ptr, size, &access, 1);
+    if (result != CUDA_SUCCESS) {
+        gpu_device_unmap(*ptr, size);
+    }
+    return result;
+}
+
+void gpu_device_unmap(CUdeviceptr ptr, size_t size)
+{
+    cuMemUnmap(ptr, size);
+    cuMemAddressFree(ptr, size);
+}
+
+int gpu_device_copy_out(gpu_device_t *dev, CUmemGenericAllocationHandle handle,
+                        size_t alloc_size, size_t length, gpu_device_sink_fn sink, void *arg)
+{
+    CUdeviceptr ptr;
+    CUstream stream = NULL;
+    void *staging[2] = { NULL, NULL };
+    CUevent copied[2] = { NULL, NULL };
+    size_t pending[2] = { 0, 0 };    // Bytes in flight into each buffer
+    int rc = 0;
+
+    if (gpu_device_make_current(dev) != CUDA_SUCCESS ||
+        gpu_device_map(dev, handle, alloc_size, &ptr) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+    CUresult result = cuStreamCreate(&stream, CU_STREAM_NON_BLOCKING);
+    for (int i = 0; i < 2 && result == CUDA_SUCCESS; i++) {
+        result = cuMemHostAlloc(&staging[i], GPU_DEVICE_COPY_CHUNK, 0);
+        if (result == CUDA_SUCCESS) {
+            result = cuEventCreate(&copied[i], CU_EVENT_DISABLE_TIMING);
+        }
+    }
+    if (result != CUDA_SUCCESS) {
+        rc = -ENOMEM;
+    }
+
+    // Chunk n goes into buffer n % 2; while it copies, chunk n - 1 is sunk
+    size_t pos = 0;
+    for (unsigned n = 0; rc == 0; n++) {
+        int slot = n & 1;
+        if (pos < length) {
+            pending[slot] = MIN(GPU_DEVICE_COPY_CHUNK, length - pos);
+            result = cuMemcpyDtoHAsync(staging[slot], ptr + pos, pending[slot], stream);
+            if (result == CUDA_SUCCESS) {
+                result = cuEventRecord(copied[slot], stream);
+            }
+            if (result != CUDA_SUCCESS) {
+                rc = -EIO;
+                break;
+            }
+            pos += pending[slot];
+        }
+
+        int prev = slot ^ 1;
+        if (pending[prev] == 0) {
+            if (pos >= length && pending[slot] == 0) {
+                break;  // Everything sunk
+            }
+            continue;
+        }
+        if (cuEventSynchronize(copied[prev]) != CUDA_SUCCESS) {
+            rc = -EIO;
+            break;
+        }
+        rc = sink(staging[prev], pending[prev], arg);
+        pending[prev] = 0;
+    }
+
+    if (stream) {
+        cuStreamSynchronize(stream);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (copied[i]) {
+            cuEventDestroy(copied[i]);
+        }
+        if (staging[i]) {
+            cuMemFreeHost(staging[i]);
+        }
+    }
+    if (stream) {
+        cuStreamDestroy(stream);
+    }
+    gpu_device_unmap(ptr, alloc_size);
+    return rc;
+}
+
+GString *gpu_device_format(const gpu_device_t *devices, int count)
+{
+    GString *out = g_string_new(NULL);
+    for (int i = 0; i < count; i++) {
+        const gpu_device_t *dev = &devices[i];
+        g_string_append_printf(out, "%d %zu %zu %lld %lld %d %llu %llu %s\n", dev->ordinal,
+                               dev->memory, dev->granularity, (long long)dev->init_us,
+                               (long long)dev->warmup_us, (int)dev->result,
+                               (unsigned long long)__atomic_load_n(&dev->ctx_switches, __ATOMIC_RELAXED),
+                               (unsigned long long)__atomic_load_n(&dev->ctx_skips, __ATOMIC_RELAXED),
+                               dev->name[0] ? dev->name : "-");
+    }
+    return out;
+}
@@ -0,0 +1,64 @@
+#ifndef GPU_DEVICE_H
+#define GPU_DEVICE_H
+
+#include <cuda.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Device discovery. Every visible device is initialised on its own thread:
+// its primary context is retained and a small allocation is created,
+// exported and released so the driver's first-use costs are paid at mount
+// time rather than by the first client. Must run after the daemon forks,
+// since CUDA state does not survive fork().
+
+typedef struct {
+    int ordinal;
+    CUdevice device;
+    CUcontext context;            // Retained primary context, NULL if retain failed
+    char name[128];
+    size_t memory;                // Total device memory
+    size_t granularity;           // Minimum allocation granularity
+    int64_t init_us;              // Time to initialise, including warm-up
+    int64_t warmup_us;            // Time of the create/export/release cycle
+    CUresult result;              // First failure, CUDA_SUCCESS if usable
+    uint64_t ctx_switches;        // cuCtxSetCurrent calls made for this device
+    uint64_t ctx_skips;           // Calls avoided because it was already current
+} gpu_device_t;
+
+void gpu_device_alloc_props(CUdevice device, CUmemAllocationProp *props);
+
+// Initialise all devices in parallel. Returns 0 if at least one device was
+// found (individual devices may still have failed, see result).
+int gpu_device_discover(gpu_device_t **devices, int *count);
+void gpu_device_release_all(gpu_device_t *devices, int count);
+
+// Make the device's primary context current on the calling thread. Each
+// thread remembers its current context, so only the first call on a thread
+// (or a change of device) reaches the driver. Only calls that need a context
+// (events, streams) should use this; the VMM calls (cuMemCreate, export,
+// cuMemRelease) do not depend on one.
+CUresult gpu_device_make_current(gpu_device_t *dev);
+
+// Map an allocation into the daemon's address space, readable and writable
+// from the device, so the daemon can copy to and from it
+CUresult gpu_device_map(gpu_device_t *dev, CUmemGenericAllocationHandle handle, size_t size,
+                        CUdeviceptr *ptr);
+void gpu_device_unmap(CUdeviceptr ptr, size_t size);
+
+#define GPU_DEVICE_COPY_CHUNK (16ULL << 20)   // Staging buffer size of copy_out
+
+// Receives the contents of an allocation in order, 0 or -errno to stop
+typedef int (*gpu_device_sink_fn)(const void *data, size_t len, void *arg);
+
+// Stream the first length bytes of an allocation to sink through two pinned
+// staging buffers, so the copy of one chunk overlaps sink consuming the
+// previous one. Returns 0, the sink's error, or -EIO.
+int gpu_device_copy_out(gpu_device_t *dev, CUmemGenericAllocationHandle handle,
+                        size_t alloc_size, size_t length, gpu_device_sink_fn sink, void *arg);
+
+// One line per device:
+// "ordinal memory granularity init_us warmup_us result ctx_switches ctx_skips name"
+GString *gpu_device_format(const gpu_device_t *devices, int count);
+
+#endif // GPU_DEVICE_H
@@ -0,0 +1,696 @@
+#include "gpu_ingest.h"
+#include "gpu_crc32c.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GPU_INGEST_JSON_DEPTH 64
+
+// Cursor over the JSON header
+typedef struct {
+    const char *p;
+    const char *end;
+} gpu_ingest_json_t;
+
+static void gpu_ingest_json_ws(gpu_ingest_json_t *j)
+{
+    while (j->p < j->end && (*j->p == ' ' || *j->p == '\t' || *j->p == '\n' || *j->p == '\r')) {
+        j->p++;
+    }
+}
+
+// Consume c after optional whitespace
+static bool gpu_ingest_json_eat(gpu_ingest_json_t *j, char c)
+{
+    gpu_ingest_json_ws(j);
+    if (j->p < j->end && *j->p == c) {
+        j->p++;
+        return true;
+    }
+    return false;
+}
+
+static int gpu_ingest_json_hex4(gpu_ingest_json_t *j, unsigned *out)
+{
+    if (j->end - j->p < 4) {
+        return -EINVAL;
+    }
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = *j->p++;
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return -EINVAL;
+        }
+    }
+    *out = value;
+    return 0;
+}
+
+// Append one byte, failing when the string does not fit
+static int gpu_ingest_json_put(char *out, size_t len, size_t *n, char c)
+{
+    if (out) {
+        if (*n + 1 >= len) {
+            return -EINVAL;
+        }
+        out[*n] = c;
+    }
+    (*n)++;
+    return 0;
+}
+
+// Parse a string into out (NUL terminated), or skip it if out is NULL
+static int gpu_ingest_json_string(gpu_ingest_json_t *j, char *out, size_t len)
+{
+    if (!gpu_ingest_json_eat(j, '"')) {
+        return -EINVAL;
+    }
+
+    size_t n = 0;
+    while (j->p < j->end && *j->p != '"') {
+        char c = *j->p++;
+        if ((unsigned char)c < 0x20) {
+            return -EINVAL;
+        }
+        if (c != '\\') {
+            if (gpu_ingest_json_put(out, len, &n, c) != 0) {
+                return -EINVAL;
+            }
+            continue;
+        }
+        if (j->p >= j->end) {
+            return -EINVAL;
+        }
+
+        unsigned cp;
+        switch (*j->p++) {
+        case '"': cp = '"'; break;
+        case '\\': cp = '\\'; break;
+        case '/': cp = '/'; break;
+        case 'b': cp = '\b'; break;
+        case 'f': cp = '\f'; break;
+        case 'n': cp = '\n'; break;
+        case 'r': cp = '\r'; break;
+        case 't': cp = '\t'; break;
+        case 'u':
+            if (gpu_ingest_json_hex4(j, &cp) != 0) {
+                return -EINVAL;
+            }
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                // High surrogate, the low half must follow
+                unsigned low;
+                if (j->end - j->p < 2 || j->p[0] != '\\' || j->p[1] != 'u') {
+                    return -EINVAL;
+                }
+                j->p += 2;
+                if (gpu_ingest_json_hex4(j, &low) != 0 || low < 0xDC00 || low > 0xDFFF) {
+                    return -EINVAL;
+                }
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+            break;
+        default:
+            return -EINVAL;
+        }
+        if (cp == 0) {
+            return -EINVAL;  // Would truncate the string
+        }
+
+        // Encode as UTF-8
+        char utf8[4];
+        int bytes;
+        if (cp < 0x80) {
+            utf8[0] = cp;
+            bytes = 1;
+        } else if (cp < 0x800) {
+            utf8[0] = 0xC0 | (cp >> 6);
+            utf8[1] = 0x80 | (cp & 0x3F);
+            bytes = 2;
+        } else if (cp < 0x10000) {
+            utf8[0] = 0xE0 | (cp >> 12);
+            utf8[1] = 0x80 | ((cp >> 6) & 0x3F);
+            utf8[2] = 0x80 | (cp & 0x3F);
+            bytes = 3;
+        } else {
+            utf8[0] = 0xF0 | (cp >> 18);
+            utf8[1] = 0x80 | ((cp >> 12) & 0x3F);
+            utf8[2] = 0x80 | ((cp >> 6) & 0x3F);
+            utf8[3] = 0x80 | (cp & 0x3F);
+            bytes = 4;
+        }
+        for (int i = 0; i < bytes; i++) {
+            if (gpu_ingest_json_put(out, len, &n, utf8[i]) != 0) {
+                return -EINVAL;
+            }
+        }
+    }
+    if (j->p >= j->end) {
+        return -EINVAL;  // Unterminated
+    }
+    j->p++;
+
+    if (out) {
+        out[n] = '\0';
+    }
+    return 0;
+}
+
+static int gpu_ingest_json_uint(gpu_ingest_json_t *j, uint64_t *out)
+{
+    gpu_ingest_json_ws(j);
+    if (j->p >= j->end || *j->p < '0' || *j->p > '9') {
+        return -EINVAL;
+    }
+
+    uint64_t value = 0;
+    while (j->p < j->end && *j->p >= '0' && *j->p <= '9') {
+        unsigned digit = *j->p++ - '0';
+        if (value > (UINT64_MAX - digit) / 10) {
+            return -EINVAL;  // Overflow
+        }
+        value = value * 10 + digit;
+    }
+    *out = value;
+    return 0;
+}
+
+static int gpu_ingest_json_skip(gpu_ingest_json_t *j, int depth)
+{
+    if (depth > GPU_INGEST_JSON_DEPTH) {
+        return -EINVAL;
+    }
+
+    gpu_ingest_json_ws(j);
+    if (j->p >= j->end) {
+        return -EINVAL;
+    }
+
+    if (*j->p == '"') {
+        return gpu_ingest_json_string(j, NULL, 0);
+    }
+    if (*j->p == '{' || *j->p == '[') {
+        bool object = *j->p == '{';
+        char close = object ? '}' : ']';
+        j->p++;
+        if (gpu_ingest_json_eat(j, close)) {
+            return 0;
+        }
+        do {
+            if (object && (gpu_ingest_json_string(j, NULL, 0) != 0 ||
+                           !gpu_ingest_json_eat(j, ':'))) {
+                return -EINVAL;
+            }
+            if (gpu_ingest_json_skip(j, depth + 1) != 0) {
+                return -EINVAL;
+            }
+        } while (gpu_ingest_json_eat(j, ','));
+        return gpu_ingest_json_eat(j, close) ? 0 : -EINVAL;
+    }
+
+    // Number, true, false or null
+    const char *start = j->p;
+    while (j->p < j->end && strchr(",}] \t\r\n", *j->p) == NULL) {
+        j->p++;
+    }
+    return j->p > start ? 0 : -EINVAL;
+}
+
+// Parse "[n, n, ...]" into at most max values
+static int gpu_ingest_json_uints(gpu_ingest_json_t *j, uint64_t *values, int max, int *count)
+{
+    if (!gpu_ingest_json_eat(j, '[')) {
+        return -EINVAL;
+    }
+    *count = 0;
+    if (gpu_ingest_json_eat(j, ']')) {
+        return 0;
+    }
+    do {
+        if (*count == max || gpu_ingest_json_uint(j, &values[*count]) != 0) {
+            return -EINVAL;
+        }
+        (*count)++;
+    } while (gpu_ingest_json_eat(j, ','));
+    return gpu_ingest_json_eat(j, ']') ? 0 : -EINVAL;
+}
+
+// {"dtype": "F32", "shape": [2, 3], "data_offsets": [begin, end]}
+static int gpu_ingest_json_tensor(gpu_ingest_json_t *j, gpu_ingest_tensor_t *tensor)
+{
+    bool have_dtype = false, have_shape = false, have_offsets = false;
+    uint64_t offsets[2];
+
+    if (!gpu_ingest_json_eat(j, '{')) {
+        return -EINVAL;
+    }
+    if (gpu_ingest_json_eat(j, '}')) {
+        return -EINVAL;
+    }
+    do {
+        char key[32];
+        if (gpu_ingest_json_string(j, key, sizeof(key)) != 0 || !gpu_ingest_json_eat(j, ':')) {
+            return -EINVAL;
+        }
+
+        int rc;
+        if (strcmp(key, "dtype") == 0) {
+            rc = gpu_ingest_json_string(j, tensor->dtype, sizeof(tensor->dtype));
+            have_dtype = true;
+        } else if (strcmp(key, "shape") == 0) {
+            uint64_t dims[GPU_INGEST_MAX_DIMS];
+            rc = gpu_ingest_json_uints(j, dims, GPU_INGEST_MAX_DIMS, &tensor->ndim);
+            for (int i = 0; rc == 0 && i < tensor->ndim; i++) {
+                if (dims[i] > INT64_MAX) {
+                    rc = -EINVAL;
+                }
+                tensor->shape[i] = (int64_t)dims[i];
+            }
+            have_shape = true;
+        } else if (strcmp(key, "data_offsets") == 0) {
+            int count;
+            rc = gpu_ingest_json_uints(j, offsets, 2, &count);
+            if (rc == 0 && (count != 2 || offsets[1] < offsets[0])) {
+                rc = -EINVAL;
+            }
+            have_offsets = true;
+        } else {
+            rc = gpu_ingest_json_skip(j, 1);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    } while (gpu_ingest_json_eat(j, ','));
+
+    if (!gpu_ingest_json_eat(j, '}') || !have_dtype || !have_shape || !have_offsets) {
+        return -EINVAL;
+    }
+    tensor->offset = offsets[0];  // Relative to the data section until rebased
+    tensor->length = offsets[1] - offsets[0];
+    return 0;
+}
+
+// Element size of the dtypes defined by the format, 0 if unknown
+static size_t gpu_ingest_dtype_size(const char *dtype)
+{
+    static const struct {
+        const char *name;
+        size_t size;
+    } dtypes[] = {
+        { "F64", 8 }, { "I64", 8 }, { "U64", 8 },
+        { "F32", 4 }, { "I32", 4 }, { "U32", 4 },
+        { "F16", 2 }, { "BF16", 2 }, { "I16", 2 }, { "U16", 2 },
+        { "F8_E4M3", 1 }, { "F8_E5M2", 1 }, { "I8", 1 }, { "U8", 1 }, { "BOOL", 1 },
+    };
+    for (size_t i = 0; i < G_N_ELEMENTS(dtypes); i++) {
+        if (strcmp(dtype, dtypes[i].name) == 0) {
+            return dtypes[i].size;
+        }
+    }
+    return 0;
+}
+
+// The byte range must match the shape for every dtype we know the size of
+static bool gpu_ingest_check_length(const gpu_ingest_tensor_t *tensor)
+{
+    uint64_t bytes = gpu_ingest_dtype_size(tensor->dtype);
+    if (bytes == 0) {
+        return true;
+    }
+    for (int i = 0; i < tensor->ndim; i++) {
+        uint64_t dim = (uint64_t)tensor->shape[i];
+        if (dim != 0 && bytes > UINT64_MAX / dim) {
+            return false;
+        }
+        bytes *= dim;
+    }
+    return bytes == tensor->length;
+}
+
+static gint gpu_ingest_compare_offset(gconstpointer a, gconstpointer b)
+{
+    const gpu_ingest_tensor_t *ta = a, *tb = b;
+    return ta->offset < tb->offset ? -1 : ta->offset > tb->offset;
+}
+
+// pread until len bytes or end of file. Returns the bytes read or -errno.
+static ssize_t gpu_ingest_read(int fd, void *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, (off_t)(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+int gpu_ingest_parse(int fd, GArray **tensors)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -errno;
+    }
+
+    uint8_t prefix[8];
+    if (gpu_ingest_read(fd, prefix, sizeof(prefix), 0) != (ssize_t)sizeof(prefix)) {
+        return -EINVAL;
+    }
+    uint64_t header_len = 0;
+    for (int i = 7; i >= 0; i--) {
+        header_len = (header_len << 8) | prefix[i];  // Little endian
+    }
+    if (header_len < 2 || header_len > GPU_INGEST_MAX_HEADER ||
+        sizeof(prefix) + header_len > (uint64_t)st.st_size) {
+        return -EINVAL;
+    }
+    uint64_t data_start = sizeof(prefix) + header_len;
+    uint64_t data_len = (uint64_t)st.st_size - data_start;
+
+    char *header = malloc(header_len);
+    if (!header) {
+        return -ENOMEM;
+    }
+    if (gpu_ingest_read(fd, header, header_len, sizeof(prefix)) != (ssize_t)header_len) {
+        free(header);
+        return -EIO;
+    }
+
+    GArray *out = g_array_new(FALSE, TRUE, sizeof(gpu_ingest_tensor_t));
+    gpu_ingest_json_t j = { .p = header, .end = header + header_len };
+    int rc = gpu_ingest_json_eat(&j, '{') ? 0 : -EINVAL;
+    if (rc == 0 && !gpu_ingest_json_eat(&j, '}')) {
+        do {
+            gpu_ingest_tensor_t tensor;
+            memset(&tensor, 0, sizeof(tensor));
+            if (gpu_ingest_json_string(&j, tensor.name, sizeof(tensor.name)) != 0 ||
+                !gpu_ingest_json_eat(&j, ':')) {
+                rc = -EINVAL;
+                break;
+            }
+            if (strcmp(tensor.name, "__metadata__") == 0) {
+                rc = gpu_ingest_json_skip(&j, 1);
+            } else {
+                rc = gpu_ingest_json_tensor(&j, &tensor);
+                if (rc == 0 && (tensor.offset + tensor.length > data_len ||
+                                !gpu_ingest_check_length(&tensor))) {
+                    rc = -EINVAL;
+                }
+                if (rc == 0) {
+                    tensor.offset += data_start;
+                    g_array_append_val(out, tensor);
+                }
+            }
+        } while (rc == 0 && gpu_ingest_json_eat(&j, ','));
+        if (rc == 0 && !gpu_ingest_json_eat(&j, '}')) {
+            rc = -EINVAL;
+        }
+    }
+    // Only padding may follow the header object
+    gpu_ingest_json_ws(&j);
+    if (rc == 0 && j.p != j.end) {
+        rc = -EINVAL;
+    }
+    free(header);
+
+    if (rc != 0) {
+        g_array_free(out, TRUE);
+        return rc;
+    }
+    g_array_sort(out, gpu_ingest_compare_offset);  // Read the file front to back
+    *tensors = out;
+    return 0;
+}
+
+void gpu_ingest_format_shape(const gpu_ingest_tensor_t *tensor, char *buf, size_t len)
+{
+    size_t n = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < tensor->ndim && n < len; i++) {
+        n += snprintf(buf + n, len - n, i ? ",%lld" : "%lld", (long long)tensor->shape[i]);
+    }
+}
+
+// One read and copy; chunks are handed out in file order
+typedef struct {
+    size_t copy;                  // Index into copies
+    uint64_t pos;                 // Offset within the range
+    uint64_t len;
+} gpu_ingest_chunk_t;
+
+typedef struct {
+    gpu_device_t *dev;
+    int fd;
+    const gpu_ingest_copy_t *copies;
+    CUdeviceptr *ptrs;            // Mapping of each allocation
+    const gpu_ingest_chunk_t *chunks;
+    size_t nchunks;
+    size_t next;                  // Next chunk to take (atomic)
+    int rc;                       // First failure (atomic)
+    uint64_t verified;            // (atomic)
+} gpu_ingest_job_t;
+
+static void gpu_ingest_fail(gpu_ingest_job_t *job, int rc)
+{
+    int expected = 0;
+    __atomic_compare_exchange_n(&job->rc, &expected, rc, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Check a chunk against the checksums of its range; chunks start on
+// multiples of GPU_INGEST_CHUNK, so on checksum boundaries too
+static int gpu_ingest_verify(gpu_ingest_job_t *job, const gpu_ingest_chunk_t *chunk,
+                             const char *data)
+{
+    const gpu_ingest_copy_t *copy = &job->copies[chunk->copy];
+    if (!copy->crcs) {
+        return 0;
+    }
+    for (uint64_t done = 0; done < chunk->len; done += copy->crc_chunk) {
+        size_t n = MIN(copy->crc_chunk, chunk->len - done);
+        size_t index = (chunk->pos + done) / copy->crc_chunk;
+        if (gpu_crc32c(0, data + done, n) != copy->crcs[index]) {
+            printf("Checksum mismatch at offset %llu of a %llu byte range\n",
+                   (unsigned long long)(chunk->pos + done), (unsigned long long)copy->length);
+            return -EIO;
+        }
+    }
+    __atomic_add_fetch(&job->verified, chunk->len, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Host memory stand-in for the worker's device resources
+static CUresult gpu_ingest_host_alloc(void **buf, size_t size)
+{
+    return posix_memalign(buf, GPU_INGEST_ALIGN, size) == 0 ? CUDA_SUCCESS
+                                                            : CUDA_ERROR_OUT_OF_MEMORY;
+}
+
+// Each worker owns a stream and two staging buffers: the read into one
+// buffer overlaps the checksum and device copy of the other. Without a
+// device the copy is a memcpy and nothing overlaps.
+static void *gpu_ingest_worker(void *arg)
+{
+    gpu_ingest_job_t *job = arg;
+    CUstream stream = NULL;
+    void *staging[2] = { NULL, NULL };
+    CUevent copied[2] = { NULL, NULL };
+    bool pending[2] = { false, false };
+    const size_t staging_size = GPU_INGEST_CHUNK + GPU_INGEST_ALIGN;
+
+    CUresult result = CUDA_SUCCESS;
+    if (job->dev) {
+        result = gpu_device_make_current(job->dev);
+        if (result == CUDA_SUCCESS) {
+            result = cuStreamCreate(&stream, CU_STREAM_NON_BLOCKING);
+        }
+    }
+    for (int i = 0; i < 2 && result == CUDA_SUCCESS; i++) {
+        // Page aligned, as O_DIRECT requires
+        if (!job->dev) {
+            result = gpu_ingest_host_alloc(&staging[i], staging_size);
+            continue;
+        }
+        result = cuMemHostAlloc(&staging[i], staging_size, 0);
+        if (result == CUDA_SUCCESS) {
+            result = cuEventCreate(&copied[i], CU_EVENT_DISABLE_TIMING);
+        }
+    }
+    if (result != CUDA_SUCCESS) {
+        printf("Ingest worker setup failed: %d\n", result);
+        gpu_ingest_fail(job, -ENOMEM);
+    }
+
+    for (unsigned n = 0; result == CUDA_SUCCESS; n++) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->nchunks || __atomic_load_n(&job->rc, __ATOMIC_RELAXED) != 0) {
+            break;
+        }
+        const gpu_ingest_chunk_t *chunk = &job->chunks[index];
+        const gpu_ingest_copy_t *copy = &job->copies[chunk->copy];
+        int slot = n & 1;
+
+        // The buffer is free again once its previous copy has completed
+        if (pending[slot] && cuEventSynchronize(copied[slot]) != CUDA_SUCCESS) {
+            gpu_ingest_fail(job, -EIO);
+            break;
+        }
+        pending[slot] = false;
+
+        uint64_t offset = copy->offset + chunk->pos;
+        uint64_t start = offset & ~(uint64_t)(GPU_INGEST_ALIGN - 1);
+        size_t skew = offset - start;
+        size_t want = (skew + chunk->len + GPU_INGEST_ALIGN - 1) & ~(size_t)(GPU_INGEST_ALIGN - 1);
+        ssize_t got = gpu_ingest_read(job->fd, staging[slot], want, start);
+        if (got < 0 || (size_t)got < skew + chunk->len) {
+            gpu_ingest_fail(job, got < 0 ? (int)got : -EIO);
+            break;
+        }
+        int rc = gpu_ingest_verify(job, chunk, (char *)staging[slot] + skew);
+        if (rc != 0) {
+            gpu_ingest_fail(job, rc);
+            break;
+        }
+        if (!job->dev) {
+            memcpy((char *)copy->host + chunk->pos, (char *)staging[slot] + skew, chunk->len);
+            continue;
+        }
+
+        result = cuMemcpyHtoDAsync(job->ptrs[chunk->copy] + chunk->pos,
+                                   (char *)staging[slot] + skew, chunk->len, stream);
+        if (result == CUDA_SUCCESS) {
+            result = cuEventRecord(copied[slot], stream);
+        }
+        if (result != CUDA_SUCCESS) {
+            printf("Ingest copy failed: %d\n", result);
+            gpu_ingest_fail(job, -EIO);
+            break;
+        }
+        pending[slot] = true;
+    }
+
+    if (stream && cuStreamSynchronize(stream) != CUDA_SUCCESS) {
+        gpu_ingest_fail(job, -EIO);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (copied[i]) {
+            cuEventDestroy(copied[i]);
+        }
+        if (staging[i] && job->dev) {
+            cuMemFreeHost(staging[i]);
+        } else {
+            free(staging[i]);
+        }
+    }
+    if (stream) {
+        cuStreamDestroy(stream);
+    }
+    return NULL;
+}
+
+int gpu_ingest_open(const char *path)
+{
+    // Bypass the page cache where the file system allows it; the data is
+    // read once and would only evict something more useful
+    int fd = open(path, O_RDONLY | O_DIRECT);
+    if (fd < 0) {
+        fd = open(path, O_RDONLY);
+    }
+    return fd >= 0 ? fd : -errno;
+}
+
+int gpu_ingest_copy(gpu_device_t *dev, int fd, const gpu_ingest_copy_t *copies, size_t count,
+                    unsigned nthreads, gpu_ingest_stats_t *stats)
+{
+    int64_t start = g_get_monotonic_time();
+    memset(stats, 0, sizeof(*stats));
+    stats->direct = (fcntl(fd, F_GETFL) & O_DIRECT) != 0;
+
+    gpu_ingest_job_t job = { .dev = dev, .fd = fd, .copies = copies };
+    GArray *chunks = g_array_new(FALSE, FALSE, sizeof(gpu_ingest_chunk_t));
+    for (size_t i = 0; i < count; i++) {
+        if (copies[i].crcs &&
+            (copies[i].crc_chunk == 0 || GPU_INGEST_CHUNK % copies[i].crc_chunk != 0)) {
+            job.rc = -EINVAL;
+        }
+        for (uint64_t pos = 0; pos < copies[i].length; pos += GPU_INGEST_CHUNK) {
+            gpu_ingest_chunk_t chunk = {
+                .copy = i,
+                .pos = pos,
+                .len = MIN(GPU_INGEST_CHUNK, copies[i].length - pos),
+            };
+            g_array_append_val(chunks, chunk);
+            stats->bytes += chunk.len;
+        }
+    }
+    job.chunks = (const gpu_ingest_chunk_t *)chunks->data;
+    job.nchunks = chunks->len;
+
+    job.ptrs = calloc(count ? count : 1, sizeof(CUdeviceptr));
+    size_t mapped = 0;
+    if (!job.ptrs) {
+        job.rc = -ENOMEM;
+    } else if (dev && gpu_device_make_current(dev) != CUDA_SUCCESS) {
+        job.rc = -EIO;
+    }
+    for (; job.rc == 0 && dev && mapped < count; mapped++) {
+        if (copies[mapped].length == 0) {
+            continue;  // Nothing to copy, may not even have an allocation
+        }
+        CUresult result = gpu_device_map(dev, copies[mapped].handle, copies[mapped].alloc_size,
+                                         &job.ptrs[mapped]);
+        if (result != CUDA_SUCCESS) {
+            printf("Failed to map allocation for ingest: %d\n", result);
+            job.rc = -ENOMEM;
+            break;
+        }
+    }
+
+    if (job.rc == 0) {
+        // The calling thread is one of the workers
+        unsigned extra = MIN(MAX(nthreads, 1u), MAX(job.nchunks, (size_t)1)) - 1;
+        pthread_t *threads = calloc(extra ? extra : 1, sizeof(pthread_t));
+        unsigned started = 0;
+        while (threads && started < extra &&
+               pthread_create(&threads[started], NULL, gpu_ingest_worker, &job) == 0) {
+            started++;
+        }
+        gpu_ingest_worker(&job);
+        for (unsigned i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        stats->threads = started + 1;
+    }
+
+    for (size_t i = 0; i < mapped; i++) {
+        if (copies[i].length != 0) {
+            gpu_device_unmap(job.ptrs[i], copies[i].alloc_size);
+        }
+    }
+    free(job.ptrs);
+    g_array_free(chunks, TRUE);
+
+    stats->verified = job.verified;
+    stats->elapsed_us = g_get_monotonic_time() - start;
+    return job.rc;
+}
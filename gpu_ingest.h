@@ -0,0 +1,74 @@
+#ifndef GPU_INGEST_H
+#define GPU_INGEST_H
+
+#include <cuda.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gpu_device.h"
+
+// Loading of safetensors checkpoints. A safetensors file is an 8-byte
+// little-endian header length, a JSON header mapping tensor names to their
+// dtype, shape and byte range, and the raw tensor data. The parser reads the
+// header only; the copy engine streams the data into mapped allocations
+// with several threads, each reading large aligned chunks into pinned
+// staging buffers and copying them to the device while the next read runs.
+
+#define GPU_INGEST_NAME_LEN 256
+#define GPU_INGEST_DTYPE_LEN 16
+#define GPU_INGEST_MAX_DIMS 8
+#define GPU_INGEST_SHAPE_LEN 192                 // "d0,d1,..." of GPU_INGEST_MAX_DIMS
+#define GPU_INGEST_MAX_HEADER (100ULL << 20)     // Header size limit of the format
+#define GPU_INGEST_CHUNK (16ULL << 20)           // Bytes per read and copy
+#define GPU_INGEST_ALIGN 4096                    // Alignment of reads for O_DIRECT
+
+typedef struct {
+    char name[GPU_INGEST_NAME_LEN];
+    char dtype[GPU_INGEST_DTYPE_LEN];            // "F32", "BF16", ...
+    int ndim;
+    int64_t shape[GPU_INGEST_MAX_DIMS];
+    uint64_t offset;                             // Absolute file offset of the data
+    uint64_t length;
+} gpu_ingest_tensor_t;
+
+// Read and validate the header of an open safetensors file. Returns 0 with
+// an array of gpu_ingest_tensor_t sorted by offset, or -EINVAL/-EIO.
+int gpu_ingest_parse(int fd, GArray **tensors);
+
+// "d0,d1,...", empty for a scalar
+void gpu_ingest_format_shape(const gpu_ingest_tensor_t *tensor, char *buf, size_t len);
+
+// One range of the file to copy to the start of an allocation
+typedef struct {
+    CUmemGenericAllocationHandle handle;
+    size_t alloc_size;                           // Size of the allocation to map
+    void *host;                                  // Destination instead, without a device
+    uint64_t offset;
+    uint64_t length;                             // At most alloc_size
+    const uint32_t *crcs;                        // CRC32C per crc_chunk bytes, NULL if none
+    size_t crc_chunk;                            // Must divide GPU_INGEST_CHUNK
+} gpu_ingest_copy_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t verified;                           // Bytes checked against crcs
+    unsigned threads;                            // Copy threads that ran
+    int direct;                                  // Reads bypassed the page cache
+    int64_t elapsed_us;
+} gpu_ingest_stats_t;
+
+// Open a file for gpu_ingest_copy, with O_DIRECT if the file system
+// supports it. Returns the descriptor or -errno.
+int gpu_ingest_open(const char *path);
+
+// Copy every range of the file to the device. The allocations are mapped
+// into the daemon for the duration of the copy. With a NULL dev the ranges
+// go to host memory through the same staging buffers, which exercises the
+// engine without a GPU. Ranges with checksums are verified in the staging
+// buffers before they go to the device, a mismatch fails the copy with
+// -EIO. Returns 0 or a negative errno of the first failure.
+int gpu_ingest_copy(gpu_device_t *dev, int fd, const gpu_ingest_copy_t *copies, size_t count,
+                    unsigned nthreads, gpu_ingest_stats_t *stats);
+
+#endif // GPU_INGEST_H
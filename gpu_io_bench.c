@@ -0,0 +1,520 @@
+// Data path throughput through a directory, normally the mount
+//
+//   gpu_io_bench [-s SIZE] [-b BS,...] [-q QD,...] [-t THREADS,...]
+//                [-m read,write,randread,randwrite] [-e pio,mmap] [-T SECONDS] [-d] [-k] DIR
+//
+// Every thread gets a file DIR/gpu_io_bench.N of SIZE bytes (default 256M),
+// created with ftruncate, the same way a mount allocates, and then filled
+// with data. Each combination of mode, engine, block size, queue depth and
+// thread count then runs for SECONDS (default 2). "pio" issues pread and
+// pwrite, "mmap" copies to and from a shared mapping of the file.
+// Sequential modes share one cursor per file; random modes pick aligned
+// blocks uniformly. There is no asynchronous I/O here. A queue depth of QD
+// is QD submitters per thread, each with its own buffer, issuing
+// synchronous calls on the same file, so THREADS * QD requests can be in
+// flight. -d opens the files with O_DIRECT, which needs a SIZE that is a
+// multiple of 4K; -k keeps the files afterwards.
+//
+// Any directory works. A local file system or tmpfs is the host
+// stand-in, the baseline the mount is measured against. Each line reports
+// bandwidth, IOPS and latency percentiles, and a "metric" line carries ten
+// bandwidth samples, one per tenth of the run, for bench_compare.py.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IO_ALIGN 4096
+#define IO_SAMPLES 10
+#define IO_FILL_CHUNK (1u << 20)
+#define IO_MAX_WORKERS 1024
+#define IO_MAX_LIST 16
+
+// Latency histogram: exact below 32 ns, then 32 buckets per power of two,
+// so a bucket is within 3% of the values in it
+#define IO_HIST_SUB 32
+#define IO_HIST_BUCKETS (IO_HIST_SUB + 59 * IO_HIST_SUB)
+
+typedef struct {
+    const char *name;
+    bool write;
+    bool random;
+} io_mode_t;
+
+static const io_mode_t io_modes[] = {
+    { "read", false, false },
+    { "write", true, false },
+    { "randread", false, true },
+    { "randwrite", true, true },
+};
+
+typedef struct {
+    int fd;
+    char *map;                        // NULL for pio
+    uint64_t cursor;                  // Next sequential offset (atomic)
+} io_file_t;
+
+typedef struct {
+    const io_mode_t *mode;
+    uint64_t size;
+    size_t bs;
+    io_file_t *files;
+    int stop;                         // (atomic)
+    uint64_t bytes;                   // Done by all workers (atomic)
+    int error;                        // First errno (atomic)
+} io_run_t;
+
+typedef struct {
+    io_run_t *run;
+    io_file_t *file;
+    uint64_t seed;
+    uint64_t ops;
+    uint64_t hist[IO_HIST_BUCKETS];
+} io_worker_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned hist_index(uint64_t v)
+{
+    if (v < IO_HIST_SUB) {
+        return (unsigned)v;
+    }
+    unsigned msb = 63 - (unsigned)__builtin_clzll(v);  // At least 5
+    unsigned sub = (unsigned)(v >> (msb - 5)) & (IO_HIST_SUB - 1);
+    return IO_HIST_SUB + (msb - 5) * IO_HIST_SUB + sub;
+}
+
+// Middle of a bucket
+static double hist_value(unsigned index)
+{
+    if (index < IO_HIST_SUB) {
+        return index;
+    }
+    unsigned msb = (index - IO_HIST_SUB) / IO_HIST_SUB + 5;
+    uint64_t sub = (index - IO_HIST_SUB) % IO_HIST_SUB;
+    uint64_t width = 1ull << (msb - 5);
+    return (double)((1ull << msb) | (sub << (msb - 5))) + width / 2.0;
+}
+
+static double hist_percentile(const uint64_t *hist, uint64_t total, double p)
+{
+    uint64_t want = (uint64_t)(p * (double)total), seen = 0;
+    for (unsigned i = 0; i < IO_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > want) {
+            return hist_value(i);
+        }
+    }
+    return 0;
+}
+
+static void io_fail(io_run_t *run, int err)
+{
+    int expected = 0;
+    __atomic_compare_exchange_n(&run->error, &expected, err, false, __ATOMIC_RELAXED,
+                                __ATOMIC_RELAXED);
+    __atomic_store_n(&run->stop, 1, __ATOMIC_RELAXED);
+}
+
+static void *io_worker(void *arg)
+{
+    io_worker_t *w = arg;
+    io_run_t *run = w->run;
+    io_file_t *file = w->file;
+    size_t bs = run->bs;
+    uint64_t blocks = run->size / bs;
+    void *buf = NULL;
+    if (posix_memalign(&buf, IO_ALIGN, bs) != 0) {
+        io_fail(run, ENOMEM);
+        return NULL;
+    }
+    memset(buf, (int)(w->seed & 0xff) | 1, bs);
+
+    uint64_t x = w->seed | 1;
+    while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+        uint64_t block;
+        if (run->mode->random) {
+            x ^= x << 13;  // xorshift64
+            x ^= x >> 7;
+            x ^= x << 17;
+            block = x % blocks;
+        } else {
+            block = __atomic_fetch_add(&file->cursor, 1, __ATOMIC_RELAXED) % blocks;
+        }
+        off_t offset = (off_t)(block * bs);
+
+        uint64_t start = now_ns();
+        ssize_t done = (ssize_t)bs;
+        if (file->map) {
+            if (run->mode->write) {
+                memcpy(file->map + offset, buf, bs);
+            } else {
+                memcpy(buf, file->map + offset, bs);
+            }
+        } else if (run->mode->write) {
+            done = pwrite(file->fd, buf, bs, offset);
+        } else {
+            done = pread(file->fd, buf, bs, offset);
+        }
+        uint64_t latency = now_ns() - start;
+        if (done != (ssize_t)bs) {
+            io_fail(run, done < 0 ? errno : EIO);
+            break;
+        }
+        w->hist[hist_index(latency)]++;
+        w->ops++;
+        __atomic_add_fetch(&run->bytes, bs, __ATOMIC_RELAXED);
+    }
+    free(buf);
+    return NULL;
+}
+
+static int io_parse_size(const char *str, uint64_t *out)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno != 0 || end == str || value == 0) {
+        return -EINVAL;
+    }
+    unsigned shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    }
+    if (*end != '\0' || (shift && value > (~0ull >> shift))) {
+        return -EINVAL;
+    }
+    *out = value << shift;
+    return 0;
+}
+
+// Comma separated sizes or counts
+static int io_parse_list(const char *str, uint64_t *values, int *count)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", str);
+    *count = 0;
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (*count == IO_MAX_LIST || io_parse_size(tok, &values[*count]) != 0) {
+            return -EINVAL;
+        }
+        (*count)++;
+    }
+    return *count > 0 ? 0 : -EINVAL;
+}
+
+// Create the file the way a mount allocates, then give it contents
+static int io_prepare(const char *path, uint64_t size, int flags)
+{
+    int fd = open(path, O_RDWR | O_CREAT | flags, 0644);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat st;
+    int rc = fstat(fd, &st) == 0 ? 0 : -errno;
+    if (rc == 0 && (uint64_t)st.st_size != size &&
+        (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0)) {
+        rc = -errno;
+    }
+    void *buf = NULL;
+    if (rc == 0 && posix_memalign(&buf, IO_ALIGN, IO_FILL_CHUNK) != 0) {
+        rc = -ENOMEM;
+    }
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; rc == 0 && i < IO_FILL_CHUNK; i++) {
+        x ^= x << 13;  // Incompressible
+        x ^= x >> 17;
+        x ^= x << 5;
+        ((unsigned char *)buf)[i] = (unsigned char)x;
+    }
+    for (uint64_t pos = 0; rc == 0 && pos < size; pos += IO_FILL_CHUNK) {
+        size_t n = size - pos < IO_FILL_CHUNK ? (size_t)(size - pos) : IO_FILL_CHUNK;
+        ssize_t done = pwrite(fd, buf, n, (off_t)pos);
+        if (done != (ssize_t)n) {
+            rc = done < 0 ? -errno : -EIO;
+        }
+    }
+    free(buf);
+    if (rc != 0) {
+        close(fd);
+        return rc;
+    }
+    return fd;
+}
+
+typedef struct {
+    const io_mode_t *mode;
+    bool mmap;
+    size_t bs;
+    unsigned qd;
+    unsigned threads;
+} io_config_t;
+
+// Run one combination and print its lines. Returns 0 or an errno.
+static int io_run(const io_config_t *config, int *fds, uint64_t size, double seconds)
+{
+    io_run_t run = { .mode = config->mode, .size = size, .bs = config->bs };
+    io_file_t files[IO_MAX_WORKERS];
+    unsigned nworkers = config->threads * config->qd;
+    io_worker_t *workers = calloc(nworkers, sizeof(io_worker_t));
+    pthread_t *tids = calloc(nworkers, sizeof(pthread_t));
+    if (!workers || !tids) {
+        free(workers);
+        free(tids);
+        return ENOMEM;
+    }
+    run.files = files;
+    int rc = 0;
+    for (unsigned i = 0; i < config->threads; i++) {
+        files[i] = (io_file_t){ .fd = fds[i] };
+        if (config->mmap) {
+            void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[i], 0);
+            if (map == MAP_FAILED) {
+                rc = errno;
+                for (unsigned j = 0; j < i; j++) {
+                    munmap(files[j].map, size);
+                }
+                free(workers);
+                free(tids);
+                return rc;
+            }
+            files[i].map = map;
+        }
+    }
+
+    unsigned started = 0;
+    for (unsigned i = 0; i < nworkers; i++) {
+        workers[i] = (io_worker_t){ .run = &run, .file = &files[i / config->qd],
+                                    .seed = 0x9e3779b97f4a7c15ull * (i + 1) };
+    }
+    uint64_t start = now_ns();
+    while (started < nworkers && pthread_create(&tids[started], NULL, io_worker,
+                                                &workers[started]) == 0) {
+        started++;
+    }
+    if (started < nworkers) {
+        io_fail(&run, EAGAIN);
+    }
+
+    // Bandwidth of each tenth of the run is one sample
+    double samples[IO_SAMPLES];
+    int nsamples = 0;
+    uint64_t last_bytes = 0, last_ns = start;
+    for (int i = 0; i < IO_SAMPLES && !__atomic_load_n(&run.stop, __ATOMIC_RELAXED); i++) {
+        uint64_t due = start + (uint64_t)(seconds * 1e9 * (i + 1) / IO_SAMPLES);
+        struct timespec ts = { .tv_sec = due / 1000000000ull, .tv_nsec = due % 1000000000ull };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        uint64_t bytes = __atomic_load_n(&run.bytes, __ATOMIC_RELAXED), t = now_ns();
+        samples[nsamples++] = (double)(bytes - last_bytes) / ((t - last_ns) / 1e9) / 1e6;
+        last_bytes = bytes;
+        last_ns = t;
+    }
+    __atomic_store_n(&run.stop, 1, __ATOMIC_RELAXED);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    static uint64_t hist[IO_HIST_BUCKETS];
+    memset(hist, 0, sizeof(hist));
+    uint64_t ops = 0;
+    for (unsigned i = 0; i < nworkers; i++) {
+        ops += workers[i].ops;
+        for (unsigned b = 0; b < IO_HIST_BUCKETS; b++) {
+            hist[b] += workers[i].hist[b];
+        }
+    }
+    for (unsigned i = 0; i < config->threads; i++) {
+        if (files[i].map) {
+            munmap(files[i].map, size);
+        }
+    }
+    free(workers);
+    free(tids);
+
+    const char *engine = config->mmap ? "mmap" : "pio";
+    rc = run.error;
+    if (rc != 0) {
+        printf("%-9s %-4s %7zu %3u %3u  failed: %s\n", config->mode->name, engine, config->bs,
+               config->qd, config->threads, strerror(rc));
+        return rc;
+    }
+    printf("%-9s %-4s %7zu %3u %3u %10.1f %10.0f %9.1f %9.1f %9.1f\n", config->mode->name,
+           engine, config->bs, config->qd, config->threads,
+           (double)ops * config->bs / elapsed / 1e6, ops / elapsed,
+           hist_percentile(hist, ops, 0.5) / 1e3, hist_percentile(hist, ops, 0.99) / 1e3,
+           hist_percentile(hist, ops, 0.999) / 1e3);
+    printf("metric io.%s.%s.bs%zu.qd%u.t%u MB/s higher", config->mode->name, engine, config->bs,
+           config->qd, config->threads);
+    for (int i = 0; i < nsamples; i++) {
+        printf(" %.3f", samples[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-s SIZE] [-b BS,...] [-q QD,...] [-t THREADS,...]\n"
+            "          [-m read,write,randread,randwrite] [-e pio,mmap] [-T SECONDS] [-d] [-k] "
+            "DIR\n"
+            "SIZE and BS take K, M and G suffixes; with -d (O_DIRECT) SIZE must be a "
+            "multiple of 4K\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t size = 256ull << 20;
+    const char *bs_list = "4K,1M", *qd_list = "1", *thread_list = "1,4";
+    const char *mode_list = "read,write,randread,randwrite", *engine_list = "pio";
+    double seconds = 2;
+    int flags = 0;
+    bool keep = false;
+    int c;
+    while ((c = getopt(argc, argv, "s:b:q:t:m:e:T:dk")) != -1) {
+        switch (c) {
+        case 's':
+            if (io_parse_size(optarg, &size) != 0) {
+                size = 0;
+            }
+            break;
+        case 'b': bs_list = optarg; break;
+        case 'q': qd_list = optarg; break;
+        case 't': thread_list = optarg; break;
+        case 'm': mode_list = optarg; break;
+        case 'e': engine_list = optarg; break;
+        case 'T': seconds = strtod(optarg, NULL); break;
+        case 'd': flags |= O_DIRECT; break;
+        case 'k': keep = true; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    uint64_t bss[IO_MAX_LIST], qds[IO_MAX_LIST], threads[IO_MAX_LIST];
+    int nbs, nqd, nthreads;
+    if (argc - optind != 1 || size == 0 || !(seconds > 0) ||
+        io_parse_list(bs_list, bss, &nbs) != 0 || io_parse_list(qd_list, qds, &nqd) != 0 ||
+        io_parse_list(thread_list, threads, &nthreads) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if ((flags & O_DIRECT) && size % IO_ALIGN != 0) {
+        // The last fill write would be short of a block and fail with EINVAL
+        fprintf(stderr, "With -d, SIZE must be a multiple of %d\n", IO_ALIGN);
+        return 2;
+    }
+    uint64_t max_threads = 0;
+    for (int i = 0; i < nbs; i++) {
+        if (bss[i] > size || bss[i] % 512 != 0) {
+            fprintf(stderr, "Block sizes must be multiples of 512 and at most SIZE\n");
+            return 2;
+        }
+    }
+    for (int i = 0; i < nthreads; i++) {
+        for (int j = 0; j < nqd; j++) {
+            if (threads[i] * qds[j] > IO_MAX_WORKERS) {
+                fprintf(stderr, "THREADS * QD must be at most %d\n", IO_MAX_WORKERS);
+                return 2;
+            }
+        }
+        max_threads = threads[i] > max_threads ? threads[i] : max_threads;
+    }
+
+    const io_mode_t *modes[4];
+    int nmodes = 0;
+    bool engines[2] = { false, false };  // pio, mmap
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", mode_list);
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        int found = -1;
+        for (int i = 0; i < 4; i++) {
+            found = strcmp(tok, io_modes[i].name) == 0 ? i : found;
+        }
+        if (found < 0 || nmodes == 4) {
+            usage(argv[0]);
+            return 2;
+        }
+        modes[nmodes++] = &io_modes[found];
+    }
+    snprintf(buf, sizeof(buf), "%s", engine_list);
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (strcmp(tok, "pio") == 0 || strcmp(tok, "mmap") == 0) {
+            engines[tok[0] == 'm'] = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    char path[4096];
+    int fds[IO_MAX_WORKERS];
+    int rc = 0;
+    unsigned opened = 0;
+    uint64_t prep_start = now_ns();
+    for (; opened < max_threads; opened++) {
+        snprintf(path, sizeof(path), "%s/gpu_io_bench.%u", argv[optind], opened);
+        fds[opened] = io_prepare(path, size, flags);
+        if (fds[opened] < 0) {
+            fprintf(stderr, "%s: %s\n", path, strerror(-fds[opened]));
+            rc = 1;
+            break;
+        }
+    }
+    if (rc == 0) {
+        printf("%s: %u files of %llu MiB prepared in %.2f s, %.1f s per run%s\n", argv[optind],
+               opened, (unsigned long long)(size >> 20), (now_ns() - prep_start) / 1e9, seconds,
+               flags & O_DIRECT ? ", O_DIRECT" : "");
+        printf("%-9s %-4s %7s %3s %3s %10s %10s %9s %9s %9s\n", "mode", "eng", "bs", "qd", "thr",
+               "MB/s", "IOPS", "p50_us", "p99_us", "p999_us");
+    }
+    for (int e = 0; e < 2 && rc == 0; e++) {
+        for (int m = 0; m < nmodes && engines[e]; m++) {
+            for (int b = 0; b < nbs; b++) {
+                for (int q = 0; q < nqd; q++) {
+                    for (int t = 0; t < nthreads; t++) {
+                        io_config_t config = {
+                            .mode = modes[m],
+                            .mmap = e == 1,
+                            .bs = (size_t)bss[b],
+                            .qd = (unsigned)qds[q],
+                            .threads = (unsigned)threads[t],
+                        };
+                        rc |= io_run(&config, fds, size, seconds) != 0;
+                    }
+                }
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < opened; i++) {
+        close(fds[i]);
+        snprintf(path, sizeof(path), "%s/gpu_io_bench.%u", argv[optind], i);
+        if (!keep) {
+            unlink(path);
+        }
+    }
+    return rc ? 1 : 0;
+}
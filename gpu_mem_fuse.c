@@ -1,6 +1,8 @@
 #define FUSE_USE_VERSION 31
 
 #include "gpu_mem_fuse.h"
+#include "gpu_bundle.h"
+#include "gpu_policy.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,52 +17,516 @@
 #include <cuda_runtime.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
 
 // Global context
 static gpu_fuse_context_t *g_gpu_ctx = NULL;
 
+// Allocation properties shared by every allocation the daemon creates
+void gpu_fuse_init_alloc_props(gpu_fuse_context_t *ctx, CUmemAllocationProp *props)
+{
+    gpu_device_alloc_props(ctx->cuda_device, props);
+}
+
 // CUDA initialization
 int gpu_fuse_init_cuda(gpu_fuse_context_t *ctx)
 {
-    CUresult result = cuInit(0);
-    if (result != CUDA_SUCCESS) {
-        printf("Failed to initialize CUDA: %d\n", result);
+    if (gpu_device_discover(&ctx->devices, &ctx->ndevices) != 0) {
         return -1;
     }
     
-    result = cuDeviceGet(&ctx->cuda_device, 0);
-    if (result != CUDA_SUCCESS) {
-        printf("Failed to get CUDA device: %d\n", result);
+    // Allocations are served by a single device
+    int ordinal = ctx->opts.device;
+    if (ordinal < 0 || ordinal >= ctx->ndevices) {
+        printf("Invalid device %d, %d devices found\n", ordinal, ctx->ndevices);
+        return -1;
+    }
+    gpu_device_t *dev = &ctx->devices[ordinal];
+    if (dev->result != CUDA_SUCCESS) {
+        printf("Failed to initialize device %d: %d\n", ordinal, dev->result);
         return -1;
     }
+    ctx->device = dev;
+    ctx->cuda_device = dev->device;
+    ctx->device_memory = dev->memory;
+    ctx->granularity = dev->granularity;
     
     printf("CUDA initialized successfully\n");
     return 0;
 }
 
-// Helper function to get file by path
+// Parse a byte count with an optional K/M/G/T (binary) suffix
+int gpu_fuse_parse_size(const char *str, size_t *out)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno != 0 || end == str) {
+        return -EINVAL;
+    }
+    
+    unsigned shift = 0;
+    switch (*end) {
+        case 'T': case 't': shift = 40; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'K': case 'k': shift = 10; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || (shift && value > (~0ULL >> shift))) {
+        return -EINVAL;
+    }
+    
+    *out = (size_t)(value << shift);
+    return 0;
+}
+
+// Setup admission control for the device from the mount options
+static int gpu_fuse_init_admission(gpu_fuse_context_t *ctx)
+{
+    size_t capacity = ctx->device_memory;
+    if (ctx->opts.capacity && gpu_fuse_parse_size(ctx->opts.capacity, &capacity) != 0) {
+        fprintf(stderr, "Invalid capacity: %s\n", ctx->opts.capacity);
+        return -1;
+    }
+    
+    gpu_admit_policy_t policy = GPU_ADMIT_FIFO;
+    if (ctx->opts.alloc_policy && gpu_policy_parse_admit(ctx->opts.alloc_policy, &policy) != 0) {
+        fprintf(stderr, "Invalid alloc_policy: %s\n", ctx->opts.alloc_policy);
+        return -1;
+    }
+    
+    gpu_admit_init(&ctx->admit, capacity, policy, ctx->opts.alloc_wait != 0,
+                   ctx->opts.alloc_timeout_ms);
+    printf("Admission: capacity=%zu bytes, policy=%s, wait=%s (timeout %u ms)\n",
+           capacity, gpu_policy_admit_name(policy),
+           ctx->opts.alloc_wait ? "yes" : "no", ctx->opts.alloc_timeout_ms);
+    return 0;
+}
+
+// Helper function to get file by path. Takes a reference that keeps the
+// file alive if it is unlinked or replaced; drop it with gpu_fuse_put_file().
 gpu_file_t *gpu_fuse_get_file_from_path(gpu_fuse_context_t *ctx, const char *path)
 {
     pthread_mutex_lock(&ctx->global_mutex);
     gpu_file_t *file = g_hash_table_lookup(ctx->files, path);
+    if (file) {
+        file->refcount++;
+    }
     pthread_mutex_unlock(&ctx->global_mutex);
     return file;
 }
 
-// Cleanup GPU memory for a file
+// Create the interprocess fence that producers record and consumers wait on
+static int gpu_fuse_create_fence(CUevent *fence_out, CUipcEventHandle *handle_out)
+{
+    CUresult result = gpu_device_make_current(g_gpu_ctx->device);
+    if (result != CUDA_SUCCESS) {
+        printf("cuCtxSetCurrent failed: %d\n", result);
+        return -1;
+    }
+    
+    CUevent fence;
+    result = cuEventCreate(&fence, CU_EVENT_INTERPROCESS | CU_EVENT_DISABLE_TIMING);
+    if (result != CUDA_SUCCESS) {
+        printf("cuEventCreate failed: %d\n", result);
+        return -1;
+    }
+    
+    result = cuIpcGetEventHandle(handle_out, fence);
+    if (result != CUDA_SUCCESS) {
+        printf("cuIpcGetEventHandle failed: %d\n", result);
+        cuEventDestroy(fence);
+        return -1;
+    }
+    
+    *fence_out = fence;
+    return 0;
+}
+
+// Destroy the fence of a version, if any
+static void gpu_fuse_destroy_fence(gpu_version_t *version)
+{
+    if (version->fence != NULL) {
+        gpu_device_make_current(g_gpu_ctx->device);
+        cuEventDestroy(version->fence);
+        version->fence = NULL;
+    }
+}
+
+// Charge an allocation to the file's reservation, or to the caller's cgroup
+// and the device admission (which may queue until deadline)
+static int gpu_fuse_charge(gpu_reservation_t *resv, gpu_cgroup_t *cgroup, size_t size,
+                           int priority, const struct timespec *deadline)
+{
+    if (resv) {
+        return gpu_resv_draw(g_gpu_ctx, resv, size);
+    }
+    
+    int rc = gpu_cgroup_charge(&g_gpu_ctx->cgroups, cgroup, size);
+    if (rc != 0) {
+        return rc;
+    }
+    rc = gpu_admit_acquire(&g_gpu_ctx->admit, size, priority, deadline);
+    if (rc != 0) {
+        gpu_cgroup_uncharge(&g_gpu_ctx->cgroups, cgroup, size);
+    }
+    return rc;
+}
+
+// Return the bytes of an allocation to the budget they were drawn from
+static void gpu_fuse_uncharge(gpu_reservation_t *resv, gpu_cgroup_t *cgroup, size_t size)
+{
+    if (resv) {
+        gpu_resv_return(g_gpu_ctx, resv, size);
+    } else {
+        gpu_admit_release(&g_gpu_ctx->admit, size);
+        gpu_cgroup_uncharge(&g_gpu_ctx->cgroups, cgroup, size);
+    }
+}
+
+// Limits and weights are set by root or the user running the daemon only
+static bool gpu_fuse_privileged(void)
+{
+    struct fuse_context *fctx = fuse_get_context();
+    return !fctx || fctx->uid == 0 || fctx->uid == getuid();
+}
+
+// Reservations are used and cancelled by their creator, or a privileged user
+static bool gpu_fuse_may_use_resv(const gpu_reservation_t *resv)
+{
+    struct fuse_context *fctx = fuse_get_context();
+    return gpu_fuse_privileged() || resv->owner == fctx->uid;
+}
+
+// Scheduler tenant of the calling process: its uid or its cgroup
+static void gpu_fuse_tenant(char *buf, size_t len)
+{
+    struct fuse_context *fctx = fuse_get_context();
+    if (g_gpu_ctx->sched_by_cgroup) {
+        gpu_cgroup_t *cgroup = gpu_cgroup_of_pid(&g_gpu_ctx->cgroups, fctx ? fctx->pid : 0);
+        snprintf(buf, len, "%s", cgroup ? cgroup->path : "/");
+    } else {
+        snprintf(buf, len, "uid:%u", fctx ? (unsigned)fctx->uid : 0);
+    }
+}
+
+typedef struct {
+    CUmemGenericAllocationHandle handle;
+    CUresult result;
+} gpu_fuse_release_work_t;
+
+static void gpu_fuse_release_work(void *arg)
+{
+    gpu_fuse_release_work_t *work = arg;
+    work->result = cuMemRelease(work->handle);
+}
+
+// Release a physical allocation through the fair scheduler
+static CUresult gpu_fuse_release_handle(CUmemGenericAllocationHandle handle)
+{
+    char tenant[GPU_SCHED_TENANT_LEN];
+    gpu_fuse_tenant(tenant, sizeof(tenant));
+    
+    gpu_fuse_release_work_t work = { .handle = handle };
+    gpu_sched_run(&g_gpu_ctx->sched, tenant, 1, gpu_fuse_release_work, &work);
+    return work.result;
+}
+
+static gpu_version_t *gpu_fuse_version_get(gpu_version_t *version)
+{
+    __atomic_add_fetch(&version->refcount, 1, __ATOMIC_RELAXED);
+    return version;
+}
+
+// Drop a reference; the last one releases the memory and its charge.
+// Must not be called with a file mutex held.
+static int gpu_fuse_version_put(gpu_version_t *version)
+{
+    if (__atomic_sub_fetch(&version->refcount, 1, __ATOMIC_ACQ_REL) != 0) {
+        return 0;
+    }
+    
+    int rc = 0;
+    gpu_fuse_destroy_fence(version);
+    CUresult result = gpu_fuse_release_handle(version->gpu_handle);
+    if (result != CUDA_SUCCESS) {
+        printf("Failed to release GPU memory: %d\n", result);
+        rc = -1;
+    }
+    gpu_fuse_uncharge(version->reservation, version->cgroup, version->size);
+    if (version->reservation) {
+        gpu_resv_put(g_gpu_ctx, version->reservation);
+    }
+    printf("Released version %llu (%zu bytes)\n", (unsigned long long)version->seq, version->size);
+    free(version);
+    return rc;
+}
+
+// Stop counting a file among the sharers of its current version, before
+// the file lets go of it. Called with file->mutex held.
+static void gpu_fuse_unshare_locked(gpu_file_t *file)
+{
+    if (file->shared) {
+        file->shared = false;
+        __atomic_sub_fetch(&file->current->sharers, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Cleanup GPU memory for a file. Versions still pinned by open handles are
+// released when those handles are.
 int gpu_fuse_cleanup_gpu_memory(gpu_file_t *file)
 {
-    if (file->gpu_handle != 0) {
-        CUresult result = cuMemRelease(file->gpu_handle);
-        if (result != CUDA_SUCCESS) {
-            printf("Failed to release GPU memory: %d\n", result);
-            return -1;
+    pthread_mutex_lock(&file->mutex);
+    gpu_fuse_unshare_locked(file);
+    gpu_version_t *current = file->current;
+    gpu_version_t *staged = file->staged;
+    file->current = NULL;
+    file->staged = NULL;
+    file->ready = false;
+    pthread_mutex_unlock(&file->mutex);
+    
+    int rc = 0;
+    if (current && gpu_fuse_version_put(current) != 0) {
+        rc = -1;
+    }
+    if (staged && gpu_fuse_version_put(staged) != 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+// Wake every poller waiting for the file to become ready (file->mutex held)
+static void gpu_fuse_notify_ready(gpu_file_t *file)
+{
+    for (GList *l = file->poll_handles; l != NULL; l = l->next) {
+        struct fuse_pollhandle *ph = l->data;
+        fuse_notify_poll(ph);
+        fuse_pollhandle_destroy(ph);
+    }
+    g_list_free(file->poll_handles);
+    file->poll_handles = NULL;
+}
+
+// Free a file that is out of the index and no longer referenced
+static void gpu_fuse_free_file(gpu_file_t *file)
+{
+    gpu_fuse_cleanup_gpu_memory(file);
+    if (file->reservation) {
+        gpu_resv_put(g_gpu_ctx, file->reservation);
+    }
+    // Pollers wake up and find the file gone
+    gpu_fuse_notify_ready(file);
+    if (file->restore) {
+        __atomic_sub_fetch(&g_gpu_ctx->restore_pending, 1, __ATOMIC_RELAXED);
+        free(file->restore);
+    }
+    pthread_cond_destroy(&file->restore_cond);
+    pthread_mutex_destroy(&file->mutex);
+    free(file);
+}
+
+static void gpu_fuse_put_file(gpu_file_t *file)
+{
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    bool last = --file->refcount == 0;
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    if (last) {
+        gpu_fuse_free_file(file);
+    }
+}
+
+// Drop the index references of files taken out of the index
+static void gpu_fuse_put_files(GPtrArray *files)
+{
+    for (guint i = 0; i < files->len; i++) {
+        gpu_fuse_put_file(g_ptr_array_index(files, i));
+    }
+    g_ptr_array_free(files, TRUE);
+}
+
+static void gpu_fuse_release_batch(gpointer data, gpointer user_data)
+{
+    UNUSED(user_data);
+    GPtrArray *batch = data;
+    guint count = batch->len;
+    gpu_fuse_put_files(batch);
+    __atomic_sub_fetch(&g_gpu_ctx->release_pending, count, __ATOMIC_RELAXED);
+}
+
+// Drop the references of detached files in the background, in batches that
+// the release pool frees in parallel. Without a pool they are dropped inline.
+static void gpu_fuse_put_files_async(GPtrArray *files)
+{
+    if (!g_gpu_ctx->release_pool) {
+        gpu_fuse_put_files(files);
+        return;
+    }
+    
+    for (guint start = 0; start < files->len; start += GPU_FUSE_RELEASE_BATCH) {
+        guint end = MIN(files->len, start + GPU_FUSE_RELEASE_BATCH);
+        GPtrArray *batch = g_ptr_array_sized_new(end - start);
+        for (guint i = start; i < end; i++) {
+            g_ptr_array_add(batch, g_ptr_array_index(files, i));
+        }
+        __atomic_add_fetch(&g_gpu_ctx->release_pending, batch->len, __ATOMIC_RELAXED);
+        g_thread_pool_push(g_gpu_ctx->release_pool, batch, NULL);
+    }
+    g_ptr_array_free(files, TRUE);
+}
+
+// Namespace helpers, all called with global_mutex held. Files and
+// directories are kept in flat path-keyed tables; a directory's children are
+// the entries whose path extends it by one component.
+
+// True if path lies strictly below dir
+static bool gpu_fuse_path_below(const char *path, const char *dir)
+{
+    if (strcmp(dir, "/") == 0) {
+        return path[0] == '/' && path[1] != '\0';
+    }
+    size_t len = strlen(dir);
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+// Name of path within dir if it is a direct child, NULL otherwise
+static const char *gpu_fuse_child_name(const char *path, const char *dir)
+{
+    if (!gpu_fuse_path_below(path, dir)) {
+        return NULL;
+    }
+    const char *name = path + (strcmp(dir, "/") == 0 ? 1 : strlen(dir) + 1);
+    return strchr(name, '/') ? NULL : name;
+}
+
+static bool gpu_fuse_parent_is_dir_locked(const char *path)
+{
+    char *parent = g_path_get_dirname(path);
+    bool is_dir = g_hash_table_contains(g_gpu_ctx->dirs, parent);
+    g_free(parent);
+    return is_dir;
+}
+
+static bool gpu_fuse_dir_is_empty_locked(const char *dir)
+{
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, g_gpu_ctx->files);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (gpu_fuse_path_below(key, dir)) {
+            return false;
         }
-        file->gpu_handle = 0;
-        file->size = 0;
-        printf("Released GPU memory for %s\n", file->path);
     }
-    return 0;
+    g_hash_table_iter_init(&iter, g_gpu_ctx->dirs);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (gpu_fuse_path_below(key, dir)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static gpu_dir_t *gpu_fuse_add_dir_locked(const char *path)
+{
+    gpu_dir_t *dir = calloc(1, sizeof(gpu_dir_t));
+    if (!dir) {
+        return NULL;
+    }
+    snprintf(dir->path, sizeof(dir->path), "%s", path);
+    dir->created_time = dir->modify_time = time(NULL);
+    g_hash_table_insert(g_gpu_ctx->dirs, strdup(path), dir);
+    return dir;
+}
+
+// Take a file out of the index, handing its index reference to the caller
+static gpu_file_t *gpu_fuse_unlink_file_locked(const char *path)
+{
+    gpointer key, value;
+    if (!g_hash_table_lookup_extended(g_gpu_ctx->files, path, &key, &value)) {
+        return NULL;
+    }
+    g_hash_table_steal(g_gpu_ctx->files, path);
+    free(key);
+    return value;
+}
+
+static void gpu_fuse_move_file_locked(const char *from, const char *to)
+{
+    gpu_file_t *file = gpu_fuse_unlink_file_locked(from);
+    pthread_mutex_lock(&file->mutex);
+    snprintf(file->path, sizeof(file->path), "%s", to);
+    pthread_mutex_unlock(&file->mutex);
+    g_hash_table_insert(g_gpu_ctx->files, strdup(to), file);
+}
+
+static void gpu_fuse_move_dir_locked(const char *from, const char *to)
+{
+    gpointer key, value;
+    g_hash_table_lookup_extended(g_gpu_ctx->dirs, from, &key, &value);
+    g_hash_table_steal(g_gpu_ctx->dirs, from);
+    free(key);
+    gpu_dir_t *dir = value;
+    snprintf(dir->path, sizeof(dir->path), "%s", to);
+    g_hash_table_insert(g_gpu_ctx->dirs, strdup(to), dir);
+}
+
+// Paths of all files or directories below dir, copied
+static GPtrArray *gpu_fuse_collect_below_locked(GHashTable *table, const char *dir)
+{
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (gpu_fuse_path_below(key, dir)) {
+            g_ptr_array_add(paths, g_strdup(key));
+        }
+    }
+    return paths;
+}
+
+// Path of an entry below from, rebased below to
+static int gpu_fuse_rebase_path(const char *path, const char *from, const char *to,
+                                char *out, size_t len)
+{
+    const char *suffix = path + strlen(from);
+    int n = snprintf(out, len, "%s%s", strcmp(to, "/") == 0 ? "" : to, suffix);
+    return n < 0 || (size_t)n >= len ? -ENAMETOOLONG : 0;
+}
+
+static gint gpu_fuse_compare_path_len(gconstpointer a, gconstpointer b)
+{
+    size_t la = strlen(*(const char * const *)a);
+    size_t lb = strlen(*(const char * const *)b);
+    return la < lb ? -1 : la > lb;
+}
+
+// Take a directory and everything below it out of the namespace. The
+// files' index references are appended to files for the caller to drop
+// once global_mutex is released.
+static void gpu_fuse_detach_tree_locked(const char *path, GPtrArray *files)
+{
+    GPtrArray *paths = gpu_fuse_collect_below_locked(g_gpu_ctx->files, path);
+    for (guint i = 0; i < paths->len; i++) {
+        g_ptr_array_add(files, gpu_fuse_unlink_file_locked(g_ptr_array_index(paths, i)));
+    }
+    g_ptr_array_free(paths, TRUE);
+    
+    paths = gpu_fuse_collect_below_locked(g_gpu_ctx->dirs, path);
+    for (guint i = 0; i < paths->len; i++) {
+        g_hash_table_remove(g_gpu_ctx->dirs, g_ptr_array_index(paths, i));
+    }
+    g_ptr_array_free(paths, TRUE);
+    g_hash_table_remove(g_gpu_ctx->dirs, path);
+}
+
+static bool gpu_fuse_is_dir(const char *path)
+{
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    bool is_dir = g_hash_table_contains(g_gpu_ctx->dirs, path);
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    return is_dir;
 }
 
 // FUSE getattr - check file attributes
@@ -70,22 +536,33 @@ static int gpu_fuse_getattr(const char *path, struct stat *stbuf, struct fuse_fi
     
     memset(stbuf, 0, sizeof(struct stat));
     
-    if (strcmp(path, "/") == 0) {
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    gpu_dir_t *dir = g_hash_table_lookup(g_gpu_ctx->dirs, path);
+    if (dir) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
+        stbuf->st_mtime = dir->modify_time;
+        stbuf->st_ctime = dir->created_time;
+        pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
         return 0;
     }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
     
     gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
     if (file) {
         pthread_mutex_lock(&file->mutex);
         stbuf->st_mode = S_IFREG | 0644;
         stbuf->st_nlink = 1;
-        stbuf->st_size = file->size;
+        if (file->current) {
+            stbuf->st_size = file->current->size;
+        } else if (file->restore) {
+            stbuf->st_size = file->restore->rec->alloc_size;  // Not rehydrated yet
+        }
         stbuf->st_atime = file->access_time;
         stbuf->st_mtime = file->modify_time;
         stbuf->st_ctime = file->created_time;
         pthread_mutex_unlock(&file->mutex);
+        gpu_fuse_put_file(file);
         return 0;
     }
     
@@ -100,24 +577,28 @@ static int gpu_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
     UNUSED(fi);
     UNUSED(flags);
     
-    if (strcmp(path, "/") != 0) {
-        return -ENOENT;
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    
+    if (!g_hash_table_contains(g_gpu_ctx->dirs, path)) {
+        pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+        return g_hash_table_contains(g_gpu_ctx->files, path) ? -ENOTDIR : -ENOENT;
     }
     
     filler(buf, ".", NULL, 0, 0);
     filler(buf, "..", NULL, 0, 0);
     
-    // List all files
-    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
-    
-    GHashTableIter iter;
-    gpointer key, value;
-    
-    g_hash_table_iter_init(&iter, g_gpu_ctx->files);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        char *file_path = (char*)key;
-        if (file_path[0] == '/') file_path++; // Skip leading slash
-        filler(buf, file_path, NULL, 0, 0);
+    // List the direct children
+    GHashTable *tables[] = { g_gpu_ctx->dirs, g_gpu_ctx->files };
+    for (size_t t = 0; t < G_N_ELEMENTS(tables); t++) {
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, tables[t]);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            const char *name = gpu_fuse_child_name(key, path);
+            if (name) {
+                filler(buf, name, NULL, 0, 0);
+            }
+        }
     }
     
     pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
@@ -125,6 +606,51 @@ static int gpu_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
     return 0;
 }
 
+// Allocate a file entry with no GPU memory, not yet in the index
+static gpu_file_t *gpu_fuse_new_file(const char *path)
+{
+    gpu_file_t *new_file = malloc(sizeof(gpu_file_t));
+    if (!new_file) {
+        return NULL;
+    }
+    
+    strncpy(new_file->path, path, MAX_PATH_LEN - 1);
+    new_file->path[MAX_PATH_LEN - 1] = '\0';
+    new_file->refcount = 1;            // Held by the index
+    new_file->current = NULL;          // No GPU memory allocated yet
+    new_file->staged = NULL;
+    new_file->next_seq = 1;
+    time_t current_time = time(NULL);
+    new_file->created_time = current_time;
+    new_file->access_time = current_time;
+    new_file->modify_time = current_time;
+    new_file->ready = false;           // Not published until the producer says so
+    new_file->shared = false;
+    new_file->allocating = false;
+    new_file->priority = 0;
+    new_file->reservation = NULL;      // Draw from the device admission
+    new_file->durable = false;
+    new_file->dtype[0] = '\0';        // Not a tensor
+    new_file->shape[0] = '\0';
+    new_file->poll_handles = NULL;
+    new_file->restore = NULL;          // Contents are not in a checkpoint
+    new_file->first_access = 0;
+    pthread_mutex_init(&new_file->mutex, NULL);
+    pthread_cond_init(&new_file->restore_cond, NULL);
+    return new_file;
+}
+
+// Pin the current version to an open file handle so it outlives a publish.
+// Reads bypass the page cache, since the handle they return is per open.
+static void gpu_fuse_pin_current(gpu_file_t *file, struct fuse_file_info *fi)
+{
+    pthread_mutex_lock(&file->mutex);
+    gpu_version_t *current = file->current;
+    fi->fh = current ? (uint64_t)(uintptr_t)gpu_fuse_version_get(current) : 0;
+    pthread_mutex_unlock(&file->mutex);
+    fi->direct_io = 1;
+}
+
 // FUSE create - create a new file path (no GPU memory allocated yet)
 static int gpu_fuse_create(const char *path, mode_t mode, struct fuse_file_info *fi)
 {
@@ -135,268 +661,2856 @@ static int gpu_fuse_create(const char *path, mode_t mode, struct fuse_file_info
     gpu_file_t *existing = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
     if (existing) {
         printf("File %s already exists\n", path);
+        gpu_fuse_pin_current(existing, fi);
+        gpu_fuse_put_file(existing);
         return 0;  // File already exists, return success
     }
     
     // Create a new file entry (no GPU memory allocated yet)
-    gpu_file_t *new_file = malloc(sizeof(gpu_file_t));
+    gpu_file_t *new_file = gpu_fuse_new_file(path);
     if (!new_file) {
         return -ENOMEM;
     }
     
-    strncpy(new_file->path, path, MAX_PATH_LEN - 1);
-    new_file->path[MAX_PATH_LEN - 1] = '\0';
-    new_file->gpu_handle = 0;          // No GPU memory allocated yet
-    new_file->size = 0;                // No size yet
-    time_t current_time = time(NULL);
-    new_file->created_time = current_time;
-    new_file->access_time = current_time;
-    new_file->modify_time = current_time;
-    pthread_mutex_init(&new_file->mutex, NULL);
-    
     pthread_mutex_lock(&g_gpu_ctx->global_mutex);
-    char *path_key = strdup(path);
-    g_hash_table_insert(g_gpu_ctx->files, path_key, new_file);
+    int rc = 0;
+    if (g_hash_table_contains(g_gpu_ctx->dirs, path)) {
+        rc = -EISDIR;
+    } else if (!gpu_fuse_parent_is_dir_locked(path)) {
+        rc = -ENOENT;
+    } else if (g_hash_table_contains(g_gpu_ctx->files, path)) {
+        rc = -EEXIST;  // Lost a race with another create
+    } else {
+        char *path_key = strdup(path);
+        g_hash_table_insert(g_gpu_ctx->files, path_key, new_file);
+    }
     pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    if (rc != 0) {
+        pthread_mutex_destroy(&new_file->mutex);
+        free(new_file);
+        return rc;
+    }
 
+    fi->fh = 0;
+    fi->direct_io = 1;
     printf("Created file entry %s (no GPU memory allocated yet)\n", path);
     return 0;
 }
 
-// FUSE truncate - allocate/deallocate GPU memory based on size
-static int gpu_fuse_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+// FUSE mkdir - create a directory
+static int gpu_fuse_mkdir(const char *path, mode_t mode)
 {
-    UNUSED(fi);
-    
-    printf("gpu_fuse_truncate called: path=%s, size=%ld\n", path, size);
+    UNUSED(mode);
     
-    if (size < 0) {
-        return -EINVAL;
+    if (strlen(path) >= MAX_PATH_LEN) {
+        return -ENAMETOOLONG;
     }
     
-    // Get the file
-    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
-    if (!file) {
-        return -ENOENT;  // File doesn't exist
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    int rc = 0;
+    if (g_hash_table_contains(g_gpu_ctx->dirs, path) ||
+        g_hash_table_contains(g_gpu_ctx->files, path)) {
+        rc = -EEXIST;
+    } else if (!gpu_fuse_parent_is_dir_locked(path)) {
+        rc = -ENOENT;
+    } else if (!gpu_fuse_add_dir_locked(path)) {
+        rc = -ENOMEM;
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    
+    if (rc == 0) {
+        printf("Created directory %s\n", path);
+    }
+    return rc;
+}
+
+// FUSE unlink - remove a file; open handles keep their version until closed
+static int gpu_fuse_unlink(const char *path)
+{
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    gpu_file_t *file = NULL;
+    int rc = 0;
+    if (g_hash_table_contains(g_gpu_ctx->dirs, path)) {
+        rc = -EISDIR;
+    } else {
+        file = gpu_fuse_unlink_file_locked(path);
+        if (!file) {
+            rc = -ENOENT;
+        }
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    
+    if (file) {
+        gpu_fuse_put_file(file);
+        printf("Unlinked %s\n", path);
+    }
+    return rc;
+}
+
+// FUSE rmdir - remove an empty directory
+static int gpu_fuse_rmdir(const char *path)
+{
+    if (strcmp(path, "/") == 0) {
+        return -EBUSY;
+    }
+    
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    int rc = 0;
+    if (!g_hash_table_contains(g_gpu_ctx->dirs, path)) {
+        rc = g_hash_table_contains(g_gpu_ctx->files, path) ? -ENOTDIR : -ENOENT;
+    } else if (!gpu_fuse_dir_is_empty_locked(path)) {
+        rc = -ENOTEMPTY;
+    } else {
+        g_hash_table_remove(g_gpu_ctx->dirs, path);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    return rc;
+}
+
+// Move a directory and everything below it (global_mutex held). Every
+// entry below it is re-keyed, so this is linear in the size of the index.
+static int gpu_fuse_rename_dir_locked(const char *from, const char *to)
+{
+    GPtrArray *dirs = gpu_fuse_collect_below_locked(g_gpu_ctx->dirs, from);
+    GPtrArray *files = gpu_fuse_collect_below_locked(g_gpu_ctx->files, from);
+    char target[MAX_PATH_LEN];
+    int rc = 0;
+    
+    // Check every new path fits before moving anything
+    for (guint i = 0; i < dirs->len && rc == 0; i++) {
+        rc = gpu_fuse_rebase_path(g_ptr_array_index(dirs, i), from, to, target, sizeof(target));
+    }
+    for (guint i = 0; i < files->len && rc == 0; i++) {
+        rc = gpu_fuse_rebase_path(g_ptr_array_index(files, i), from, to, target, sizeof(target));
+    }
+    
+    if (rc == 0) {
+        g_hash_table_remove(g_gpu_ctx->dirs, to);  // Empty target directory, if any
+        gpu_fuse_move_dir_locked(from, to);
+        for (guint i = 0; i < dirs->len; i++) {
+            const char *path = g_ptr_array_index(dirs, i);
+            gpu_fuse_rebase_path(path, from, to, target, sizeof(target));
+            gpu_fuse_move_dir_locked(path, target);
+        }
+        for (guint i = 0; i < files->len; i++) {
+            const char *path = g_ptr_array_index(files, i);
+            gpu_fuse_rebase_path(path, from, to, target, sizeof(target));
+            gpu_fuse_move_file_locked(path, target);
+        }
+    }
+    
+    g_ptr_array_free(dirs, TRUE);
+    g_ptr_array_free(files, TRUE);
+    return rc;
+}
+
+// FUSE rename - move a file or directory, replacing a file at the target
+static int gpu_fuse_rename(const char *from, const char *to, unsigned int flags)
+{
+    printf("gpu_fuse_rename called: from=%s, to=%s, flags=%u\n", from, to, flags);
+    
+    if (flags & RENAME_EXCHANGE) {
+        return -EINVAL;
+    }
+    if (strlen(to) >= MAX_PATH_LEN) {
+        return -ENAMETOOLONG;
+    }
+    
+    gpu_file_t *replaced = NULL;
+    int rc = 0;
+    
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    bool from_file = g_hash_table_contains(g_gpu_ctx->files, from);
+    bool from_dir = g_hash_table_contains(g_gpu_ctx->dirs, from);
+    bool to_file = g_hash_table_contains(g_gpu_ctx->files, to);
+    bool to_dir = g_hash_table_contains(g_gpu_ctx->dirs, to);
+    
+    if (!from_file && !from_dir) {
+        rc = -ENOENT;
+    } else if (strcmp(from, to) == 0) {
+        rc = 0;
+    } else if (!gpu_fuse_parent_is_dir_locked(to)) {
+        rc = -ENOENT;
+    } else if ((to_file || to_dir) && (flags & RENAME_NOREPLACE)) {
+        rc = -EEXIST;
+    } else if (from_file) {
+        if (to_dir) {
+            rc = -EISDIR;
+        } else {
+            replaced = gpu_fuse_unlink_file_locked(to);
+            gpu_fuse_move_file_locked(from, to);
+        }
+    } else if (strcmp(from, "/") == 0 || gpu_fuse_path_below(to, from)) {
+        rc = -EINVAL;  // A directory cannot move below itself
+    } else if (to_file) {
+        rc = -ENOTDIR;
+    } else if (to_dir && !gpu_fuse_dir_is_empty_locked(to)) {
+        rc = -ENOTEMPTY;
+    } else {
+        rc = gpu_fuse_rename_dir_locked(from, to);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    
+    if (replaced) {
+        gpu_fuse_put_file(replaced);
+    }
+    return rc;
+}
+
+// Driver work of one allocation attempt, run on a scheduler worker
+typedef struct {
+    size_t size;
+    CUresult result;              // Of cuMemCreate, for the out-of-memory retry
+    int rc;
+    CUmemGenericAllocationHandle gpu_handle;
+    CUmemFabricHandle fabric_handle;
+    CUevent fence;
+    CUipcEventHandle fence_handle;
+} gpu_fuse_alloc_work_t;
+
+static void gpu_fuse_alloc_work(void *arg)
+{
+    gpu_fuse_alloc_work_t *work = arg;
+    work->rc = 0;
+    
+    // Setup allocation properties
+    CUmemAllocationProp props;
+    gpu_fuse_init_alloc_props(g_gpu_ctx, &props);
+    
+    work->result = cuMemCreate(&work->gpu_handle, work->size, &props, 0);
+    if (work->result != CUDA_SUCCESS) {
+        printf("cuMemCreate failed: %d\n", work->result);
+        work->rc = -ENOMEM;
+        return;
+    }
+    
+    CUresult result = cuMemExportToShareableHandle((void *)&work->fabric_handle, work->gpu_handle,
+                                                   CU_MEM_HANDLE_TYPE_FABRIC, 0);
+    if (result != CUDA_SUCCESS) {
+        printf("cuMemExportToShareableHandle failed: %d\n", result);
+        work->rc = -ENOMEM;
+    } else if (gpu_fuse_create_fence(&work->fence, &work->fence_handle) != 0) {
+        work->rc = -ENOMEM;
+    }
+    if (work->rc != 0) {
+        cuMemRelease(work->gpu_handle);
+    }
+}
+
+// Allocate a new version of a file. Called with file->mutex held; the lock
+// is dropped while the request waits for admission and talks to the driver,
+// with file->allocating fencing off concurrent allocations.
+static int gpu_fuse_allocate(gpu_file_t *file, size_t size, gpu_version_t **out)
+{
+    if (file->allocating) {
+        return -EBUSY;
+    }
+    file->allocating = true;
+    int priority = file->priority;
+    gpu_reservation_t *resv = file->reservation;  // Cannot change while allocating
+    pthread_mutex_unlock(&file->mutex);
+    
+    printf("Allocating GPU memory for %s with size %zu bytes\n", file->path, size);
+    
+    // Reserved memory was charged to the reserving cgroup already
+    gpu_cgroup_t *cgroup = NULL;
+    if (!resv) {
+        // Prefetched restores have no caller and are charged to the root
+        struct fuse_context *fctx = fuse_get_context();
+        cgroup = gpu_cgroup_of_pid(&g_gpu_ctx->cgroups, fctx ? fctx->pid : 0);
+        if (!cgroup) {
+            pthread_mutex_lock(&file->mutex);
+            file->allocating = false;
+            return -ENOMEM;
+        }
+    }
+    
+    // Draw from the file's reservation, or admit the request against the
+    // device capacity, queueing if configured
+    struct timespec ts;
+    const struct timespec *deadline = gpu_admit_deadline(&g_gpu_ctx->admit, &ts);
+    int rc = gpu_fuse_charge(resv, cgroup, size, priority, deadline);
+    if (rc != 0) {
+        printf("Admission of %zu bytes for %s failed\n", size, file->path);
+        pthread_mutex_lock(&file->mutex);
+        file->allocating = false;
+        return rc;
+    }
+    
+    gpu_version_t *version = calloc(1, sizeof(gpu_version_t));
+    if (!version) {
+        gpu_fuse_uncharge(resv, cgroup, size);
+        pthread_mutex_lock(&file->mutex);
+        file->allocating = false;
+        return -ENOMEM;
+    }
+    
+    // Run the driver work through the fair scheduler on behalf of the caller
+    char tenant[GPU_SCHED_TENANT_LEN];
+    gpu_fuse_tenant(tenant, sizeof(tenant));
+    
+    gpu_fuse_alloc_work_t work = { .size = size };
+    for (;;) {
+        uint64_t gen = gpu_admit_generation(&g_gpu_ctx->admit);
+        gpu_sched_run(&g_gpu_ctx->sched, tenant, 1, gpu_fuse_alloc_work, &work);
+        // Memory used outside the daemon can fill the device even though the
+        // request was admitted; in wait mode retry after the next release.
+        // The wait happens here so it never occupies a scheduler worker.
+        if (work.result != CUDA_ERROR_OUT_OF_MEMORY || deadline == NULL ||
+            gpu_admit_wait_release(&g_gpu_ctx->admit, gen, deadline) != 0) {
+            break;
+        }
+    }
+    rc = work.rc;
+    
+    pthread_mutex_lock(&file->mutex);
+    file->allocating = false;
+    
+    if (rc != 0) {
+        gpu_fuse_uncharge(resv, cgroup, size);
+        free(version);
+        return rc;
+    }
+    
+    version->refcount = 1;
+    version->seq = file->next_seq++;
+    version->gpu_handle = work.gpu_handle;
+    memcpy(&version->fabric_handle, &work.fabric_handle, sizeof(CUmemFabricHandle));
+    version->size = size;
+    version->fence = work.fence;
+    version->fence_handle = work.fence_handle;
+    version->reservation = resv;
+    version->cgroup = cgroup;
+    if (resv) {
+        gpu_resv_hold(g_gpu_ctx, resv);
+    }
+    file->modify_time = time(NULL);  // Update modification time
+    
+    printf("GPU memory allocated for %s: version=%llu, size=%zu, handle=%llu\n", file->path,
+           (unsigned long long)version->seq, size, (unsigned long long)version->gpu_handle);
+    *out = version;
+    return 0;
+}
+
+// Load the contents of a file restored from a checkpoint. Callers that need
+// the memory (demand) block until their own file is in; the prefetch thread
+// works through the others in the background. Returns 0 once the file has
+// no pending restore, or the error of this attempt, leaving it pending.
+static int gpu_fuse_rehydrate(gpu_file_t *file, bool demand)
+{
+    pthread_mutex_lock(&file->mutex);
+    if (demand && file->first_access == 0) {
+        // Rank for the prefetch order after the next restart
+        file->first_access = __atomic_add_fetch(&g_gpu_ctx->access_clock, 1, __ATOMIC_RELAXED);
+    }
+    while (file->restore && file->restore->running) {
+        pthread_cond_wait(&file->restore_cond, &file->mutex);  // Prefetch got there first
+    }
+    gpu_restore_t *restore = file->restore;
+    if (!restore) {
+        pthread_mutex_unlock(&file->mutex);
+        return 0;
+    }
+    restore->running = true;
+    const gpu_ckpt_record_t *rec = restore->rec;
+    
+    int64_t start = g_get_monotonic_time();
+    gpu_version_t *version = NULL;
+    int rc = gpu_fuse_allocate(file, rec->alloc_size, &version);
+    pthread_mutex_unlock(&file->mutex);
+    
+    if (rc == 0 && rec->length != 0) {
+        gpu_ingest_copy_t copy = {
+            .handle = version->gpu_handle,
+            .alloc_size = version->size,
+            .offset = rec->offset,
+            .length = rec->length,
+            .crcs = gpu_ckpt_crcs(&g_gpu_ctx->ckpt, rec),
+            .crc_chunk = rec->crc_chunk,
+        };
+        gpu_ingest_stats_t stats;
+        if (demand) {
+            __atomic_add_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);  // A client waits
+        }
+        rc = gpu_xfer_read(&g_gpu_ctx->xfer, g_gpu_ctx->ckpt_fd, &copy, 1,
+                           g_gpu_ctx->opts.ingest_threads, &stats);
+        if (demand) {
+            __atomic_sub_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&g_gpu_ctx->restore_verified, stats.verified, __ATOMIC_RELAXED);
+    }
+    
+    pthread_mutex_lock(&file->mutex);
+    restore->running = false;
+    gpu_version_t *unused = rc == 0 ? NULL : version;
+    if (rc == 0) {
+        if (file->current == NULL) {
+            file->current = version;
+        } else {
+            unused = version;  // Replaced while loading
+        }
+        file->restore = NULL;
+        free(restore);
+    }
+    pthread_cond_broadcast(&file->restore_cond);
+    pthread_mutex_unlock(&file->mutex);
+    if (unused) {
+        gpu_fuse_version_put(unused);
+    }
+    
+    if (rc == 0) {
+        __atomic_sub_fetch(&g_gpu_ctx->restore_pending, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(demand ? &g_gpu_ctx->restored_demand : &g_gpu_ctx->restored_prefetch,
+                           1, __ATOMIC_RELAXED);
+        printf("Rehydrated %s (%llu bytes, %s) in %lld us\n", file->path,
+               (unsigned long long)rec->length, demand ? "on demand" : "prefetch",
+               (long long)(g_get_monotonic_time() - start));
+    } else {
+        __atomic_add_fetch(&g_gpu_ctx->restore_errors, 1, __ATOMIC_RELAXED);
+        printf("Rehydrating %s failed: %s\n", file->path, strerror(-rc));
+    }
+    return rc;
+}
+
+// FUSE truncate - allocate/deallocate GPU memory based on size
+static int gpu_fuse_truncate_file(gpu_file_t *file, const char *path, off_t size)
+{
+    if (size != 0) {
+        // A restored file keeps its checkpointed size
+        int rc = gpu_fuse_rehydrate(file, true);
+        if (rc != 0) {
+            return rc;
+        }
     }
     
     pthread_mutex_lock(&file->mutex);
     
     if (size == 0) {
-        // Truncate to 0 - deallocate GPU memory if allocated
-        if (file->gpu_handle != 0) {
+        // The checkpointed contents are not needed any more
+        while (file->restore && file->restore->running) {
+            pthread_cond_wait(&file->restore_cond, &file->mutex);
+        }
+        if (file->restore) {
+            free(file->restore);
+            file->restore = NULL;
+            __atomic_sub_fetch(&g_gpu_ctx->restore_pending, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+    if (file->allocating) {
+        pthread_mutex_unlock(&file->mutex);
+        return -EBUSY;  // An allocation is in flight
+    }
+    
+    if (size == 0) {
+        // Truncate to 0 - drop the current version; readers that have it
+        // pinned keep its memory until they close
+        gpu_fuse_unshare_locked(file);
+        gpu_version_t *old = file->current;
+        file->current = NULL;
+        file->ready = false;
+        file->modify_time = time(NULL);  // Update modification time
+        pthread_mutex_unlock(&file->mutex);
+        
+        if (old) {
             printf("Deallocating GPU memory for %s\n", path);
-            CUresult result = cuMemRelease(file->gpu_handle);
-            if (result != CUDA_SUCCESS) {
-                printf("cuMemRelease failed: %d\n", result);
-                pthread_mutex_unlock(&file->mutex);
+            if (gpu_fuse_version_put(old) != 0) {
                 return -EIO;
             }
-            file->gpu_handle = 0;
         }
-        file->size = 0;
-        file->modify_time = time(NULL);  // Update modification time
-        pthread_mutex_unlock(&file->mutex);
         printf("File %s truncated to 0 (GPU memory deallocated)\n", path);
         return 0;
     }
     
-    if (file->size == 0 && file->gpu_handle == 0) {
+    int rc = 0;
+    if (file->current == NULL) {
         // This is a new allocation - create GPU memory
-        printf("Allocating GPU memory for %s with size %ld bytes\n", path, size);
-        
-        // Setup allocation properties
-        CUmemAllocationProp props = {};
-        props.type = CU_MEM_ALLOCATION_TYPE_PINNED;
-        props.location.type = CU_MEM_LOCATION_TYPE_DEVICE;
-        props.location.id = g_gpu_ctx->cuda_device;
-        props.requestedHandleTypes = CU_MEM_HANDLE_TYPE_FABRIC;
-        
-        CUmemGenericAllocationHandle gpu_handle;
-        CUresult result = cuMemCreate(&gpu_handle, size, &props, 0);
-        if (result != CUDA_SUCCESS) {
-            printf("cuMemCreate failed: %d\n", result);
-            pthread_mutex_unlock(&file->mutex);
-            return -ENOMEM;
-        }
-
-        CUmemFabricHandle fabricHandle;
-        result = cuMemExportToShareableHandle((void *)&fabricHandle, gpu_handle, CU_MEM_HANDLE_TYPE_FABRIC, 0);
-        if (result != CUDA_SUCCESS) {
-            printf("cuMemExportToShareableHandle failed: %d\n", result);
-            pthread_mutex_unlock(&file->mutex);
-            return -ENOMEM;
+        gpu_version_t *version;
+        rc = gpu_fuse_allocate(file, size, &version);
+        if (rc == 0) {
+            file->current = version;
+            file->ready = false;  // Producer publishes via user.gpu.ready
         }
-
-        memcpy(&file->fabric_handle, &fabricHandle, sizeof(CUmemFabricHandle));
-        file->gpu_handle = gpu_handle;
-        file->size = size;
-        file->modify_time = time(NULL);  // Update modification time
-        
-        printf("GPU memory allocated for %s: size=%zu, handle=%llu\n", 
-               path, file->size, (unsigned long long)file->gpu_handle);
-    } else if (file->size != (size_t)size) {
+    } else if (file->current->size != (size_t)size) {
         // Resize not supported
         printf("Resize not supported for %s (current: %zu, requested: %ld)\n", 
-               path, file->size, size);
-        pthread_mutex_unlock(&file->mutex);
-        return -ENOTSUP;
+               path, file->current->size, size);
+        rc = -ENOTSUP;
     } else {
         printf("File %s already has size %ld\n", path, size);
     }
     
     pthread_mutex_unlock(&file->mutex);
-    return 0;
+    return rc;
 }
 
-// FUSE init - initialize filesystem
-static void *gpu_fuse_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+static int gpu_fuse_truncate(const char *path, off_t size, struct fuse_file_info *fi)
 {
-    UNUSED(conn);
-    UNUSED(cfg);
+    UNUSED(fi);
     
-    printf("GPU Memory FUSE filesystem initialized\n");
+    printf("gpu_fuse_truncate called: path=%s, size=%ld\n", path, size);
+    
+    if (size < 0) {
+        return -EINVAL;
+    }
+    
+    // Get the file
+    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
+    if (!file) {
+        return -ENOENT;  // File doesn't exist
+    }
+    
+    int rc = gpu_fuse_truncate_file(file, path, size);
+    gpu_fuse_put_file(file);
+    return rc;
+}
+
+// Describe a file in a checkpoint record (file->mutex held)
+static void gpu_fuse_ckpt_record_locked(gpu_file_t *file, gpu_ckpt_record_t *rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->path, sizeof(rec->path), "%s", file->path);
+    rec->flags = (file->ready ? GPU_CKPT_READY : 0) | (file->durable ? GPU_CKPT_DURABLE : 0);
+    rec->priority = file->priority;
+    snprintf(rec->dtype, sizeof(rec->dtype), "%s", file->dtype);
+    snprintf(rec->shape, sizeof(rec->shape), "%s", file->shape);
+    rec->first_access = file->first_access;
+    if (file->current) {
+        rec->seq = file->current->seq;
+        rec->alloc_size = file->current->size;
+    } else if (file->restore) {
+        rec->seq = file->restore->rec->seq;
+        rec->alloc_size = file->restore->rec->alloc_size;
+    }
+}
+
+// Throttle of checkpoint chunks, arg is the rate of background checkpoints
+// or NULL. Background checkpoints yield to foreground copies (ingest,
+// on-demand restores): every chunk that sees one in flight halves the
+// rate, every chunk that does not raises it again.
+static void gpu_fuse_ckpt_throttle(size_t bytes, void *arg)
+{
+    gpu_rate_t *rate = arg;
+    if (rate) {
+        if (__atomic_load_n(&g_gpu_ctx->fg_active, __ATOMIC_RELAXED) > 0) {
+            gpu_rate_backoff(rate);
+        } else {
+            gpu_rate_recover(rate);
+        }
+        gpu_rate_take(rate, bytes);
+    }
+    __atomic_add_fetch(&g_gpu_ctx->ckpt_job.done, bytes, __ATOMIC_RELAXED);
+}
+
+static void gpu_fuse_ckpt_job_state(gpu_fuse_ckpt_state_t state, int rc)
+{
+    gpu_fuse_ckpt_job_t *job = &g_gpu_ctx->ckpt_job;
+    pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+    job->state = state;
+    if (state == GPU_FUSE_CKPT_IDLE) {
+        job->elapsed_us = g_get_monotonic_time() - job->start_us;
+        job->rc = rc;
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+}
+
+// Save every directory and every durable file to the checkpoint container.
+// Each file is copied from the version current when the checkpoint reaches
+// it, so producers that publish new versions instead of writing in place
+// always leave a consistent copy. The copies go to the host tier, and the
+// caller only waits for them; the container is written in the background
+// unless wait is set. Files not rehydrated since the restart are copied
+// from the container they were restored from. Background checkpoints are
+// held to the ckpt_bw bandwidth.
+static int gpu_fuse_checkpoint(bool wait, bool background)
+{
+    const char *path = g_gpu_ctx->opts.checkpoint;
+    if (!path || !g_gpu_ctx->tier_started) {
+        return -EINVAL;  // No checkpoint=PATH given
+    }
+    
+    pthread_mutex_lock(&g_gpu_ctx->ckpt_mutex);
+    int64_t start = g_get_monotonic_time();
+    
+    GPtrArray *dirs = g_ptr_array_new_with_free_func(free);
+    GPtrArray *files = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer key, value;
+    uint64_t total = 0;
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    g_hash_table_iter_init(&iter, g_gpu_ctx->dirs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (strcmp(key, "/") != 0) {
+            g_ptr_array_add(dirs, strdup(key));
+        }
+    }
+    g_hash_table_iter_init(&iter, g_gpu_ctx->files);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        gpu_file_t *file = value;
+        pthread_mutex_lock(&file->mutex);
+        if (file->durable) {
+            file->refcount++;
+            g_ptr_array_add(files, file);
+            if (file->current) {
+                total += file->current->size;
+            } else if (file->restore) {
+                total += file->restore->rec->length;
+            }
+        }
+        pthread_mutex_unlock(&file->mutex);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    g_ptr_array_sort(dirs, gpu_fuse_compare_path_len);  // Parents first
+    
+    pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+    gpu_fuse_ckpt_job_t *job = &g_gpu_ctx->ckpt_job;
+    job->id++;
+    job->background = background;
+    job->state = GPU_FUSE_CKPT_COPYING;
+    job->total = total;  // Estimate, files may change while they are copied
+    __atomic_store_n(&job->done, 0, __ATOMIC_RELAXED);
+    job->start_us = start;
+    pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+    
+    gpu_tier_t *tier = &g_gpu_ctx->tier;
+    gpu_ckpt_record_t rec;
+    uint64_t bytes = 0;
+    int rc = 0;
+    gpu_tier_begin(tier, path, gpu_fuse_ckpt_throttle,
+                   background ? &g_gpu_ctx->ckpt_rate : NULL);
+    for (guint i = 0; i < dirs->len; i++) {
+        memset(&rec, 0, sizeof(rec));
+        snprintf(rec.path, sizeof(rec.path), "%s", (const char *)g_ptr_array_index(dirs, i));
+        rec.flags = GPU_CKPT_DIR;
+        gpu_tier_add(tier, &rec);
+    }
+    for (guint i = 0; i < files->len && rc == 0; i++) {
+        gpu_file_t *file = g_ptr_array_index(files, i);
+        pthread_mutex_lock(&file->mutex);
+        gpu_fuse_ckpt_record_locked(file, &rec);
+        gpu_version_t *version = file->current ? gpu_fuse_version_get(file->current) : NULL;
+        // Records of the open checkpoint live until shutdown
+        const gpu_ckpt_record_t *pending = !version && file->restore ? file->restore->rec : NULL;
+        pthread_mutex_unlock(&file->mutex);
+        
+        if (pending) {
+            gpu_tier_copy_from(tier, &rec, &g_gpu_ctx->ckpt, pending);
+        } else if (!version) {
+            gpu_tier_add(tier, &rec);
+        } else {
+            rc = gpu_tier_copy(tier, &rec, version->gpu_handle, version->size, version->size);
+            bytes += version->size;
+            gpu_fuse_version_put(version);
+        }
+    }
+    uint64_t ticket = gpu_tier_end(tier, rc);
+    
+    if (rc == 0) {
+        printf("Checkpoint %s: %u files, %u directories, %llu bytes copied to host in %lld us\n",
+               path, files->len, dirs->len, (unsigned long long)bytes,
+               (long long)(g_get_monotonic_time() - start));
+    } else {
+        printf("Checkpoint %s failed: %s\n", path, strerror(-rc));
+    }
+    gpu_fuse_put_files(files);
+    g_ptr_array_free(dirs, TRUE);
+    if (rc == 0 && wait) {
+        gpu_fuse_ckpt_job_state(GPU_FUSE_CKPT_WRITING, 0);
+        rc = gpu_tier_wait(tier, ticket);
+    }
+    gpu_fuse_ckpt_job_state(GPU_FUSE_CKPT_IDLE, rc);
+    pthread_mutex_unlock(&g_gpu_ctx->ckpt_mutex);
+    return rc;
+}
+
+// Take a background checkpoint every ckpt_interval seconds. Each one waits
+// for its container to be written, so they never pile up in the host tier.
+static void *gpu_fuse_ckpt_thread(void *arg)
+{
+    UNUSED(arg);
+    
+    pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+    while (!g_gpu_ctx->ckpt_stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += g_gpu_ctx->opts.ckpt_interval;
+        int rc = 0;
+        while (!g_gpu_ctx->ckpt_stop && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&g_gpu_ctx->job_cond, &g_gpu_ctx->job_mutex, &ts);
+        }
+        if (g_gpu_ctx->ckpt_stop) {
+            break;
+        }
+        pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+        gpu_fuse_checkpoint(true, true);
+        pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
     return NULL;
 }
 
-// FUSE utimens - set file timestamps
-static int gpu_fuse_utimens(const char *path, const struct timespec ts[2], struct fuse_file_info *fi) {
-    UNUSED(fi);
+// Verify every payload of the checkpoint container against its checksums.
+// The container is opened on its own, so checkpoints taken meanwhile
+// replace the file without disturbing the scrub.
+static void *gpu_fuse_scrub_thread(void *arg)
+{
+    UNUSED(arg);
     
-    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
-    if (!file) {
+    const char *path = g_gpu_ctx->opts.checkpoint;
+    gpu_ckpt_reader_t reader;
+    int rc = gpu_ckpt_open(&reader, path);
+    if (rc == 0) {
+        rc = gpu_ckpt_scrub(&reader, g_gpu_ctx->opts.ingest_threads, &g_gpu_ctx->scrub_stop,
+                            &g_gpu_ctx->scrub_stats);
+        gpu_ckpt_close(&reader);
+    }
+    
+    gpu_ckpt_scrub_stats_t *stats = &g_gpu_ctx->scrub_stats;
+    if (rc == -EIO) {
+        printf("Scrub of %s: %llu of %llu payloads corrupt, first %s\n", path,
+               (unsigned long long)stats->errors,
+               (unsigned long long)(stats->errors + stats->records), stats->first_error);
+    } else if (rc != 0) {
+        printf("Scrub of %s failed: %s\n", path, strerror(-rc));
+    } else {
+        printf("Scrub of %s: %llu payloads, %llu bytes verified in %lld us\n", path,
+               (unsigned long long)stats->records, (unsigned long long)stats->bytes,
+               (long long)stats->elapsed_us);
+    }
+    
+    pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+    g_gpu_ctx->scrub_rc = rc;
+    g_gpu_ctx->scrub_running = false;
+    pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+    return NULL;
+}
+
+// Start a scrub unless one is running
+static int gpu_fuse_scrub_start(void)
+{
+    if (!g_gpu_ctx->opts.checkpoint) {
         return -ENOENT;
     }
+    pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+    if (g_gpu_ctx->scrub_running) {
+        pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+        return -EBUSY;
+    }
+    if (g_gpu_ctx->scrub_started) {
+        pthread_join(g_gpu_ctx->scrub_thread, NULL);  // Already finished
+        g_gpu_ctx->scrub_started = false;
+    }
+    memset(&g_gpu_ctx->scrub_stats, 0, sizeof(g_gpu_ctx->scrub_stats));
+    __atomic_store_n(&g_gpu_ctx->scrub_stop, false, __ATOMIC_RELAXED);
+    g_gpu_ctx->scrub_start_us = g_get_monotonic_time();
+    g_gpu_ctx->scrub_running = true;
+    int rc = 0;
+    if (pthread_create(&g_gpu_ctx->scrub_thread, NULL, gpu_fuse_scrub_thread, NULL) == 0) {
+        g_gpu_ctx->scrub_started = true;
+    } else {
+        g_gpu_ctx->scrub_running = false;
+        rc = -EAGAIN;
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+    return rc;
+}
+
+static gint gpu_fuse_compare_first_access(gconstpointer a, gconstpointer b)
+{
+    const gpu_file_t *fa = *(gpu_file_t * const *)a;
+    const gpu_file_t *fb = *(gpu_file_t * const *)b;
+    if (fa->first_access == 0 || fb->first_access == 0) {
+        return (fa->first_access == 0) - (fb->first_access == 0);  // Never used go last
+    }
+    return fa->first_access < fb->first_access ? -1 : fa->first_access > fb->first_access;
+}
+
+// Restore pending files ahead of use, in the order they were first used
+// before the checkpoint. Holds a reference on every file in the list.
+static void *gpu_fuse_prefetch_thread(void *arg)
+{
+    GPtrArray *files = arg;
+    int64_t start = g_get_monotonic_time();
+    
+    for (guint i = 0; i < files->len; i++) {
+        gpu_file_t *file = g_ptr_array_index(files, i);
+        if (!__atomic_load_n(&g_gpu_ctx->prefetch_stop, __ATOMIC_RELAXED)) {
+            int rc = gpu_fuse_rehydrate(file, false);
+            if (rc != 0) {
+                printf("Prefetch of %s failed: %s\n", file->path, strerror(-rc));
+            }
+        }
+        gpu_fuse_put_file(file);
+    }
+    printf("Prefetch finished in %lld us, %llu files restored on demand\n",
+           (long long)(g_get_monotonic_time() - start), (unsigned long long)
+           __atomic_load_n(&g_gpu_ctx->restored_demand, __ATOMIC_RELAXED));
+    g_ptr_array_free(files, TRUE);
+    return NULL;
+}
+
+// Recreate the namespace saved in the checkpoint container. Runs from
+// init; only metadata is loaded, so the mount is usable right away. File
+// contents stay in the container until first use (gpu_fuse_rehydrate) or
+// until the prefetch thread gets to them.
+static int gpu_fuse_restore(void)
+{
+    const char *path = g_gpu_ctx->opts.checkpoint;
+    if (!path) {
+        return 0;
+    }
+    
+    int64_t start = g_get_monotonic_time();
+    gpu_ckpt_reader_t *reader = &g_gpu_ctx->ckpt;
+    int rc = gpu_ckpt_open(reader, path);
+    if (rc == -ENOENT) {
+        printf("No checkpoint at %s, starting empty\n", path);
+        return 0;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Failed to open checkpoint %s: %s\n", path, strerror(-rc));
+        return rc;
+    }
+    for (uint64_t i = 0; i < reader->header.count; i++) {
+        if (reader->records[i].flags & GPU_CKPT_ZLIB) {
+            // Compressed payloads cannot be read in place on demand
+            fprintf(stderr, "%s is an export bundle, import it with user.gpu.import\n", path);
+            gpu_ckpt_close(reader);
+            return -EINVAL;
+        }
+    }
+    // Opened once, so a later checkpoint replacing the file does not
+    // change what pending files are restored from
+    g_gpu_ctx->ckpt_fd = gpu_ingest_open(path);
+    if (g_gpu_ctx->ckpt_fd < 0) {
+        rc = g_gpu_ctx->ckpt_fd;
+        fprintf(stderr, "Failed to open checkpoint %s: %s\n", path, strerror(-rc));
+        return rc;
+    }
+    
+    GPtrArray *dirs = g_ptr_array_new();
+    for (uint64_t i = 0; i < reader->header.count; i++) {
+        if (reader->records[i].flags & GPU_CKPT_DIR) {
+            g_ptr_array_add(dirs, reader->records[i].path);
+        }
+    }
+    g_ptr_array_sort(dirs, gpu_fuse_compare_path_len);  // Parents first
+    
+    GPtrArray *pending = g_ptr_array_new();
+    uint64_t clock = 0;
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    for (guint i = 0; i < dirs->len; i++) {
+        const char *dir = g_ptr_array_index(dirs, i);
+        if (gpu_fuse_parent_is_dir_locked(dir) && !g_hash_table_contains(g_gpu_ctx->dirs, dir)) {
+            gpu_fuse_add_dir_locked(dir);
+        }
+    }
+    for (uint64_t i = 0; i < reader->header.count; i++) {
+        const gpu_ckpt_record_t *rec = &reader->records[i];
+        if (rec->flags & GPU_CKPT_DIR) {
+            continue;
+        }
+        
+        gpu_file_t *file = NULL;
+        if (gpu_fuse_parent_is_dir_locked(rec->path) &&
+            !g_hash_table_contains(g_gpu_ctx->files, rec->path) &&
+            !g_hash_table_contains(g_gpu_ctx->dirs, rec->path)) {
+            file = gpu_fuse_new_file(rec->path);
+        }
+        if (!file) {
+            printf("Skipping %s from checkpoint\n", rec->path);
+            continue;
+        }
+        
+        // Published files come back published; fetching the handle waits
+        // for the contents
+        file->ready = (rec->flags & GPU_CKPT_READY) != 0;
+        file->durable = (rec->flags & GPU_CKPT_DURABLE) != 0;
+        file->priority = rec->priority;
+        file->next_seq = rec->seq ? rec->seq : 1;  // Version numbers carry on
+        file->first_access = rec->first_access;
+        clock = MAX(clock, rec->first_access);
+        snprintf(file->dtype, sizeof(file->dtype), "%s", rec->dtype);
+        snprintf(file->shape, sizeof(file->shape), "%s", rec->shape);
+        if (rec->alloc_size != 0) {
+            file->restore = calloc(1, sizeof(gpu_restore_t));
+            if (!file->restore) {
+                // Leave it out rather than bring it back empty
+                printf("Out of memory restoring %s, skipped\n", rec->path);
+                __atomic_add_fetch(&g_gpu_ctx->restore_errors, 1, __ATOMIC_RELAXED);
+                gpu_fuse_free_file(file);
+                continue;
+            }
+            file->restore->rec = rec;
+            file->refcount++;  // Held by the prefetch list
+            g_ptr_array_add(pending, file);
+        }
+        g_hash_table_insert(g_gpu_ctx->files, strdup(rec->path), file);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    g_ptr_array_free(dirs, TRUE);
+    
+    __atomic_store_n(&g_gpu_ctx->access_clock, clock, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_gpu_ctx->restore_pending, pending->len, __ATOMIC_RELAXED);
+    printf("Restored namespace of %llu records from %s in %lld us, %u files pending\n",
+           (unsigned long long)reader->header.count, path,
+           (long long)(g_get_monotonic_time() - start), pending->len);
+    
+    // Stable, so files never used keep their order in the container
+    g_ptr_array_sort(pending, gpu_fuse_compare_first_access);
+    if (pthread_create(&g_gpu_ctx->prefetch_thread, NULL, gpu_fuse_prefetch_thread,
+                       pending) == 0) {
+        g_gpu_ctx->prefetch_started = true;
+    } else {
+        // Everything is restored on demand instead
+        gpu_fuse_put_files(pending);
+    }
+    return 0;
+}
+
+// FUSE init - initialize filesystem
+// CUDA is set up here rather than in main() because fuse_main() forks when
+// not run in the foreground, and CUDA state and threads do not survive that.
+static void *gpu_fuse_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    UNUSED(conn);
+    UNUSED(cfg);
+    
+    if (gpu_fuse_init_cuda(g_gpu_ctx) != 0) {
+        fprintf(stderr, "Failed to initialize CUDA\n");
+        goto fail;
+    }
+    if (gpu_fuse_init_admission(g_gpu_ctx) != 0) {
+        goto fail;
+    }
+    if (gpu_sched_init(&g_gpu_ctx->sched, g_gpu_ctx->opts.sched_threads) != 0) {
+        fprintf(stderr, "Failed to start %u scheduler threads\n", g_gpu_ctx->opts.sched_threads);
+        gpu_admit_destroy(&g_gpu_ctx->admit);
+        goto fail;
+    }
+    
+    // Optional: without the writer, full trace buffers are written inline
+    if (g_gpu_ctx->trace_open && gpu_trace_start(&g_gpu_ctx->trace) != 0) {
+        fprintf(stderr, "Failed to start the trace writer\n");
+    }
+    
+    // Optional: without the pool removed trees are released inline
+    g_gpu_ctx->release_pool = g_thread_pool_new(gpu_fuse_release_batch, NULL,
+                                                GPU_FUSE_RELEASE_THREADS, FALSE, NULL);
+    
+    g_gpu_ctx->started = true;
+    gpu_xfer_backend_t xfer = GPU_XFER_AUTO;
+    if (g_gpu_ctx->opts.xfer &&
+        (gpu_xfer_parse(g_gpu_ctx->opts.xfer, &xfer) != 0 || xfer == GPU_XFER_HOST)) {
+        // host only serves gpu_xfer_bench, the daemon always has a device
+        fprintf(stderr, "Invalid xfer: %s (auto, cuda or gds)\n", g_gpu_ctx->opts.xfer);
+        fuse_exit(fuse_get_context()->fuse);
+        return NULL;
+    }
+    int xfer_rc = gpu_xfer_init(&g_gpu_ctx->xfer, xfer, g_gpu_ctx->device);
+    if (xfer_rc != 0) {
+        fprintf(stderr, "Failed to set up %s transfers: %s\n", gpu_xfer_name(xfer),
+                strerror(-xfer_rc));
+        fuse_exit(fuse_get_context()->fuse);
+        return NULL;
+    }
+    g_gpu_ctx->xfer_started = true;
+    printf("Restores and ingest use %s transfers\n", gpu_xfer_name(g_gpu_ctx->xfer.backend));
+    if (g_gpu_ctx->opts.checkpoint) {
+        size_t ckpt_host = GPU_FUSE_CKPT_HOST;
+        if (g_gpu_ctx->opts.ckpt_host &&
+            gpu_fuse_parse_size(g_gpu_ctx->opts.ckpt_host, &ckpt_host) != 0) {
+            fprintf(stderr, "Invalid ckpt_host: %s\n", g_gpu_ctx->opts.ckpt_host);
+            fuse_exit(fuse_get_context()->fuse);
+            return NULL;
+        }
+        size_t ckpt_bw = GPU_FUSE_CKPT_BW;
+        if (g_gpu_ctx->opts.ckpt_bw &&
+            gpu_fuse_parse_size(g_gpu_ctx->opts.ckpt_bw, &ckpt_bw) != 0) {
+            fprintf(stderr, "Invalid ckpt_bw: %s\n", g_gpu_ctx->opts.ckpt_bw);
+            fuse_exit(fuse_get_context()->fuse);
+            return NULL;
+        }
+        if (gpu_tier_init(&g_gpu_ctx->tier, g_gpu_ctx->device, ckpt_host) != 0) {
+            fprintf(stderr, "Failed to set up the checkpoint host tier\n");
+            fuse_exit(fuse_get_context()->fuse);
+            return NULL;
+        }
+        gpu_rate_init(&g_gpu_ctx->ckpt_rate, ckpt_bw, GPU_TIER_CHUNK);
+        g_gpu_ctx->tier_started = true;
+    }
+    if (gpu_fuse_restore() != 0) {
+        // Serving without the durable files would look like data loss
+        fuse_exit(fuse_get_context()->fuse);
+        return NULL;
+    }
+    if (g_gpu_ctx->tier_started && g_gpu_ctx->opts.ckpt_interval > 0) {
+        if (pthread_create(&g_gpu_ctx->ckpt_thread, NULL, gpu_fuse_ckpt_thread, NULL) == 0) {
+            g_gpu_ctx->ckpt_thread_started = true;
+        } else {
+            fprintf(stderr, "Failed to start periodic checkpoints\n");
+        }
+    }
+    printf("GPU Memory FUSE filesystem initialized\n");
+    return NULL;
+    
+fail:
+    if (g_gpu_ctx->devices) {
+        gpu_device_release_all(g_gpu_ctx->devices, g_gpu_ctx->ndevices);
+        g_gpu_ctx->devices = NULL;
+        g_gpu_ctx->ndevices = 0;
+        g_gpu_ctx->device = NULL;
+    }
+    fuse_exit(fuse_get_context()->fuse);
+    return NULL;
+}
+
+// FUSE utimens - set file timestamps
+static int gpu_fuse_utimens(const char *path, const struct timespec ts[2], struct fuse_file_info *fi) {
+    UNUSED(fi);
+    
+    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
+    if (!file) {
+        return -ENOENT;
+    }
+    
+    pthread_mutex_lock(&file->mutex);
+    
+    // ts[0] is access time, ts[1] is modification time
+    if (ts) {
+        if (ts[0].tv_nsec != UTIME_OMIT) {
+            file->access_time = ts[0].tv_sec;
+        }
+        if (ts[1].tv_nsec != UTIME_OMIT) {
+            file->modify_time = ts[1].tv_sec;
+        }
+    } else {
+        // If ts is NULL, set both times to current time
+        time_t current_time = time(NULL);
+        file->access_time = current_time;
+        file->modify_time = current_time;
+    }
+    
+    pthread_mutex_unlock(&file->mutex);
+    gpu_fuse_put_file(file);
+    
+    printf("Updated timestamps for %s\n", path);
+    return 0;
+}
+
+// Copy one version's contents into another of the same size on the device
+static int gpu_fuse_copy_version(const gpu_version_t *src, gpu_version_t *dst)
+{
+    gpu_device_t *dev = g_gpu_ctx->device;
+    CUdeviceptr from, to;
+    if (gpu_device_make_current(dev) != CUDA_SUCCESS ||
+        gpu_device_map(dev, src->gpu_handle, src->size, &from) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+    int rc = -EIO;
+    if (gpu_device_map(dev, dst->gpu_handle, dst->size, &to) == CUDA_SUCCESS) {
+        rc = cuMemcpyDtoD(to, from, src->size) == CUDA_SUCCESS ? 0 : -EIO;
+        gpu_device_unmap(to, dst->size);
+    }
+    gpu_device_unmap(from, src->size);
+    return rc;
+}
+
+// Give a file opened for writing its own copy of a version it still shares
+// with a snapshot, so kernels writing through its handle leave the other
+// side alone. The copy becomes the current version; handles opened earlier
+// keep the shared one.
+static int gpu_fuse_copy_on_write(gpu_file_t *file)
+{
+    pthread_mutex_lock(&file->mutex);
+    if (!file->shared) {
+        pthread_mutex_unlock(&file->mutex);
+        return 0;
+    }
+    if (__atomic_load_n(&file->current->sharers, __ATOMIC_RELAXED) == 1) {
+        gpu_fuse_unshare_locked(file);  // The other sides have moved on
+        pthread_mutex_unlock(&file->mutex);
+        return 0;
+    }
+    
+    gpu_version_t *shared = gpu_fuse_version_get(file->current);
+    uint64_t seq = shared->seq;
+    gpu_version_t *copy = NULL;
+    int rc = gpu_fuse_allocate(file, shared->size, &copy);
+    if (rc == 0) {
+        file->allocating = true;  // Fence off other mutators during the copy
+        pthread_mutex_unlock(&file->mutex);
+        rc = gpu_fuse_copy_version(shared, copy);
+        pthread_mutex_lock(&file->mutex);
+        file->allocating = false;
+    }
+    
+    gpu_version_t *unused = copy;  // Failed, or the file moved on meanwhile
+    if (rc == 0 && file->shared && file->current == shared) {
+        gpu_fuse_unshare_locked(file);
+        file->current = copy;
+        unused = shared;  // The file's reference
+    }
+    pthread_mutex_unlock(&file->mutex);
+    if (unused) {
+        gpu_fuse_version_put(unused);
+    }
+    gpu_fuse_version_put(shared);
+    if (rc == 0) {
+        printf("Copied shared version %llu of %s for writing\n", (unsigned long long)seq,
+               file->path);
+    }
+    return rc;
+}
+
+// FUSE open - open file for reading/writing
+static int gpu_fuse_open(const char *path, struct fuse_file_info *fi)
+{
+    printf("gpu_fuse_open called: path=%s, flags=%d\n", path, fi->flags);
+    
+    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
+    if (!file) {
+        return -ENOENT;
+    }
+    
+    // The pinned version must hold the checkpointed contents
+    int rc = gpu_fuse_rehydrate(file, true);
+    if (rc == 0 && (fi->flags & O_ACCMODE) != O_RDONLY) {
+        rc = gpu_fuse_copy_on_write(file);
+    }
+    if (rc == 0) {
+        gpu_fuse_pin_current(file, fi);
+    }
+    gpu_fuse_put_file(file);
+    return rc;
+}
+
+// FUSE release - drop the version pinned at open
+static int gpu_fuse_release(const char *path, struct fuse_file_info *fi)
+{
+    UNUSED(path);
+    
+    gpu_version_t *pinned = (gpu_version_t *)(uintptr_t)fi->fh;
+    if (pinned) {
+        fi->fh = 0;
+        gpu_fuse_version_put(pinned);
+    }
+    return 0;
+}
+
+// Copy an xattr value (not NUL-terminated) into a string buffer
+static int gpu_fuse_copy_value(const char *value, size_t size, char *buf, size_t buflen)
+{
+    if (size == 0 || size >= buflen) {
+        return -EINVAL;
+    }
+    memcpy(buf, value, size);
+    buf[size] = '\0';
+    return 0;
+}
+
+// Parse a boolean xattr value ("1"/"0", "true"/"false")
+static int gpu_fuse_parse_bool(const char *value, size_t size, bool *out)
+{
+    char buf[8];
+    if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0) {
+        return -EINVAL;
+    }
+    
+    if (strcmp(buf, "1") == 0 || strcmp(buf, "true") == 0) {
+        *out = true;
+    } else if (strcmp(buf, "0") == 0 || strcmp(buf, "false") == 0) {
+        *out = false;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// Parse a decimal integer xattr value
+static int gpu_fuse_parse_int(const char *value, size_t size, long *out)
+{
+    char buf[32];
+    if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0) {
+        return -EINVAL;
+    }
+    
+    char *end;
+    errno = 0;
+    *out = strtol(buf, &end, 10);
+    if (errno != 0 || end == buf || *end != '\0') {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// Return a string attribute following the getxattr size protocol
+static int gpu_fuse_reply_binary(char *value, size_t size, const void *data, size_t len)
+{
+    if (size == 0) {
+        return len;  // Caller is asking for the size of the attribute
+    }
+    if (size < len) {
+        return -ERANGE;  // Buffer too small
+    }
+    memcpy(value, data, len);
+    return len;
+}
+
+static int gpu_fuse_reply_string(char *value, size_t size, const char *str)
+{
+    return gpu_fuse_reply_binary(value, size, str, strlen(str));
+}
+
+// getxattr on the mount root - daemon-wide state
+static int gpu_fuse_getxattr_root(const char *name, char *value, size_t size)
+{
+    if (strcmp(name, "user.gpu.admission") == 0) {
+        gpu_admit_stats_t stats;
+        gpu_admit_get_stats(&g_gpu_ctx->admit, &stats);
+        
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+                 "capacity=%zu used=%zu waiting=%u queued=%llu timed_out=%llu\n",
+                 stats.capacity, stats.used, stats.waiting,
+                 (unsigned long long)stats.queued, (unsigned long long)stats.timed_out);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.reservations") == 0) {
+        GString *list = gpu_resv_format(g_gpu_ctx);
+        int rc = gpu_fuse_reply_string(value, size, list->str);
+        g_string_free(list, TRUE);
+        return rc;
+        
+    } else if (strcmp(name, "user.gpu.cgroups") == 0) {
+        GString *list = gpu_cgroup_format(&g_gpu_ctx->cgroups);
+        int rc = gpu_fuse_reply_string(value, size, list->str);
+        g_string_free(list, TRUE);
+        return rc;
+        
+    } else if (strcmp(name, "user.gpu.sched") == 0) {
+        GString *list = gpu_sched_format(&g_gpu_ctx->sched);
+        int rc = gpu_fuse_reply_string(value, size, list->str);
+        g_string_free(list, TRUE);
+        return rc;
+        
+    } else if (strcmp(name, "user.gpu.devices") == 0) {
+        GString *list = gpu_device_format(g_gpu_ctx->devices, g_gpu_ctx->ndevices);
+        int rc = gpu_fuse_reply_string(value, size, list->str);
+        g_string_free(list, TRUE);
+        return rc;
+        
+    } else if (strcmp(name, "user.gpu.release_pending") == 0) {
+        // Files of removed trees whose memory is still being released
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)
+                 __atomic_load_n(&g_gpu_ctx->release_pending, __ATOMIC_RELAXED));
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.ckpt_tier") == 0) {
+        // Host tier of checkpoints: memory held, backpressure and how long
+        // the last checkpoint paused callers versus how long it took to
+        // reach the disk
+        if (!g_gpu_ctx->tier_started) {
+            return -ENODATA;
+        }
+        gpu_tier_stats_t stats;
+        gpu_tier_get_stats(&g_gpu_ctx->tier, &stats);
+        char buf[384];
+        snprintf(buf, sizeof(buf),
+                 "capacity=%zu used=%zu peak=%zu queued=%u completed=%llu failed=%llu "
+                 "waits=%llu wait_us=%llu last_pause_us=%lld last_drain_us=%lld "
+                 "last_bytes=%llu\n",
+                 stats.capacity, stats.used, stats.peak, stats.queued,
+                 (unsigned long long)stats.completed, (unsigned long long)stats.failed,
+                 (unsigned long long)stats.waits, (unsigned long long)stats.wait_us,
+                 (long long)stats.last_pause_us, (long long)stats.last_drain_us,
+                 (unsigned long long)stats.last_bytes);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.ckpt_status") == 0) {
+        // Progress of the running or last checkpoint and the throttle state
+        if (!g_gpu_ctx->tier_started) {
+            return -ENODATA;
+        }
+        static const char *states[] = { "idle", "copying", "writing" };
+        gpu_rate_stats_t rate;
+        gpu_rate_get_stats(&g_gpu_ctx->ckpt_rate, &rate);
+        pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+        gpu_fuse_ckpt_job_t job = g_gpu_ctx->ckpt_job;
+        pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+        uint64_t done = __atomic_load_n(&g_gpu_ctx->ckpt_job.done, __ATOMIC_RELAXED);
+        int64_t elapsed = job.state == GPU_FUSE_CKPT_IDLE ? job.elapsed_us
+                                                           : g_get_monotonic_time() - job.start_us;
+        
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+                 "job=%llu state=%s background=%d done=%llu total=%llu elapsed_us=%lld "
+                 "bw=%llu limit=%llu rate=%llu backoffs=%llu throttled_us=%llu last_rc=%d "
+                 "interval=%u\n",
+                 (unsigned long long)job.id, states[job.state], job.background,
+                 (unsigned long long)done, (unsigned long long)job.total, (long long)elapsed,
+                 (unsigned long long)(elapsed > 0 ? done * 1000000 / (uint64_t)elapsed : 0),
+                 (unsigned long long)rate.max_rate, (unsigned long long)rate.rate,
+                 (unsigned long long)rate.backoffs, (unsigned long long)rate.throttled_us,
+                 job.rc, g_gpu_ctx->opts.ckpt_interval);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.restore") == 0) {
+        // Progress of the lazy restore from the checkpoint
+        char buf[192];
+        snprintf(buf, sizeof(buf),
+                 "pending=%llu demand=%llu prefetched=%llu verified=%llu errors=%llu\n",
+                 (unsigned long long)__atomic_load_n(&g_gpu_ctx->restore_pending, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&g_gpu_ctx->restored_demand, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&g_gpu_ctx->restored_prefetch,
+                                                     __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&g_gpu_ctx->restore_verified,
+                                                     __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&g_gpu_ctx->restore_errors,
+                                                     __ATOMIC_RELAXED));
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.xfer") == 0) {
+        // Transfer path of restores and ingest, and how much went each way
+        if (!g_gpu_ctx->xfer_started) {
+            return -ENODATA;
+        }
+        gpu_xfer_t *xfer = &g_gpu_ctx->xfer;
+        char buf[192];
+        snprintf(buf, sizeof(buf), "backend=%s direct_bytes=%llu bounce_bytes=%llu fallbacks=%llu\n",
+                 gpu_xfer_name(xfer->backend),
+                 (unsigned long long)__atomic_load_n(&xfer->direct_bytes, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&xfer->bounce_bytes, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&xfer->fallbacks, __ATOMIC_RELAXED));
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.trace") == 0) {
+        // Operation trace being recorded
+        if (!g_gpu_ctx->trace_open) {
+            return -ENODATA;
+        }
+        gpu_trace_t *trace = &g_gpu_ctx->trace;
+        char buf[MAX_PATH_LEN + 128];
+        pthread_mutex_lock(&trace->mutex);
+        snprintf(buf, sizeof(buf), "path=%s recorded=%llu dropped=%llu error=%d\n", trace->path,
+                 (unsigned long long)(trace->written + trace->fill + trace->pending),
+                 (unsigned long long)trace->dropped, trace->error);
+        pthread_mutex_unlock(&trace->mutex);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.scrub") == 0) {
+        // Progress of the running or last scrub of the checkpoint
+        pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+        bool running = g_gpu_ctx->scrub_running;
+        bool started = g_gpu_ctx->scrub_started;
+        int64_t start_us = g_gpu_ctx->scrub_start_us;
+        int last_rc = g_gpu_ctx->scrub_rc;
+        pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+        if (!started) {
+            return -ENODATA;
+        }
+        gpu_ckpt_scrub_stats_t *stats = &g_gpu_ctx->scrub_stats;
+        uint64_t bytes = __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+        int64_t elapsed = running ? g_get_monotonic_time() - start_us : stats->elapsed_us;
+        
+        char buf[256 + GPU_CKPT_PATH_LEN];
+        snprintf(buf, sizeof(buf),
+                 "state=%s records=%llu unchecked=%llu bytes=%llu errors=%llu elapsed_us=%lld "
+                 "bw=%llu last_rc=%d first_error=%s\n",
+                 running ? "running" : "idle",
+                 (unsigned long long)__atomic_load_n(&stats->records, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&stats->unchecked, __ATOMIC_RELAXED),
+                 (unsigned long long)bytes,
+                 (unsigned long long)__atomic_load_n(&stats->errors, __ATOMIC_RELAXED),
+                 (long long)elapsed,
+                 (unsigned long long)(elapsed > 0 ? bytes * 1000000 / (uint64_t)elapsed : 0),
+                 running ? 0 : last_rc, running ? "" : stats->first_error);
+        return gpu_fuse_reply_string(value, size, buf);
+    }
+    
+    return -ENODATA;  // Attribute not found
+}
+
+// Per-file attributes
+static int gpu_fuse_getxattr_file(gpu_file_t *file, const char *name, char *value, size_t size)
+{
+    if (strcmp(name, "user.fabric_handle") == 0 || strcmp(name, "user.allocation_size") == 0 ||
+        strcmp(name, "user.gpu.fence") == 0 || strcmp(name, "user.gpu.version") == 0 ||
+        strcmp(name, "user.gpu.cgroup") == 0) {
+        // Describe the allocation, so it has to exist
+        int rc = gpu_fuse_rehydrate(file, true);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    
+    pthread_mutex_lock(&file->mutex);
+    gpu_version_t *current = file->current;
+    
+    if (strcmp(name, "user.fabric_handle") == 0) {
+        // Return the fabric handle
+        if (current == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;  // No GPU allocation
+        }
+        
+        if (size == 0) {
+            // Caller is asking for the size of the attribute
+            pthread_mutex_unlock(&file->mutex);
+            return sizeof(CUmemFabricHandle);
+        }
+        
+        if (size < sizeof(CUmemFabricHandle)) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ERANGE;  // Buffer too small
+        }
+        
+        memcpy(value, &current->fabric_handle, sizeof(CUmemFabricHandle));
+        pthread_mutex_unlock(&file->mutex);
+        printf("Returned fabric handle via getxattr: %zu bytes\n", sizeof(CUmemFabricHandle));
+        return sizeof(CUmemFabricHandle);
+        
+    } else if (strcmp(name, "user.allocation_size") == 0) {
+        // Return the allocation size as a string
+        if (current == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;  // No GPU allocation
+        }
+        
+        char size_str[32];
+        int len = snprintf(size_str, sizeof(size_str), "%zu", current->size);
+        
+        if (size == 0) {
+            // Caller is asking for the size of the attribute
+            pthread_mutex_unlock(&file->mutex);
+            return len;
+        }
+        
+        if (size < (size_t)len + 1) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ERANGE;  // Buffer too small
+        }
+        
+        strcpy(value, size_str);
+        pthread_mutex_unlock(&file->mutex);
+        printf("Returned allocation size via getxattr: %s bytes\n", size_str);
+        return len;  
+        
+    } else if (strcmp(name, "user.gpu.fence") == 0) {
+        // Return the interprocess event handle of the allocation's fence
+        if (current == NULL || current->fence == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;  // No GPU allocation
+        }
+        
+        if (size == 0) {
+            pthread_mutex_unlock(&file->mutex);
+            return sizeof(CUipcEventHandle);
+        }
+        
+        if (size < sizeof(CUipcEventHandle)) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ERANGE;  // Buffer too small
+        }
+        
+        memcpy(value, &current->fence_handle, sizeof(CUipcEventHandle));
+        pthread_mutex_unlock(&file->mutex);
+        return sizeof(CUipcEventHandle);
+        
+    } else if (strcmp(name, "user.gpu.staged_fabric_handle") == 0 ||
+               strcmp(name, "user.gpu.staged_fence") == 0) {
+        // Handles of the staged version, for the producer filling it
+        if (file->staged == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;  // Nothing staged
+        }
+        bool fence = strcmp(name, "user.gpu.staged_fence") == 0;
+        int rc = fence ? gpu_fuse_reply_binary(value, size, &file->staged->fence_handle,
+                                               sizeof(CUipcEventHandle))
+                       : gpu_fuse_reply_binary(value, size, &file->staged->fabric_handle,
+                                               sizeof(CUmemFabricHandle));
+        pthread_mutex_unlock(&file->mutex);
+        return rc;
+        
+    } else if (strcmp(name, "user.gpu.version") == 0) {
+        // Number of the current version, changes on every publish
+        if (current == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;
+        }
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)current->seq);
+        pthread_mutex_unlock(&file->mutex);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.ready") == 0) {
+        // Return the publish state as "1" or "0"
+        bool ready = file->ready;
+        pthread_mutex_unlock(&file->mutex);
+        
+        if (size == 0) {
+            return 1;
+        }
+        value[0] = ready ? '1' : '0';
+        return 1;
+        
+    } else if (strcmp(name, "user.gpu.priority") == 0) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", file->priority);
+        pthread_mutex_unlock(&file->mutex);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.durable") == 0) {
+        bool durable = file->durable;
+        pthread_mutex_unlock(&file->mutex);
+        return gpu_fuse_reply_string(value, size, durable ? "1" : "0");
+        
+    } else if (strcmp(name, "user.gpu.dtype") == 0 || strcmp(name, "user.gpu.shape") == 0) {
+        // Tensor description, set by ingest or by the producer
+        if (file->dtype[0] == '\0') {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;  // Not a tensor
+        }
+        char buf[GPU_INGEST_SHAPE_LEN];
+        strcpy(buf, strcmp(name, "user.gpu.dtype") == 0 ? file->dtype : file->shape);
+        pthread_mutex_unlock(&file->mutex);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.reservation") == 0) {
+        if (file->reservation == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -ENODATA;  // Not bound to a reservation
+        }
+        char buf[GPU_RESV_NAME_LEN];
+        strcpy(buf, file->reservation->name);
+        pthread_mutex_unlock(&file->mutex);
+        return gpu_fuse_reply_string(value, size, buf);
+        
+    } else if (strcmp(name, "user.gpu.cgroup") == 0) {
+        // cgroup the current allocation is charged to
+        gpu_cgroup_t *cgroup = NULL;
+        if (current) {
+            cgroup = current->reservation ? current->reservation->cgroup : current->cgroup;
+        }
+        pthread_mutex_unlock(&file->mutex);
+        if (cgroup == NULL) {
+            return -ENODATA;
+        }
+        return gpu_fuse_reply_string(value, size, cgroup->path);
+    }
+    
+    pthread_mutex_unlock(&file->mutex);
+    return -ENODATA;  // Attribute not found
+}
+
+// Directory attributes
+static int gpu_fuse_getxattr_dir(const char *path, const char *name, char *value, size_t size)
+{
+    if (strcmp(name, "user.gpu.generation") == 0) {
+        // Bumped by every commit; readers compare it before and after
+        pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+        gpu_dir_t *dir = g_hash_table_lookup(g_gpu_ctx->dirs, path);
+        uint64_t generation = dir ? dir->generation : 0;
+        pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+        if (!dir) {
+            return -ENOENT;
+        }
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)generation);
+        return gpu_fuse_reply_string(value, size, buf);
+    }
+    
+    return -ENODATA;
+}
+
+// FUSE getxattr - get extended attributes
+static int gpu_fuse_getxattr(const char *path, const char *name, char *value, size_t size)
+{
+    printf("gpu_fuse_getxattr called: path=%s, name=%s, size=%zu\n", path, name, size);
+    
+    if (strcmp(path, "/") == 0) {
+        int rc = gpu_fuse_getxattr_root(name, value, size);
+        if (rc != -ENODATA) {
+            return rc;
+        }
+    }
+    if (gpu_fuse_is_dir(path)) {
+        return gpu_fuse_getxattr_dir(path, name, value, size);
+    }
+    
+    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
+    if (!file) {
+        return -ENOENT;
+    }
+    
+    int rc = gpu_fuse_getxattr_file(file, name, value, size);
+    gpu_fuse_put_file(file);
+    return rc;
+}
+
+// FUSE listxattr - list extended attributes
+static int gpu_fuse_listxattr(const char *path, char *list, size_t size)
+{
+    printf("gpu_fuse_listxattr called: path=%s, size=%zu\n", path, size);
+    
+    const char *attrs;
+    size_t attrs_len;
+    if (strcmp(path, "/") == 0) {
+        attrs = "user.gpu.admission\0user.gpu.reservations\0user.gpu.cgroups\0"
+                "user.gpu.sched\0user.gpu.devices\0user.gpu.generation\0"
+                "user.gpu.release_pending\0user.gpu.restore\0user.gpu.ckpt_tier\0"
+                "user.gpu.ckpt_status\0user.gpu.scrub\0user.gpu.xfer\0user.gpu.trace\0";
+        attrs_len = strlen("user.gpu.admission") + 1 +
+                    strlen("user.gpu.reservations") + 1 +
+                    strlen("user.gpu.cgroups") + 1 +
+                    strlen("user.gpu.sched") + 1 +
+                    strlen("user.gpu.devices") + 1 +
+                    strlen("user.gpu.generation") + 1 +
+                    strlen("user.gpu.release_pending") + 1 +
+                    strlen("user.gpu.restore") + 1 +
+                    strlen("user.gpu.ckpt_tier") + 1 +
+                    strlen("user.gpu.ckpt_status") + 1 +
+                    strlen("user.gpu.scrub") + 1 +
+                    strlen("user.gpu.xfer") + 1 +
+                    strlen("user.gpu.trace") + 1;
+    } else if (gpu_fuse_is_dir(path)) {
+        attrs = "user.gpu.generation\0";
+        attrs_len = strlen("user.gpu.generation") + 1;
+    } else {
+        gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
+        if (!file) {
+            return -ENOENT;
+        }
+        gpu_fuse_put_file(file);
+        
+        attrs = "user.fabric_handle\0user.allocation_size\0user.gpu.fence\0"
+                "user.gpu.ready\0user.gpu.priority\0user.gpu.reservation\0user.gpu.cgroup\0"
+                "user.gpu.durable\0user.gpu.version\0user.gpu.staged_fabric_handle\0"
+                "user.gpu.staged_fence\0user.gpu.dtype\0user.gpu.shape\0";
+        attrs_len = strlen("user.fabric_handle") + 1 + 
+                    strlen("user.allocation_size") + 1 +
+                    strlen("user.gpu.fence") + 1 +
+                    strlen("user.gpu.ready") + 1 +
+                    strlen("user.gpu.priority") + 1 +
+                    strlen("user.gpu.reservation") + 1 +
+                    strlen("user.gpu.cgroup") + 1 +
+                    strlen("user.gpu.durable") + 1 +
+                    strlen("user.gpu.version") + 1 +
+                    strlen("user.gpu.staged_fabric_handle") + 1 +
+                    strlen("user.gpu.staged_fence") + 1 +
+                    strlen("user.gpu.dtype") + 1 +
+                    strlen("user.gpu.shape") + 1;
+    }
+    
+    if (size == 0) {
+        // Caller is asking for the size needed
+        return attrs_len;
+    }
+    
+    if (size < attrs_len) {
+        return -ERANGE;  // Buffer too small
+    }
+    
+    memcpy(list, attrs, attrs_len);
+    printf("Listed %zu bytes of extended attribute names\n", attrs_len);
+    return attrs_len;
+}
+
+// setxattr on the mount root - daemon-wide control operations
+static int gpu_fuse_setxattr_root(const char *name, const char *value, size_t size)
+{
+    char buf[MAX_PATH_LEN];
+    if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0) {
+        return -EINVAL;
+    }
+    
+    if (strcmp(name, "user.gpu.reserve") == 0) {
+        // "name:SIZE[:prealloc]"
+        char *save;
+        char *resv_name = strtok_r(buf, ":", &save);
+        char *budget_str = strtok_r(NULL, ":", &save);
+        char *flag = strtok_r(NULL, ":", &save);
+        size_t budget;
+        if (!resv_name || !budget_str || gpu_fuse_parse_size(budget_str, &budget) != 0) {
+            return -EINVAL;
+        }
+        if (flag && strcmp(flag, "prealloc") != 0) {
+            return -EINVAL;
+        }
+        gpu_cgroup_t *cgroup = gpu_cgroup_of_pid(&g_gpu_ctx->cgroups, fuse_get_context()->pid);
+        if (!cgroup) {
+            return -ENOMEM;
+        }
+        return gpu_resv_create(g_gpu_ctx, resv_name, budget, flag != NULL, cgroup,
+                               fuse_get_context()->uid);
+        
+    } else if (strcmp(name, "user.gpu.unreserve") == 0) {
+        uid_t caller = fuse_get_context()->uid;
+        return gpu_resv_cancel(g_gpu_ctx, buf, gpu_fuse_privileged() ? NULL : &caller);
+        
+    } else if (strcmp(name, "user.gpu.cgroup_limit") == 0) {
+        // "PATH=SIZE", a SIZE of 0 removes the limit
+        if (!gpu_fuse_privileged()) {
+            return -EPERM;
+        }
+        char *sep = strrchr(buf, '=');
+        size_t limit;
+        if (!sep || gpu_fuse_parse_size(sep + 1, &limit) != 0) {
+            return -EINVAL;
+        }
+        *sep = '\0';
+        return gpu_cgroup_set_limit(&g_gpu_ctx->cgroups, buf, limit);
+        
+    } else if (strcmp(name, "user.gpu.sched_weight") == 0) {
+        // "TENANT=WEIGHT", tenants are "uid:N" or cgroup paths
+        if (!gpu_fuse_privileged()) {
+            return -EPERM;
+        }
+        char *sep = strrchr(buf, '=');
+        long weight;
+        if (!sep || sep == buf || gpu_fuse_parse_int(sep + 1, strlen(sep + 1), &weight) != 0 ||
+            weight <= 0) {
+            return -EINVAL;
+        }
+        *sep = '\0';
+        return gpu_sched_set_weight(&g_gpu_ctx->sched, buf, (unsigned)weight);
+        
+    } else if (strcmp(name, "user.gpu.checkpoint") == 0) {
+        // "1" returns once the contents are in host memory, "sync" once
+        // the container is on disk
+        if (strcmp(buf, "sync") == 0) {
+            return gpu_fuse_checkpoint(true, false);
+        }
+        bool confirm;
+        if (gpu_fuse_parse_bool(value, size, &confirm) != 0 || !confirm) {
+            return -EINVAL;
+        }
+        return gpu_fuse_checkpoint(false, false);
+        
+    } else if (strcmp(name, "user.gpu.scrub") == 0) {
+        // "1" starts verifying the checkpoint in the background, "0" stops it
+        bool start;
+        if (gpu_fuse_parse_bool(value, size, &start) != 0) {
+            return -EINVAL;
+        }
+        if (!start) {
+            __atomic_store_n(&g_gpu_ctx->scrub_stop, true, __ATOMIC_RELAXED);
+            return 0;
+        }
+        return gpu_fuse_scrub_start();
+    }
+    
+    return -ENOTSUP;
+}
+
+// Staging directory of a transaction: DIR/.txn.NAME
+static int gpu_fuse_txn_path(const char *dir, const char *value, size_t size,
+                             char *out, size_t len)
+{
+    char name[GPU_RESV_NAME_LEN];
+    if (gpu_fuse_copy_value(value, size, name, sizeof(name)) != 0 || strchr(name, '/')) {
+        return -EINVAL;
+    }
+    int n = snprintf(out, len, "%s/" GPU_FUSE_TXN_PREFIX "%s",
+                     strcmp(dir, "/") == 0 ? "" : dir, name);
+    return n < 0 || (size_t)n >= len ? -ENAMETOOLONG : 0;
+}
+
+static int gpu_fuse_txn_begin(const char *staging)
+{
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    int rc = 0;
+    if (g_hash_table_contains(g_gpu_ctx->dirs, staging) ||
+        g_hash_table_contains(g_gpu_ctx->files, staging)) {
+        rc = -EEXIST;
+    } else if (!gpu_fuse_add_dir_locked(staging)) {
+        rc = -ENOMEM;
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    return rc;
+}
+
+// Move everything staged into the directory in one step under global_mutex,
+// replacing files of the same name, and bump the directory's generation
+static int gpu_fuse_txn_commit(const char *path, const char *staging)
+{
+    GPtrArray *replaced = g_ptr_array_new();
+    char target[MAX_PATH_LEN];
+    int rc = 0;
+    
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    gpu_dir_t *dir = g_hash_table_lookup(g_gpu_ctx->dirs, path);
+    if (!dir || !g_hash_table_contains(g_gpu_ctx->dirs, staging)) {
+        pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+        g_ptr_array_free(replaced, TRUE);
+        return -ENOENT;
+    }
+    
+    GPtrArray *dirs = gpu_fuse_collect_below_locked(g_gpu_ctx->dirs, staging);
+    GPtrArray *files = gpu_fuse_collect_below_locked(g_gpu_ctx->files, staging);
+    g_ptr_array_sort(dirs, gpu_fuse_compare_path_len);  // Parents first
+    
+    // Validate everything first, a commit applies fully or not at all
+    for (guint i = 0; i < dirs->len && rc == 0; i++) {
+        rc = gpu_fuse_rebase_path(g_ptr_array_index(dirs, i), staging, path, target, sizeof(target));
+        if (rc == 0 && g_hash_table_contains(g_gpu_ctx->files, target)) {
+            rc = -ENOTDIR;
+        }
+    }
+    for (guint i = 0; i < files->len && rc == 0; i++) {
+        rc = gpu_fuse_rebase_path(g_ptr_array_index(files, i), staging, path, target, sizeof(target));
+        if (rc == 0 && g_hash_table_contains(g_gpu_ctx->dirs, target)) {
+            rc = -EISDIR;
+        }
+    }
+    
+    if (rc == 0) {
+        for (guint i = 0; i < dirs->len; i++) {
+            gpu_fuse_rebase_path(g_ptr_array_index(dirs, i), staging, path, target, sizeof(target));
+            if (!g_hash_table_contains(g_gpu_ctx->dirs, target)) {
+                gpu_fuse_add_dir_locked(target);
+            }
+        }
+        for (guint i = 0; i < files->len; i++) {
+            const char *from = g_ptr_array_index(files, i);
+            gpu_fuse_rebase_path(from, staging, path, target, sizeof(target));
+            gpu_file_t *victim = gpu_fuse_unlink_file_locked(target);
+            if (victim) {
+                g_ptr_array_add(replaced, victim);
+            }
+            gpu_fuse_move_file_locked(from, target);
+        }
+        gpu_fuse_detach_tree_locked(staging, replaced);  // Only empty directories left
+        dir->generation++;
+        dir->modify_time = time(NULL);
+        printf("Committed %u files into %s, generation %llu\n", files->len, path,
+               (unsigned long long)dir->generation);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    
+    g_ptr_array_free(dirs, TRUE);
+    g_ptr_array_free(files, TRUE);
+    gpu_fuse_put_files_async(replaced);
+    return rc;
+}
+
+static int gpu_fuse_txn_abort(const char *staging)
+{
+    GPtrArray *dropped = g_ptr_array_new();
+    
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    bool found = g_hash_table_contains(g_gpu_ctx->dirs, staging);
+    if (found) {
+        gpu_fuse_detach_tree_locked(staging, dropped);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    
+    gpu_fuse_put_files_async(dropped);
+    return found ? 0 : -ENOENT;
+}
+
+// Remove a directory with everything below it. The subtree leaves the
+// namespace at once; its memory is released in the background.
+static int gpu_fuse_rmtree(const char *path)
+{
+    if (strcmp(path, "/") == 0) {
+        return -EBUSY;
+    }
+    
+    GPtrArray *files = g_ptr_array_new();
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    bool found = g_hash_table_contains(g_gpu_ctx->dirs, path);
+    if (found) {
+        gpu_fuse_detach_tree_locked(path, files);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    
+    if (found) {
+        printf("Removed %s, releasing %u files in the background\n", path, files->len);
+    }
+    gpu_fuse_put_files_async(files);
+    return found ? 0 : -ENOENT;
+}
+
+// Clone a directory tree. The clone's files share the current versions of
+// the originals, so no device memory is allocated or copied up front;
+// replacing a version on either side (truncate, publish) leaves the other
+// untouched, and opening a shared file for writing copies it first.
+static int gpu_fuse_snapshot(const char *path, const char *value, size_t size)
+{
+    char dst[MAX_PATH_LEN];
+    if (gpu_fuse_copy_value(value, size, dst, sizeof(dst)) != 0 || dst[0] != '/') {
+        return -EINVAL;
+    }
+    size_t len = strlen(dst);
+    while (len > 1 && dst[len - 1] == '/') {
+        dst[--len] = '\0';
+    }
+    if (strcmp(dst, path) == 0 || gpu_fuse_path_below(dst, path)) {
+        return -EINVAL;  // Cannot snapshot into itself
+    }
+    
+    char target[MAX_PATH_LEN];
+    GPtrArray *partial = g_ptr_array_new();
+    int rc = 0;
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    GPtrArray *dirs = gpu_fuse_collect_below_locked(g_gpu_ctx->dirs, path);
+    GPtrArray *files = gpu_fuse_collect_below_locked(g_gpu_ctx->files, path);
+    g_ptr_array_sort(dirs, gpu_fuse_compare_path_len);  // Parents first
+    
+    if (g_hash_table_contains(g_gpu_ctx->dirs, dst) ||
+        g_hash_table_contains(g_gpu_ctx->files, dst)) {
+        rc = -EEXIST;
+    } else if (!gpu_fuse_parent_is_dir_locked(dst)) {
+        rc = -ENOENT;
+    }
+    for (guint i = 0; i < dirs->len && rc == 0; i++) {
+        rc = gpu_fuse_rebase_path(g_ptr_array_index(dirs, i), path, dst, target, sizeof(target));
+    }
+    for (guint i = 0; i < files->len && rc == 0; i++) {
+        rc = gpu_fuse_rebase_path(g_ptr_array_index(files, i), path, dst, target, sizeof(target));
+    }
+    
+    if (rc == 0) {
+        gpu_fuse_add_dir_locked(dst);
+        for (guint i = 0; i < dirs->len; i++) {
+            gpu_fuse_rebase_path(g_ptr_array_index(dirs, i), path, dst, target, sizeof(target));
+            gpu_fuse_add_dir_locked(target);
+        }
+        for (guint i = 0; i < files->len; i++) {
+            gpu_file_t *src = g_hash_table_lookup(g_gpu_ctx->files, g_ptr_array_index(files, i));
+            gpu_fuse_rebase_path(src->path, path, dst, target, sizeof(target));
+            gpu_file_t *clone = gpu_fuse_new_file(target);
+            if (!clone) {
+                rc = -ENOMEM;
+                break;
+            }
+            
+            // The staged version and any allocation in flight stay with the source
+            pthread_mutex_lock(&src->mutex);
+            if (src->current) {
+                if (!src->shared) {
+                    src->shared = true;
+                    __atomic_store_n(&src->current->sharers, 1, __ATOMIC_RELAXED);
+                }
+                __atomic_add_fetch(&src->current->sharers, 1, __ATOMIC_RELAXED);
+                clone->current = gpu_fuse_version_get(src->current);
+                clone->shared = true;
+                clone->next_seq = src->current->seq + 1;
+            } else if (src->restore) {
+                // Not loaded yet; the clone loads its own copy on first use
+                clone->restore = malloc(sizeof(gpu_restore_t));
+                if (!clone->restore) {
+                    pthread_mutex_unlock(&src->mutex);
+                    gpu_fuse_free_file(clone);  // Not an empty copy
+                    rc = -ENOMEM;
+                    break;
+                }
+                clone->restore->rec = src->restore->rec;
+                clone->restore->running = false;
+                clone->next_seq = src->next_seq;
+                clone->first_access = src->first_access;
+                __atomic_add_fetch(&g_gpu_ctx->restore_pending, 1, __ATOMIC_RELAXED);
+            }
+            clone->ready = src->ready;
+            clone->priority = src->priority;
+            clone->durable = src->durable;
+            memcpy(clone->dtype, src->dtype, sizeof(clone->dtype));
+            memcpy(clone->shape, src->shape, sizeof(clone->shape));
+            // Only a caller who may draw from the reservation keeps the binding
+            if (src->reservation && gpu_fuse_may_use_resv(src->reservation)) {
+                clone->reservation = src->reservation;
+                gpu_resv_hold(g_gpu_ctx, clone->reservation);
+            }
+            pthread_mutex_unlock(&src->mutex);
+            
+            g_hash_table_insert(g_gpu_ctx->files, strdup(target), clone);
+        }
+        if (rc != 0) {
+            gpu_fuse_detach_tree_locked(dst, partial);  // Out of memory half way
+        }
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    gpu_fuse_put_files(partial);
+    
+    if (rc == 0) {
+        printf("Snapshot of %s as %s: %u files, %u directories\n", path, dst, files->len, dirs->len);
+    }
+    g_ptr_array_free(dirs, TRUE);
+    g_ptr_array_free(files, TRUE);
+    return rc;
+}
+
+// Create an unpublished file per tensor in dir. Fails without creating
+// anything if a name is unusable or taken.
+static int gpu_fuse_ingest_create(const char *dir, GArray *tensors, GPtrArray *files)
+{
+    char target[MAX_PATH_LEN];
+    int rc = 0;
+    
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    if (!g_hash_table_contains(g_gpu_ctx->dirs, dir)) {
+        rc = -ENOENT;
+    }
+    for (guint i = 0; i < tensors->len && rc == 0; i++) {
+        gpu_ingest_tensor_t *tensor = &g_array_index(tensors, gpu_ingest_tensor_t, i);
+        if (tensor->name[0] == '\0' || strchr(tensor->name, '/') ||
+            strcmp(tensor->name, ".") == 0 || strcmp(tensor->name, "..") == 0) {
+            rc = -EINVAL;
+            break;
+        }
+        if (snprintf(target, sizeof(target), "%s/%s", strcmp(dir, "/") == 0 ? "" : dir,
+                     tensor->name) >= (int)sizeof(target)) {
+            rc = -ENAMETOOLONG;
+            break;
+        }
+        if (g_hash_table_contains(g_gpu_ctx->files, target) ||
+            g_hash_table_contains(g_gpu_ctx->dirs, target)) {
+            rc = -EEXIST;  // Also catches a tensor name repeated in the header
+            break;
+        }
+        
+        gpu_file_t *file = gpu_fuse_new_file(target);
+        if (!file) {
+            rc = -ENOMEM;
+            break;
+        }
+        snprintf(file->dtype, sizeof(file->dtype), "%s", tensor->dtype);
+        gpu_ingest_format_shape(tensor, file->shape, sizeof(file->shape));
+        file->refcount++;  // Held by the ingest until it completes
+        g_hash_table_insert(g_gpu_ctx->files, strdup(target), file);
+        g_ptr_array_add(files, file);
+    }
+    
+    if (rc != 0) {
+        for (guint i = 0; i < files->len; i++) {
+            gpu_file_t *file = g_ptr_array_index(files, i);
+            gpu_fuse_unlink_file_locked(file->path);
+            file->refcount--;  // Index reference, the caller drops its own
+        }
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    return rc;
+}
+
+// Load a safetensors file into a directory: one file per tensor, sized to
+// the tensor rounded up to the granularity, with dtype and shape attributes.
+// The files appear unpublished and are published together once every
+// tensor has been copied; on failure they are removed again.
+static int gpu_fuse_ingest(const char *path, const char *value, size_t size)
+{
+    char source[MAX_PATH_LEN];
+    if (gpu_fuse_copy_value(value, size, source, sizeof(source)) != 0 || source[0] != '/') {
+        return -EINVAL;  // Resolved by the daemon, so it must be absolute
+    }
+    
+    int fd = open(source, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+    GArray *tensors;
+    int rc = gpu_ingest_parse(fd, &tensors);
+    close(fd);
+    if (rc != 0) {
+        printf("Failed to parse safetensors header of %s: %s\n", source, strerror(-rc));
+        return rc;
+    }
+    
+    GPtrArray *files = g_ptr_array_new();
+    rc = gpu_fuse_ingest_create(path, tensors, files);
+    
+    // Allocate on this thread, the allocation path needs the FUSE context
+    GPtrArray *versions = g_ptr_array_new();
+    gpu_ingest_copy_t *copies = calloc(tensors->len ? tensors->len : 1, sizeof(gpu_ingest_copy_t));
+    if (!copies) {
+        rc = -ENOMEM;
+    }
+    for (guint i = 0; i < files->len && rc == 0; i++) {
+        gpu_ingest_tensor_t *tensor = &g_array_index(tensors, gpu_ingest_tensor_t, i);
+        gpu_file_t *file = g_ptr_array_index(files, i);
+        if (tensor->length == 0) {
+            continue;  // Empty tensor, nothing to allocate
+        }
+        
+        size_t alloc_size = gpu_policy_alloc_size(tensor->length, g_gpu_ctx->granularity);
+        rc = gpu_fuse_truncate_file(file, file->path, (off_t)alloc_size);
+        if (rc != 0) {
+            break;
+        }
+        pthread_mutex_lock(&file->mutex);
+        gpu_version_t *version = file->current ? gpu_fuse_version_get(file->current) : NULL;
+        pthread_mutex_unlock(&file->mutex);
+        if (!version) {
+            rc = -ENOENT;  // Truncated behind our back
+            break;
+        }
+        g_ptr_array_add(versions, version);
+        copies[i].handle = version->gpu_handle;
+        copies[i].alloc_size = version->size;
+        copies[i].offset = tensor->offset;
+        copies[i].length = tensor->length;
+    }
+    
+    gpu_ingest_stats_t stats;
+    if (rc == 0) {
+        fd = gpu_ingest_open(source);
+        __atomic_add_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
+        rc = fd < 0 ? fd : gpu_xfer_read(&g_gpu_ctx->xfer, fd, copies, files->len,
+                                         g_gpu_ctx->opts.ingest_threads, &stats);
+        __atomic_sub_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    
+    if (rc == 0) {
+        for (guint i = 0; i < files->len; i++) {
+            gpu_file_t *file = g_ptr_array_index(files, i);
+            pthread_mutex_lock(&file->mutex);
+            file->ready = true;
+            gpu_fuse_notify_ready(file);
+            pthread_mutex_unlock(&file->mutex);
+        }
+        printf("Ingested %u tensors (%llu bytes) from %s into %s in %lld us, %u threads%s\n",
+               files->len, (unsigned long long)stats.bytes, source, path,
+               (long long)stats.elapsed_us, stats.threads, stats.direct ? ", direct I/O" : "");
+    } else if (files->len > 0) {
+        // Take back the files that are still the ones we created
+        printf("Ingest of %s into %s failed: %s\n", source, path, strerror(-rc));
+        pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+        for (guint i = 0; i < files->len; i++) {
+            gpu_file_t *file = g_ptr_array_index(files, i);
+            if (g_hash_table_lookup(g_gpu_ctx->files, file->path) == file) {
+                gpu_fuse_unlink_file_locked(file->path);
+                file->refcount--;
+            }
+        }
+        pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    }
+    
+    for (guint i = 0; i < versions->len; i++) {
+        gpu_fuse_version_put(g_ptr_array_index(versions, i));
+    }
+    g_ptr_array_free(versions, TRUE);
+    free(copies);
+    gpu_fuse_put_files(files);
+    g_array_free(tensors, TRUE);
+    return rc;
+}
+
+typedef struct {
+    gpu_ckpt_writer_t *writer;
+    GByteArray *frames;
+    int level;                    // 0 for plain payloads
+    uint64_t raw;
+    uint64_t stored;
+} gpu_fuse_export_t;
+
+// Sink of gpu_device_copy_out: compresses each staged chunk while the next
+// one is copied from the device
+static int gpu_fuse_export_sink(const void *data, size_t len, void *arg)
+{
+    gpu_fuse_export_t *ex = arg;
+    ex->raw += len;
+    if (ex->level == 0) {
+        ex->stored += len;
+        return gpu_ckpt_writer_append(ex->writer, data, len);
+    }
+    g_byte_array_set_size(ex->frames, 0);
+    int rc = gpu_bundle_pack(data, len, ex->level, g_gpu_ctx->opts.ingest_threads, ex->frames);
+    if (rc != 0) {
+        return rc;
+    }
+    ex->stored += ex->frames->len;
+    return gpu_ckpt_writer_append(ex->writer, ex->frames->data, ex->frames->len);
+}
+
+// Write a directory tree into a bundle at an absolute path, "PATH[:LEVEL]"
+// with a zlib level from 0 (stored) to 9. Paths in the bundle are relative
+// to the directory. Files still in a checkpoint are loaded first; each
+// file is saved from the version current when the export reaches it.
+static int gpu_fuse_export(const char *path, const char *value, size_t size)
+{
+    char dst[MAX_PATH_LEN];
+    if (gpu_fuse_copy_value(value, size, dst, sizeof(dst)) != 0 || dst[0] != '/') {
+        return -EINVAL;
+    }
+    int level = GPU_BUNDLE_LEVEL;
+    char *colon = strrchr(dst, ':');
+    if (colon && colon[1] != '\0' && strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+        level = atoi(colon + 1);
+        *colon = '\0';
+        if (level > 9) {
+            return -EINVAL;
+        }
+    }
+    
+    int64_t start = g_get_monotonic_time();
+    GPtrArray *files = g_ptr_array_new();
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    GPtrArray *dirs = gpu_fuse_collect_below_locked(g_gpu_ctx->dirs, path);
+    GPtrArray *paths = gpu_fuse_collect_below_locked(g_gpu_ctx->files, path);
+    for (guint i = 0; i < paths->len; i++) {
+        gpu_file_t *file = g_hash_table_lookup(g_gpu_ctx->files, g_ptr_array_index(paths, i));
+        pthread_mutex_lock(&file->mutex);
+        file->refcount++;
+        pthread_mutex_unlock(&file->mutex);
+        g_ptr_array_add(files, file);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    g_ptr_array_free(paths, TRUE);
+    g_ptr_array_sort(dirs, gpu_fuse_compare_path_len);  // Parents first
+    
+    // "/" keeps absolute paths, anything else is cut off
+    size_t cut = strcmp(path, "/") == 0 ? 0 : strlen(path);
+    gpu_ckpt_writer_t writer;
+    gpu_ckpt_record_t rec;
+    int rc = gpu_ckpt_writer_open(&writer, dst);
+    bool opened = rc == 0;
+    for (guint i = 0; i < dirs->len && rc == 0; i++) {
+        memset(&rec, 0, sizeof(rec));
+        snprintf(rec.path, sizeof(rec.path), "%s", (const char *)g_ptr_array_index(dirs, i) + cut);
+        rec.flags = GPU_CKPT_DIR;
+        rc = gpu_ckpt_writer_add(&writer, &rec);
+    }
+    
+    gpu_fuse_export_t ex = { .writer = &writer, .frames = g_byte_array_new(), .level = level };
+    __atomic_add_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
+    for (guint i = 0; i < files->len && rc == 0; i++) {
+        gpu_file_t *file = g_ptr_array_index(files, i);
+        rc = gpu_fuse_rehydrate(file, false);
+        if (rc != 0) {
+            break;
+        }
+        pthread_mutex_lock(&file->mutex);
+        gpu_fuse_ckpt_record_locked(file, &rec);
+        snprintf(rec.path, sizeof(rec.path), "%s", file->path + cut);
+        gpu_version_t *version = file->current ? gpu_fuse_version_get(file->current) : NULL;
+        pthread_mutex_unlock(&file->mutex);
+        
+        if (!version) {
+            rc = gpu_ckpt_writer_add(&writer, &rec);
+            continue;
+        }
+        if (level > 0) {
+            rec.flags |= GPU_CKPT_ZLIB;
+            rec.frame_size = GPU_BUNDLE_FRAME;
+            rec.raw_length = version->size;
+        }
+        rc = gpu_ckpt_writer_begin(&writer, &rec);
+        if (rc == 0) {
+            rc = gpu_device_copy_out(g_gpu_ctx->device, version->gpu_handle, version->size,
+                                     version->size, gpu_fuse_export_sink, &ex);
+        }
+        if (rc == 0) {
+            rc = gpu_ckpt_writer_end(&writer);
+        }
+        gpu_fuse_version_put(version);
+    }
+    __atomic_sub_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
+    
+    if (rc == 0) {
+        rc = gpu_ckpt_writer_finish(&writer);
+    } else if (opened) {
+        gpu_ckpt_writer_abort(&writer);
+    }
+    if (rc == 0) {
+        printf("Exported %s to %s: %u files, %u directories, %llu bytes stored as %llu "
+               "(level %d) in %lld us\n", path, dst, files->len, dirs->len,
+               (unsigned long long)ex.raw, (unsigned long long)ex.stored, level,
+               (long long)(g_get_monotonic_time() - start));
+    } else {
+        printf("Export of %s to %s failed: %s\n", path, dst, strerror(-rc));
+    }
+    g_byte_array_free(ex.frames, TRUE);
+    gpu_fuse_put_files(files);
+    g_ptr_array_free(dirs, TRUE);
+    return rc;
+}
+
+// True if every component of an absolute path is a usable name
+static bool gpu_fuse_path_is_clean(const char *path)
+{
+    for (const char *p = path; *p == '/';) {
+        const char *end = strchrnul(p + 1, '/');
+        size_t len = end - (p + 1);
+        if (len == 0 || (len == 1 && p[1] == '.') || (len == 2 && p[1] == '.' && p[2] == '.')) {
+            return false;
+        }
+        if (*end == '\0') {
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
+
+// Take back what an import created, as far as it is still its own
+static void gpu_fuse_import_undo_locked(GPtrArray *created, GPtrArray *files)
+{
+    for (guint i = 0; i < files->len; i++) {
+        gpu_file_t *file = g_ptr_array_index(files, i);
+        if (g_hash_table_lookup(g_gpu_ctx->files, file->path) == file) {
+            gpu_fuse_unlink_file_locked(file->path);
+            file->refcount--;  // Index reference, the caller drops its own
+        }
+    }
+    for (guint i = created->len; i > 0; i--) {  // Children first
+        const char *dir = g_ptr_array_index(created, i - 1);
+        if (g_hash_table_contains(g_gpu_ctx->dirs, dir) && gpu_fuse_dir_is_empty_locked(dir)) {
+            g_hash_table_remove(g_gpu_ctx->dirs, dir);
+        }
+    }
+}
+
+// Create the directories and unpublished files of a bundle below dir.
+// Fails without creating anything if a path is unusable, a parent is
+// missing, or a file would replace an existing entry; directories that
+// already exist are reused. created receives the new directories, files
+// the new files, each holding a reference for the import.
+static int gpu_fuse_import_create(const char *dir, const gpu_ckpt_reader_t *reader,
+                                  GPtrArray *created, GPtrArray *files)
+{
+    GPtrArray *dir_recs = g_ptr_array_new();
+    for (uint64_t i = 0; i < reader->header.count; i++) {
+        if (reader->records[i].flags & GPU_CKPT_DIR) {
+            g_ptr_array_add(dir_recs, reader->records[i].path);
+        }
+    }
+    g_ptr_array_sort(dir_recs, gpu_fuse_compare_path_len);  // Parents first
+    
+    // Bundle paths taken so far, new directories map to themselves
+    GHashTable *taken = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    char target[MAX_PATH_LEN];
+    int rc = 0;
+    pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+    if (!g_hash_table_contains(g_gpu_ctx->dirs, dir)) {
+        rc = -ENOENT;
+    }
+    size_t nrecords = dir_recs->len + reader->header.count;
+    for (size_t i = 0; i < nrecords && rc == 0; i++) {
+        // Directories in order first, then every file record
+        bool is_dir = i < dir_recs->len;
+        const gpu_ckpt_record_t *rec = is_dir ? NULL : &reader->records[i - dir_recs->len];
+        const char *name = is_dir ? g_ptr_array_index(dir_recs, i) : rec->path;
+        if (rec && (rec->flags & GPU_CKPT_DIR)) {
+            continue;
+        }
+        if (!gpu_fuse_path_is_clean(name)) {
+            rc = -EINVAL;
+            break;
+        }
+        if (snprintf(target, sizeof(target), "%s%s", strcmp(dir, "/") == 0 ? "" : dir,
+                     name) >= (int)sizeof(target)) {
+            rc = -ENAMETOOLONG;
+            break;
+        }
+        bool exists_dir = g_hash_table_contains(g_gpu_ctx->dirs, target);
+        if (is_dir && exists_dir) {
+            continue;  // Merged into the existing directory
+        }
+        if (exists_dir || g_hash_table_contains(g_gpu_ctx->files, target) ||
+            g_hash_table_contains(taken, target)) {
+            rc = -EEXIST;
+            break;
+        }
+        char *parent = g_path_get_dirname(target);
+        bool parent_ok = g_hash_table_contains(g_gpu_ctx->dirs, parent) ||
+                         g_hash_table_lookup(taken, parent) != NULL;
+        g_free(parent);
+        if (!parent_ok) {
+            rc = -EINVAL;  // The bundle lacks a directory record
+            break;
+        }
+        char *key = strdup(target);
+        g_hash_table_insert(taken, key, is_dir ? key : NULL);
+        if (is_dir) {
+            g_ptr_array_add(created, strdup(target));
+        }
+    }
+    
+    for (guint i = 0; i < created->len && rc == 0; i++) {
+        if (!gpu_fuse_add_dir_locked(g_ptr_array_index(created, i))) {
+            rc = -ENOMEM;
+        }
+    }
+    for (uint64_t i = 0; i < reader->header.count && rc == 0; i++) {
+        const gpu_ckpt_record_t *rec = &reader->records[i];
+        if (rec->flags & GPU_CKPT_DIR) {
+            continue;
+        }
+        snprintf(target, sizeof(target), "%s%s", strcmp(dir, "/") == 0 ? "" : dir, rec->path);
+        gpu_file_t *file = gpu_fuse_new_file(target);
+        if (!file) {
+            rc = -ENOMEM;
+            break;
+        }
+        file->durable = (rec->flags & GPU_CKPT_DURABLE) != 0;
+        file->priority = rec->priority;
+        snprintf(file->dtype, sizeof(file->dtype), "%s", rec->dtype);
+        snprintf(file->shape, sizeof(file->shape), "%s", rec->shape);
+        file->refcount++;  // Held by the import until it completes
+        g_hash_table_insert(g_gpu_ctx->files, strdup(target), file);
+        g_ptr_array_add(files, file);
+    }
+    
+    if (rc != 0) {
+        gpu_fuse_import_undo_locked(created, files);
+    }
+    pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
+    g_hash_table_destroy(taken);
+    g_ptr_array_free(dir_recs, TRUE);
+    return rc;
+}
+
+typedef struct {
+    CUdeviceptr ptr;
+    uint64_t pos;
+} gpu_fuse_import_sink_t;
+
+static int gpu_fuse_import_sink(const void *data, size_t len, void *arg)
+{
+    gpu_fuse_import_sink_t *sink = arg;
+    if (cuMemcpyHtoD(sink->ptr + sink->pos, data, len) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+    sink->pos += len;
+    return 0;
+}
+
+// Decompress a payload into an allocation
+static int gpu_fuse_import_unpack(const gpu_ckpt_reader_t *reader, const gpu_ckpt_record_t *rec,
+                                  gpu_version_t *version)
+{
+    gpu_device_t *dev = g_gpu_ctx->device;
+    gpu_fuse_import_sink_t sink = { 0 };
+    if (gpu_device_make_current(dev) != CUDA_SUCCESS ||
+        gpu_device_map(dev, version->gpu_handle, version->size, &sink.ptr) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+    int rc = gpu_bundle_read(reader, rec, g_gpu_ctx->opts.ingest_threads, gpu_fuse_import_sink,
+                             &sink);
+    gpu_device_unmap(sink.ptr, version->size);
+    return rc;
+}
+
+// Load a bundle written by user.gpu.export into a directory. The tree
+// appears unpublished, like an ingest. Plain payloads are read with the
+// transfer backend; compressed ones are decompressed on the host, frames
+// in parallel, and copied to the device. Files that were published at
+// export time are published once everything is loaded; on failure the
+// tree is removed again.
+static int gpu_fuse_import(const char *path, const char *value, size_t size)
+{
+    char source[MAX_PATH_LEN];
+    if (gpu_fuse_copy_value(value, size, source, sizeof(source)) != 0 || source[0] != '/') {
+        return -EINVAL;
+    }
+    
+    int64_t start = g_get_monotonic_time();
+    gpu_ckpt_reader_t reader;
+    int rc = gpu_ckpt_open(&reader, source);
+    if (rc != 0) {
+        printf("Failed to open bundle %s: %s\n", source, strerror(-rc));
+        return rc;
+    }
+    GPtrArray *created = g_ptr_array_new_with_free_func(free);
+    GPtrArray *files = g_ptr_array_new();
+    rc = gpu_fuse_import_create(path, &reader, created, files);
+    
+    // Allocate on this thread, the allocation path needs the FUSE context.
+    // versions has an entry per file, NULL for files without memory.
+    GPtrArray *versions = g_ptr_array_new();
+    GArray *copies = g_array_new(FALSE, TRUE, sizeof(gpu_ingest_copy_t));
+    for (uint64_t i = 0; i < reader.header.count && rc == 0; i++) {
+        const gpu_ckpt_record_t *rec = &reader.records[i];
+        if (rec->flags & GPU_CKPT_DIR) {
+            continue;
+        }
+        gpu_file_t *file = g_ptr_array_index(files, versions->len);
+        gpu_version_t *version = NULL;
+        if (rec->alloc_size != 0) {
+            // The exporting device may have had a smaller granularity
+            size_t alloc_size = gpu_policy_alloc_size(rec->alloc_size, g_gpu_ctx->granularity);
+            rc = gpu_fuse_truncate_file(file, file->path, (off_t)alloc_size);
+            if (rc != 0) {
+                break;
+            }
+            pthread_mutex_lock(&file->mutex);
+            version = file->current ? gpu_fuse_version_get(file->current) : NULL;
+            pthread_mutex_unlock(&file->mutex);
+            if (!version) {
+                rc = -ENOENT;  // Truncated behind our back
+                break;
+            }
+        }
+        g_ptr_array_add(versions, version);
+        if (version && rec->length != 0 && !(rec->flags & GPU_CKPT_ZLIB)) {
+            gpu_ingest_copy_t copy = {
+                .handle = version->gpu_handle,
+                .alloc_size = version->size,
+                .offset = rec->offset,
+                .length = rec->length,
+                .crcs = gpu_ckpt_crcs(&reader, rec),
+                .crc_chunk = rec->crc_chunk,
+            };
+            g_array_append_val(copies, copy);
+        }
+    }
+    
+    uint64_t bytes = 0;
+    __atomic_add_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
+    if (rc == 0 && copies->len > 0) {
+        gpu_ingest_stats_t stats = { 0 };  // Left alone if the open fails
+        int fd = gpu_ingest_open(source);
+        rc = fd < 0 ? fd : gpu_xfer_read(&g_gpu_ctx->xfer, fd, (gpu_ingest_copy_t *)copies->data,
+                                         copies->len, g_gpu_ctx->opts.ingest_threads, &stats);
+        if (fd >= 0) {
+            close(fd);
+        }
+        bytes += stats.bytes;
+    }
+    for (uint64_t i = 0, n = 0; i < reader.header.count && rc == 0; i++) {
+        const gpu_ckpt_record_t *rec = &reader.records[i];
+        if (rec->flags & GPU_CKPT_DIR) {
+            continue;
+        }
+        gpu_version_t *version = g_ptr_array_index(versions, n++);
+        if (version && (rec->flags & GPU_CKPT_ZLIB)) {
+            rc = gpu_fuse_import_unpack(&reader, rec, version);
+            bytes += rec->raw_length;
+        }
+    }
+    __atomic_sub_fetch(&g_gpu_ctx->fg_active, 1, __ATOMIC_RELAXED);
     
-    pthread_mutex_lock(&file->mutex);
-    
-    // ts[0] is access time, ts[1] is modification time
-    if (ts) {
-        if (ts[0].tv_nsec != UTIME_OMIT) {
-            file->access_time = ts[0].tv_sec;
-        }
-        if (ts[1].tv_nsec != UTIME_OMIT) {
-            file->modify_time = ts[1].tv_sec;
+    if (rc == 0) {
+        for (uint64_t i = 0, n = 0; i < reader.header.count; i++) {
+            const gpu_ckpt_record_t *rec = &reader.records[i];
+            if (rec->flags & GPU_CKPT_DIR) {
+                continue;
+            }
+            gpu_file_t *file = g_ptr_array_index(files, n++);
+            if (rec->flags & GPU_CKPT_READY) {
+                pthread_mutex_lock(&file->mutex);
+                file->ready = true;
+                gpu_fuse_notify_ready(file);
+                pthread_mutex_unlock(&file->mutex);
+            }
         }
+        printf("Imported %s into %s: %u files, %u new directories, %llu bytes in %lld us\n",
+               source, path, files->len, created->len, (unsigned long long)bytes,
+               (long long)(g_get_monotonic_time() - start));
     } else {
-        // If ts is NULL, set both times to current time
-        time_t current_time = time(NULL);
-        file->access_time = current_time;
-        file->modify_time = current_time;
+        printf("Import of %s into %s failed: %s\n", source, path, strerror(-rc));
+        pthread_mutex_lock(&g_gpu_ctx->global_mutex);
+        gpu_fuse_import_undo_locked(created, files);
+        pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
     }
     
-    pthread_mutex_unlock(&file->mutex);
-    
-    printf("Updated timestamps for %s\n", path);
-    return 0;
+    for (guint i = 0; i < versions->len; i++) {
+        if (g_ptr_array_index(versions, i)) {
+            gpu_fuse_version_put(g_ptr_array_index(versions, i));
+        }
+    }
+    g_ptr_array_free(versions, TRUE);
+    g_array_free(copies, TRUE);
+    gpu_fuse_put_files(files);
+    g_ptr_array_free(created, TRUE);
+    gpu_ckpt_close(&reader);
+    return rc;
 }
 
-// FUSE open - open file for reading/writing
-static int gpu_fuse_open(const char *path, struct fuse_file_info *fi)
+// Directory attributes
+static int gpu_fuse_setxattr_dir(const char *path, const char *name, const char *value,
+                                 size_t size)
 {
-    printf("gpu_fuse_open called: path=%s, flags=%d\n", path, fi->flags);
+    if (strcmp(name, "user.gpu.rmtree") == 0) {
+        bool confirm;
+        if (gpu_fuse_parse_bool(value, size, &confirm) != 0 || !confirm) {
+            return -EINVAL;
+        }
+        return gpu_fuse_rmtree(path);
+    } else if (strcmp(name, "user.gpu.snapshot") == 0) {
+        return gpu_fuse_snapshot(path, value, size);
+    } else if (strcmp(name, "user.gpu.ingest") == 0) {
+        return gpu_fuse_ingest(path, value, size);
+    } else if (strcmp(name, "user.gpu.export") == 0) {
+        return gpu_fuse_export(path, value, size);
+    } else if (strcmp(name, "user.gpu.import") == 0) {
+        return gpu_fuse_import(path, value, size);
+    }
     
-    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
-    if (!file) {
-        return -ENOENT;
+    char staging[MAX_PATH_LEN];
+    bool begin = strcmp(name, "user.gpu.txn_begin") == 0;
+    bool commit = strcmp(name, "user.gpu.txn_commit") == 0;
+    bool abort_txn = strcmp(name, "user.gpu.txn_abort") == 0;
+    if (!begin && !commit && !abort_txn) {
+        return -ENOTSUP;
     }
     
-    // File exists, allow opening
-    return 0;
+    int rc = gpu_fuse_txn_path(path, value, size, staging, sizeof(staging));
+    if (rc != 0) {
+        return rc;
+    }
+    if (begin) {
+        rc = gpu_fuse_txn_begin(staging);
+    } else if (commit) {
+        rc = gpu_fuse_txn_commit(path, staging);
+    } else {
+        rc = gpu_fuse_txn_abort(staging);
+    }
+    printf("Transaction %s on %s: %s\n", staging, name + strlen("user.gpu.txn_"),
+           rc == 0 ? "ok" : strerror(-rc));
+    return rc;
 }
 
-// FUSE getxattr - get extended attributes
-static int gpu_fuse_getxattr(const char *path, const char *name, char *value, size_t size)
+// Per-file attributes
+static int gpu_fuse_setxattr_file(gpu_file_t *file, const char *path, const char *name,
+                                  const char *value, size_t size)
 {
-    printf("gpu_fuse_getxattr called: path=%s, name=%s, size=%zu\n", path, name, size);
-    
-    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
-    if (!file) {
-        return -ENOENT;
-    }
-    
-    pthread_mutex_lock(&file->mutex);
-    
-    if (strcmp(name, "user.fabric_handle") == 0) {
-        // Return the fabric handle
-        if (file->gpu_handle == 0) {
-            pthread_mutex_unlock(&file->mutex);
-            return -ENODATA;  // No GPU allocation
+    if (strcmp(name, "user.gpu.size") == 0) {
+        // Allocate (or with 0, free) in one call, same as truncate -s SIZE
+        char buf[32];
+        size_t alloc_size;
+        if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0 ||
+            gpu_fuse_parse_size(buf, &alloc_size) != 0) {
+            return -EINVAL;
         }
+        return gpu_fuse_truncate_file(file, path, (off_t)alloc_size);
         
-        if (size == 0) {
-            // Caller is asking for the size of the attribute
-            pthread_mutex_unlock(&file->mutex);
-            return sizeof(CUmemFabricHandle);
+    } else if (strcmp(name, "user.gpu.stage_size") == 0) {
+        // Allocate the next version next to the current one, or discard it with 0
+        char buf[32];
+        size_t alloc_size;
+        if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0 ||
+            gpu_fuse_parse_size(buf, &alloc_size) != 0) {
+            return -EINVAL;
         }
         
-        if (size < sizeof(CUmemFabricHandle)) {
+        // The restored version comes first in the numbering
+        int rc = alloc_size != 0 ? gpu_fuse_rehydrate(file, true) : 0;
+        if (rc != 0) {
+            return rc;
+        }
+        
+        pthread_mutex_lock(&file->mutex);
+        if (alloc_size == 0) {
+            gpu_version_t *staged = file->staged;
+            file->staged = NULL;
             pthread_mutex_unlock(&file->mutex);
-            return -ERANGE;  // Buffer too small
+            if (staged) {
+                gpu_fuse_version_put(staged);
+            }
+            return 0;
+        }
+        if (file->staged) {
+            pthread_mutex_unlock(&file->mutex);
+            return -EBUSY;  // Publish or discard the staged version first
         }
         
-        memcpy(value, &file->fabric_handle, sizeof(CUmemFabricHandle));
+        gpu_version_t *version;
+        rc = gpu_fuse_allocate(file, alloc_size, &version);
+        if (rc == 0) {
+            file->staged = version;
+        }
         pthread_mutex_unlock(&file->mutex);
-        printf("Returned fabric handle via getxattr: %zu bytes\n", sizeof(CUmemFabricHandle));
-        return sizeof(CUmemFabricHandle);
+        return rc;
         
-    } else if (strcmp(name, "user.allocation_size") == 0) {
-        // Return the allocation size as a string
-        if (file->gpu_handle == 0) {
+    } else if (strcmp(name, "user.gpu.publish") == 0) {
+        // Atomically make the staged version current. Readers that opened
+        // the file earlier keep the old version until they close it.
+        bool publish;
+        if (gpu_fuse_parse_bool(value, size, &publish) != 0 || !publish) {
+            return -EINVAL;
+        }
+        
+        pthread_mutex_lock(&file->mutex);
+        if (file->allocating) {
             pthread_mutex_unlock(&file->mutex);
-            return -ENODATA;  // No GPU allocation
+            return -EBUSY;  // A truncate would overwrite the published version
+        }
+        if (file->staged == NULL) {
+            pthread_mutex_unlock(&file->mutex);
+            return -EINVAL;  // Nothing to publish
         }
+        gpu_fuse_unshare_locked(file);
+        gpu_version_t *old = file->current;
+        file->current = file->staged;
+        file->staged = NULL;
+        file->ready = true;
+        file->modify_time = time(NULL);
+        gpu_fuse_notify_ready(file);
+        uint64_t seq = file->current->seq;
+        pthread_mutex_unlock(&file->mutex);
         
-        char size_str[32];
-        int len = snprintf(size_str, sizeof(size_str), "%zu", file->size);
+        if (old) {
+            gpu_fuse_version_put(old);
+        }
+        printf("File %s published version %llu\n", path, (unsigned long long)seq);
+        return 0;
         
-        if (size == 0) {
-            // Caller is asking for the size of the attribute
-            pthread_mutex_unlock(&file->mutex);
-            return len;
+    } else if (strcmp(name, "user.gpu.durable") == 0) {
+        // Durable files are persisted, scratch buffers never are
+        bool durable;
+        if (gpu_fuse_parse_bool(value, size, &durable) != 0) {
+            return -EINVAL;
         }
         
-        if (size < (size_t)len + 1) {
+        pthread_mutex_lock(&file->mutex);
+        file->durable = durable;
+        pthread_mutex_unlock(&file->mutex);
+        
+        printf("File %s marked %s\n", path, durable ? "durable" : "scratch");
+        return 0;
+        
+    } else if (strcmp(name, "user.gpu.dtype") == 0) {
+        char buf[GPU_INGEST_DTYPE_LEN];
+        if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0) {
+            return -EINVAL;
+        }
+        pthread_mutex_lock(&file->mutex);
+        strcpy(file->dtype, buf);
+        pthread_mutex_unlock(&file->mutex);
+        return 0;
+        
+    } else if (strcmp(name, "user.gpu.shape") == 0) {
+        // Comma separated dimensions, empty for a scalar
+        char buf[GPU_INGEST_SHAPE_LEN];
+        if (gpu_fuse_copy_value(value, size, buf, sizeof(buf)) != 0 ||
+            strspn(buf, "0123456789,") != strlen(buf)) {
+            return -EINVAL;
+        }
+        pthread_mutex_lock(&file->mutex);
+        strcpy(file->shape, buf);
+        pthread_mutex_unlock(&file->mutex);
+        return 0;
+        
+    } else if (strcmp(name, "user.gpu.ready") == 0) {
+        // Producer marks the allocation as published (or retracts it)
+        bool ready;
+        if (gpu_fuse_parse_bool(value, size, &ready) != 0) {
+            return -EINVAL;
+        }
+        
+        pthread_mutex_lock(&file->mutex);
+        if (ready && file->current == NULL) {
             pthread_mutex_unlock(&file->mutex);
-            return -ERANGE;  // Buffer too small
+            return -EINVAL;  // Nothing to publish yet
+        }
+        file->ready = ready;
+        if (ready) {
+            gpu_fuse_notify_ready(file);
         }
+        pthread_mutex_unlock(&file->mutex);
         
-        strcpy(value, size_str);
+        printf("File %s marked %s\n", path, ready ? "ready" : "not ready");
+        return 0;
+        
+    } else if (strcmp(name, "user.gpu.priority") == 0) {
+        // Admission priority used when allocations queue under alloc_policy=priority
+        long priority;
+        if (gpu_fuse_parse_int(value, size, &priority) != 0 ||
+            priority < -1000 || priority > 1000) {
+            return -EINVAL;
+        }
+        
+        pthread_mutex_lock(&file->mutex);
+        file->priority = (int)priority;
         pthread_mutex_unlock(&file->mutex);
-        printf("Returned allocation size via getxattr: %s bytes\n", size_str);
-        return len;  
+        return 0;
+        
+    } else if (strcmp(name, "user.gpu.reservation") == 0) {
+        // Bind the file to a reservation its next allocation draws from
+        char resv_name[GPU_RESV_NAME_LEN];
+        if (gpu_fuse_copy_value(value, size, resv_name, sizeof(resv_name)) != 0) {
+            return -EINVAL;
+        }
+        gpu_reservation_t *resv = gpu_resv_get(g_gpu_ctx, resv_name);
+        if (!resv) {
+            return -ENOENT;
+        }
+        if (!gpu_fuse_may_use_resv(resv)) {
+            gpu_resv_put(g_gpu_ctx, resv);
+            return -EPERM;  // Another job's budget
+        }
+        
+        pthread_mutex_lock(&file->mutex);
+        if (file->current || file->staged || file->allocating) {
+            // Existing versions are charged to the old binding
+            pthread_mutex_unlock(&file->mutex);
+            gpu_resv_put(g_gpu_ctx, resv);
+            return -EBUSY;
+        }
+        gpu_reservation_t *old = file->reservation;
+        file->reservation = resv;
+        pthread_mutex_unlock(&file->mutex);
+        
+        if (old) {
+            gpu_resv_put(g_gpu_ctx, old);
+        }
+        return 0;
     }
     
-    pthread_mutex_unlock(&file->mutex);
-    return -ENODATA;  // Attribute not found
+    return -ENOTSUP;
 }
 
-// FUSE listxattr - list extended attributes
-static int gpu_fuse_listxattr(const char *path, char *list, size_t size)
+// FUSE setxattr - set extended attributes
+static int gpu_fuse_setxattr(const char *path, const char *name, const char *value,
+                             size_t size, int flags)
 {
-    printf("gpu_fuse_listxattr called: path=%s, size=%zu\n", path, size);
+    UNUSED(flags);
+    
+    printf("gpu_fuse_setxattr called: path=%s, name=%s, size=%zu\n", path, name, size);
+    
+    if (strcmp(path, "/") == 0) {
+        int rc = gpu_fuse_setxattr_root(name, value, size);
+        if (rc != -ENOTSUP) {
+            return rc;
+        }
+    }
+    if (gpu_fuse_is_dir(path)) {
+        return gpu_fuse_setxattr_dir(path, name, value, size);
+    }
     
     gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
     if (!file) {
         return -ENOENT;
     }
     
-    const char *attrs = "user.fabric_handle\0user.allocation_size\0";
-    size_t attrs_len = strlen("user.fabric_handle") + 1 + 
-                       strlen("user.allocation_size") + 1;
+    int rc = gpu_fuse_setxattr_file(file, path, name, value, size);
+    gpu_fuse_put_file(file);
+    return rc;
+}
+
+// FUSE poll - readable once the producer has published the allocation
+static int gpu_fuse_poll(const char *path, struct fuse_file_info *fi,
+                         struct fuse_pollhandle *ph, unsigned *reventsp)
+{
+    UNUSED(fi);
     
-    if (size == 0) {
-        // Caller is asking for the size needed
-        return attrs_len;
+    gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
+    if (!file) {
+        if (ph) {
+            fuse_pollhandle_destroy(ph);
+        }
+        return -ENOENT;
     }
     
-    if (size < attrs_len) {
-        return -ERANGE;  // Buffer too small
+    pthread_mutex_lock(&file->mutex);
+    if (file->ready) {
+        *reventsp |= POLLIN | POLLRDNORM;
+        if (ph) {
+            fuse_pollhandle_destroy(ph);
+        }
+    } else if (ph) {
+        // Keep the handle so gpu_fuse_notify_ready() can wake the caller
+        file->poll_handles = g_list_prepend(file->poll_handles, ph);
     }
+    pthread_mutex_unlock(&file->mutex);
+    gpu_fuse_put_file(file);
     
-    memcpy(list, attrs, attrs_len);
-    printf("Listed extended attributes: fabric_handle, allocation_size\n");
-    return attrs_len;
+    return 0;
 }
 
 // FUSE destroy - cleanup filesystem
@@ -407,6 +3521,44 @@ static void gpu_fuse_destroy(void *private_data)
     if (g_gpu_ctx) {
         printf("Destroying GPU Memory FUSE filesystem\n");
         
+        // A throttled checkpoint in progress finishes at full speed
+        if (g_gpu_ctx->ckpt_thread_started) {
+            pthread_mutex_lock(&g_gpu_ctx->job_mutex);
+            g_gpu_ctx->ckpt_stop = true;
+            pthread_cond_broadcast(&g_gpu_ctx->job_cond);
+            pthread_mutex_unlock(&g_gpu_ctx->job_mutex);
+            gpu_rate_set_max(&g_gpu_ctx->ckpt_rate, 0);
+            pthread_join(g_gpu_ctx->ckpt_thread, NULL);
+            g_gpu_ctx->ckpt_thread_started = false;
+        }
+        
+        if (g_gpu_ctx->scrub_started) {
+            __atomic_store_n(&g_gpu_ctx->scrub_stop, true, __ATOMIC_RELAXED);
+            pthread_join(g_gpu_ctx->scrub_thread, NULL);
+            g_gpu_ctx->scrub_started = false;
+        }
+        
+        // Files not prefetched yet stay in the checkpoint
+        if (g_gpu_ctx->prefetch_started) {
+            __atomic_store_n(&g_gpu_ctx->prefetch_stop, true, __ATOMIC_RELAXED);
+            pthread_join(g_gpu_ctx->prefetch_thread, NULL);
+            g_gpu_ctx->prefetch_started = false;
+        }
+        
+        // Checkpoints taken before unmount still reach the disk
+        if (g_gpu_ctx->tier_started) {
+            gpu_rate_set_max(&g_gpu_ctx->ckpt_rate, 0);
+            gpu_tier_destroy(&g_gpu_ctx->tier);
+            gpu_rate_destroy(&g_gpu_ctx->ckpt_rate);
+            g_gpu_ctx->tier_started = false;
+        }
+        
+        // Finish background releases, they still use the scheduler
+        if (g_gpu_ctx->release_pool) {
+            g_thread_pool_free(g_gpu_ctx->release_pool, FALSE, TRUE);
+            g_gpu_ctx->release_pool = NULL;
+        }
+        
         // Cleanup all files and their GPU memory
         pthread_mutex_lock(&g_gpu_ctx->global_mutex);
         
@@ -415,15 +3567,40 @@ static void gpu_fuse_destroy(void *private_data)
         
         g_hash_table_iter_init(&iter, g_gpu_ctx->files);
         while (g_hash_table_iter_next(&iter, &key, &value)) {
-            gpu_file_t *file = (gpu_file_t*)value;
-            gpu_fuse_cleanup_gpu_memory(file);
-            pthread_mutex_destroy(&file->mutex);
+            gpu_fuse_free_file((gpu_file_t*)value);
         }
         
         pthread_mutex_unlock(&g_gpu_ctx->global_mutex);
         
-        // Cleanup hash table
+        // Cleanup hash tables
         g_hash_table_destroy(g_gpu_ctx->files);
+        g_hash_table_destroy(g_gpu_ctx->dirs);
+        if (g_gpu_ctx->ckpt.records) {
+            gpu_ckpt_close(&g_gpu_ctx->ckpt);
+        }
+        if (g_gpu_ctx->ckpt_fd >= 0) {
+            close(g_gpu_ctx->ckpt_fd);
+        }
+        if (g_gpu_ctx->xfer_started) {
+            gpu_xfer_destroy(&g_gpu_ctx->xfer);
+        }
+        if (g_gpu_ctx->trace_open) {
+            gpu_trace_close(&g_gpu_ctx->trace);
+            g_gpu_ctx->trace_open = false;
+        }
+        
+        if (g_gpu_ctx->started) {
+            gpu_sched_destroy(&g_gpu_ctx->sched);
+        }
+        gpu_resv_cancel_all(g_gpu_ctx);
+        g_hash_table_destroy(g_gpu_ctx->reservations);
+        pthread_mutex_destroy(&g_gpu_ctx->resv_mutex);
+        gpu_cgroup_ledger_destroy(&g_gpu_ctx->cgroups);
+        
+        if (g_gpu_ctx->started) {
+            gpu_device_release_all(g_gpu_ctx->devices, g_gpu_ctx->ndevices);
+            gpu_admit_destroy(&g_gpu_ctx->admit);
+        }
         
         pthread_mutex_destroy(&g_gpu_ctx->global_mutex);
         
@@ -436,16 +3613,31 @@ static void gpu_fuse_destroy(void *private_data)
 // FUSE read - read from file
 // Probably not needed since we can use getxattr to get the fabric handle. This is just for testing.
 static int gpu_fuse_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    UNUSED(fi);
-    
     printf("gpu_fuse_read called: path=%s, size=%zu, offset=%ld\n", path, size, offset);
     gpu_file_t *file = gpu_fuse_get_file_from_path(g_gpu_ctx, path);
     if (!file) {
         return -ENOENT;
     }
 
+    // Serve the version pinned at open, so a reader never sees a handle
+    // change under it; handles opened before any allocation see the current one
+    CUmemFabricHandle fabric_handle;
+    gpu_version_t *pinned = fi ? (gpu_version_t *)(uintptr_t)fi->fh : NULL;
+    bool allocated = true;
+    if (pinned) {
+        memcpy(&fabric_handle, &pinned->fabric_handle, sizeof(CUmemFabricHandle));
+    } else {
+        pthread_mutex_lock(&file->mutex);
+        allocated = file->current != NULL;
+        if (allocated) {
+            memcpy(&fabric_handle, &file->current->fabric_handle, sizeof(CUmemFabricHandle));
+        }
+        pthread_mutex_unlock(&file->mutex);
+    }
+    gpu_fuse_put_file(file);
+    
     // Check if GPU memory is allocated
-    if (file->gpu_handle == 0) {
+    if (!allocated) {
         printf("No GPU memory allocated for %s\n", path);
         return -ENODATA;
     }
@@ -457,7 +3649,7 @@ static int gpu_fuse_read(const char *path, char *buf, size_t size, off_t offset,
 
     // Read the fabric handle
     if (size >= sizeof(CUmemFabricHandle)) {
-        memcpy(buf, &file->fabric_handle, sizeof(CUmemFabricHandle));
+        memcpy(buf, &fabric_handle, sizeof(CUmemFabricHandle));
         printf("Read fabric handle for %s: %zu bytes\n", path, sizeof(CUmemFabricHandle));
         return sizeof(CUmemFabricHandle);  // Return actual bytes read
     } else {
@@ -473,21 +3665,261 @@ static struct fuse_operations gpu_fuse_ops = {
     .getattr    = gpu_fuse_getattr,  // Required to check if file exists
     .readdir    = gpu_fuse_readdir,  // Required for ls to work
     .create     = gpu_fuse_create,   // Required to create files
+    .mkdir      = gpu_fuse_mkdir,    // Group files into directories
+    .rmdir      = gpu_fuse_rmdir,    // Remove empty directories
+    .unlink     = gpu_fuse_unlink,   // Remove files
+    .rename     = gpu_fuse_rename,   // Move files and directories
     .open       = gpu_fuse_open,     // Required to open files for reading/writing
     .truncate   = gpu_fuse_truncate, // Required for truncate -s SIZE
     .utimens    = gpu_fuse_utimens,  // Required to avoid touch warnings
     .getxattr   = gpu_fuse_getxattr, // Get extended attributes (fabric handle, size)
+    .setxattr   = gpu_fuse_setxattr, // Set extended attributes (publish state)
     .listxattr  = gpu_fuse_listxattr,// List available extended attributes
+    .poll       = gpu_fuse_poll,     // Wait for the producer to publish
+    .release    = gpu_fuse_release,  // Unpin the version seen at open
     .init       = gpu_fuse_init,     // Required for filesystem initialization
     .destroy    = gpu_fuse_destroy,  // Required for cleanup
     .read       = gpu_fuse_read,     // Required for read
 };
 
+// Wrappers recording each operation with -o trace. The calling thread is
+// the thread id of the client, 0 where the kernel calls on its own.
+static void gpu_fuse_trace(gpu_trace_op_t op, const char *path, uint64_t arg, uint64_t aux,
+                           uint64_t start, int rc)
+{
+    struct fuse_context *fctx = fuse_get_context();
+    gpu_trace_record(&g_gpu_ctx->trace, op, path, arg, aux, fctx ? (uint32_t)fctx->pid : 0,
+                     start, rc);
+}
+
+static int gpu_fuse_traced_getattr(const char *path, struct stat *stbuf,
+                                   struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_getattr(path, stbuf, fi);
+    gpu_fuse_trace(GPU_TRACE_GETATTR, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                                   off_t offset, struct fuse_file_info *fi,
+                                   enum fuse_readdir_flags flags)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_readdir(path, buf, filler, offset, fi, flags);
+    gpu_fuse_trace(GPU_TRACE_READDIR, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_create(const char *path, mode_t mode, struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_create(path, mode, fi);
+    gpu_fuse_trace(GPU_TRACE_CREATE, path, 0, (uint64_t)fi->flags, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_mkdir(const char *path, mode_t mode)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_mkdir(path, mode);
+    gpu_fuse_trace(GPU_TRACE_MKDIR, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_rmdir(const char *path)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_rmdir(path);
+    gpu_fuse_trace(GPU_TRACE_RMDIR, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_unlink(const char *path)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_unlink(path);
+    gpu_fuse_trace(GPU_TRACE_UNLINK, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_rename(const char *from, const char *to, unsigned int flags)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_rename(from, to, flags);
+    gpu_fuse_trace(GPU_TRACE_RENAME, from, flags, gpu_trace_hash(to), start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_open(const char *path, struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_open(path, fi);
+    gpu_fuse_trace(GPU_TRACE_OPEN, path, 0, (uint64_t)fi->flags, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_truncate(path, size, fi);
+    gpu_fuse_trace(GPU_TRACE_TRUNCATE, path, (uint64_t)size, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_utimens(const char *path, const struct timespec ts[2],
+                                   struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_utimens(path, ts, fi);
+    gpu_fuse_trace(GPU_TRACE_UTIMENS, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_getxattr(const char *path, const char *name, char *value, size_t size)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_getxattr(path, name, value, size);
+    gpu_fuse_trace(GPU_TRACE_GETXATTR, path, size, gpu_trace_hash(name), start, rc);
+    return rc;
+}
+
+// Values that drive allocation are recorded parsed, so traces can be
+// replayed and simulated: sizes, the priority and the flags. Anything else,
+// or a value that does not parse, is recorded by its length.
+static uint64_t gpu_fuse_trace_xattr_arg(const char *name, const char *value, size_t size)
+{
+    char buf[32];
+    size_t bytes;
+    long priority;
+    bool flag;
+    if ((strcmp(name, "user.gpu.size") == 0 || strcmp(name, "user.gpu.stage_size") == 0) &&
+        gpu_fuse_copy_value(value, size, buf, sizeof(buf)) == 0 &&
+        gpu_fuse_parse_size(buf, &bytes) == 0) {
+        return bytes;
+    }
+    if (strcmp(name, "user.gpu.priority") == 0 && gpu_fuse_parse_int(value, size, &priority) == 0) {
+        return (uint64_t)priority;
+    }
+    if ((strcmp(name, "user.gpu.ready") == 0 || strcmp(name, "user.gpu.durable") == 0 ||
+         strcmp(name, "user.gpu.publish") == 0) &&
+        gpu_fuse_parse_bool(value, size, &flag) == 0) {
+        return flag;
+    }
+    return size;
+}
+
+static int gpu_fuse_traced_setxattr(const char *path, const char *name, const char *value,
+                                    size_t size, int flags)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_setxattr(path, name, value, size, flags);
+    gpu_fuse_trace(GPU_TRACE_SETXATTR, path, gpu_fuse_trace_xattr_arg(name, value, size),
+                   gpu_trace_hash(name), start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_listxattr(const char *path, char *list, size_t size)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_listxattr(path, list, size);
+    gpu_fuse_trace(GPU_TRACE_LISTXATTR, path, size, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_poll(const char *path, struct fuse_file_info *fi,
+                                struct fuse_pollhandle *ph, unsigned *reventsp)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_poll(path, fi, ph, reventsp);
+    gpu_fuse_trace(GPU_TRACE_POLL, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_release(const char *path, struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_release(path, fi);
+    gpu_fuse_trace(GPU_TRACE_RELEASE, path, 0, 0, start, rc);
+    return rc;
+}
+
+static int gpu_fuse_traced_read(const char *path, char *buf, size_t size, off_t offset,
+                                struct fuse_file_info *fi)
+{
+    uint64_t start = gpu_trace_now();
+    int rc = gpu_fuse_read(path, buf, size, offset, fi);
+    gpu_fuse_trace(GPU_TRACE_READ, path, size, (uint64_t)offset, start, rc);
+    return rc;
+}
+
+// Same operations, each recorded to the trace
+static struct fuse_operations gpu_fuse_traced_ops = {
+    .getattr    = gpu_fuse_traced_getattr,
+    .readdir    = gpu_fuse_traced_readdir,
+    .create     = gpu_fuse_traced_create,
+    .mkdir      = gpu_fuse_traced_mkdir,
+    .rmdir      = gpu_fuse_traced_rmdir,
+    .unlink     = gpu_fuse_traced_unlink,
+    .rename     = gpu_fuse_traced_rename,
+    .open       = gpu_fuse_traced_open,
+    .truncate   = gpu_fuse_traced_truncate,
+    .utimens    = gpu_fuse_traced_utimens,
+    .getxattr   = gpu_fuse_traced_getxattr,
+    .setxattr   = gpu_fuse_traced_setxattr,
+    .listxattr  = gpu_fuse_traced_listxattr,
+    .poll       = gpu_fuse_traced_poll,
+    .release    = gpu_fuse_traced_release,
+    .init       = gpu_fuse_init,
+    .destroy    = gpu_fuse_destroy,
+    .read       = gpu_fuse_traced_read,
+};
+
+#define GPU_FUSE_OPT(templ, field, value) { templ, offsetof(gpu_fuse_options_t, field), value }
+
+// Daemon specific mount options, everything else is passed to FUSE
+static const struct fuse_opt gpu_fuse_opts[] = {
+    GPU_FUSE_OPT("capacity=%s", capacity, 0),
+    GPU_FUSE_OPT("alloc_wait", alloc_wait, 1),
+    GPU_FUSE_OPT("alloc_timeout_ms=%u", alloc_timeout_ms, 0),
+    GPU_FUSE_OPT("alloc_policy=%s", alloc_policy, 0),
+    GPU_FUSE_OPT("cgroup_limits=%s", cgroup_limits, 0),
+    GPU_FUSE_OPT("sched_threads=%u", sched_threads, 0),
+    GPU_FUSE_OPT("sched_tenant=%s", sched_tenant, 0),
+    GPU_FUSE_OPT("device=%d", device, 0),
+    GPU_FUSE_OPT("ingest_threads=%u", ingest_threads, 0),
+    GPU_FUSE_OPT("checkpoint=%s", checkpoint, 0),
+    GPU_FUSE_OPT("ckpt_host=%s", ckpt_host, 0),
+    GPU_FUSE_OPT("ckpt_interval=%u", ckpt_interval, 0),
+    GPU_FUSE_OPT("ckpt_bw=%s", ckpt_bw, 0),
+    GPU_FUSE_OPT("xfer=%s", xfer, 0),
+    GPU_FUSE_OPT("trace=%s", trace, 0),
+    FUSE_OPT_END
+};
+
 // Main function
 int main(int argc, char *argv[])
 {
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <mountpoint> [FUSE options]\n", argv[0]);
+        fprintf(stderr, "GPU options:\n"
+                "    -o capacity=SIZE         admission capacity (default: device memory)\n"
+                "    -o alloc_wait            queue allocations while the device is full\n"
+                "    -o alloc_timeout_ms=N    longest admission wait (default: 30000)\n"
+                "    -o alloc_policy=POLICY   fifo or priority (default: fifo)\n"
+                "    -o cgroup_limits=FILE    per-cgroup limits, \"PATH SIZE\" per line\n"
+                "    -o sched_threads=N       driver worker threads, 0 runs inline (default: 0)\n"
+                "    -o sched_tenant=KEY      schedule tenants by uid or cgroup (default: uid)\n"
+                "    -o device=N              device that serves allocations (default: 0)\n"
+                "    -o ingest_threads=N      threads loading a checkpoint (default: 4)\n"
+                "    -o checkpoint=FILE       save durable files to FILE, restore them at start\n"
+                "    -o ckpt_host=SIZE        pinned host memory checkpoints stage in (default: 1G)\n"
+                "    -o ckpt_interval=SEC     take a background checkpoint every SEC seconds\n"
+                "    -o ckpt_bw=SIZE          bandwidth cap of background checkpoints per second,\n"
+                "                             0 for none (default: 1G)\n"
+                "    -o xfer=BACKEND          auto, cuda or gds: how restores and ingest reach\n"
+                "                             the device (default: auto)\n"
+                "    -o trace=FILE            record every operation to FILE for gpu_trace_replay\n");
         return 1;
     }
     
@@ -499,17 +3931,61 @@ int main(int argc, char *argv[])
     }
     
     g_gpu_ctx->mount_point = strdup(argv[1]);
-    g_gpu_ctx->files = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    g_gpu_ctx->files = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    g_gpu_ctx->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
     pthread_mutex_init(&g_gpu_ctx->global_mutex, NULL);
+    g_gpu_ctx->reservations = g_hash_table_new(g_str_hash, g_str_equal);
+    pthread_mutex_init(&g_gpu_ctx->resv_mutex, NULL);
+    pthread_mutex_init(&g_gpu_ctx->ckpt_mutex, NULL);
+    pthread_mutex_init(&g_gpu_ctx->job_mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);  // Intervals ignore clock changes
+    pthread_cond_init(&g_gpu_ctx->job_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    g_gpu_ctx->ckpt_fd = -1;
+    gpu_cgroup_ledger_init(&g_gpu_ctx->cgroups);
+    gpu_fuse_add_dir_locked("/");
     
-    // Initialize CUDA
-    if (gpu_fuse_init_cuda(g_gpu_ctx) != 0) {
-        fprintf(stderr, "Failed to initialize CUDA\n");
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    g_gpu_ctx->opts.alloc_timeout_ms = 30000;
+    g_gpu_ctx->opts.ingest_threads = 4;
+    if (fuse_opt_parse(&args, &g_gpu_ctx->opts, gpu_fuse_opts, NULL) != 0) {
+        return 1;
+    }
+    
+    if (g_gpu_ctx->opts.cgroup_limits &&
+        gpu_cgroup_load_limits(&g_gpu_ctx->cgroups, g_gpu_ctx->opts.cgroup_limits,
+                               gpu_fuse_parse_size) != 0) {
+        fprintf(stderr, "Failed to load cgroup limits from %s\n", g_gpu_ctx->opts.cgroup_limits);
         return 1;
     }
     
+    if (g_gpu_ctx->opts.sched_tenant) {
+        if (strcmp(g_gpu_ctx->opts.sched_tenant, "cgroup") == 0) {
+            g_gpu_ctx->sched_by_cgroup = true;
+        } else if (strcmp(g_gpu_ctx->opts.sched_tenant, "uid") != 0) {
+            fprintf(stderr, "Invalid sched_tenant: %s\n", g_gpu_ctx->opts.sched_tenant);
+            return 1;
+        }
+    }
+    
+    // Opened before fuse_main forks, so a relative path and errors behave
+    // as expected; the writer thread starts in init
+    if (g_gpu_ctx->opts.trace) {
+        int rc = gpu_trace_open(&g_gpu_ctx->trace, g_gpu_ctx->opts.trace);
+        if (rc != 0) {
+            fprintf(stderr, "Failed to open trace %s: %s\n", g_gpu_ctx->opts.trace, strerror(-rc));
+            return 1;
+        }
+        g_gpu_ctx->trace_open = true;
+    }
+    
     printf("Starting GPU Memory FUSE filesystem on %s\n", argv[1]);
     
     // Start FUSE
-    return fuse_main(argc, argv, &gpu_fuse_ops, NULL);
+    int ret = fuse_main(args.argc, args.argv,
+                        g_gpu_ctx->trace_open ? &gpu_fuse_traced_ops : &gpu_fuse_ops, NULL);
+    fuse_opt_free_args(&args);
+    return ret;
 }
\ No newline at end of file
@@ -6,35 +6,189 @@
 #include <glib.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
+#include "gpu_admit.h"
+#include "gpu_resv.h"
+#include "gpu_cgroup.h"
+#include "gpu_sched.h"
+#include "gpu_device.h"
+#include "gpu_ingest.h"
+#include "gpu_ckpt.h"
+#include "gpu_tier.h"
+#include "gpu_rate.h"
+#include "gpu_xfer.h"
+#include "gpu_trace.h"
+
 // Configuration constants
 #define MAX_PATH_LEN 512
+#define GPU_FUSE_TXN_PREFIX ".txn."   // Staging directories of transactions
+#define GPU_FUSE_RELEASE_BATCH 64     // Files per background release task
+#define GPU_FUSE_RELEASE_THREADS 4    // Threads releasing removed trees
+#define GPU_FUSE_CKPT_HOST (1ULL << 30) // Default host tier of checkpoints
+#define GPU_FUSE_CKPT_BW (1ULL << 30)   // Default bandwidth cap of periodic checkpoints, bytes/s
 
 #define UNUSED(x) (void)(x)
 
+// One GPU allocation of a file. A file points at its current version and
+// possibly a staged one; open file handles pin the version that was current
+// when they were opened, so publishing a new version never pulls memory out
+// from under a reader. The memory is released with the last reference.
+typedef struct {
+    int refcount;                             // File pointers + open handles
+    uint64_t seq;                             // Version number within the file
+    CUmemGenericAllocationHandle gpu_handle;
+    CUmemFabricHandle fabric_handle;
+    size_t size;
+    CUevent fence;                            // Interprocess completion event, NULL if none
+    CUipcEventHandle fence_handle;            // Exported handle for fence
+    gpu_reservation_t *reservation;           // Drawn from (referenced), NULL for device
+    gpu_cgroup_t *cgroup;                     // Charged cgroup, NULL if drawn from a reservation
+    int sharers;                              // Files with shared set pointing at it (atomic)
+} gpu_version_t;
+
+// Contents of a file still in the checkpoint container after a restart.
+// They are copied to the device when a client first needs the memory, or
+// earlier by the background prefetch.
+typedef struct {
+    const gpu_ckpt_record_t *rec;             // In the daemon's open container
+    bool running;                             // Copy in flight, file->mutex dropped
+} gpu_restore_t;
+
 // Simple file entry - tracks files and their GPU allocations
 typedef struct {
-    char path[MAX_PATH_LEN];
-    CUmemGenericAllocationHandle gpu_handle;  // 0 means no GPU memory allocated
-    CUmemFabricHandle fabric_handle;          // 0 means no fabric handle allocated
-    size_t size;                              // 0 means no GPU memory allocated
+    char path[MAX_PATH_LEN];                  // Changed by rename under global_mutex
+    int refcount;                             // Index + in-flight operations, global_mutex
+    gpu_version_t *current;                   // Published allocation, NULL if none
+    gpu_version_t *staged;                    // Next version being filled, NULL if none
+    uint64_t next_seq;                        // Number of the next version
     time_t created_time;
     time_t access_time;
     time_t modify_time;
+    bool ready;                               // Set by the producer via user.gpu.ready
+    bool shared;                              // current came from or went to a snapshot
+    GList *poll_handles;                      // struct fuse_pollhandle* waiting for ready
+    bool allocating;                          // Allocation in flight, mutex dropped
+    int priority;                             // Admission priority, higher goes first
+    gpu_reservation_t *reservation;           // Budget allocations draw from, NULL for device
+    bool durable;                             // Persisted across restarts, else scratch
+    char dtype[GPU_INGEST_DTYPE_LEN];         // Element type of a tensor, empty if none
+    char shape[GPU_INGEST_SHAPE_LEN];         // "d0,d1,..." of a tensor
+    gpu_restore_t *restore;                   // Pending restore, NULL once in memory
+    pthread_cond_t restore_cond;              // Broadcast when a restore attempt ends
+    uint64_t first_access;                    // Order of first use, 0 if unused
     pthread_mutex_t mutex;
 } gpu_file_t;
 
-// Main FUSE context
+// Directory entry. Directories only group files; the generation is bumped
+// by every transaction committed into the directory so readers can detect
+// that a set of files changed while they were reading it.
 typedef struct {
+    char path[MAX_PATH_LEN];
+    uint64_t generation;
+    time_t created_time;
+    time_t modify_time;
+} gpu_dir_t;
+
+typedef enum {
+    GPU_FUSE_CKPT_IDLE,
+    GPU_FUSE_CKPT_COPYING,                    // Into the host tier
+    GPU_FUSE_CKPT_WRITING,                    // Waiting for the container to reach the disk
+} gpu_fuse_ckpt_state_t;
+
+// The running or last checkpoint, for user.gpu.ckpt_status
+typedef struct {
+    uint64_t id;
+    bool background;                          // Periodic, throttled
+    gpu_fuse_ckpt_state_t state;
+    uint64_t total;                           // Payload bytes to copy
+    uint64_t done;                            // Payload bytes copied (atomic)
+    int64_t start_us;
+    int64_t elapsed_us;                       // Set when the job ends
+    int rc;
+} gpu_fuse_ckpt_job_t;
+
+// Mount options, parsed from -o name[=value]
+typedef struct {
+    char *capacity;               // Admission capacity ("40G"), defaults to device memory
+    int alloc_wait;               // Queue allocations instead of failing with ENOMEM
+    unsigned alloc_timeout_ms;    // Longest time an allocation may queue
+    char *alloc_policy;           // "fifo" (default) or "priority"
+    char *cgroup_limits;          // File of "PATH SIZE" cgroup limits
+    unsigned sched_threads;       // Driver worker threads, 0 runs driver calls inline
+    char *sched_tenant;           // "uid" (default) or "cgroup"
+    int device;                   // Ordinal of the device serving allocations
+    unsigned ingest_threads;      // Threads copying a checkpoint to the device
+    char *checkpoint;             // Container durable files are saved to and restored from
+    char *ckpt_host;              // Pinned host memory checkpoints are staged in ("1G")
+    unsigned ckpt_interval;       // Seconds between periodic checkpoints, 0 for none
+    char *ckpt_bw;                // Bandwidth cap of periodic checkpoints per second ("1G")
+    char *xfer;                   // Restore and ingest path: "auto" (default), "cuda" or "gds"
+    char *trace;                  // File every operation is recorded to
+} gpu_fuse_options_t;
+
+// Main FUSE context
+typedef struct gpu_fuse_context {
     char *mount_point;
     GHashTable *files;            // path -> gpu_file_t*
+    GHashTable *dirs;             // path -> gpu_dir_t*, includes "/"
     pthread_mutex_t global_mutex;
-    CUdevice cuda_device;
+    gpu_device_t *devices;        // Every visible device, set up by gpu_fuse_init
+    int ndevices;
+    bool started;                 // gpu_fuse_init completed
+    gpu_device_t *device;         // Entry of devices serving allocations
+    CUdevice cuda_device;         // Device serving allocations
+    size_t device_memory;         // Total memory of cuda_device
+    gpu_fuse_options_t opts;
+    size_t granularity;           // Minimum allocation granularity of cuda_device
+    gpu_admit_t admit;            // Admission control for cuda_device
+    GHashTable *reservations;     // name -> gpu_reservation_t*
+    pthread_mutex_t resv_mutex;   // Protects reservations and their counters
+    gpu_cgroup_ledger_t cgroups;  // Per-cgroup usage and limits
+    gpu_sched_t sched;            // Fair scheduler for driver operations
+    bool sched_by_cgroup;         // Tenants are cgroups rather than uids
+    gpu_xfer_t xfer;              // Reads checkpoints and safetensors files into allocations
+    bool xfer_started;
+    GThreadPool *release_pool;    // Frees removed trees in the background
+    uint64_t release_pending;     // Files queued on release_pool (atomic)
+    pthread_mutex_t ckpt_mutex;   // Serialises checkpoints
+    gpu_tier_t tier;              // Host tier checkpoints are copied into
+    bool tier_started;
+    gpu_rate_t ckpt_rate;         // Throttles periodic checkpoints
+    pthread_mutex_t job_mutex;    // Protects ckpt_job, the periodic thread and scrub state
+    pthread_cond_t job_cond;      // Wakes the periodic thread to stop
+    gpu_fuse_ckpt_job_t ckpt_job;
+    pthread_t ckpt_thread;        // Takes periodic checkpoints
+    bool ckpt_thread_started;
+    bool ckpt_stop;
+    uint64_t fg_active;           // Foreground copies in flight (ingest, on-demand restores, atomic)
+    gpu_ckpt_reader_t ckpt;       // Container restored from, open while files are pending
+    int ckpt_fd;                  // Same file for the copy engine, -1 if none
+    uint64_t access_clock;        // Last first_access stamp (atomic)
+    pthread_t prefetch_thread;    // Restores pending files in first-access order
+    bool prefetch_started;
+    bool prefetch_stop;           // Asks the prefetch thread to exit (atomic)
+    uint64_t restore_pending;     // Files not restored yet (atomic)
+    uint64_t restored_demand;     // Restored because a client asked (atomic)
+    uint64_t restored_prefetch;   // Restored ahead of use (atomic)
+    uint64_t restore_verified;    // Restored bytes checked against checksums (atomic)
+    uint64_t restore_errors;      // Restores that failed, checksum mismatches included (atomic)
+    pthread_t scrub_thread;       // Verifies the checkpoint container
+    bool scrub_started;           // scrub_thread has to be joined
+    bool scrub_running;
+    bool scrub_stop;              // Asks the scrub to stop (atomic)
+    int64_t scrub_start_us;
+    gpu_ckpt_scrub_stats_t scrub_stats;
+    int scrub_rc;                 // Result of the last scrub
+    gpu_trace_t trace;            // Operation trace, with -o trace
+    bool trace_open;
 } gpu_fuse_context_t;
 
 // Function declarations
 int gpu_fuse_init_cuda(gpu_fuse_context_t *ctx);
+int gpu_fuse_parse_size(const char *str, size_t *out);
+void gpu_fuse_init_alloc_props(gpu_fuse_context_t *ctx, CUmemAllocationProp *props);
 //gpu_file_t *gpu_fuse_get_file(gpu_fuse_context_t *ctx, const char *path);
 int gpu_fuse_cleanup_gpu_memory(gpu_file_t *file);
 
@@ -0,0 +1,100 @@
+#include "gpu_policy.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *gpu_policy_evict_names[] = { "none", "lru", "largest", "priority" };
+
+bool gpu_policy_queue_ahead(gpu_admit_policy_t policy, int priority, int queued_priority)
+{
+    return policy == GPU_ADMIT_PRIORITY && queued_priority < priority;
+}
+
+int gpu_policy_parse_admit(const char *str, gpu_admit_policy_t *policy)
+{
+    if (strcmp(str, "fifo") == 0) {
+        *policy = GPU_ADMIT_FIFO;
+    } else if (strcmp(str, "priority") == 0) {
+        *policy = GPU_ADMIT_PRIORITY;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+const char *gpu_policy_admit_name(gpu_admit_policy_t policy)
+{
+    return policy == GPU_ADMIT_PRIORITY ? "priority" : "fifo";
+}
+
+size_t gpu_policy_alloc_size(size_t size, size_t granularity)
+{
+    if (granularity == 0) {
+        return size;
+    }
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+static int gpu_policy_cmp_u64(uint64_t a, uint64_t b)
+{
+    return (a > b) - (a < b);
+}
+
+static int gpu_policy_cmp_lru(const void *a, const void *b)
+{
+    const gpu_evict_candidate_t *x = a, *y = b;
+    int rc = gpu_policy_cmp_u64(x->last_use, y->last_use);
+    return rc != 0 ? rc : gpu_policy_cmp_u64(x->id, y->id);
+}
+
+static int gpu_policy_cmp_largest(const void *a, const void *b)
+{
+    const gpu_evict_candidate_t *x = a, *y = b;
+    int rc = gpu_policy_cmp_u64(y->bytes, x->bytes);
+    return rc != 0 ? rc : gpu_policy_cmp_lru(a, b);
+}
+
+static int gpu_policy_cmp_priority(const void *a, const void *b)
+{
+    const gpu_evict_candidate_t *x = a, *y = b;
+    int rc = (x->priority > y->priority) - (x->priority < y->priority);
+    return rc != 0 ? rc : gpu_policy_cmp_lru(a, b);
+}
+
+void gpu_policy_evict_order(gpu_evict_policy_t policy, gpu_evict_candidate_t *candidates,
+                            size_t count)
+{
+    if (count < 2) {
+        return;
+    }
+    switch (policy) {
+    case GPU_EVICT_LRU:
+        qsort(candidates, count, sizeof(*candidates), gpu_policy_cmp_lru);
+        break;
+    case GPU_EVICT_LARGEST:
+        qsort(candidates, count, sizeof(*candidates), gpu_policy_cmp_largest);
+        break;
+    case GPU_EVICT_PRIORITY:
+        qsort(candidates, count, sizeof(*candidates), gpu_policy_cmp_priority);
+        break;
+    case GPU_EVICT_NONE:
+        break;
+    }
+}
+
+int gpu_policy_parse_evict(const char *str, gpu_evict_policy_t *policy)
+{
+    for (size_t i = 0; i < sizeof(gpu_policy_evict_names) / sizeof(gpu_policy_evict_names[0]);
+         i++) {
+        if (strcmp(str, gpu_policy_evict_names[i]) == 0) {
+            *policy = (gpu_evict_policy_t)i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+const char *gpu_policy_evict_name(gpu_evict_policy_t policy)
+{
+    return policy <= GPU_EVICT_PRIORITY ? gpu_policy_evict_names[policy] : "unknown";
+}
@@ -0,0 +1,44 @@
+#ifndef GPU_POLICY_H
+#define GPU_POLICY_H
+
+#include "gpu_admit.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocation policy decisions, kept free of CUDA and locking so that
+// gpu_alloc_sim evaluates a trace with the same code the daemon runs.
+
+// Whether a new request of priority is queued ahead of a waiting one
+bool gpu_policy_queue_ahead(gpu_admit_policy_t policy, int priority, int queued_priority);
+int gpu_policy_parse_admit(const char *str, gpu_admit_policy_t *policy);
+const char *gpu_policy_admit_name(gpu_admit_policy_t policy);
+
+// Bytes the device sets aside for an allocation of size
+size_t gpu_policy_alloc_size(size_t size, size_t granularity);
+
+// Eviction drops the device copy of a published durable file that nobody
+// has open; the file is loaded from the checkpoint again on its next use,
+// like a lazily restored one.
+typedef enum {
+    GPU_EVICT_NONE,                  // Fail or queue instead
+    GPU_EVICT_LRU,                   // Least recently used first
+    GPU_EVICT_LARGEST,               // Largest first, fewest files dropped
+    GPU_EVICT_PRIORITY,              // Lowest user.gpu.priority first, then LRU
+} gpu_evict_policy_t;
+
+typedef struct {
+    size_t bytes;
+    int priority;
+    uint64_t last_use;               // Any increasing clock
+    uint64_t id;                     // Tie breaker, keeps the order deterministic
+    void *item;
+} gpu_evict_candidate_t;
+
+// Sort candidates into the order they are evicted in
+void gpu_policy_evict_order(gpu_evict_policy_t policy, gpu_evict_candidate_t *candidates,
+                            size_t count);
+int gpu_policy_parse_evict(const char *str, gpu_evict_policy_t *policy);
+const char *gpu_policy_evict_name(gpu_evict_policy_t policy);
+
+#endif // GPU_POLICY_H
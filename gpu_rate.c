@@ -0,0 +1,119 @@
+#include "gpu_rate.h"
+#include <string.h>
+#include <time.h>
+
+static int64_t gpu_rate_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void gpu_rate_init(gpu_rate_t *rate, uint64_t max_rate, size_t burst)
+{
+    memset(rate, 0, sizeof(*rate));
+    pthread_mutex_init(&rate->mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&rate->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    rate->max_rate = (double)max_rate;
+    rate->rate = rate->max_rate;
+    rate->burst = (double)burst;
+    rate->tokens = rate->burst;
+    rate->last_us = gpu_rate_now_us();
+}
+
+void gpu_rate_destroy(gpu_rate_t *rate)
+{
+    pthread_cond_destroy(&rate->cond);
+    pthread_mutex_destroy(&rate->mutex);
+}
+
+static void gpu_rate_refill_locked(gpu_rate_t *rate, int64_t now)
+{
+    rate->tokens += rate->rate * (double)(now - rate->last_us) / 1e6;
+    if (rate->tokens > rate->burst) {
+        rate->tokens = rate->burst;
+    }
+    rate->last_us = now;
+}
+
+void gpu_rate_take(gpu_rate_t *rate, size_t bytes)
+{
+    pthread_mutex_lock(&rate->mutex);
+    if (rate->max_rate == 0) {
+        pthread_mutex_unlock(&rate->mutex);
+        return;
+    }
+    int64_t start = gpu_rate_now_us();
+    gpu_rate_refill_locked(rate, start);
+    rate->tokens -= (double)bytes;
+
+    // Sleep off the debt at the current rate, rechecking when the rate
+    // changes; set_max(0) clears the debt
+    while (rate->tokens < 0 && rate->max_rate != 0) {
+        int64_t wait_us = (int64_t)(-rate->tokens / rate->rate * 1e6) + 1;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += wait_us / 1000000;
+        ts.tv_nsec += (long)(wait_us % 1000000) * 1000;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&rate->cond, &rate->mutex, &ts);
+        gpu_rate_refill_locked(rate, gpu_rate_now_us());
+    }
+    rate->throttled_us += gpu_rate_now_us() - start;
+    pthread_mutex_unlock(&rate->mutex);
+}
+
+void gpu_rate_set_max(gpu_rate_t *rate, uint64_t max_rate)
+{
+    pthread_mutex_lock(&rate->mutex);
+    gpu_rate_refill_locked(rate, gpu_rate_now_us());
+    rate->max_rate = (double)max_rate;
+    rate->rate = rate->max_rate;
+    if (max_rate == 0) {
+        rate->tokens = rate->burst;
+    }
+    pthread_cond_broadcast(&rate->cond);
+    pthread_mutex_unlock(&rate->mutex);
+}
+
+void gpu_rate_backoff(gpu_rate_t *rate)
+{
+    pthread_mutex_lock(&rate->mutex);
+    if (rate->max_rate != 0) {
+        gpu_rate_refill_locked(rate, gpu_rate_now_us());  // Bank tokens at the old rate
+        double floor = rate->max_rate / GPU_RATE_FLOOR_DIV;
+        rate->rate = rate->rate / 2 > floor ? rate->rate / 2 : floor;
+        rate->backoffs++;
+    }
+    pthread_mutex_unlock(&rate->mutex);
+}
+
+void gpu_rate_recover(gpu_rate_t *rate)
+{
+    pthread_mutex_lock(&rate->mutex);
+    if (rate->max_rate != 0 && rate->rate < rate->max_rate) {
+        gpu_rate_refill_locked(rate, gpu_rate_now_us());
+        rate->rate += rate->max_rate / GPU_RATE_STEP_DIV;
+        if (rate->rate > rate->max_rate) {
+            rate->rate = rate->max_rate;
+        }
+    }
+    pthread_mutex_unlock(&rate->mutex);
+}
+
+void gpu_rate_get_stats(gpu_rate_t *rate, gpu_rate_stats_t *stats)
+{
+    pthread_mutex_lock(&rate->mutex);
+    stats->max_rate = (uint64_t)rate->max_rate;
+    stats->rate = (uint64_t)rate->rate;
+    stats->backoffs = rate->backoffs;
+    stats->throttled_us = rate->throttled_us;
+    pthread_mutex_unlock(&rate->mutex);
+}
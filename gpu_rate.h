@@ -0,0 +1,51 @@
+#ifndef GPU_RATE_H
+#define GPU_RATE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bandwidth limit for background work: a token bucket whose rate adapts by
+// additive increase / multiplicative decrease. Callers that see foreground
+// traffic call backoff, which halves the rate down to a floor; every take
+// without contention raises it by a step until the cap is reached again.
+// Tokens may go negative, the debt is paid by sleeping, so a take of any
+// size waits exactly as long as the rate requires.
+
+#define GPU_RATE_FLOOR_DIV 64     // Floor is the cap divided by this
+#define GPU_RATE_STEP_DIV 16      // Additive increase per uncontended take
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;          // Wakes sleepers early when the limit changes
+    double max_rate;              // Cap in bytes per second, 0 for unlimited
+    double rate;                  // Current rate
+    double tokens;
+    double burst;                 // Most tokens that can be banked
+    int64_t last_us;              // Last refill
+    uint64_t backoffs;
+    uint64_t throttled_us;        // Time takers spent sleeping
+} gpu_rate_t;
+
+void gpu_rate_init(gpu_rate_t *rate, uint64_t max_rate, size_t burst);
+void gpu_rate_destroy(gpu_rate_t *rate);
+
+// Wait until bytes fit in the current rate
+void gpu_rate_take(gpu_rate_t *rate, size_t bytes);
+// Change the cap, 0 lifts it and releases every sleeper
+void gpu_rate_set_max(gpu_rate_t *rate, uint64_t max_rate);
+
+void gpu_rate_backoff(gpu_rate_t *rate);
+void gpu_rate_recover(gpu_rate_t *rate);
+
+typedef struct {
+    uint64_t max_rate;
+    uint64_t rate;
+    uint64_t backoffs;
+    uint64_t throttled_us;
+} gpu_rate_stats_t;
+
+void gpu_rate_get_stats(gpu_rate_t *rate, gpu_rate_stats_t *stats);
+
+#endif // GPU_RATE_H
@@ -0,0 +1,251 @@
+#include "gpu_resv.h"
+#include "gpu_mem_fuse.h"
+#include "gpu_policy.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reservation names end up in xattr values and log lines, keep them simple
+static bool gpu_resv_valid_name(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0 || len >= GPU_RESV_NAME_LEN) {
+        return false;
+    }
+    for (const char *c = name; *c; c++) {
+        if (!g_ascii_isalnum(*c) && *c != '_' && *c != '-' && *c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Release held chunks until at most keep physical bytes remain (resv_mutex held)
+static void gpu_resv_trim_locked(gpu_reservation_t *resv, size_t keep)
+{
+    while (resv->chunks->len > 0 && resv->chunk_bytes > keep) {
+        guint last = resv->chunks->len - 1;
+        gpu_resv_chunk_t *chunk = &g_array_index(resv->chunks, gpu_resv_chunk_t, last);
+        CUresult result = cuMemRelease(chunk->handle);
+        if (result != CUDA_SUCCESS) {
+            printf("cuMemRelease of reservation chunk failed: %d\n", result);
+        }
+        resv->chunk_bytes -= chunk->size;
+        g_array_remove_index(resv->chunks, last);
+    }
+}
+
+// Back the whole budget with physical chunks so later draws cannot fail in
+// the driver because of memory taken outside the daemon
+static int gpu_resv_prealloc(gpu_fuse_context_t *ctx, gpu_reservation_t *resv)
+{
+    CUmemAllocationProp props;
+    gpu_fuse_init_alloc_props(ctx, &props);
+
+    while (resv->chunk_bytes < resv->budget) {
+        size_t left = resv->budget - resv->chunk_bytes;
+        size_t size = left < GPU_RESV_CHUNK_SIZE ? left : GPU_RESV_CHUNK_SIZE;
+        size = gpu_policy_alloc_size(size, ctx->granularity);
+
+        gpu_resv_chunk_t chunk = { .size = size };
+        CUresult result = cuMemCreate(&chunk.handle, size, &props, 0);
+        if (result != CUDA_SUCCESS) {
+            printf("cuMemCreate of reservation chunk failed: %d\n", result);
+            return -ENOMEM;
+        }
+        g_array_append_val(resv->chunks, chunk);
+        resv->chunk_bytes += size;
+    }
+    return 0;
+}
+
+static void gpu_resv_free(gpu_reservation_t *resv)
+{
+    g_array_free(resv->chunks, TRUE);
+    free(resv);
+}
+
+int gpu_resv_create(gpu_fuse_context_t *ctx, const char *name, size_t budget,
+                    bool prealloc, gpu_cgroup_t *cgroup, uid_t owner)
+{
+    if (!gpu_resv_valid_name(name) || budget == 0) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ctx->resv_mutex);
+    bool exists = g_hash_table_contains(ctx->reservations, name);
+    pthread_mutex_unlock(&ctx->resv_mutex);
+    if (exists) {
+        return -EEXIST;
+    }
+
+    // Charge and admit the whole budget at once, it is all or nothing
+    int rc = gpu_cgroup_charge(&ctx->cgroups, cgroup, budget);
+    if (rc != 0) {
+        return rc;
+    }
+    struct timespec ts;
+    const struct timespec *deadline = gpu_admit_deadline(&ctx->admit, &ts);
+    rc = gpu_admit_acquire(&ctx->admit, budget, 0, deadline);
+    if (rc != 0) {
+        printf("Reservation %s of %zu bytes not admitted\n", name, budget);
+        gpu_cgroup_uncharge(&ctx->cgroups, cgroup, budget);
+        return rc;
+    }
+
+    gpu_reservation_t *resv = calloc(1, sizeof(gpu_reservation_t));
+    if (!resv) {
+        gpu_admit_release(&ctx->admit, budget);
+        gpu_cgroup_uncharge(&ctx->cgroups, cgroup, budget);
+        return -ENOMEM;
+    }
+    strcpy(resv->name, name);
+    resv->budget = budget;
+    resv->remaining = budget;
+    resv->refcount = 1;  // Owned by the table
+    resv->cgroup = cgroup;
+    resv->owner = owner;
+    resv->chunks = g_array_new(FALSE, FALSE, sizeof(gpu_resv_chunk_t));
+
+    if (prealloc && gpu_resv_prealloc(ctx, resv) != 0) {
+        gpu_resv_trim_locked(resv, 0);
+        gpu_resv_free(resv);
+        gpu_admit_release(&ctx->admit, budget);
+        gpu_cgroup_uncharge(&ctx->cgroups, cgroup, budget);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&ctx->resv_mutex);
+    if (g_hash_table_contains(ctx->reservations, name)) {
+        // Lost a race with a reservation of the same name
+        pthread_mutex_unlock(&ctx->resv_mutex);
+        gpu_resv_trim_locked(resv, 0);
+        gpu_resv_free(resv);
+        gpu_admit_release(&ctx->admit, budget);
+        gpu_cgroup_uncharge(&ctx->cgroups, cgroup, budget);
+        return -EEXIST;
+    }
+    g_hash_table_insert(ctx->reservations, resv->name, resv);
+    pthread_mutex_unlock(&ctx->resv_mutex);
+
+    printf("Reserved %zu bytes as %s (%zu bytes preallocated)\n",
+           budget, name, resv->chunk_bytes);
+    return 0;
+}
+
+int gpu_resv_cancel(gpu_fuse_context_t *ctx, const char *name, const uid_t *owner)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    gpu_reservation_t *resv = g_hash_table_lookup(ctx->reservations, name);
+    if (!resv) {
+        pthread_mutex_unlock(&ctx->resv_mutex);
+        return -ENOENT;
+    }
+    if (owner && resv->owner != *owner) {
+        pthread_mutex_unlock(&ctx->resv_mutex);
+        return -EPERM;
+    }
+    g_hash_table_remove(ctx->reservations, name);
+
+    // Undrawn bytes go back to the device now, drawn bytes as files release them
+    resv->cancelled = true;
+    gpu_resv_trim_locked(resv, 0);
+    gpu_admit_release(&ctx->admit, resv->remaining);
+    gpu_cgroup_uncharge(&ctx->cgroups, resv->cgroup, resv->remaining);
+    printf("Unreserved %s, returned %zu of %zu bytes\n", name, resv->remaining, resv->budget);
+    resv->remaining = 0;
+    pthread_mutex_unlock(&ctx->resv_mutex);
+
+    gpu_resv_put(ctx, resv);
+    return 0;
+}
+
+gpu_reservation_t *gpu_resv_get(gpu_fuse_context_t *ctx, const char *name)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    gpu_reservation_t *resv = g_hash_table_lookup(ctx->reservations, name);
+    if (resv) {
+        resv->refcount++;
+    }
+    pthread_mutex_unlock(&ctx->resv_mutex);
+    return resv;
+}
+
+void gpu_resv_hold(gpu_fuse_context_t *ctx, gpu_reservation_t *resv)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    resv->refcount++;
+    pthread_mutex_unlock(&ctx->resv_mutex);
+}
+
+void gpu_resv_put(gpu_fuse_context_t *ctx, gpu_reservation_t *resv)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    bool last = --resv->refcount == 0;
+    pthread_mutex_unlock(&ctx->resv_mutex);
+    if (last) {
+        gpu_resv_free(resv);
+    }
+}
+
+int gpu_resv_draw(gpu_fuse_context_t *ctx, gpu_reservation_t *resv, size_t bytes)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    if (resv->cancelled || resv->remaining < bytes) {
+        pthread_mutex_unlock(&ctx->resv_mutex);
+        return -ENOMEM;
+    }
+    resv->remaining -= bytes;
+    // Hand physical memory back to the driver for the allocation to take
+    gpu_resv_trim_locked(resv, resv->remaining);
+    pthread_mutex_unlock(&ctx->resv_mutex);
+    return 0;
+}
+
+void gpu_resv_return(gpu_fuse_context_t *ctx, gpu_reservation_t *resv, size_t bytes)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    if (resv->cancelled) {
+        gpu_admit_release(&ctx->admit, bytes);
+        gpu_cgroup_uncharge(&ctx->cgroups, resv->cgroup, bytes);
+    } else {
+        resv->remaining += bytes;
+    }
+    pthread_mutex_unlock(&ctx->resv_mutex);
+}
+
+GString *gpu_resv_format(gpu_fuse_context_t *ctx)
+{
+    GString *out = g_string_new(NULL);
+
+    pthread_mutex_lock(&ctx->resv_mutex);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ctx->reservations);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        gpu_reservation_t *resv = value;
+        g_string_append_printf(out, "%s %zu %zu %zu\n", resv->name, resv->budget,
+                               resv->remaining, resv->chunk_bytes);
+    }
+    pthread_mutex_unlock(&ctx->resv_mutex);
+
+    return out;
+}
+
+void gpu_resv_cancel_all(gpu_fuse_context_t *ctx)
+{
+    pthread_mutex_lock(&ctx->resv_mutex);
+    GList *names = g_hash_table_get_keys(ctx->reservations);
+    GList *copies = NULL;
+    for (GList *l = names; l != NULL; l = l->next) {
+        copies = g_list_prepend(copies, g_strdup(l->data));
+    }
+    g_list_free(names);
+    pthread_mutex_unlock(&ctx->resv_mutex);
+
+    for (GList *l = copies; l != NULL; l = l->next) {
+        gpu_resv_cancel(ctx, l->data, NULL);
+    }
+    g_list_free_full(copies, g_free);
+}
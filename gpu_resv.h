@@ -0,0 +1,56 @@
+#ifndef GPU_RESV_H
+#define GPU_RESV_H
+
+#include <cuda.h>
+#include <glib.h>
+#include "gpu_cgroup.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define GPU_RESV_NAME_LEN 64
+#define GPU_RESV_CHUNK_SIZE (1ULL << 30)  // Backing chunk size for prealloc
+
+typedef struct {
+    CUmemGenericAllocationHandle handle;
+    size_t size;
+} gpu_resv_chunk_t;
+
+// A byte budget admitted up front for a job. Files bound to a reservation
+// draw their allocations from it instead of from the device admission, so a
+// job either gets all of its memory at reserve time or fails fast.
+typedef struct {
+    char name[GPU_RESV_NAME_LEN];
+    size_t budget;                          // Bytes admitted at reserve time
+    size_t remaining;                       // Bytes not drawn yet
+    bool cancelled;                         // Unreserved; returns go to the device
+    int refcount;                           // Table, bound files and versions drawn from it
+    GArray *chunks;                         // gpu_resv_chunk_t held for prealloc
+    size_t chunk_bytes;                     // Physical bytes held in chunks
+    gpu_cgroup_t *cgroup;                   // Charged with the whole budget
+    uid_t owner;                            // Creator, the only user who may bind or cancel
+} gpu_reservation_t;
+
+struct gpu_fuse_context;
+
+int gpu_resv_create(struct gpu_fuse_context *ctx, const char *name, size_t budget,
+                    bool prealloc, gpu_cgroup_t *cgroup, uid_t owner);
+// Cancel a reservation created by *owner, -EPERM if someone else created
+// it. A NULL owner cancels any.
+int gpu_resv_cancel(struct gpu_fuse_context *ctx, const char *name, const uid_t *owner);
+
+// Look up a reservation and take a reference, NULL if unknown
+gpu_reservation_t *gpu_resv_get(struct gpu_fuse_context *ctx, const char *name);
+void gpu_resv_put(struct gpu_fuse_context *ctx, gpu_reservation_t *resv);
+void gpu_resv_hold(struct gpu_fuse_context *ctx, gpu_reservation_t *resv);
+
+// Draw bytes for an allocation (-ENOMEM if the budget is exhausted) and
+// return them when the allocation is released
+int gpu_resv_draw(struct gpu_fuse_context *ctx, gpu_reservation_t *resv, size_t bytes);
+void gpu_resv_return(struct gpu_fuse_context *ctx, gpu_reservation_t *resv, size_t bytes);
+
+// One line per reservation: "name budget remaining held"
+GString *gpu_resv_format(struct gpu_fuse_context *ctx);
+void gpu_resv_cancel_all(struct gpu_fuse_context *ctx);
+
+#endif // GPU_RESV_H
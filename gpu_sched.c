@@ -0,0 +1,259 @@
+#include "gpu_sched.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static gpu_sched_tenant_t *gpu_sched_tenant_get_locked(gpu_sched_t *sched, const char *name)
+{
+    gpu_sched_tenant_t *tenant = g_hash_table_lookup(sched->tenants, name);
+    if (tenant) {
+        return tenant;
+    }
+
+    tenant = calloc(1, sizeof(gpu_sched_tenant_t));
+    if (!tenant) {
+        return NULL;
+    }
+    snprintf(tenant->name, sizeof(tenant->name), "%s", name);
+    tenant->weight = sched->default_weight;
+    g_hash_table_insert(sched->tenants, tenant->name, tenant);
+    return tenant;
+}
+
+// Deficit round robin: the tenant at the head of the active list receives
+// weight units of credit once per visit and runs operations while their cost
+// fits; then it moves to the tail. Called with sched->mutex held.
+static gpu_sched_op_t *gpu_sched_pick_locked(gpu_sched_t *sched, gpu_sched_tenant_t **owner)
+{
+    while (!g_queue_is_empty(&sched->active)) {
+        gpu_sched_tenant_t *tenant = g_queue_peek_head(&sched->active);
+        if (!tenant->in_round) {
+            tenant->deficit += tenant->weight;
+            tenant->in_round = true;
+        }
+
+        gpu_sched_op_t *op = tenant->head;
+        if ((long)op->cost <= tenant->deficit) {
+            tenant->head = op->next;
+            if (!tenant->head) {
+                tenant->tail = NULL;
+            }
+            tenant->queued--;
+            tenant->deficit -= op->cost;
+
+            if (tenant->queued == 0) {
+                // Idle tenants do not bank credit
+                g_queue_pop_head(&sched->active);
+                tenant->active = false;
+                tenant->in_round = false;
+                tenant->deficit = 0;
+            }
+            *owner = tenant;
+            return op;
+        }
+
+        // Out of credit for this round
+        g_queue_pop_head(&sched->active);
+        g_queue_push_tail(&sched->active, tenant);
+        tenant->in_round = false;
+    }
+    return NULL;
+}
+
+static void gpu_sched_record_wait_locked(gpu_sched_tenant_t *tenant, int64_t wait_us)
+{
+    uint64_t wait = wait_us > 0 ? (uint64_t)wait_us : 0;
+    unsigned bucket = 0;
+    while (bucket < GPU_SCHED_HIST_BUCKETS - 1 && (wait >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    tenant->wait_hist[bucket]++;
+    tenant->wait_us_total += wait;
+    if (wait > tenant->wait_us_max) {
+        tenant->wait_us_max = wait;
+    }
+}
+
+static void *gpu_sched_worker(void *arg)
+{
+    gpu_sched_t *sched = arg;
+
+    pthread_mutex_lock(&sched->mutex);
+    for (;;) {
+        gpu_sched_tenant_t *tenant;
+        gpu_sched_op_t *op = gpu_sched_pick_locked(sched, &tenant);
+        if (!op) {
+            if (sched->stopping) {
+                break;
+            }
+            pthread_cond_wait(&sched->work_cond, &sched->mutex);
+            continue;
+        }
+
+        gpu_sched_record_wait_locked(tenant, g_get_monotonic_time() - op->enqueue_us);
+        pthread_mutex_unlock(&sched->mutex);
+
+        op->fn(op->arg);
+
+        pthread_mutex_lock(&sched->mutex);
+        tenant->ops++;
+        op->done = true;
+        pthread_cond_signal(&op->done_cond);
+    }
+    pthread_mutex_unlock(&sched->mutex);
+    return NULL;
+}
+
+int gpu_sched_init(gpu_sched_t *sched, unsigned nworkers)
+{
+    memset(sched, 0, sizeof(*sched));
+    pthread_mutex_init(&sched->mutex, NULL);
+    pthread_cond_init(&sched->work_cond, NULL);
+    sched->tenants = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free);
+    g_queue_init(&sched->active);
+    sched->default_weight = 1;
+
+    if (nworkers == 0) {
+        return 0;
+    }
+    sched->workers = calloc(nworkers, sizeof(pthread_t));
+    if (!sched->workers) {
+        return -ENOMEM;
+    }
+    for (unsigned i = 0; i < nworkers; i++) {
+        int rc = pthread_create(&sched->workers[i], NULL, gpu_sched_worker, sched);
+        if (rc != 0) {
+            gpu_sched_destroy(sched);
+            return -rc;
+        }
+        sched->nworkers++;
+    }
+    return 0;
+}
+
+void gpu_sched_destroy(gpu_sched_t *sched)
+{
+    // Workers drain the queues before they exit
+    pthread_mutex_lock(&sched->mutex);
+    sched->stopping = true;
+    pthread_cond_broadcast(&sched->work_cond);
+    pthread_mutex_unlock(&sched->mutex);
+
+    for (unsigned i = 0; i < sched->nworkers; i++) {
+        pthread_join(sched->workers[i], NULL);
+    }
+    free(sched->workers);
+    sched->workers = NULL;
+    sched->nworkers = 0;
+
+    g_queue_clear(&sched->active);
+    g_hash_table_destroy(sched->tenants);
+    pthread_cond_destroy(&sched->work_cond);
+    pthread_mutex_destroy(&sched->mutex);
+}
+
+void gpu_sched_run(gpu_sched_t *sched, const char *tenant_name, unsigned cost,
+                   gpu_sched_fn fn, void *arg)
+{
+    if (sched->nworkers == 0) {
+        fn(arg);
+        return;
+    }
+
+    gpu_sched_op_t op = {
+        .fn = fn,
+        .arg = arg,
+        .cost = cost ? cost : 1,
+        .enqueue_us = g_get_monotonic_time(),
+    };
+    pthread_cond_init(&op.done_cond, NULL);
+
+    pthread_mutex_lock(&sched->mutex);
+    gpu_sched_tenant_t *tenant = gpu_sched_tenant_get_locked(sched, tenant_name);
+    if (!tenant || sched->stopping) {
+        pthread_mutex_unlock(&sched->mutex);
+        pthread_cond_destroy(&op.done_cond);
+        fn(arg);
+        return;
+    }
+
+    if (tenant->tail) {
+        tenant->tail->next = &op;
+    } else {
+        tenant->head = &op;
+    }
+    tenant->tail = &op;
+    tenant->queued++;
+    if (!tenant->active) {
+        tenant->active = true;
+        g_queue_push_tail(&sched->active, tenant);
+    }
+    pthread_cond_signal(&sched->work_cond);
+
+    while (!op.done) {
+        pthread_cond_wait(&op.done_cond, &sched->mutex);
+    }
+    pthread_mutex_unlock(&sched->mutex);
+    pthread_cond_destroy(&op.done_cond);
+}
+
+int gpu_sched_set_weight(gpu_sched_t *sched, const char *tenant_name, unsigned weight)
+{
+    if (weight == 0 || weight > 1000) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&sched->mutex);
+    gpu_sched_tenant_t *tenant = gpu_sched_tenant_get_locked(sched, tenant_name);
+    if (tenant) {
+        tenant->weight = weight;
+    }
+    pthread_mutex_unlock(&sched->mutex);
+    return tenant ? 0 : -ENOMEM;
+}
+
+// Upper bound (in microseconds) of the bucket holding the given percentile
+static uint64_t gpu_sched_percentile(const gpu_sched_tenant_t *tenant, uint64_t count, double pct)
+{
+    uint64_t target = (uint64_t)(count * pct / 100.0);
+    uint64_t seen = 0;
+    for (unsigned bucket = 0; bucket < GPU_SCHED_HIST_BUCKETS; bucket++) {
+        seen += tenant->wait_hist[bucket];
+        if (seen > target) {
+            return (2ULL << bucket) - 1;
+        }
+    }
+    return tenant->wait_us_max;
+}
+
+static gint gpu_sched_compare_name(gconstpointer a, gconstpointer b)
+{
+    return strcmp(a, b);
+}
+
+GString *gpu_sched_format(gpu_sched_t *sched)
+{
+    GString *out = g_string_new(NULL);
+
+    pthread_mutex_lock(&sched->mutex);
+    GList *names = g_list_sort(g_hash_table_get_keys(sched->tenants), gpu_sched_compare_name);
+    for (GList *l = names; l != NULL; l = l->next) {
+        gpu_sched_tenant_t *tenant = g_hash_table_lookup(sched->tenants, l->data);
+        uint64_t count = 0;
+        for (unsigned bucket = 0; bucket < GPU_SCHED_HIST_BUCKETS; bucket++) {
+            count += tenant->wait_hist[bucket];
+        }
+        g_string_append_printf(out, "%s %u %llu %u %llu %llu %llu %llu\n",
+                               tenant->name, tenant->weight,
+                               (unsigned long long)tenant->ops, tenant->queued,
+                               (unsigned long long)(count ? tenant->wait_us_total / count : 0),
+                               (unsigned long long)(count ? gpu_sched_percentile(tenant, count, 50) : 0),
+                               (unsigned long long)(count ? gpu_sched_percentile(tenant, count, 99) : 0),
+                               (unsigned long long)tenant->wait_us_max);
+    }
+    g_list_free(names);
+    pthread_mutex_unlock(&sched->mutex);
+
+    return out;
+}
@@ -0,0 +1,68 @@
+#ifndef GPU_SCHED_H
+#define GPU_SCHED_H
+
+#include <glib.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Weighted fair scheduling of driver operations. Callers submit work tagged
+// with a tenant (uid or cgroup) and block until a worker has run it. Workers
+// pick tenants by deficit round robin: every round a tenant may spend its
+// weight in operation cost, so a tenant flooding the queue only delays
+// itself while others keep their share of the driver.
+
+#define GPU_SCHED_TENANT_LEN 256
+#define GPU_SCHED_HIST_BUCKETS 32   // log2 microsecond buckets of queueing latency
+
+typedef void (*gpu_sched_fn)(void *arg);
+
+typedef struct gpu_sched_op {
+    gpu_sched_fn fn;
+    void *arg;
+    unsigned cost;
+    int64_t enqueue_us;
+    bool done;
+    pthread_cond_t done_cond;
+    struct gpu_sched_op *next;
+} gpu_sched_op_t;
+
+typedef struct gpu_sched_tenant {
+    char name[GPU_SCHED_TENANT_LEN];
+    unsigned weight;
+    long deficit;                   // Cost the tenant may still spend this round
+    bool in_round;                  // Quantum already granted for this visit
+    bool active;                    // Linked in the round robin list
+    gpu_sched_op_t *head, *tail;    // Pending operations
+    unsigned queued;
+    uint64_t ops;                   // Completed operations
+    uint64_t wait_us_total;
+    uint64_t wait_us_max;
+    uint64_t wait_hist[GPU_SCHED_HIST_BUCKETS];
+} gpu_sched_tenant_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    GHashTable *tenants;            // name -> gpu_sched_tenant_t*
+    GQueue active;                  // Round robin list of tenants with work
+    unsigned default_weight;
+    unsigned nworkers;              // 0 runs operations inline
+    pthread_t *workers;
+    bool stopping;
+} gpu_sched_t;
+
+int gpu_sched_init(gpu_sched_t *sched, unsigned nworkers);
+void gpu_sched_destroy(gpu_sched_t *sched);
+
+// Run fn(arg) on behalf of tenant and wait for it to complete
+void gpu_sched_run(gpu_sched_t *sched, const char *tenant, unsigned cost,
+                   gpu_sched_fn fn, void *arg);
+
+int gpu_sched_set_weight(gpu_sched_t *sched, const char *tenant, unsigned weight);
+
+// One line per tenant:
+// "tenant weight ops queued avg_wait_us p50_wait_us p99_wait_us max_wait_us"
+GString *gpu_sched_format(gpu_sched_t *sched);
+
+#endif // GPU_SCHED_H
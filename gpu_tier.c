@@ -0,0 +1,399 @@
+#include "gpu_tier.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void gpu_tier_push_locked(gpu_tier_t *tier, gpu_tier_op_t *op)
+{
+    op->next = NULL;
+    if (tier->tail) {
+        tier->tail->next = op;
+    } else {
+        tier->head = op;
+    }
+    tier->tail = op;
+    pthread_cond_signal(&tier->work_cond);
+}
+
+static void gpu_tier_push(gpu_tier_t *tier, gpu_tier_op_t *op)
+{
+    pthread_mutex_lock(&tier->mutex);
+    gpu_tier_push_locked(tier, op);
+    pthread_mutex_unlock(&tier->mutex);
+}
+
+static void gpu_tier_put_chunk(gpu_tier_t *tier, gpu_tier_chunk_t *chunk)
+{
+    pthread_mutex_lock(&tier->mutex);
+    chunk->next = tier->free_chunks;
+    tier->free_chunks = chunk;
+    tier->stats.used -= GPU_TIER_CHUNK;
+    pthread_cond_signal(&tier->free_cond);
+    pthread_mutex_unlock(&tier->mutex);
+}
+
+// Take a free chunk, create one while under capacity, or wait for the
+// writer to return one. Called on the copy thread with its context current.
+static gpu_tier_chunk_t *gpu_tier_get_chunk(gpu_tier_t *tier)
+{
+    pthread_mutex_lock(&tier->mutex);
+    if (!tier->free_chunks && tier->nchunks < tier->max_chunks) {
+        tier->nchunks++;
+        pthread_mutex_unlock(&tier->mutex);
+
+        gpu_tier_chunk_t *chunk = calloc(1, sizeof(gpu_tier_chunk_t));
+        if (chunk && cuMemHostAlloc(&chunk->data, GPU_TIER_CHUNK, 0) == CUDA_SUCCESS &&
+            cuEventCreate(&chunk->copied, CU_EVENT_DISABLE_TIMING) == CUDA_SUCCESS) {
+            pthread_mutex_lock(&tier->mutex);
+            tier->stats.used += GPU_TIER_CHUNK;
+            tier->stats.peak = MAX(tier->stats.peak, tier->stats.used);
+            pthread_mutex_unlock(&tier->mutex);
+            return chunk;
+        }
+        if (chunk && chunk->data) {
+            cuMemFreeHost(chunk->data);
+        }
+        free(chunk);
+        pthread_mutex_lock(&tier->mutex);
+        tier->nchunks--;
+        if (tier->nchunks == 0) {
+            pthread_mutex_unlock(&tier->mutex);
+            return NULL;  // Nothing to wait for
+        }
+        tier->max_chunks = tier->nchunks;  // Pinned memory ran out, stay below it
+    }
+
+    if (!tier->free_chunks) {
+        int64_t start = g_get_monotonic_time();
+        while (!tier->free_chunks) {
+            pthread_cond_wait(&tier->free_cond, &tier->mutex);
+        }
+        tier->stats.waits++;
+        tier->stats.wait_us += g_get_monotonic_time() - start;
+    }
+    gpu_tier_chunk_t *chunk = tier->free_chunks;
+    tier->free_chunks = chunk->next;
+    tier->stats.used += GPU_TIER_CHUNK;
+    tier->stats.peak = MAX(tier->stats.peak, tier->stats.used);
+    pthread_mutex_unlock(&tier->mutex);
+    return chunk;
+}
+
+static gpu_tier_op_t *gpu_tier_new_op(gpu_tier_op_kind_t kind, const gpu_ckpt_record_t *rec)
+{
+    gpu_tier_op_t *op = g_new0(gpu_tier_op_t, 1);  // Aborts rather than fail
+    op->kind = kind;
+    if (rec) {
+        op->rec = g_new(gpu_ckpt_record_t, 1);
+        *op->rec = *rec;
+    }
+    return op;
+}
+
+static void gpu_tier_free_op(gpu_tier_op_t *op)
+{
+    g_free(op->rec);
+    g_free(op->path);
+    g_free(op);
+}
+
+// Payload of a record in another container, through a bounce buffer
+static int gpu_tier_write_source(gpu_ckpt_writer_t *w, const gpu_tier_op_t *op)
+{
+    void *buf = malloc(GPU_TIER_CHUNK);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    int rc = 0;
+    for (uint64_t pos = 0; pos < op->src->length && rc == 0;) {
+        if (op->throttle) {
+            op->throttle(MIN(GPU_TIER_CHUNK, op->src->length - pos), op->throttle_arg);
+        }
+        ssize_t n = gpu_ckpt_read(op->reader, op->src, buf, GPU_TIER_CHUNK, pos);
+        if (n <= 0) {
+            rc = n < 0 ? (int)n : -EIO;
+            break;
+        }
+        // Corruption in the old container must not get fresh checksums
+        rc = gpu_ckpt_verify(op->reader, op->src, pos, buf, n);
+        if (rc == 0) {
+            rc = gpu_ckpt_writer_append(w, buf, n);
+        }
+        pos += n;
+    }
+    free(buf);
+    return rc;
+}
+
+// Applies queued ops to the container. After a failure the rest of that
+// checkpoint is consumed without writing, so its chunks return to the pool,
+// and the container is aborted at FINISH.
+static void *gpu_tier_writer_thread(void *arg)
+{
+    gpu_tier_t *tier = arg;
+    gpu_ckpt_writer_t w;
+    bool open = false;
+    int rc = 0;
+    uint64_t bytes = 0;
+    char *path = NULL;
+
+    gpu_device_make_current(tier->dev);  // For the chunk events
+    for (;;) {
+        pthread_mutex_lock(&tier->mutex);
+        while (!tier->head && !tier->stopping) {
+            pthread_cond_wait(&tier->work_cond, &tier->mutex);
+        }
+        gpu_tier_op_t *op = tier->head;
+        if (!op) {
+            pthread_mutex_unlock(&tier->mutex);
+            break;  // Stopping and drained
+        }
+        tier->head = op->next;
+        if (!tier->head) {
+            tier->tail = NULL;
+        }
+        pthread_mutex_unlock(&tier->mutex);
+
+        switch (op->kind) {
+        case GPU_TIER_OPEN:
+            rc = gpu_ckpt_writer_open(&w, op->path);
+            open = rc == 0;
+            bytes = 0;
+            path = op->path;
+            op->path = NULL;
+            break;
+        case GPU_TIER_ADD:
+            if (rc == 0) {
+                rc = gpu_ckpt_writer_add(&w, op->rec);
+            }
+            break;
+        case GPU_TIER_BEGIN:
+            if (rc == 0) {
+                rc = gpu_ckpt_writer_begin(&w, op->rec);
+            }
+            break;
+        case GPU_TIER_DATA:
+            if (cuEventSynchronize(op->chunk->copied) != CUDA_SUCCESS && rc == 0) {
+                rc = -EIO;
+            }
+            if (rc == 0) {
+                rc = gpu_ckpt_writer_append(&w, op->chunk->data, op->len);
+                bytes += op->len;
+            }
+            gpu_tier_put_chunk(tier, op->chunk);
+            break;
+        case GPU_TIER_SOURCE:
+            if (rc == 0) {
+                rc = gpu_tier_write_source(&w, op);
+                bytes += op->src->length;
+            }
+            break;
+        case GPU_TIER_END:
+            if (rc == 0) {
+                rc = gpu_ckpt_writer_end(&w);
+            }
+            break;
+        case GPU_TIER_FINISH:
+            if (rc == 0) {
+                rc = op->rc;
+            }
+            if (open) {
+                if (rc == 0) {
+                    rc = gpu_ckpt_writer_finish(&w);
+                } else {
+                    gpu_ckpt_writer_abort(&w);
+                }
+            }
+            open = false;
+
+            pthread_mutex_lock(&tier->mutex);
+            int64_t drain_us = g_get_monotonic_time() - op->start_us;
+            tier->finished++;
+            tier->stats.queued--;
+            tier->stats.last_rc = rc;
+            if (rc == 0) {
+                tier->stats.completed++;
+                tier->stats.last_pause_us = op->pause_us;
+                tier->stats.last_drain_us = drain_us;
+                tier->stats.last_bytes = bytes;
+            } else {
+                tier->stats.failed++;
+            }
+            pthread_cond_broadcast(&tier->done_cond);
+            pthread_mutex_unlock(&tier->mutex);
+
+            if (rc == 0) {
+                printf("Checkpoint %s written: %llu bytes, paused %lld us, on disk after %lld us\n",
+                       path, (unsigned long long)bytes, (long long)op->pause_us,
+                       (long long)drain_us);
+            } else {
+                printf("Checkpoint %s failed: %s\n", path ? path : "", strerror(-rc));
+            }
+            g_free(path);
+            path = NULL;
+            rc = 0;
+            break;
+        }
+        gpu_tier_free_op(op);
+    }
+    return NULL;
+}
+
+int gpu_tier_init(gpu_tier_t *tier, gpu_device_t *dev, size_t capacity)
+{
+    memset(tier, 0, sizeof(*tier));
+    tier->dev = dev;
+    tier->max_chunks = MAX(capacity / GPU_TIER_CHUNK, GPU_TIER_MIN_CHUNKS);
+    tier->stats.capacity = (size_t)tier->max_chunks * GPU_TIER_CHUNK;
+
+    if (gpu_device_make_current(dev) != CUDA_SUCCESS ||
+        cuStreamCreate(&tier->stream, CU_STREAM_NON_BLOCKING) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+    pthread_mutex_init(&tier->mutex, NULL);
+    pthread_cond_init(&tier->work_cond, NULL);
+    pthread_cond_init(&tier->free_cond, NULL);
+    pthread_cond_init(&tier->done_cond, NULL);
+    if (pthread_create(&tier->writer, NULL, gpu_tier_writer_thread, tier) != 0) {
+        cuStreamDestroy(tier->stream);
+        pthread_cond_destroy(&tier->done_cond);
+        pthread_cond_destroy(&tier->free_cond);
+        pthread_cond_destroy(&tier->work_cond);
+        pthread_mutex_destroy(&tier->mutex);
+        return -EAGAIN;
+    }
+    return 0;
+}
+
+void gpu_tier_destroy(gpu_tier_t *tier)
+{
+    pthread_mutex_lock(&tier->mutex);
+    tier->stopping = true;
+    pthread_cond_signal(&tier->work_cond);
+    pthread_mutex_unlock(&tier->mutex);
+    pthread_join(tier->writer, NULL);
+
+    gpu_device_make_current(tier->dev);
+    while (tier->free_chunks) {
+        gpu_tier_chunk_t *chunk = tier->free_chunks;
+        tier->free_chunks = chunk->next;
+        cuEventDestroy(chunk->copied);
+        cuMemFreeHost(chunk->data);
+        free(chunk);
+    }
+    cuStreamDestroy(tier->stream);
+    pthread_cond_destroy(&tier->done_cond);
+    pthread_cond_destroy(&tier->free_cond);
+    pthread_cond_destroy(&tier->work_cond);
+    pthread_mutex_destroy(&tier->mutex);
+}
+
+void gpu_tier_begin(gpu_tier_t *tier, const char *path, gpu_tier_throttle_fn throttle,
+                    void *throttle_arg)
+{
+    gpu_tier_op_t *op = gpu_tier_new_op(GPU_TIER_OPEN, NULL);
+    op->path = g_strdup(path);
+
+    pthread_mutex_lock(&tier->mutex);
+    tier->submitted++;
+    tier->stats.queued++;
+    tier->copy_start = g_get_monotonic_time();
+    tier->throttle = throttle;
+    tier->throttle_arg = throttle_arg;
+    gpu_tier_push_locked(tier, op);
+    pthread_mutex_unlock(&tier->mutex);
+}
+
+void gpu_tier_add(gpu_tier_t *tier, const gpu_ckpt_record_t *rec)
+{
+    gpu_tier_push(tier, gpu_tier_new_op(GPU_TIER_ADD, rec));
+}
+
+int gpu_tier_copy(gpu_tier_t *tier, const gpu_ckpt_record_t *rec,
+                  CUmemGenericAllocationHandle handle, size_t alloc_size, size_t length)
+{
+    CUdeviceptr ptr;
+    if (gpu_device_make_current(tier->dev) != CUDA_SUCCESS ||
+        gpu_device_map(tier->dev, handle, alloc_size, &ptr) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+
+    // Chunks are queued as soon as their copy is issued; the writer waits
+    // on each chunk's event, so writing starts while the copy runs
+    gpu_tier_push(tier, gpu_tier_new_op(GPU_TIER_BEGIN, rec));
+    int rc = 0;
+    for (size_t pos = 0; pos < length && rc == 0;) {
+        size_t len = MIN(GPU_TIER_CHUNK, length - pos);
+        if (tier->throttle) {
+            tier->throttle(len, tier->throttle_arg);
+        }
+        gpu_tier_chunk_t *chunk = gpu_tier_get_chunk(tier);
+        if (!chunk) {
+            rc = -ENOMEM;
+            break;
+        }
+        if (cuMemcpyDtoHAsync(chunk->data, ptr + pos, len, tier->stream) != CUDA_SUCCESS ||
+            cuEventRecord(chunk->copied, tier->stream) != CUDA_SUCCESS) {
+            rc = -EIO;  // Queued anyway to return the chunk; end aborts the container
+        }
+        gpu_tier_op_t *op = gpu_tier_new_op(GPU_TIER_DATA, NULL);
+        op->chunk = chunk;
+        op->len = len;
+        gpu_tier_push(tier, op);
+        pos += len;
+    }
+    gpu_tier_push(tier, gpu_tier_new_op(GPU_TIER_END, NULL));
+
+    // The mapping must outlive the copies
+    if (cuStreamSynchronize(tier->stream) != CUDA_SUCCESS && rc == 0) {
+        rc = -EIO;
+    }
+    gpu_device_unmap(ptr, alloc_size);
+    return rc;
+}
+
+void gpu_tier_copy_from(gpu_tier_t *tier, const gpu_ckpt_record_t *rec,
+                        const gpu_ckpt_reader_t *reader, const gpu_ckpt_record_t *src)
+{
+    gpu_tier_push(tier, gpu_tier_new_op(GPU_TIER_BEGIN, rec));
+    gpu_tier_op_t *op = gpu_tier_new_op(GPU_TIER_SOURCE, NULL);
+    op->reader = reader;
+    op->src = src;
+    op->throttle = tier->throttle;
+    op->throttle_arg = tier->throttle_arg;
+    gpu_tier_push(tier, op);
+    gpu_tier_push(tier, gpu_tier_new_op(GPU_TIER_END, NULL));
+}
+
+uint64_t gpu_tier_end(gpu_tier_t *tier, int rc)
+{
+    gpu_tier_op_t *op = gpu_tier_new_op(GPU_TIER_FINISH, NULL);
+    op->rc = rc;
+
+    pthread_mutex_lock(&tier->mutex);
+    op->start_us = tier->copy_start;
+    op->pause_us = g_get_monotonic_time() - tier->copy_start;
+    uint64_t ticket = tier->submitted;
+    gpu_tier_push_locked(tier, op);
+    pthread_mutex_unlock(&tier->mutex);
+    return ticket;
+}
+
+int gpu_tier_wait(gpu_tier_t *tier, uint64_t ticket)
+{
+    pthread_mutex_lock(&tier->mutex);
+    while (tier->finished < ticket) {
+        pthread_cond_wait(&tier->done_cond, &tier->mutex);
+    }
+    int rc = tier->stats.last_rc;
+    pthread_mutex_unlock(&tier->mutex);
+    return rc;
+}
+
+void gpu_tier_get_stats(gpu_tier_t *tier, gpu_tier_stats_t *stats)
+{
+    pthread_mutex_lock(&tier->mutex);
+    *stats = tier->stats;
+    pthread_mutex_unlock(&tier->mutex);
+}
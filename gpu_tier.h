@@ -0,0 +1,124 @@
+#ifndef GPU_TIER_H
+#define GPU_TIER_H
+
+#include <cuda.h>
+#include <glib.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gpu_ckpt.h"
+#include "gpu_device.h"
+
+// Host tier of checkpoints. A checkpoint copies every allocation into a
+// pool of pinned host chunks, which takes only as long as the transfer over
+// the bus, and queues the chunks for a writer thread that drains them into
+// the container file in the background. The pool has a fixed capacity:
+// when it is full the copy waits for the writer to hand chunks back, so a
+// checkpoint larger than the pool degrades to the speed of the disk instead
+// of using unbounded host memory. Checkpoints queue behind each other and
+// are written in the order they were taken.
+
+#define GPU_TIER_CHUNK GPU_DEVICE_COPY_CHUNK
+#define GPU_TIER_MIN_CHUNKS 2
+
+// Called before each chunk of a checkpoint is copied, from the copy thread
+// for device contents and from the writer for payloads read from another
+// container. May sleep to limit bandwidth.
+typedef void (*gpu_tier_throttle_fn)(size_t bytes, void *arg);
+
+typedef struct gpu_tier_chunk {
+    void *data;                      // GPU_TIER_CHUNK pinned bytes
+    CUevent copied;                  // Recorded after the copy into data
+    struct gpu_tier_chunk *next;     // Free list
+} gpu_tier_chunk_t;
+
+typedef enum {
+    GPU_TIER_OPEN,                   // Start a container at path
+    GPU_TIER_ADD,                    // Record without payload
+    GPU_TIER_BEGIN,                  // Record whose payload follows
+    GPU_TIER_DATA,                   // One chunk of payload
+    GPU_TIER_SOURCE,                 // Payload read from another container
+    GPU_TIER_END,
+    GPU_TIER_FINISH,                 // Commit, or abort if rc is set
+} gpu_tier_op_kind_t;
+
+typedef struct gpu_tier_op {
+    gpu_tier_op_kind_t kind;
+    gpu_ckpt_record_t *rec;          // ADD, BEGIN
+    char *path;                      // OPEN
+    gpu_tier_chunk_t *chunk;         // DATA
+    size_t len;
+    const gpu_ckpt_reader_t *reader; // SOURCE, must stay open until drained
+    const gpu_ckpt_record_t *src;
+    gpu_tier_throttle_fn throttle;   // SOURCE
+    void *throttle_arg;
+    int rc;                          // FINISH: error of the copy phase
+    int64_t start_us;                // FINISH: when the copy phase started
+    int64_t pause_us;                // FINISH: how long the copy phase took
+    struct gpu_tier_op *next;
+} gpu_tier_op_t;
+
+typedef struct {
+    size_t capacity;
+    size_t used;                     // Bytes in chunks waiting to be written
+    size_t peak;
+    unsigned queued;                 // Checkpoints copied but not yet written
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t waits;                  // Times a copy waited for a free chunk
+    uint64_t wait_us;
+    int64_t last_pause_us;           // Copy phase of the last checkpoint
+    int64_t last_drain_us;           // From its copy phase to the container being synced
+    uint64_t last_bytes;
+    int last_rc;
+} gpu_tier_stats_t;
+
+typedef struct {
+    gpu_device_t *dev;
+    CUstream stream;                 // Copy phase, one checkpoint at a time
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;        // Ops queued or stopping
+    pthread_cond_t free_cond;        // Chunk returned to the pool
+    pthread_cond_t done_cond;        // Checkpoint written
+    unsigned max_chunks;
+    unsigned nchunks;                // Allocated so far, chunks are created on demand
+    gpu_tier_chunk_t *free_chunks;
+    gpu_tier_op_t *head, *tail;
+    uint64_t submitted;              // Checkpoints queued
+    uint64_t finished;               // Checkpoints written or failed
+    int64_t copy_start;              // Start of the current copy phase
+    gpu_tier_throttle_fn throttle;   // Of the current copy phase, may be NULL
+    void *throttle_arg;
+    pthread_t writer;
+    bool stopping;
+    gpu_tier_stats_t stats;
+} gpu_tier_t;
+
+// capacity is rounded down to whole chunks, at least GPU_TIER_MIN_CHUNKS
+int gpu_tier_init(gpu_tier_t *tier, gpu_device_t *dev, size_t capacity);
+// Writes everything still queued, then frees the pool
+void gpu_tier_destroy(gpu_tier_t *tier);
+
+// Copy phase of one checkpoint, callers serialise checkpoints: begin, any
+// number of add/copy/copy_from, end. end returns a ticket for wait.
+void gpu_tier_begin(gpu_tier_t *tier, const char *path, gpu_tier_throttle_fn throttle,
+                    void *throttle_arg);
+void gpu_tier_add(gpu_tier_t *tier, const gpu_ckpt_record_t *rec);
+// Copy the first length bytes of an allocation into the pool; returns once
+// the device-to-host copies are complete. 0, -ENOMEM or -EIO.
+int gpu_tier_copy(gpu_tier_t *tier, const gpu_ckpt_record_t *rec,
+                  CUmemGenericAllocationHandle handle, size_t alloc_size, size_t length);
+// Payload that already is in another container, copied by the writer
+void gpu_tier_copy_from(gpu_tier_t *tier, const gpu_ckpt_record_t *rec,
+                        const gpu_ckpt_reader_t *reader, const gpu_ckpt_record_t *src);
+uint64_t gpu_tier_end(gpu_tier_t *tier, int rc);
+
+// Wait until the checkpoint with this ticket is on disk. Returns the result
+// of the last checkpoint written, which is this one unless more were queued.
+int gpu_tier_wait(gpu_tier_t *tier, uint64_t ticket);
+
+void gpu_tier_get_stats(gpu_tier_t *tier, gpu_tier_stats_t *stats);
+
+#endif // GPU_TIER_H
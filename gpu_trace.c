@@ -0,0 +1,259 @@
+#include "gpu_trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *gpu_trace_op_names[GPU_TRACE_NOPS] = {
+    "getattr", "readdir", "create", "mkdir", "rmdir", "unlink", "rename", "open",
+    "truncate", "utimens", "getxattr", "setxattr", "listxattr", "poll", "release", "read",
+};
+
+const char *gpu_trace_op_name(unsigned op)
+{
+    return op < GPU_TRACE_NOPS ? gpu_trace_op_names[op] : "unknown";
+}
+
+uint64_t gpu_trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t gpu_trace_hash(const char *str)
+{
+    if (!str) {
+        return 0;
+    }
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static int gpu_trace_write(int fd, const void *data, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, (const char *)data + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static void gpu_trace_write_header(gpu_trace_t *trace, uint64_t count)
+{
+    gpu_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GPU_TRACE_MAGIC, sizeof(header.magic));
+    header.version = GPU_TRACE_VERSION;
+    header.record_size = sizeof(gpu_trace_record_t);
+    header.start_realtime_ns = trace->start_realtime_ns;
+    header.count = count;
+    header.dropped = trace->dropped;
+    if (pwrite(trace->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) &&
+        trace->error == 0) {
+        trace->error = -EIO;
+    }
+}
+
+int gpu_trace_open(gpu_trace_t *trace, const char *path)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->bufs[0] = malloc(GPU_TRACE_BUFFER * sizeof(gpu_trace_record_t));
+    trace->bufs[1] = malloc(GPU_TRACE_BUFFER * sizeof(gpu_trace_record_t));
+    trace->path = strdup(path);
+    if (!trace->bufs[0] || !trace->bufs[1] || !trace->path) {
+        free(trace->bufs[0]);
+        free(trace->bufs[1]);
+        free(trace->path);
+        return -ENOMEM;
+    }
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace->fd < 0) {
+        int rc = -errno;
+        free(trace->bufs[0]);
+        free(trace->bufs[1]);
+        free(trace->path);
+        return rc;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    trace->start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    trace->start_ns = gpu_trace_now();
+    pthread_mutex_init(&trace->mutex, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    gpu_trace_write_header(trace, 0);
+    if (trace->error == 0 && lseek(trace->fd, sizeof(gpu_trace_header_t), SEEK_SET) < 0) {
+        trace->error = -errno;  // Records are written after the header
+    }
+    return trace->error;
+}
+
+// Write the pending buffer with the mutex released
+static void gpu_trace_flush_locked(gpu_trace_t *trace)
+{
+    const gpu_trace_record_t *buf = trace->bufs[trace->active ^ 1];
+    size_t count = trace->pending;
+    pthread_mutex_unlock(&trace->mutex);
+    int rc = gpu_trace_write(trace->fd, buf, count * sizeof(gpu_trace_record_t));
+    pthread_mutex_lock(&trace->mutex);
+    if (rc != 0 && trace->error == 0) {
+        fprintf(stderr, "Writing trace %s failed: %s\n", trace->path, strerror(-rc));
+        trace->error = rc;
+    }
+    trace->written += rc == 0 ? count : 0;
+    trace->pending = 0;
+}
+
+static void *gpu_trace_writer(void *arg)
+{
+    gpu_trace_t *trace = arg;
+    pthread_mutex_lock(&trace->mutex);
+    for (;;) {
+        while (trace->pending == 0 && !trace->stopping) {
+            pthread_cond_wait(&trace->cond, &trace->mutex);
+        }
+        if (trace->pending == 0) {
+            break;  // Stopping, the active buffer is left to close
+        }
+        gpu_trace_flush_locked(trace);
+    }
+    pthread_mutex_unlock(&trace->mutex);
+    return NULL;
+}
+
+int gpu_trace_start(gpu_trace_t *trace)
+{
+    if (pthread_create(&trace->writer, NULL, gpu_trace_writer, trace) != 0) {
+        return -EAGAIN;
+    }
+    trace->writer_started = true;
+    return 0;
+}
+
+void gpu_trace_record(gpu_trace_t *trace, gpu_trace_op_t op, const char *path, uint64_t arg,
+                      uint64_t aux, uint32_t tid, uint64_t start_ns, int rc)
+{
+    uint64_t latency_us = (gpu_trace_now() - start_ns) / 1000;
+    gpu_trace_record_t rec = {
+        .time_ns = start_ns - trace->start_ns,
+        .path = gpu_trace_hash(path),
+        .arg = arg,
+        .aux = aux,
+        .latency_us = latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us,
+        .tid = tid,
+        .op = (uint16_t)op,
+        .err = (uint16_t)(rc < 0 ? -rc : 0),
+    };
+
+    pthread_mutex_lock(&trace->mutex);
+    if (trace->fill == GPU_TRACE_BUFFER) {
+        if (trace->pending != 0) {
+            trace->dropped++;  // Writer still busy with the other buffer
+            pthread_mutex_unlock(&trace->mutex);
+            return;
+        }
+        trace->pending = trace->fill;
+        trace->active ^= 1;
+        trace->fill = 0;
+        if (trace->writer_started) {
+            pthread_cond_signal(&trace->cond);
+        } else {
+            gpu_trace_flush_locked(trace);
+        }
+    }
+    trace->bufs[trace->active][trace->fill++] = rec;
+    pthread_mutex_unlock(&trace->mutex);
+}
+
+void gpu_trace_close(gpu_trace_t *trace)
+{
+    pthread_mutex_lock(&trace->mutex);
+    trace->stopping = true;
+    pthread_cond_signal(&trace->cond);
+    pthread_mutex_unlock(&trace->mutex);
+    if (trace->writer_started) {
+        pthread_join(trace->writer, NULL);
+    }
+
+    pthread_mutex_lock(&trace->mutex);
+    if (trace->pending != 0) {
+        gpu_trace_flush_locked(trace);  // Writer never ran
+    }
+    trace->active ^= 1;  // Flush writes the other buffer
+    trace->pending = trace->fill;
+    if (trace->pending != 0) {
+        gpu_trace_flush_locked(trace);
+    }
+    trace->fill = 0;
+    pthread_mutex_unlock(&trace->mutex);
+
+    gpu_trace_write_header(trace, trace->written);
+    fsync(trace->fd);
+    close(trace->fd);
+    printf("Trace %s: %llu operations recorded, %llu dropped\n", trace->path,
+           (unsigned long long)trace->written, (unsigned long long)trace->dropped);
+    pthread_mutex_destroy(&trace->mutex);
+    pthread_cond_destroy(&trace->cond);
+    free(trace->bufs[0]);
+    free(trace->bufs[1]);
+    free(trace->path);
+    memset(trace, 0, sizeof(*trace));
+    trace->fd = -1;
+}
+
+int gpu_trace_load(const char *path, gpu_trace_header_t *header, gpu_trace_record_t **records,
+                   size_t *count)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat st;
+    int rc = 0;
+    if (fstat(fd, &st) != 0) {
+        rc = -errno;
+    } else if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) ||
+               memcmp(header->magic, GPU_TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+               header->version != GPU_TRACE_VERSION ||
+               header->record_size != sizeof(gpu_trace_record_t)) {
+        rc = -EINVAL;
+    }
+
+    // The header count is only set at close; a crashed daemon leaves 0
+    size_t n = rc == 0 ? ((size_t)st.st_size - sizeof(*header)) / sizeof(gpu_trace_record_t) : 0;
+    *records = rc == 0 ? malloc(n ? n * sizeof(gpu_trace_record_t) : 1) : NULL;
+    if (rc == 0 && !*records) {
+        rc = -ENOMEM;
+    }
+    size_t len = n * sizeof(gpu_trace_record_t), done = 0;
+    while (rc == 0 && done < len) {
+        ssize_t got = pread(fd, (char *)*records + done, len - done,
+                            (off_t)(sizeof(*header) + done));
+        if (got <= 0) {
+            rc = got < 0 ? -errno : -EINVAL;
+        }
+        done += got > 0 ? (size_t)got : 0;
+    }
+    close(fd);
+    if (rc != 0) {
+        free(*records);
+        *records = NULL;
+        return rc;
+    }
+    *count = n;
+    return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef GPU_TRACE_H
+#define GPU_TRACE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Operation traces. With -o trace=FILE the daemon appends one fixed size
+// record per FUSE operation to FILE, and gpu_trace_replay drives a mount
+// with the same operations later. Layout (little endian):
+//
+//   [header, 64 bytes][record]...
+//
+// Paths are stored as 64-bit FNV-1a hashes, so a trace carries the shape
+// of the namespace but not its names. Records are buffered and written by
+// a background thread; when the writer falls behind by a whole buffer,
+// records are dropped and counted rather than stalling the operation. A
+// trace cut short by a crash still loads up to its last whole record.
+
+#define GPU_TRACE_MAGIC "GPUTRC01"
+#define GPU_TRACE_VERSION 1
+#define GPU_TRACE_BUFFER 65536           // Records per buffer, two buffers
+
+typedef enum {
+    GPU_TRACE_GETATTR,
+    GPU_TRACE_READDIR,
+    GPU_TRACE_CREATE,
+    GPU_TRACE_MKDIR,
+    GPU_TRACE_RMDIR,
+    GPU_TRACE_UNLINK,
+    GPU_TRACE_RENAME,
+    GPU_TRACE_OPEN,
+    GPU_TRACE_TRUNCATE,
+    GPU_TRACE_UTIMENS,
+    GPU_TRACE_GETXATTR,
+    GPU_TRACE_SETXATTR,
+    GPU_TRACE_LISTXATTR,
+    GPU_TRACE_POLL,
+    GPU_TRACE_RELEASE,
+    GPU_TRACE_READ,
+    GPU_TRACE_NOPS,
+} gpu_trace_op_t;
+
+typedef struct {
+    char magic[8];                   // GPU_TRACE_MAGIC
+    uint32_t version;
+    uint32_t record_size;            // sizeof(gpu_trace_record_t)
+    uint64_t start_realtime_ns;      // Wall clock time of time_ns 0
+    uint64_t count;                  // Records, set when the trace is closed
+    uint64_t dropped;                // Records lost to a slow disk
+    uint8_t reserved[24];
+} gpu_trace_header_t;
+
+typedef struct {
+    uint64_t time_ns;                // Start of the operation, since the trace began
+    uint64_t path;                   // gpu_trace_hash of the path, 0 if none
+    uint64_t arg;                    // Size: truncate size, read length, xattr value length;
+                                     // for setxattr of sizes, priority and flags the value
+    uint64_t aux;                    // Rename target hash, xattr name hash, read offset or open flags
+    uint32_t latency_us;
+    uint32_t tid;                    // Calling thread, 0 if the kernel called on its own
+    uint16_t op;                     // gpu_trace_op_t
+    uint16_t err;                    // errno returned, 0 on success
+    uint32_t reserved;
+} gpu_trace_record_t;
+
+_Static_assert(sizeof(gpu_trace_header_t) == 64, "header size is part of the format");
+_Static_assert(sizeof(gpu_trace_record_t) == 48, "record size is part of the format");
+
+typedef struct {
+    int fd;
+    char *path;
+    uint64_t start_ns;               // Monotonic time of time_ns 0
+    uint64_t start_realtime_ns;
+    pthread_mutex_t mutex;           // Everything below
+    pthread_cond_t cond;             // Wakes the writer
+    gpu_trace_record_t *bufs[2];
+    int active;                      // Buffer records go into
+    size_t fill;                     // Records in the active buffer
+    size_t pending;                  // Records of the other buffer to write, 0 if none
+    bool stopping;
+    pthread_t writer;
+    bool writer_started;
+    uint64_t written;                // Records on disk
+    uint64_t dropped;
+    int error;                       // First write error
+} gpu_trace_t;
+
+// Create FILE and write its header. Returns 0 or -errno.
+int gpu_trace_open(gpu_trace_t *trace, const char *path);
+// Start the writer thread; until then full buffers are written inline
+int gpu_trace_start(gpu_trace_t *trace);
+// Record an operation that began at start_ns (gpu_trace_now) and returned rc
+void gpu_trace_record(gpu_trace_t *trace, gpu_trace_op_t op, const char *path, uint64_t arg,
+                      uint64_t aux, uint32_t tid, uint64_t start_ns, int rc);
+// Write what is buffered, finish the header and close the file
+void gpu_trace_close(gpu_trace_t *trace);
+
+uint64_t gpu_trace_now(void);
+// 64-bit FNV-1a, 0 for NULL
+uint64_t gpu_trace_hash(const char *str);
+const char *gpu_trace_op_name(unsigned op);
+
+// Read a trace into memory. Returns 0 with *records from malloc, or
+// -errno, -EINVAL if the file is not a trace.
+int gpu_trace_load(const char *path, gpu_trace_header_t *header, gpu_trace_record_t **records,
+                   size_t *count);
+
+#endif // GPU_TRACE_H
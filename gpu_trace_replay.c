@@ -0,0 +1,404 @@
+// Replay of an operation trace recorded with -o trace=FILE against a mount
+//
+//   gpu_trace_replay [-s SPEED] [-t THREADS] [-d DIR] TRACE MOUNT
+//
+// Every recorded thread gets a replay thread of its own, or with -t the
+// recorded threads are spread over THREADS replay threads. Each thread
+// issues its operations in order at their recorded time divided by SPEED:
+// 1 (the default) keeps the original pacing, 10 runs ten times faster and
+// 0 issues every operation as soon as the previous one returns.
+//
+// Traces hold path hashes, not names, so the namespace is replayed flat:
+// every path becomes MOUNT/DIR/<hash> (DIR defaults to "replay") and the
+// root becomes MOUNT/DIR itself. Operations whose outcome depends on the
+// hierarchy, such as renaming a directory with files below it, may then
+// fail where the original succeeded; these are counted as mismatches.
+// Extended attributes are matched against the names the daemon knows.
+// Setting attributes is only replayed for the sizes, priority and flags,
+// whose values the trace records; poll is not replayed. The report
+// compares recorded and replayed latency per operation. Records a replay
+// thread never got to, because it failed to start, count as skipped.
+
+#include "gpu_trace.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_MAX_THREADS 256
+#define REPLAY_READ_MAX (1u << 20)
+
+// Attribute names known to the daemon, matched by hash
+static const char *xattr_names[] = {
+    "user.fabric_handle", "user.allocation_size", "user.gpu.size", "user.gpu.stage_size",
+    "user.gpu.publish", "user.gpu.fence", "user.gpu.ready",
+    "user.gpu.priority", "user.gpu.reservation", "user.gpu.cgroup", "user.gpu.durable",
+    "user.gpu.version", "user.gpu.staged_fabric_handle", "user.gpu.staged_fence",
+    "user.gpu.dtype", "user.gpu.shape", "user.gpu.generation", "user.gpu.admission",
+    "user.gpu.reservations", "user.gpu.cgroups", "user.gpu.sched", "user.gpu.devices",
+    "user.gpu.release_pending", "user.gpu.restore", "user.gpu.ckpt_tier",
+    "user.gpu.ckpt_status", "user.gpu.scrub", "user.gpu.xfer", "user.gpu.trace",
+};
+
+typedef struct {
+    const gpu_trace_record_t *records;
+    GArray *mine;                     // size_t, indexes into records
+    uint32_t *latency_us;             // Replayed latency per record
+    uint16_t *err;                    // errno per record
+    bool *skipped;                    // Per record, until its thread replays it
+    uint64_t late_max_ns;             // Worst start behind schedule
+} replay_worker_t;
+
+static const char *g_root;            // MOUNT/DIR
+static const char *g_mount;
+static uint64_t g_root_hash;
+static double g_speed;
+static uint64_t g_start_ns;
+static GHashTable *g_fds;             // path hash -> GQueue of open fds
+static pthread_mutex_t g_fds_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void replay_path(uint64_t hash, char *buf, size_t len)
+{
+    if (hash == g_root_hash) {
+        snprintf(buf, len, "%s", g_root);
+    } else {
+        snprintf(buf, len, "%s/%016llx", g_root, (unsigned long long)hash);
+    }
+}
+
+static const char *xattr_name(uint64_t hash)
+{
+    for (size_t i = 0; i < sizeof(xattr_names) / sizeof(xattr_names[0]); i++) {
+        if (gpu_trace_hash(xattr_names[i]) == hash) {
+            return xattr_names[i];
+        }
+    }
+    return NULL;
+}
+
+static void fd_push(uint64_t hash, int fd)
+{
+    pthread_mutex_lock(&g_fds_mutex);
+    GQueue *fds = g_hash_table_lookup(g_fds, &hash);
+    if (!fds) {
+        uint64_t *key = g_new(uint64_t, 1);
+        *key = hash;
+        fds = g_queue_new();
+        g_hash_table_insert(g_fds, key, fds);
+    }
+    g_queue_push_tail(fds, GINT_TO_POINTER(fd));
+    pthread_mutex_unlock(&g_fds_mutex);
+}
+
+// Oldest fd open on the path, taken out if take is set; -1 if none
+static int fd_get(uint64_t hash, bool take)
+{
+    pthread_mutex_lock(&g_fds_mutex);
+    GQueue *fds = g_hash_table_lookup(g_fds, &hash);
+    int fd = -1;
+    if (fds && !g_queue_is_empty(fds)) {
+        fd = GPOINTER_TO_INT(take ? g_queue_pop_head(fds) : g_queue_peek_head(fds));
+    }
+    pthread_mutex_unlock(&g_fds_mutex);
+    return fd;
+}
+
+// Run one operation; returns 0, an errno, or -1 if it is not replayed
+static int replay_op(const gpu_trace_record_t *rec, char *buf)
+{
+    char path[PATH_MAX], target[PATH_MAX];
+    replay_path(rec->path, path, sizeof(path));
+    const char *name;
+    int rc = 0, fd;
+
+    switch (rec->op) {
+    case GPU_TRACE_GETATTR: {
+        struct stat st;
+        rc = stat(path, &st);
+        break;
+    }
+    case GPU_TRACE_READDIR: {
+        DIR *dir = opendir(path);
+        if (!dir) {
+            return errno;
+        }
+        while (readdir(dir)) {
+        }
+        closedir(dir);
+        break;
+    }
+    case GPU_TRACE_CREATE:
+    case GPU_TRACE_OPEN:
+        fd = open(path, ((int)rec->aux & O_ACCMODE) |
+                        (rec->op == GPU_TRACE_CREATE ? O_CREAT : 0), 0644);
+        if (fd < 0) {
+            return errno;
+        }
+        fd_push(rec->path, fd);
+        break;
+    case GPU_TRACE_MKDIR:
+        rc = mkdir(path, 0755);
+        break;
+    case GPU_TRACE_RMDIR:
+        rc = rmdir(path);
+        break;
+    case GPU_TRACE_UNLINK:
+        rc = unlink(path);
+        break;
+    case GPU_TRACE_RENAME:
+        replay_path(rec->aux, target, sizeof(target));
+        rc = renameat2(AT_FDCWD, path, AT_FDCWD, target, (unsigned)rec->arg);
+        break;
+    case GPU_TRACE_TRUNCATE:
+        rc = truncate(path, (off_t)rec->arg);
+        break;
+    case GPU_TRACE_UTIMENS:
+        rc = utimensat(AT_FDCWD, path, NULL, 0);
+        break;
+    case GPU_TRACE_GETXATTR:
+        if (!(name = xattr_name(rec->aux))) {
+            return -1;
+        }
+        if (rec->path == g_root_hash) {
+            snprintf(path, sizeof(path), "%s", g_mount);  // Attributes of the mount root
+        }
+        rc = getxattr(path, name, rec->arg ? buf : NULL, MIN(rec->arg, REPLAY_READ_MAX)) < 0;
+        break;
+    case GPU_TRACE_SETXATTR:
+        // Only attributes whose value the trace records
+        name = xattr_name(rec->aux);
+        if (name && strcmp(name, "user.gpu.priority") == 0) {
+            snprintf(target, sizeof(target), "%lld", (long long)(int64_t)rec->arg);
+        } else if (name && (strcmp(name, "user.gpu.size") == 0 ||
+                            strcmp(name, "user.gpu.stage_size") == 0 ||
+                            strcmp(name, "user.gpu.ready") == 0 ||
+                            strcmp(name, "user.gpu.durable") == 0 ||
+                            strcmp(name, "user.gpu.publish") == 0)) {
+            snprintf(target, sizeof(target), "%llu", (unsigned long long)rec->arg);
+        } else {
+            return -1;
+        }
+        rc = setxattr(path, name, target, strlen(target), 0);
+        break;
+    case GPU_TRACE_LISTXATTR:
+        if (rec->path == g_root_hash) {
+            snprintf(path, sizeof(path), "%s", g_mount);
+        }
+        rc = listxattr(path, rec->arg ? buf : NULL, MIN(rec->arg, REPLAY_READ_MAX)) < 0;
+        break;
+    case GPU_TRACE_RELEASE:
+        fd = fd_get(rec->path, true);
+        if (fd < 0) {
+            return -1;  // Its open was not replayed
+        }
+        rc = close(fd);
+        break;
+    case GPU_TRACE_READ:
+        fd = fd_get(rec->path, false);
+        if (fd < 0) {
+            return -1;
+        }
+        rc = pread(fd, buf, MIN(rec->arg, REPLAY_READ_MAX), (off_t)rec->aux) < 0;
+        break;
+    default:
+        return -1;  // poll and anything newer than this tool
+    }
+    return rc != 0 ? errno : 0;
+}
+
+static void *replay_worker(void *arg)
+{
+    replay_worker_t *w = arg;
+    char *buf = malloc(REPLAY_READ_MAX);
+    for (guint i = 0; buf && i < w->mine->len; i++) {
+        size_t index = g_array_index(w->mine, size_t, i);
+        const gpu_trace_record_t *rec = &w->records[index];
+        uint64_t now = gpu_trace_now();
+        if (g_speed > 0) {
+            uint64_t due = g_start_ns + (uint64_t)(rec->time_ns / g_speed);
+            if (now < due) {
+                struct timespec ts = { .tv_sec = due / 1000000000ull,
+                                       .tv_nsec = due % 1000000000ull };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            } else if (now - due > w->late_max_ns) {
+                w->late_max_ns = now - due;
+            }
+            now = gpu_trace_now();
+        }
+        int rc = replay_op(rec, buf);
+        uint64_t latency_us = (gpu_trace_now() - now) / 1000;
+        w->skipped[index] = rc < 0;
+        w->err[index] = rc > 0 ? (uint16_t)rc : 0;
+        w->latency_us[index] = latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us;
+    }
+    free(buf);
+    return NULL;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t *values, size_t n, double p)
+{
+    if (n == 0) {
+        return 0;
+    }
+    qsort(values, n, sizeof(uint32_t), compare_u32);
+    return values[(size_t)(p * (n - 1))];
+}
+
+static void report(const gpu_trace_record_t *records, size_t count, const replay_worker_t *w,
+                   double seconds)
+{
+    uint32_t *recorded = malloc(count * sizeof(uint32_t) + 1);
+    uint32_t *replayed = malloc(count * sizeof(uint32_t) + 1);
+    size_t total = 0;
+    printf("%-10s %8s %8s %7s %10s %10s %10s %10s %10s\n", "op", "count", "skipped", "errors",
+           "mismatch", "rec_p50", "rec_p99", "rep_p50", "rep_p99");
+    for (unsigned op = 0; recorded && replayed && op < GPU_TRACE_NOPS; op++) {
+        size_t n = 0, skipped = 0, errors = 0, mismatch = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].op != op) {
+                continue;
+            }
+            if (w->skipped[i]) {
+                skipped++;
+                continue;
+            }
+            recorded[n] = records[i].latency_us;
+            replayed[n++] = w->latency_us[i];
+            errors += w->err[i] != 0;
+            mismatch += w->err[i] != records[i].err;
+        }
+        if (n + skipped == 0) {
+            continue;
+        }
+        total += n;
+        printf("%-10s %8zu %8zu %7zu %10zu %10u %10u %10u %10u\n", gpu_trace_op_name(op), n,
+               skipped, errors, mismatch, percentile(recorded, n, 0.5),
+               percentile(recorded, n, 0.99), percentile(replayed, n, 0.5),
+               percentile(replayed, n, 0.99));
+    }
+    printf("%zu operations replayed in %.3f s, %.0f ops/s; latencies in us\n", total, seconds,
+           seconds > 0 ? total / seconds : 0.0);
+    free(recorded);
+    free(replayed);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = "replay";
+    long nthreads = 0;
+    g_speed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "s:t:d:")) != -1) {
+        switch (c) {
+        case 's':
+            g_speed = strtod(optarg, NULL);
+            break;
+        case 't':
+            nthreads = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            optind = argc + 1;  // Usage below
+        }
+    }
+    if (argc - optind != 2 || g_speed < 0 || nthreads < 0 || nthreads > REPLAY_MAX_THREADS) {
+        fprintf(stderr, "Usage: %s [-s SPEED] [-t THREADS] [-d DIR] TRACE MOUNT\n", argv[0]);
+        return 2;
+    }
+
+    gpu_trace_header_t header;
+    gpu_trace_record_t *records;
+    size_t count;
+    int rc = gpu_trace_load(argv[optind], &header, &records, &count);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], rc == -EINVAL ? "not a trace" : strerror(-rc));
+        return 1;
+    }
+    if (header.dropped) {
+        printf("%s: %llu operations were dropped while recording\n", argv[optind],
+               (unsigned long long)header.dropped);
+    }
+
+    g_mount = argv[optind + 1];
+    char *root = g_strdup_printf("%s/%s", g_mount, dir);
+    g_root = root;
+    g_root_hash = gpu_trace_hash("/");
+    if (mkdir(root, 0755) != 0 && errno != EEXIST) {
+        perror(root);
+        return 1;
+    }
+    g_fds = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+    // Recorded threads go to workers in order of first appearance
+    GHashTable *tids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (size_t i = 0; i < count; i++) {
+        gpointer key = GUINT_TO_POINTER(records[i].tid + 1);
+        if (!g_hash_table_contains(tids, key)) {
+            g_hash_table_insert(tids, key, GUINT_TO_POINTER(g_hash_table_size(tids)));
+        }
+    }
+    unsigned nworkers = nthreads ? (unsigned)nthreads
+                                 : MIN(MAX(g_hash_table_size(tids), 1u), REPLAY_MAX_THREADS);
+    replay_worker_t *workers = calloc(nworkers, sizeof(replay_worker_t));
+    uint32_t *latency_us = calloc(count + 1, sizeof(uint32_t));
+    uint16_t *err = calloc(count + 1, sizeof(uint16_t));
+    bool *skipped = calloc(count + 1, sizeof(bool));
+    if (!workers || !latency_us || !err || !skipped) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memset(skipped, true, (count + 1) * sizeof(bool));
+    for (unsigned i = 0; i < nworkers; i++) {
+        workers[i] = (replay_worker_t){ .records = records, .latency_us = latency_us,
+                                        .err = err, .skipped = skipped,
+                                        .mine = g_array_new(FALSE, FALSE, sizeof(size_t)) };
+    }
+    for (size_t i = 0; i < count; i++) {
+        unsigned n = GPOINTER_TO_UINT(g_hash_table_lookup(tids,
+                                                          GUINT_TO_POINTER(records[i].tid + 1)));
+        g_array_append_val(workers[n % nworkers].mine, i);
+    }
+    printf("Replaying %zu operations of %u threads on %u threads into %s, speed %g\n", count,
+           g_hash_table_size(tids), nworkers, root, g_speed);
+
+    pthread_t *threads = calloc(nworkers, sizeof(pthread_t));
+    g_start_ns = gpu_trace_now();
+    unsigned started = 0;
+    while (threads && started < nworkers &&
+           pthread_create(&threads[started], NULL, replay_worker, &workers[started]) == 0) {
+        started++;
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (gpu_trace_now() - g_start_ns) / 1e9;
+    if (started < nworkers) {
+        fprintf(stderr, "Only %u of %u threads started\n", started, nworkers);
+    }
+
+    uint64_t late = 0;
+    for (unsigned i = 0; i < nworkers; i++) {
+        late = MAX(late, workers[i].late_max_ns);
+    }
+    replay_worker_t all = { .latency_us = latency_us, .err = err, .skipped = skipped };
+    report(records, count, &all, seconds);
+    if (g_speed > 0) {
+        printf("worst start behind schedule: %.3f ms\n", late / 1e6);
+    }
+    return started == nworkers ? 0 : 1;
+}
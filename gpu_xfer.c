@@ -0,0 +1,293 @@
+#include "gpu_xfer.h"
+#include "gpu_crc32c.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CUFILE
+#include <cufile.h>
+#endif
+
+static const char *gpu_xfer_names[] = { "auto", "cuda", "gds", "host" };
+
+int gpu_xfer_parse(const char *str, gpu_xfer_backend_t *out)
+{
+    for (size_t i = 0; i < sizeof(gpu_xfer_names) / sizeof(gpu_xfer_names[0]); i++) {
+        if (strcmp(str, gpu_xfer_names[i]) == 0) {
+            *out = (gpu_xfer_backend_t)i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+const char *gpu_xfer_name(gpu_xfer_backend_t backend)
+{
+    return gpu_xfer_names[backend];
+}
+
+int gpu_xfer_init(gpu_xfer_t *xfer, gpu_xfer_backend_t want, gpu_device_t *dev)
+{
+    memset(xfer, 0, sizeof(*xfer));
+    if ((want == GPU_XFER_HOST) != (dev == NULL)) {
+        return -EINVAL;
+    }
+    xfer->dev = dev;
+    xfer->backend = want == GPU_XFER_HOST ? GPU_XFER_HOST : GPU_XFER_CUDA;
+    if (want != GPU_XFER_AUTO && want != GPU_XFER_GDS) {
+        return 0;
+    }
+
+#ifdef HAVE_CUFILE
+    if (gpu_device_make_current(dev) == CUDA_SUCCESS) {
+        CUfileError_t status = cuFileDriverOpen();
+        if (status.err == CU_FILE_SUCCESS) {
+            xfer->driver_open = true;
+            xfer->backend = GPU_XFER_GDS;
+            return 0;
+        }
+        printf("cuFile driver unavailable (%d), using bounce buffers\n", (int)status.err);
+    }
+#else
+    if (want == GPU_XFER_GDS) {
+        printf("Built without GPUDirect Storage, using bounce buffers\n");
+    }
+#endif
+    return 0;
+}
+
+void gpu_xfer_destroy(gpu_xfer_t *xfer)
+{
+#ifdef HAVE_CUFILE
+    if (xfer->driver_open) {
+        cuFileDriverClose();
+        xfer->driver_open = false;
+    }
+#else
+    (void)xfer;
+#endif
+}
+
+#ifdef HAVE_CUFILE
+// One cuFileRead; chunks are handed out in file order
+typedef struct {
+    size_t copy;
+    uint64_t pos;
+    uint64_t len;
+} gpu_xfer_chunk_t;
+
+typedef struct {
+    gpu_device_t *dev;
+    CUfileHandle_t fh;
+    const gpu_ingest_copy_t *copies;
+    CUdeviceptr *ptrs;
+    const gpu_xfer_chunk_t *chunks;
+    size_t nchunks;
+    size_t next;                  // Next chunk to take (atomic)
+    int rc;                       // First failure (atomic)
+    uint64_t verified;            // (atomic)
+} gpu_xfer_job_t;
+
+static void gpu_xfer_fail(gpu_xfer_job_t *job, int rc)
+{
+    int expected = 0;
+    __atomic_compare_exchange_n(&job->rc, &expected, rc, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// The data never passed the CPU, so a chunk of a range with checksums is
+// copied back into buf and checked there, as the bounce path checks its
+// staging buffers
+static int gpu_xfer_gds_verify(gpu_xfer_job_t *job, const gpu_xfer_chunk_t *chunk, void *buf)
+{
+    const gpu_ingest_copy_t *copy = &job->copies[chunk->copy];
+    if (cuMemcpyDtoH(buf, job->ptrs[chunk->copy] + chunk->pos, chunk->len) != CUDA_SUCCESS) {
+        return -EIO;
+    }
+    for (uint64_t done = 0; done < chunk->len; done += copy->crc_chunk) {
+        size_t n = MIN(copy->crc_chunk, chunk->len - done);
+        size_t index = (chunk->pos + done) / copy->crc_chunk;
+        if (gpu_crc32c(0, (const char *)buf + done, n) != copy->crcs[index]) {
+            printf("Checksum mismatch at offset %llu of a %llu byte range read by GDS\n",
+                   (unsigned long long)(chunk->pos + done), (unsigned long long)copy->length);
+            return -EIO;
+        }
+    }
+    __atomic_add_fetch(&job->verified, chunk->len, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// cuFileRead blocks until the DMA is done, so parallelism comes from
+// running several readers
+static void *gpu_xfer_gds_worker(void *arg)
+{
+    gpu_xfer_job_t *job = arg;
+    void *verify_buf = NULL;      // Pinned, allocated with the first checksummed chunk
+    if (gpu_device_make_current(job->dev) != CUDA_SUCCESS) {
+        gpu_xfer_fail(job, -EIO);
+        return NULL;
+    }
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->nchunks || __atomic_load_n(&job->rc, __ATOMIC_RELAXED) != 0) {
+            break;
+        }
+        const gpu_xfer_chunk_t *chunk = &job->chunks[index];
+        const gpu_ingest_copy_t *copy = &job->copies[chunk->copy];
+        for (uint64_t done = 0; done < chunk->len;) {
+            ssize_t n = cuFileRead(job->fh, (void *)(uintptr_t)job->ptrs[chunk->copy],
+                                   chunk->len - done, (off_t)(copy->offset + chunk->pos + done),
+                                   (off_t)(chunk->pos + done));
+            if (n <= 0) {
+                printf("cuFileRead failed: %zd\n", n);
+                gpu_xfer_fail(job, -EIO);
+                break;
+            }
+            done += (uint64_t)n;
+        }
+        if (!copy->crcs || __atomic_load_n(&job->rc, __ATOMIC_RELAXED) != 0) {
+            continue;
+        }
+        if (!verify_buf && cuMemHostAlloc(&verify_buf, GPU_INGEST_CHUNK, 0) != CUDA_SUCCESS) {
+            verify_buf = NULL;
+            gpu_xfer_fail(job, -ENOMEM);
+            break;
+        }
+        int rc = gpu_xfer_gds_verify(job, chunk, verify_buf);
+        if (rc != 0) {
+            gpu_xfer_fail(job, rc);
+        }
+    }
+    if (verify_buf) {
+        cuMemFreeHost(verify_buf);
+    }
+    return NULL;
+}
+
+// Read every range with cuFile. -EOPNOTSUPP if the file cannot be used
+// with it, other errors when a transfer failed.
+static int gpu_xfer_gds_read(gpu_xfer_t *xfer, int fd, const gpu_ingest_copy_t *copies,
+                             size_t count, unsigned nthreads, gpu_ingest_stats_t *stats)
+{
+    int64_t start = g_get_monotonic_time();
+    memset(stats, 0, sizeof(*stats));
+    if (!(fcntl(fd, F_GETFL) & O_DIRECT) || gpu_device_make_current(xfer->dev) != CUDA_SUCCESS) {
+        return -EOPNOTSUPP;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (copies[i].crcs &&
+            (copies[i].crc_chunk == 0 || GPU_INGEST_CHUNK % copies[i].crc_chunk != 0)) {
+            return -EOPNOTSUPP;  // The bounce path rejects it
+        }
+    }
+    stats->direct = 1;
+
+    CUfileDescr_t descr;
+    memset(&descr, 0, sizeof(descr));
+    descr.handle.fd = fd;
+    descr.type = CU_FILE_HANDLE_TYPE_OPAQUE_FD;
+    gpu_xfer_job_t job = { .dev = xfer->dev, .copies = copies };
+    CUfileError_t status = cuFileHandleRegister(&job.fh, &descr);
+    if (status.err != CU_FILE_SUCCESS) {
+        return -EOPNOTSUPP;
+    }
+
+    GArray *chunks = g_array_new(FALSE, FALSE, sizeof(gpu_xfer_chunk_t));
+    for (size_t i = 0; i < count; i++) {
+        for (uint64_t pos = 0; pos < copies[i].length; pos += GPU_INGEST_CHUNK) {
+            gpu_xfer_chunk_t chunk = {
+                .copy = i,
+                .pos = pos,
+                .len = MIN(GPU_INGEST_CHUNK, copies[i].length - pos),
+            };
+            g_array_append_val(chunks, chunk);
+            stats->bytes += chunk.len;
+        }
+    }
+    job.chunks = (const gpu_xfer_chunk_t *)chunks->data;
+    job.nchunks = chunks->len;
+
+    // Registered ranges are DMA targets as they are; unregistered ones
+    // still work but go through cuFile's own bounce buffers
+    job.ptrs = calloc(count ? count : 1, sizeof(CUdeviceptr));
+    bool *registered = calloc(count ? count : 1, sizeof(bool));
+    size_t mapped = 0;
+    if (!job.ptrs || !registered) {
+        job.rc = -ENOMEM;
+    }
+    for (; job.rc == 0 && mapped < count; mapped++) {
+        if (copies[mapped].length == 0) {
+            continue;
+        }
+        if (gpu_device_map(xfer->dev, copies[mapped].handle, copies[mapped].alloc_size,
+                           &job.ptrs[mapped]) != CUDA_SUCCESS) {
+            job.rc = -ENOMEM;
+            break;
+        }
+        registered[mapped] = cuFileBufRegister((void *)(uintptr_t)job.ptrs[mapped],
+                                               copies[mapped].alloc_size, 0).err ==
+                             CU_FILE_SUCCESS;
+    }
+
+    if (job.rc == 0) {
+        // The calling thread is one of the readers
+        unsigned extra = MIN(MAX(nthreads, 1u), MAX(job.nchunks, (size_t)1)) - 1;
+        pthread_t *threads = calloc(extra ? extra : 1, sizeof(pthread_t));
+        unsigned started = 0;
+        while (threads && started < extra &&
+               pthread_create(&threads[started], NULL, gpu_xfer_gds_worker, &job) == 0) {
+            started++;
+        }
+        gpu_xfer_gds_worker(&job);
+        for (unsigned i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        stats->threads = started + 1;
+    }
+
+    for (size_t i = 0; i < mapped; i++) {
+        if (copies[i].length == 0) {
+            continue;
+        }
+        if (registered[i]) {
+            cuFileBufDeregister((void *)(uintptr_t)job.ptrs[i]);
+        }
+        gpu_device_unmap(job.ptrs[i], copies[i].alloc_size);
+    }
+    free(registered);
+    free(job.ptrs);
+    g_array_free(chunks, TRUE);
+    cuFileHandleDeregister(job.fh);
+
+    stats->verified = job.verified;
+    stats->elapsed_us = g_get_monotonic_time() - start;
+    return job.rc;
+}
+#endif
+
+int gpu_xfer_read(gpu_xfer_t *xfer, int fd, const gpu_ingest_copy_t *copies, size_t count,
+                  unsigned nthreads, gpu_ingest_stats_t *stats)
+{
+#ifdef HAVE_CUFILE
+    if (xfer->backend == GPU_XFER_GDS) {
+        int rc = gpu_xfer_gds_read(xfer, fd, copies, count, nthreads, stats);
+        if (rc == 0) {
+            __atomic_add_fetch(&xfer->direct_bytes, stats->bytes, __ATOMIC_RELAXED);
+            return 0;
+        }
+        // Whatever was transferred is overwritten by the retry, which also
+        // tells a corrupt container from a bad transfer
+        printf("GDS read failed (%s), using bounce buffers\n", strerror(-rc));
+        __atomic_add_fetch(&xfer->fallbacks, 1, __ATOMIC_RELAXED);
+    }
+#endif
+    int rc = gpu_ingest_copy(xfer->backend == GPU_XFER_HOST ? NULL : xfer->dev, fd, copies,
+                             count, nthreads, stats);
+    if (rc == 0) {
+        __atomic_add_fetch(&xfer->bounce_bytes, stats->bytes, __ATOMIC_RELAXED);
+    }
+    return rc;
+}
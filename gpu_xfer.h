@@ -0,0 +1,54 @@
+#ifndef GPU_XFER_H
+#define GPU_XFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gpu_device.h"
+#include "gpu_ingest.h"
+
+// Transfers from checkpoint and safetensors files into allocations. The
+// default path reads into pinned bounce buffers and copies them to the
+// device with the copy engine, so every byte crosses host memory twice.
+// Builds with HAVE_CUFILE (make GDS=1) can use GPUDirect Storage instead:
+// the allocation is registered with cuFile and the storage DMAs straight
+// into device memory. Whenever cuFile cannot serve a read (no driver, a
+// file system without O_DIRECT, a failed transfer) the read is redone over
+// the bounce buffers. GDS data never reaches the CPU on the way in, so
+// chunks of ranges with checksums are copied back from the device and
+// verified; a mismatch redoes the read over the bounce buffers.
+
+typedef enum {
+    GPU_XFER_AUTO,                   // GDS when available, else CUDA
+    GPU_XFER_CUDA,                   // Pinned bounce buffers and the copy engine
+    GPU_XFER_GDS,                    // cuFile, falling back to CUDA per read
+    GPU_XFER_HOST,                   // Bounce buffers into host memory, no GPU needed
+} gpu_xfer_backend_t;
+
+typedef struct {
+    gpu_xfer_backend_t backend;      // Resolved, never AUTO
+    gpu_device_t *dev;               // NULL for HOST
+    bool driver_open;                // cuFileDriverOpen succeeded
+    uint64_t direct_bytes;           // Read by GDS (atomic)
+    uint64_t bounce_bytes;           // Read through bounce buffers (atomic)
+    uint64_t fallbacks;              // GDS reads redone over bounce buffers (atomic)
+} gpu_xfer_t;
+
+// "auto", "cuda", "gds" or "host"
+int gpu_xfer_parse(const char *str, gpu_xfer_backend_t *out);
+const char *gpu_xfer_name(gpu_xfer_backend_t backend);
+
+// Resolve the backend and open the cuFile driver if it is used. Asking for
+// GDS in a build without it, or on a system where the driver does not
+// open, selects CUDA. Returns 0 or -EINVAL for HOST with a device or a
+// device backend without one.
+int gpu_xfer_init(gpu_xfer_t *xfer, gpu_xfer_backend_t want, gpu_device_t *dev);
+void gpu_xfer_destroy(gpu_xfer_t *xfer);
+
+// gpu_ingest_copy through the selected backend. HOST copies into the host
+// field of each range. Returns 0 or a negative errno.
+int gpu_xfer_read(gpu_xfer_t *xfer, int fd, const gpu_ingest_copy_t *copies, size_t count,
+                  unsigned nthreads, gpu_ingest_stats_t *stats);
+
+#endif // GPU_XFER_H
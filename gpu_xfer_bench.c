@@ -0,0 +1,291 @@
+// Throughput of the restore paths: reads one file into memory with every
+// transfer backend this machine supports
+//
+//   gpu_xfer_bench FILE [MiB] [THREADS] [RUNS]
+//
+// FILE is filled with MiB of data (default 1024) if it is shorter. "read"
+// is the file read alone into per-thread buffers, the ceiling of any path.
+// "host" is the bounce buffer path into host memory and runs without a
+// GPU; "cuda" and "gds" need a device, "gds" a build with GDS=1. Each
+// backend runs RUNS times (default 3) and the median is reported, followed
+// by a "metric" line with every run for bench_compare.py. Reads use O_DIRECT
+// where the file system allows it; otherwise later runs may be served
+// from the page cache.
+
+#include "gpu_crc32c.h"
+#include "gpu_device.h"
+#include "gpu_xfer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS 3
+#define BENCH_MAX_RUNS 100
+
+static int g_runs = BENCH_RUNS;
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    uint64_t next;                // Next chunk offset (atomic)
+} read_job_t;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int fill_file(const char *path, uint64_t size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    size_t len = GPU_INGEST_CHUNK;
+    unsigned char *buf = malloc(len);
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; buf && i < len; i++) {
+        x ^= x << 13;  // xorshift, incompressible
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (unsigned char)x;
+    }
+    int rc = buf ? 0 : -1;
+    for (uint64_t pos = 0; rc == 0 && pos < size; pos += len) {
+        size_t n = size - pos < len ? size - pos : len;
+        buf[0] = (unsigned char)(pos >> 24);  // No two chunks alike
+        if (pwrite(fd, buf, n, (off_t)pos) != (ssize_t)n) {
+            perror("pwrite");
+            rc = -1;
+        }
+    }
+    if (rc == 0 && fsync(fd) != 0) {
+        perror("fsync");
+        rc = -1;
+    }
+    free(buf);
+    close(fd);
+    return rc;
+}
+
+static void *read_worker(void *arg)
+{
+    read_job_t *job = arg;
+    void *buf = NULL;
+    if (posix_memalign(&buf, GPU_INGEST_ALIGN, GPU_INGEST_CHUNK) != 0) {
+        return NULL;
+    }
+    for (;;) {
+        uint64_t pos = __atomic_fetch_add(&job->next, GPU_INGEST_CHUNK, __ATOMIC_RELAXED);
+        if (pos >= job->size) {
+            break;
+        }
+        size_t n = job->size - pos < GPU_INGEST_CHUNK ? job->size - pos : GPU_INGEST_CHUNK;
+        n = (n + GPU_INGEST_ALIGN - 1) & ~(size_t)(GPU_INGEST_ALIGN - 1);
+        if (pread(job->fd, buf, n, (off_t)pos) < 0) {
+            perror("pread");
+            break;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static double run_read(int fd, uint64_t size, unsigned nthreads)
+{
+    read_job_t job = { .fd = fd, .size = size };
+    pthread_t threads[64];
+    double start = now_seconds();
+    unsigned started = 0;
+    while (started < nthreads && started < 64 &&
+           pthread_create(&threads[started], NULL, read_worker, &job) == 0) {
+        started++;
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return now_seconds() - start;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t size, double *seconds, int direct, const char *note)
+{
+    qsort(seconds, g_runs, sizeof(double), compare_doubles);
+    double median = seconds[g_runs / 2];
+    printf("%-6s %8.2f GB/s  median %.3f s  min %.3f s  o_direct=%d  %s\n", name,
+           size / median / 1e9, median, seconds[0], direct, note);
+    printf("metric xfer.%s GB/s higher", name);
+    for (int run = 0; run < g_runs; run++) {
+        printf(" %.4f", size / seconds[run] / 1e9);
+    }
+    printf("\n");
+}
+
+// Run one backend BENCH_RUNS times; the destination is checked against
+// the file's checksum after the first run
+static int run_backend(gpu_xfer_t *xfer, gpu_device_t *dev, int fd, uint64_t size,
+                       unsigned nthreads, uint32_t expect)
+{
+    gpu_ingest_copy_t copy = { .offset = 0, .length = size };
+    CUmemGenericAllocationHandle handle = 0;
+    size_t alloc_size = size;
+    void *host = NULL;
+
+    if (dev) {
+        CUmemAllocationProp props;
+        gpu_device_alloc_props(dev->device, &props);
+        props.requestedHandleTypes = CU_MEM_HANDLE_TYPE_NONE;  // Never exported
+        alloc_size = (size + dev->granularity - 1) / dev->granularity * dev->granularity;
+        if (cuMemCreate(&handle, alloc_size, &props, 0) != CUDA_SUCCESS) {
+            fprintf(stderr, "cuMemCreate of %zu bytes failed\n", alloc_size);
+            return -ENOMEM;
+        }
+        copy.handle = handle;
+        copy.alloc_size = alloc_size;
+    }
+    host = malloc(size);
+    if (!host) {
+        if (dev) {
+            cuMemRelease(handle);
+        }
+        return -ENOMEM;
+    }
+    copy.host = host;
+
+    double seconds[BENCH_MAX_RUNS];
+    gpu_ingest_stats_t stats;
+    int rc = 0;
+    for (int run = 0; run < g_runs && rc == 0; run++) {
+        uint64_t fallbacks = xfer->fallbacks;
+        rc = gpu_xfer_read(xfer, fd, &copy, 1, nthreads, &stats);
+        seconds[run] = stats.elapsed_us / 1e6;
+        if (rc == 0 && xfer->fallbacks != fallbacks) {
+            printf("%s: run %d fell back to bounce buffers\n", gpu_xfer_name(xfer->backend),
+                   run);
+        }
+    }
+
+    if (rc == 0 && dev) {
+        CUdeviceptr ptr;
+        rc = gpu_device_make_current(dev) == CUDA_SUCCESS &&
+             gpu_device_map(dev, handle, alloc_size, &ptr) == CUDA_SUCCESS ? 0 : -EIO;
+        if (rc == 0) {
+            rc = cuMemcpyDtoH(host, ptr, size) == CUDA_SUCCESS ? 0 : -EIO;
+            gpu_device_unmap(ptr, alloc_size);
+        }
+    }
+    if (rc == 0) {
+        bool match = gpu_crc32c(0, host, size) == expect;
+        report(gpu_xfer_name(xfer->backend), size, seconds, stats.direct,
+               match ? "data ok" : "DATA MISMATCH");
+        rc = match ? 0 : -EIO;
+    } else {
+        fprintf(stderr, "%s: %s\n", gpu_xfer_name(xfer->backend), strerror(-rc));
+    }
+
+    free(host);
+    if (dev) {
+        cuMemRelease(handle);
+    }
+    return rc;
+}
+
+static uint32_t file_crc(int fd, uint64_t size)
+{
+    void *buf = NULL;
+    uint32_t crc = 0;
+    if (posix_memalign(&buf, GPU_INGEST_ALIGN, GPU_INGEST_CHUNK) != 0) {
+        return 0;
+    }
+    for (uint64_t pos = 0; pos < size; pos += GPU_INGEST_CHUNK) {
+        size_t n = size - pos < GPU_INGEST_CHUNK ? size - pos : GPU_INGEST_CHUNK;
+        size_t want = (n + GPU_INGEST_ALIGN - 1) & ~(size_t)(GPU_INGEST_ALIGN - 1);
+        if (pread(fd, buf, want, (off_t)pos) < (ssize_t)n) {
+            break;
+        }
+        crc = gpu_crc32c(crc, buf, n);
+    }
+    free(buf);
+    return crc;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 5) {
+        fprintf(stderr, "Usage: %s FILE [MiB] [THREADS] [RUNS]\n", argv[0]);
+        return 2;
+    }
+    long mib = argc >= 3 ? strtol(argv[2], NULL, 10) : 1024;
+    long nthreads = argc >= 4 ? strtol(argv[3], NULL, 10) : 4;
+    long runs = argc >= 5 ? strtol(argv[4], NULL, 10) : BENCH_RUNS;
+    if (mib <= 0 || nthreads <= 0 || nthreads > 64 || runs <= 0 || runs > BENCH_MAX_RUNS) {
+        fprintf(stderr, "MiB must be positive, THREADS between 1 and 64 and RUNS between 1 and %d\n",
+                BENCH_MAX_RUNS);
+        return 2;
+    }
+    g_runs = (int)runs;
+    uint64_t size = (uint64_t)mib << 20;
+
+    struct stat st;
+    if ((stat(argv[1], &st) != 0 || (uint64_t)st.st_size < size) && fill_file(argv[1], size) != 0) {
+        return 1;
+    }
+    int fd = gpu_ingest_open(argv[1]);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(-fd));
+        return 1;
+    }
+    int direct = (fcntl(fd, F_GETFL) & O_DIRECT) != 0;
+    uint32_t expect = file_crc(fd, size);
+    printf("%s: %llu MiB, %ld threads, crc32c %s\n", argv[1], (unsigned long long)mib,
+           nthreads, gpu_crc32c_impl());
+
+    double seconds[BENCH_MAX_RUNS];
+    for (int run = 0; run < g_runs; run++) {
+        seconds[run] = run_read(fd, size, (unsigned)nthreads);
+    }
+    report("read", size, seconds, direct, "no copy");
+
+    int rc = 0;
+    gpu_xfer_t xfer;
+    gpu_xfer_init(&xfer, GPU_XFER_HOST, NULL);
+    rc |= run_backend(&xfer, NULL, fd, size, (unsigned)nthreads, expect);
+    gpu_xfer_destroy(&xfer);
+
+    gpu_device_t *devices = NULL;
+    int ndevices = 0;
+    if (gpu_device_discover(&devices, &ndevices) != 0 || devices[0].result != CUDA_SUCCESS) {
+        printf("No usable device, skipping cuda and gds\n");
+    } else {
+        gpu_xfer_init(&xfer, GPU_XFER_CUDA, &devices[0]);
+        rc |= run_backend(&xfer, &devices[0], fd, size, (unsigned)nthreads, expect);
+        gpu_xfer_destroy(&xfer);
+
+        gpu_xfer_init(&xfer, GPU_XFER_GDS, &devices[0]);
+        if (xfer.backend == GPU_XFER_GDS) {
+            rc |= run_backend(&xfer, &devices[0], fd, size, (unsigned)nthreads, expect);
+        } else {
+            printf("GDS unavailable, skipping gds\n");
+        }
+        gpu_xfer_destroy(&xfer);
+    }
+    if (devices) {
+        gpu_device_release_all(devices, ndevices);
+    }
+    close(fd);
+    return rc ? 1 : 0;
+}
@@ -35,6 +35,9 @@ install_ubuntu_debian() {
     # GLib development
     sudo apt install -y libglib2.0-dev
     
+    # zlib, compression of export bundles
+    sudo apt install -y zlib1g-dev
+    
     # Development tools
     sudo apt install -y clang-format attr
     
@@ -77,6 +80,9 @@ install_redhat() {
     # GLib development
     sudo $PKG_MGR install -y glib2-devel
     
+    # zlib, compression of export bundles
+    sudo $PKG_MGR install -y zlib-devel
+    
     # Development tools
     sudo $PKG_MGR install -y clang-tools-extra attr
     
@@ -101,6 +107,7 @@ case "$OS" in
         echo "  - build-essential/gcc-c++"
         echo "  - libfuse3-dev/fuse3-devel"
         echo "  - libglib2.0-dev/glib2-devel"
+        echo "  - zlib1g-dev/zlib-devel"
         echo "  - CUDA Toolkit"
         exit 1
         ;;
@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/xattr.h>
+#include <poll.h>
 #include <getopt.h>
 #include <assert.h>
 
@@ -34,6 +35,7 @@
 // Tests the simplified create + truncate workflow
 
 #define TEST_MOUNT_PATH "./test_mount"
+#define PUBLISH_TIMEOUT_MS (60 * 1000)
 
 void print_test_header(const char *test_name) {
     printf("\n=== %s ===\n", test_name);
@@ -47,7 +49,10 @@ void print_usage(const char *program_name) {
     printf("Usage: %s [OPTIONS]\n", program_name);
     printf("Options:\n");
     printf("  --parent    Run as parent process (creates allocation and waits for child)\n");
-    printf("  --child     Run as child process (accesses existing allocation)\n");
+    printf("  --child     Run as child process (waits for the parent's allocation)\n");
+    printf("  --features  Round trip the daemon's features, including failure paths\n");
+    printf("  --ckpt STEP Checkpoint step against a mount with -o checkpoint=FILE:\n");
+    printf("              save, restore, or corrupt after a payload byte was changed\n");
     printf("  --help      Show this help message\n");
     printf("\nExample:\n");
     printf("  # Terminal 1 (parent):\n");
@@ -91,6 +96,168 @@ get_va_from_fabric_handle(CUmemFabricHandle fabric_handle, size_t allocation_siz
     return va;
 }
 
+// Open the allocation's interprocess completion fence
+static int open_fence(const char *path, CUevent *fence) {
+    CUipcEventHandle fence_handle;
+    ssize_t bytes_read = getxattr(path, "user.gpu.fence", &fence_handle, sizeof(fence_handle));
+    if (bytes_read != sizeof(fence_handle)) {
+        print_error("getxattr user.gpu.fence");
+        return -1;
+    }
+    CUDA_CHECK_DRV(cuIpcOpenEventHandle(fence, fence_handle));
+    return 0;
+}
+
+// Map a file's current version through its fabric handle
+static int map_file(const char *path, CUdeviceptr *va, size_t *size) {
+    char size_str[64];
+    ssize_t size_len = getxattr(path, "user.allocation_size", size_str, sizeof(size_str) - 1);
+    if (size_len < 0) {
+        print_error("getxattr allocation_size");
+        return -1;
+    }
+    size_str[size_len] = '\0';
+    *size = atol(size_str);
+
+    CUmemFabricHandle fabric_handle;
+    if (getxattr(path, "user.fabric_handle", &fabric_handle, sizeof(fabric_handle)) !=
+        sizeof(fabric_handle)) {
+        print_error("getxattr user.fabric_handle");
+        return -1;
+    }
+    *va = get_va_from_fabric_handle(fabric_handle, *size, *size);
+    return *va == (CUdeviceptr)-1 ? -1 : 0;
+}
+
+static void unmap_file(CUdeviceptr va, size_t size) {
+    cuMemUnmap(va, size);
+    cuMemAddressFree(va, size);
+}
+
+// Fill a file with (i + seed), or check that its first length bytes (all
+// of them for 0) hold that pattern
+static int access_pattern(const char *path, unsigned char seed, size_t length, bool write) {
+    CUdeviceptr va;
+    size_t size;
+    if (map_file(path, &va, &size) != 0) {
+        return -1;
+    }
+    if (length == 0 || length > size) {
+        length = size;
+    }
+    unsigned char *host = (unsigned char *)malloc(size);
+    if (!host) {
+        unmap_file(va, size);
+        return -1;
+    }
+    int rc = 0;
+    if (write) {
+        for (size_t i = 0; i < size; i++) {
+            host[i] = (unsigned char)(i + seed);
+        }
+        rc = cuMemcpyHtoD(va, host, size) == CUDA_SUCCESS ? 0 : -1;
+    } else if (cuMemcpyDtoH(host, va, length) != CUDA_SUCCESS) {
+        rc = -1;
+    } else {
+        for (size_t i = 0; i < length && rc == 0; i++) {
+            if (host[i] != (unsigned char)(i + seed)) {
+                printf("   %s: byte %zu is %u, expected %u\n", path, i, host[i],
+                       (unsigned char)(i + seed));
+                rc = -1;
+            }
+        }
+    }
+    free(host);
+    unmap_file(va, size);
+    return rc;
+}
+
+static int write_pattern(const char *path, unsigned char seed) {
+    return access_pattern(path, seed, 0, true);
+}
+
+static int check_pattern(const char *path, unsigned char seed, size_t length) {
+    return access_pattern(path, seed, length, false);
+}
+
+static int create_file(const char *path, size_t size) {
+    int fd = creat(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        print_error("create");
+        return -1;
+    }
+    close(fd);
+    if (size && truncate(path, size) != 0) {
+        print_error("truncate");
+        return -1;
+    }
+    return 0;
+}
+
+// A call that must fail with err
+static int expect_errno(int rc, int err, const char *operation) {
+    if (rc == 0) {
+        printf("ERROR in %s: succeeded, expected %s\n", operation, strerror(err));
+        return -1;
+    }
+    if (errno != err) {
+        printf("ERROR in %s: %s, expected %s\n", operation, strerror(errno), strerror(err));
+        return -1;
+    }
+    printf("   %s failed with %s as expected\n", operation, strerror(err));
+    return 0;
+}
+
+static int set_attr(const char *path, const char *name, const char *value) {
+    return setxattr(path, name, value, strlen(value), 0);
+}
+
+static int check_attr(const char *path, const char *name, const char *expected) {
+    char buf[256];
+    ssize_t len = getxattr(path, name, buf, sizeof(buf) - 1);
+    if (len < 0) {
+        print_error(name);
+        return -1;
+    }
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    if (strcmp(buf, expected) != 0) {
+        printf("ERROR: %s of %s is \"%s\", expected \"%s\"\n", name, path, buf, expected);
+        return -1;
+    }
+    return 0;
+}
+
+// Field of a "key=value ..." or "name a b c" line, -1 when missing
+static long long get_attr_field(const char *path, const char *name, const char *key, int field) {
+    char buf[4096];
+    ssize_t len = getxattr(path, name, buf, sizeof(buf) - 1);
+    if (len < 0) {
+        print_error(name);
+        return -1;
+    }
+    buf[len] = '\0';
+    for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+        if (field == 0) {
+            // key=value pairs
+            char pattern[64];
+            snprintf(pattern, sizeof(pattern), "%s=", key);
+            char *pos = strstr(line, pattern);
+            if (pos && (pos == line || pos[-1] == ' ')) {
+                return atoll(pos + strlen(pattern));
+            }
+        } else if (strncmp(line, key, strlen(key)) == 0 && line[strlen(key)] == ' ') {
+            // Columns after the name
+            char *pos = line;
+            for (int i = 0; i < field && pos; i++) {
+                pos = strchr(pos + 1, ' ');
+            }
+            return pos ? atoll(pos + 1) : -1;
+        }
+    }
+    return -1;
+}
+
 int test_parent_process() {
     print_test_header("PARENT PROCESS - Creating GPU Allocation");
     
@@ -159,9 +326,27 @@ int test_parent_process() {
     cudaStream_t stream;
     CUDA_CHECK(cudaStreamCreate(&stream));
 
+    CUevent fence;
+    if (open_fence(path, &fence) != 0) {
+        return -1;
+    }
+
+    // Record the fence behind the kernel instead of waiting for it, so the
+    // child can start queueing work while the write is still in flight
     kernel_write<<<1, 1, 0, stream>>>((void *)va, allocation_size);
+    CUDA_CHECK_DRV(cuEventRecord(fence, (CUstream)stream));
+    
+    // 6. Publish the allocation so waiting consumers wake up
+    if (setxattr(path, "user.gpu.ready", "1", 1, 0) != 0) {
+        print_error("setxattr user.gpu.ready");
+        return -1;
+    }
+    printf("6. Published allocation (user.gpu.ready=1)\n");
+    
+    // Keep the context alive until the kernel is done
     CUDA_CHECK(cudaStreamSynchronize(stream));
     CUDA_CHECK(cudaStreamDestroy(stream));
+    CUDA_CHECK_DRV(cuEventDestroy(fence));
     
     // Wait for user input (simulating child process completion)
     //getchar();
@@ -177,12 +362,30 @@ int test_child_process() {
     char path[256];
     snprintf(path, sizeof(path), "%s/shared_gpu_buffer", TEST_MOUNT_PATH);
     
-    // 1. Check if the allocation exists
-    printf("1. Checking if shared allocation exists...\n");
+    // 1. Wait for the parent to publish the allocation. Creating the entry
+    // is idempotent, so the child may start before the parent.
+    printf("1. Waiting for shared allocation to be published...\n");
+    int fd = open(path, O_RDONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        print_error("open");
+        return -1;
+    }
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int ready = poll(&pfd, 1, PUBLISH_TIMEOUT_MS);
+    close(fd);
+    if (ready < 0) {
+        print_error("poll");
+        return -1;
+    }
+    if (ready == 0) {
+        printf("ERROR: timed out waiting for the allocation to be published\n");
+        printf("   Make sure to run the parent process!\n");
+        return -1;
+    }
+    
     struct stat st;
     if (stat(path, &st) != 0) {
         print_error("stat - allocation not found");
-        printf("   Make sure to run the parent process first!\n");
         return -1;
     }
     printf("   Found allocation: %ld bytes (%.2f MB)\n", 
@@ -219,16 +422,552 @@ int test_child_process() {
     cudaStream_t stream;
     CUDA_CHECK(cudaStreamCreate(&stream));
 
+    // 6. Order the read after the parent's write on the GPU
+    CUevent fence;
+    if (open_fence(path, &fence) != 0) {
+        return -1;
+    }
+    CUDA_CHECK_DRV(cuStreamWaitEvent((CUstream)stream, fence, 0));
+
     // 7. Write to the shared memory from child
     kernel_read<<<1, 1, 0, stream>>>((void *)va, allocation_size);
     CUDA_CHECK(cudaStreamSynchronize(stream));
     CUDA_CHECK(cudaStreamDestroy(stream));
+    CUDA_CHECK_DRV(cuEventDestroy(fence));
 
     printf("5. Successfully wrote to shared GPU memory from child!\n");
     printf("✅ CHILD PROCESS completed successfully!\n");
     return 0;
 }
 
+#define MIB (1024 * 1024)
+
+// Remove a test directory with everything below it
+static void remove_tree(const char *path) {
+    set_attr(path, "user.gpu.rmtree", "1");
+}
+
+// Wait for released memory to reach the reservation again
+static long long wait_resv_remaining(const char *name, long long expected) {
+    long long remaining = -1;
+    for (int i = 0; i < 50; i++) {
+        remaining = get_attr_field(TEST_MOUNT_PATH, "user.gpu.reservations", name, 2);
+        if (remaining == expected) {
+            break;
+        }
+        usleep(100 * 1000);
+    }
+    return remaining;
+}
+
+// Cancel a reservation as another user. 0 when refused with EPERM, 1 when
+// the test cannot run.
+static int unreserve_as_other_user(const char *name) {
+    if (geteuid() != 0) {
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (setgid(65534) != 0 || setuid(65534) != 0) {
+            _exit(2);
+        }
+        int rc = set_attr(TEST_MOUNT_PATH, "user.gpu.unreserve", name);
+        _exit(rc == 0 ? 1 : errno == EPERM ? 0 : errno == EACCES ? 2 : 1);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status) == 2 ? 1 : WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int reservation_steps(const char *a, const char *b) {
+    printf("2. Binding to an unknown reservation...\n");
+    if (create_file(a, 0) != 0 ||
+        expect_errno(set_attr(a, "user.gpu.reservation", "tc_missing"), ENOENT,
+                     "binding to tc_missing") != 0) {
+        return -1;
+    }
+
+    printf("3. Drawing from the reservation...\n");
+    if (set_attr(a, "user.gpu.reservation", "tc_resv") != 0) {
+        print_error("setxattr user.gpu.reservation");
+        return -1;
+    }
+    if (truncate(a, 2 * MIB) != 0) {
+        print_error("truncate");
+        return -1;
+    }
+    char size_str[64];
+    ssize_t size_len = getxattr(a, "user.allocation_size", size_str, sizeof(size_str) - 1);
+    if (size_len < 0) {
+        print_error("getxattr allocation_size");
+        return -1;
+    }
+    size_str[size_len] = '\0';
+    long long drawn = atoll(size_str);
+    long long remaining = get_attr_field(TEST_MOUNT_PATH, "user.gpu.reservations", "tc_resv", 2);
+    printf("   Drew %lld bytes, %lld remaining\n", drawn, remaining);
+    if (remaining != 8LL * MIB - drawn) {
+        printf("ERROR: expected %lld bytes remaining\n", 8LL * MIB - drawn);
+        return -1;
+    }
+    if (expect_errno(set_attr(a, "user.gpu.reservation", "tc_resv"), EBUSY,
+                     "rebinding an allocated file") != 0) {
+        return -1;
+    }
+
+    printf("4. Exhausting the reservation...\n");
+    if (create_file(b, 0) != 0 || set_attr(b, "user.gpu.reservation", "tc_resv") != 0) {
+        print_error("setxattr user.gpu.reservation");
+        return -1;
+    }
+    if (expect_errno(truncate(b, remaining + 1), ENOMEM, "allocating past the budget") != 0) {
+        return -1;
+    }
+    if (truncate(b, remaining) != 0) {
+        print_error("truncate to the remaining budget");
+        return -1;
+    }
+    if (wait_resv_remaining("tc_resv", 0) != 0) {
+        printf("ERROR: reservation not exhausted\n");
+        return -1;
+    }
+
+    printf("5. Cancelling as another user...\n");
+    int rc = unreserve_as_other_user("tc_resv");
+    if (rc < 0) {
+        printf("ERROR: another user could cancel the reservation\n");
+        return -1;
+    }
+    printf(rc == 0 ? "   Refused with EPERM as expected\n"
+                   : "   Skipped (needs root and a mount shared with other users)\n");
+
+    printf("6. Returning memory to the reservation...\n");
+    if (unlink(a) != 0) {
+        print_error("unlink");
+        return -1;
+    }
+    if (wait_resv_remaining("tc_resv", drawn) != drawn) {
+        printf("ERROR: freed memory did not return to the reservation\n");
+        return -1;
+    }
+    return 0;
+}
+
+int test_reservation() {
+    print_test_header("RESERVATIONS - Draw, exhaust and cancel a budget");
+
+    char a[256], b[256];
+    snprintf(a, sizeof(a), "%s/tc_resv_a", TEST_MOUNT_PATH);
+    snprintf(b, sizeof(b), "%s/tc_resv_b", TEST_MOUNT_PATH);
+
+    printf("1. Reserving 8MB as tc_resv...\n");
+    if (set_attr(TEST_MOUNT_PATH, "user.gpu.reserve", "tc_resv:8M") != 0) {
+        print_error("setxattr user.gpu.reserve");
+        return -1;
+    }
+    int rc = expect_errno(set_attr(TEST_MOUNT_PATH, "user.gpu.reserve", "tc_resv:8M"), EEXIST,
+                          "reserving tc_resv twice");
+    if (rc == 0) {
+        rc = reservation_steps(a, b);
+    }
+
+    printf("7. Cancelling the reservation...\n");
+    unlink(a);
+    unlink(b);
+    if (set_attr(TEST_MOUNT_PATH, "user.gpu.unreserve", "tc_resv") != 0) {
+        print_error("setxattr user.gpu.unreserve");
+        return -1;
+    }
+    if (get_attr_field(TEST_MOUNT_PATH, "user.gpu.reservations", "tc_resv", 2) != -1 ||
+        expect_errno(set_attr(TEST_MOUNT_PATH, "user.gpu.unreserve", "tc_resv"), ENOENT,
+                     "cancelling tc_resv twice") != 0) {
+        return -1;
+    }
+    if (rc == 0) {
+        printf("✅ RESERVATIONS completed successfully!\n");
+    }
+    return rc;
+}
+
+// The caller's cgroup as the daemon resolves it, unified hierarchy first
+static int own_cgroup(char *buf, size_t len) {
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (!fp) {
+        return -1;
+    }
+    char line[1024];
+    int rc = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        // "ID:CONTROLLERS:PATH"
+        line[strcspn(line, "\n")] = '\0';
+        char *controllers = strchr(line, ':');
+        char *path = controllers ? strchr(controllers + 1, ':') : NULL;
+        if (!path) {
+            continue;
+        }
+        if (strncmp(line, "0::", 3) == 0) {
+            snprintf(buf, len, "%s", path + 1);
+            rc = 0;
+            break;
+        }
+        if (strncmp(controllers, ":memory:", 8) == 0) {
+            snprintf(buf, len, "%s", path + 1);
+            rc = 0;
+        }
+    }
+    fclose(fp);
+    return rc;
+}
+
+int test_cgroup_limit() {
+    print_test_header("CGROUP LIMITS - Allocations beyond a limit fail");
+
+    char cgroup[512], limit[600], path[256];
+    snprintf(path, sizeof(path), "%s/tc_cgroup", TEST_MOUNT_PATH);
+    if (own_cgroup(cgroup, sizeof(cgroup)) != 0) {
+        printf("   Skipped (no cgroup in /proc/self/cgroup)\n");
+        return 0;
+    }
+
+    printf("1. Limiting %s to 1MB...\n", cgroup);
+    snprintf(limit, sizeof(limit), "%s=1M", cgroup);
+    if (set_attr(TEST_MOUNT_PATH, "user.gpu.cgroup_limit", limit) != 0) {
+        print_error("setxattr user.gpu.cgroup_limit");
+        return -1;
+    }
+    int rc = create_file(path, 0);
+    if (rc == 0) {
+        rc = expect_errno(truncate(path, 2 * MIB), EDQUOT, "allocating past the limit");
+    }
+
+    printf("2. Removing the limit...\n");
+    snprintf(limit, sizeof(limit), "%s=0", cgroup);
+    if (set_attr(TEST_MOUNT_PATH, "user.gpu.cgroup_limit", limit) != 0) {
+        print_error("setxattr user.gpu.cgroup_limit");
+        rc = -1;
+    } else if (rc == 0 && truncate(path, 2 * MIB) != 0) {
+        print_error("truncate without a limit");
+        rc = -1;
+    }
+    unlink(path);
+    if (rc == 0) {
+        printf("✅ CGROUP LIMITS completed successfully!\n");
+    }
+    return rc;
+}
+
+static int snapshot_steps(const char *dir, const char *src, const char *clone) {
+    printf("1. Writing the source file...\n");
+    if (mkdir(dir, 0755) != 0 || create_file(src, 2 * MIB) != 0 || write_pattern(src, 1) != 0 ||
+        set_attr(src, "user.gpu.ready", "1") != 0) {
+        print_error("creating the source");
+        return -1;
+    }
+
+    printf("2. Cloning the directory...\n");
+    if (set_attr(dir, "user.gpu.snapshot", "/tc_snap_clone") != 0) {
+        print_error("setxattr user.gpu.snapshot");
+        return -1;
+    }
+    if (expect_errno(set_attr(dir, "user.gpu.snapshot", "/tc_snap_clone"), EEXIST,
+                     "cloning onto an existing path") != 0 ||
+        expect_errno(set_attr(dir, "user.gpu.snapshot", "/tc_snap/inner"), EINVAL,
+                     "cloning into the source") != 0 ||
+        expect_errno(set_attr(dir, "user.gpu.snapshot", "tc_snap_rel"), EINVAL,
+                     "cloning to a relative path") != 0) {
+        return -1;
+    }
+    if (check_pattern(clone, 1, 0) != 0) {
+        printf("ERROR: clone does not share the source contents\n");
+        return -1;
+    }
+
+    printf("3. Writing the clone...\n");
+    int fd = open(clone, O_RDWR);
+    if (fd < 0) {
+        print_error("open clone for writing");
+        return -1;
+    }
+    int rc = write_pattern(clone, 2);
+    close(fd);
+    if (rc != 0) {
+        return -1;
+    }
+
+    printf("4. Checking both sides...\n");
+    if (check_pattern(src, 1, 0) != 0) {
+        printf("ERROR: writing the clone changed the source\n");
+        return -1;
+    }
+    if (check_pattern(clone, 2, 0) != 0) {
+        printf("ERROR: clone lost its write\n");
+        return -1;
+    }
+    return 0;
+}
+
+int test_snapshot() {
+    print_test_header("SNAPSHOTS - Clone a directory and copy on write");
+
+    char dir[256], src[256], clone_dir[256], clone[256];
+    snprintf(dir, sizeof(dir), "%s/tc_snap", TEST_MOUNT_PATH);
+    snprintf(src, sizeof(src), "%s/tc_snap/data", TEST_MOUNT_PATH);
+    snprintf(clone_dir, sizeof(clone_dir), "%s/tc_snap_clone", TEST_MOUNT_PATH);
+    snprintf(clone, sizeof(clone), "%s/tc_snap_clone/data", TEST_MOUNT_PATH);
+
+    int rc = snapshot_steps(dir, src, clone);
+    remove_tree(clone_dir);
+    remove_tree(dir);
+    if (rc == 0) {
+        printf("✅ SNAPSHOTS completed successfully!\n");
+    }
+    return rc;
+}
+
+// Write a safetensors file with the given header and len bytes of data
+static int write_safetensors(const char *path, const char *header, const unsigned char *data,
+                             size_t len) {
+    size_t header_len = (strlen(header) + 7) & ~(size_t)7;  // Padded with spaces
+    unsigned char prefix[8];
+    for (int i = 0; i < 8; i++) {
+        prefix[i] = (unsigned char)((unsigned long long)header_len >> (8 * i));
+    }
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        print_error("fopen");
+        return -1;
+    }
+    bool ok = fwrite(prefix, 1, sizeof(prefix), fp) == sizeof(prefix) &&
+              fprintf(fp, "%-*s", (int)header_len, header) == (int)header_len &&
+              fwrite(data, 1, len, fp) == len;
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+#define INGEST_FILE "/tmp/tc_ingest.safetensors"
+#define INGEST_BAD_FILE "/tmp/tc_ingest_bad.safetensors"
+
+static int ingest_steps(const char *dir, const char *bad_dir) {
+    printf("1. Writing %s...\n", INGEST_FILE);
+    unsigned char data[8192];
+    for (size_t i = 0; i < 4096; i++) {
+        data[i] = (unsigned char)(i + 3);
+        data[4096 + i] = (unsigned char)(i + 5);
+    }
+    if (write_safetensors(INGEST_FILE,
+                          "{\"__metadata__\":{\"format\":\"pt\"},"
+                          "\"a\":{\"dtype\":\"U8\",\"shape\":[4096],\"data_offsets\":[0,4096]},"
+                          "\"b\":{\"dtype\":\"F32\",\"shape\":[2,512],\"data_offsets\":[4096,8192]}}",
+                          data, sizeof(data)) != 0 ||
+        write_safetensors(INGEST_BAD_FILE,
+                          "{\"a\":{\"dtype\":\"F32\",\"shape\":[4],\"data_offsets\":[0,8]}}",
+                          data, 8) != 0) {
+        return -1;
+    }
+
+    printf("2. Ingesting into %s...\n", dir);
+    if (mkdir(dir, 0755) != 0 || mkdir(bad_dir, 0755) != 0) {
+        print_error("mkdir");
+        return -1;
+    }
+    if (set_attr(dir, "user.gpu.ingest", INGEST_FILE) != 0) {
+        print_error("setxattr user.gpu.ingest");
+        return -1;
+    }
+
+    printf("3. Checking the tensors...\n");
+    char a[256], b[256];
+    snprintf(a, sizeof(a), "%s/a", dir);
+    snprintf(b, sizeof(b), "%s/b", dir);
+    if (check_attr(b, "user.gpu.dtype", "F32") != 0 ||
+        check_attr(b, "user.gpu.shape", "2,512") != 0 ||
+        check_attr(a, "user.gpu.ready", "1") != 0 ||
+        check_pattern(a, 3, 4096) != 0 || check_pattern(b, 5, 4096) != 0) {
+        return -1;
+    }
+
+    printf("4. Checking failures...\n");
+    if (expect_errno(set_attr(dir, "user.gpu.ingest", INGEST_FILE), EEXIST,
+                     "ingesting the same tensors twice") != 0 ||
+        expect_errno(set_attr(bad_dir, "user.gpu.ingest", INGEST_BAD_FILE), EINVAL,
+                     "ingesting a malformed header") != 0 ||
+        expect_errno(set_attr(bad_dir, "user.gpu.ingest", "tc_ingest.safetensors"), EINVAL,
+                     "ingesting a relative path") != 0) {
+        return -1;
+    }
+    char bad[256];
+    snprintf(bad, sizeof(bad), "%s/a", bad_dir);
+    struct stat st;
+    if (stat(bad, &st) == 0) {
+        printf("ERROR: failed ingest left %s behind\n", bad);
+        return -1;
+    }
+    return 0;
+}
+
+int test_ingest() {
+    print_test_header("INGEST - Load a safetensors file");
+
+    char dir[256], bad_dir[256];
+    snprintf(dir, sizeof(dir), "%s/tc_ingest", TEST_MOUNT_PATH);
+    snprintf(bad_dir, sizeof(bad_dir), "%s/tc_ingest_bad", TEST_MOUNT_PATH);
+
+    int rc = ingest_steps(dir, bad_dir);
+    remove_tree(dir);
+    remove_tree(bad_dir);
+    unlink(INGEST_FILE);
+    unlink(INGEST_BAD_FILE);
+    if (rc == 0) {
+        printf("✅ INGEST completed successfully!\n");
+    }
+    return rc;
+}
+
+#define BUNDLE_FILE "/tmp/tc_export.bundle"
+
+static int export_steps(const char *dir, const char *src, const char *import_dir,
+                        const char *copy) {
+    printf("1. Writing the exported tree...\n");
+    char sub[256];
+    snprintf(sub, sizeof(sub), "%s/sub", dir);
+    if (mkdir(dir, 0755) != 0 || mkdir(sub, 0755) != 0 || create_file(src, 2 * MIB) != 0 ||
+        write_pattern(src, 7) != 0 || set_attr(src, "user.gpu.ready", "1") != 0) {
+        print_error("creating the exported tree");
+        return -1;
+    }
+
+    printf("2. Exporting to %s...\n", BUNDLE_FILE);
+    if (set_attr(dir, "user.gpu.export", BUNDLE_FILE ":1") != 0) {
+        print_error("setxattr user.gpu.export");
+        return -1;
+    }
+    struct stat st;
+    if (expect_errno(set_attr(dir, "user.gpu.export", "/tc_no_such_dir/x.bundle"), ENOENT,
+                     "exporting to a missing directory") != 0 ||
+        stat(src, &st) != 0) {
+        return -1;
+    }
+
+    printf("3. Importing into %s...\n", import_dir);
+    if (mkdir(import_dir, 0755) != 0 || set_attr(import_dir, "user.gpu.import", BUNDLE_FILE) != 0) {
+        print_error("setxattr user.gpu.import");
+        return -1;
+    }
+    if (check_attr(copy, "user.gpu.ready", "1") != 0 || check_pattern(copy, 7, 0) != 0) {
+        return -1;
+    }
+
+    printf("4. Checking failures...\n");
+    if (expect_errno(set_attr(import_dir, "user.gpu.import", BUNDLE_FILE), EEXIST,
+                     "importing over existing files") != 0 ||
+        expect_errno(set_attr(import_dir, "user.gpu.import", "/tmp/tc_missing.bundle"), ENOENT,
+                     "importing a missing bundle") != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int test_export_import() {
+    print_test_header("EXPORT/IMPORT - Round trip a directory through a bundle");
+
+    char dir[256], src[256], import_dir[256], copy[256];
+    snprintf(dir, sizeof(dir), "%s/tc_export", TEST_MOUNT_PATH);
+    snprintf(src, sizeof(src), "%s/tc_export/sub/data", TEST_MOUNT_PATH);
+    snprintf(import_dir, sizeof(import_dir), "%s/tc_import", TEST_MOUNT_PATH);
+    snprintf(copy, sizeof(copy), "%s/tc_import/sub/data", TEST_MOUNT_PATH);
+
+    int rc = export_steps(dir, src, import_dir, copy);
+    remove_tree(import_dir);
+    remove_tree(dir);
+    unlink(BUNDLE_FILE);
+    if (rc == 0) {
+        printf("✅ EXPORT/IMPORT completed successfully!\n");
+    }
+    return rc;
+}
+
+int test_features() {
+    CUDA_CHECK_DRV(cuInit(0));
+    CUDA_CHECK(cudaFree(0));  // Make the primary context current for the copies
+
+    static const struct {
+        const char *name;
+        int (*run)();
+    } tests[] = {
+        { "reservations", test_reservation },
+        { "cgroup limits", test_cgroup_limit },
+        { "snapshots", test_snapshot },
+        { "ingest", test_ingest },
+        { "export/import", test_export_import },
+    };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (tests[i].run() != 0) {
+            printf("❌ %s failed\n", tests[i].name);
+            failed++;
+        }
+    }
+    printf("\n%d of %zu feature tests failed\n", failed, sizeof(tests) / sizeof(tests[0]));
+    return failed ? -1 : 0;
+}
+
+// Checkpoint round trip, one step per daemon run: "save" writes a durable
+// file and checkpoints it, "restore" checks it after a restart, "corrupt"
+// expects the load to fail after a payload byte was changed
+int test_checkpoint(const char *step) {
+    print_test_header("CHECKPOINT - Save and restore durable files");
+    CUDA_CHECK_DRV(cuInit(0));
+    CUDA_CHECK(cudaFree(0));
+
+    char dir[256], path[256];
+    snprintf(dir, sizeof(dir), "%s/tc_ckpt", TEST_MOUNT_PATH);
+    snprintf(path, sizeof(path), "%s/tc_ckpt/data", TEST_MOUNT_PATH);
+
+    if (strcmp(step, "save") == 0) {
+        printf("1. Writing a durable file...\n");
+        if (mkdir(dir, 0755) != 0 || create_file(path, 2 * MIB) != 0 ||
+            write_pattern(path, 9) != 0 || set_attr(path, "user.gpu.ready", "1") != 0 ||
+            set_attr(path, "user.gpu.durable", "1") != 0) {
+            print_error("creating the durable file");
+            return -1;
+        }
+        printf("2. Checkpointing...\n");
+        if (set_attr(TEST_MOUNT_PATH, "user.gpu.checkpoint", "sync") != 0) {
+            print_error("setxattr user.gpu.checkpoint");
+            return -1;
+        }
+    } else if (strcmp(step, "restore") == 0) {
+        printf("1. Checking the restored contents...\n");
+        if (check_attr(path, "user.gpu.ready", "1") != 0 || check_pattern(path, 9, 0) != 0) {
+            return -1;
+        }
+        if (get_attr_field(TEST_MOUNT_PATH, "user.gpu.restore", "errors", 0) != 0 ||
+            get_attr_field(TEST_MOUNT_PATH, "user.gpu.restore", "verified", 0) <= 0) {
+            printf("ERROR: restore was not verified cleanly\n");
+            return -1;
+        }
+    } else if (strcmp(step, "corrupt") == 0) {
+        printf("1. Opening the corrupted file...\n");
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (expect_errno(fd < 0 ? -1 : 0, EIO, "loading a corrupted payload") != 0) {
+            return -1;
+        }
+        if (get_attr_field(TEST_MOUNT_PATH, "user.gpu.restore", "errors", 0) < 1) {
+            printf("ERROR: restore errors not counted\n");
+            return -1;
+        }
+    } else {
+        printf("Error: unknown checkpoint step %s\n", step);
+        return -1;
+    }
+    printf("✅ CHECKPOINT %s completed successfully!\n", step);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     printf("GPU Memory FUSE Filesystem Test Client\n");
     printf("======================================\n");
@@ -237,16 +976,19 @@ int main(int argc, char *argv[]) {
     static struct option long_options[] = {
         {"parent", no_argument, 0, 'p'},
         {"child",  no_argument, 0, 'c'},
+        {"features", no_argument, 0, 'f'},
+        {"ckpt",   required_argument, 0, 'k'},
         {"help",   no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
     
     int option_index = 0;
     int opt;
-    enum { MODE_NONE, MODE_PARENT, MODE_CHILD } mode = MODE_NONE;
+    enum { MODE_NONE, MODE_PARENT, MODE_CHILD, MODE_FEATURES, MODE_CKPT } mode = MODE_NONE;
+    const char *ckpt_step = NULL;
     
     // Parse command line options
-    while ((opt = getopt_long(argc, argv, "pch", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "pcfk:h", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'p':
                 mode = MODE_PARENT;
@@ -254,6 +996,13 @@ int main(int argc, char *argv[]) {
             case 'c':
                 mode = MODE_CHILD;
                 break;
+            case 'f':
+                mode = MODE_FEATURES;
+                break;
+            case 'k':
+                mode = MODE_CKPT;
+                ckpt_step = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -265,7 +1014,7 @@ int main(int argc, char *argv[]) {
     
     // Check if mode was specified
     if (mode == MODE_NONE) {
-        printf("Error: You must specify either --parent or --child\n\n");
+        printf("Error: You must specify --parent, --child, --features or --ckpt\n\n");
         print_usage(argv[0]);
         return 1;
     }
@@ -287,6 +1036,12 @@ int main(int argc, char *argv[]) {
         case MODE_CHILD:
             result = test_child_process();
             break;
+        case MODE_FEATURES:
+            result = test_features();
+            break;
+        case MODE_CKPT:
+            result = test_checkpoint(ckpt_step);
+            break;
         default:
             // Should never reach here
             result = 1;